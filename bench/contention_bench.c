@@ -0,0 +1,209 @@
+/*
+ * File: contention_bench.c
+ *
+ * Descripcion: Compara el coste de compartir las ordenes de la botonera entre un
+ *              escritor y varios lectores con un mutex (como estaba
+ *              new_motors_status) y con el seqlock de main.c, y el de un indicador
+ *              (top_limit, close_condition...) con un mutex y con un atomic_bool.
+ *              El escritor publica sin pausa los cuatro campos con el mismo valor y
+ *              los lectores comprueban que nunca ven una mezcla de dos publicaciones.
+ *              Se compila aparte:
+ *
+ *                  gcc -std=gnu11 -O2 -o contention_bench bench/contention_bench.c -lpthread
+ *                  ./contention_bench [lectores] [segundos]
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_READERS               4       // tareas de los motores
+#define BENCH_SECONDS               2
+#define BENCH_MAX_READERS           16
+
+// Ordenes de la botonera protegidas con un mutex
+struct locked_status {
+	pthread_mutex_t mutex;
+	int rotation;
+	int elevation;
+	int claw;
+	unsigned int claw_presses;
+} locked_status = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0 };
+
+// Las mismas ordenes con el seqlock de main.c
+struct seqlock_status {
+	atomic_uint sequence;
+	atomic_int rotation;
+	atomic_int elevation;
+	atomic_int claw;
+	atomic_uint claw_presses;
+} seqlock_status;
+
+// Indicador con un mutex y atomico
+struct locked_flag {
+	pthread_mutex_t mutex;
+	bool value;
+} locked_flag = { PTHREAD_MUTEX_INITIALIZER, false };
+
+atomic_bool atomic_flag_value;
+
+// Estrategia: publicacion del escritor y lectura (devuelve false si es incoherente)
+typedef struct strategy {
+	const char *name;
+	void (*write)(unsigned int value);
+	bool (*read)(void);
+} strategy_t;
+
+typedef struct worker {
+	const strategy_t *strategy;
+	unsigned long ops;
+	unsigned long torn;
+} worker_t;
+
+static atomic_bool running;
+
+static void locked_write(unsigned int value) {
+	pthread_mutex_lock(&locked_status.mutex);
+	locked_status.rotation = value;
+	locked_status.elevation = value;
+	locked_status.claw = value;
+	locked_status.claw_presses = value;
+	pthread_mutex_unlock(&locked_status.mutex);
+}
+
+static bool locked_read(void) {
+	pthread_mutex_lock(&locked_status.mutex);
+	int rotation = locked_status.rotation;
+	int elevation = locked_status.elevation;
+	int claw = locked_status.claw;
+	unsigned int presses = locked_status.claw_presses;
+	pthread_mutex_unlock(&locked_status.mutex);
+	return rotation == elevation && elevation == claw && (unsigned int) claw == presses;
+}
+
+static void seqlock_write(unsigned int value) {
+	unsigned int sequence = atomic_load_explicit(&seqlock_status.sequence, memory_order_relaxed);
+	atomic_store_explicit(&seqlock_status.sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&seqlock_status.rotation, value, memory_order_relaxed);
+	atomic_store_explicit(&seqlock_status.elevation, value, memory_order_relaxed);
+	atomic_store_explicit(&seqlock_status.claw, value, memory_order_relaxed);
+	atomic_store_explicit(&seqlock_status.claw_presses, value, memory_order_relaxed);
+	atomic_store_explicit(&seqlock_status.sequence, sequence + 2, memory_order_release);
+}
+
+static bool seqlock_read(void) {
+	unsigned int begin, end, presses;
+	int rotation, elevation, claw;
+	do {
+		begin = atomic_load_explicit(&seqlock_status.sequence, memory_order_acquire);
+		rotation = atomic_load_explicit(&seqlock_status.rotation, memory_order_relaxed);
+		elevation = atomic_load_explicit(&seqlock_status.elevation, memory_order_relaxed);
+		claw = atomic_load_explicit(&seqlock_status.claw, memory_order_relaxed);
+		presses = atomic_load_explicit(&seqlock_status.claw_presses, memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		end = atomic_load_explicit(&seqlock_status.sequence, memory_order_relaxed);
+	} while ((begin & 1) || begin != end);
+	return rotation == elevation && elevation == claw && (unsigned int) claw == presses;
+}
+
+static void locked_flag_write(unsigned int value) {
+	pthread_mutex_lock(&locked_flag.mutex);
+	locked_flag.value = value & 1;
+	pthread_mutex_unlock(&locked_flag.mutex);
+}
+
+static bool locked_flag_read(void) {
+	pthread_mutex_lock(&locked_flag.mutex);
+	volatile bool value = locked_flag.value;
+	pthread_mutex_unlock(&locked_flag.mutex);
+	(void) value;
+	return true;
+}
+
+static void atomic_flag_write(unsigned int value) {
+	atomic_store_explicit(&atomic_flag_value, value & 1, memory_order_release);
+}
+
+static bool atomic_flag_read(void) {
+	volatile bool value = atomic_load_explicit(&atomic_flag_value, memory_order_acquire);
+	(void) value;
+	return true;
+}
+
+static const strategy_t STRATEGIES[] = {
+	{ "status mutex", locked_write, locked_read },
+	{ "status seqlock", seqlock_write, seqlock_read },
+	{ "flag mutex", locked_flag_write, locked_flag_read },
+	{ "flag atomic", atomic_flag_write, atomic_flag_read },
+};
+
+static void* writer_thread(void *params) {
+	worker_t *worker = (worker_t *) params;
+	unsigned int value = 0;
+	while (atomic_load_explicit(&running, memory_order_relaxed)) {
+		worker->strategy->write(++value);
+		worker->ops++;
+	}
+	return NULL;
+}
+
+static void* reader_thread(void *params) {
+	worker_t *worker = (worker_t *) params;
+	while (atomic_load_explicit(&running, memory_order_relaxed)) {
+		if (!worker->strategy->read()) {
+			worker->torn++;
+		}
+		worker->ops++;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	int readers = (argc > 1) ? atoi(argv[1]) : BENCH_READERS;
+	int seconds = (argc > 2) ? atoi(argv[2]) : BENCH_SECONDS;
+	pthread_t threads[BENCH_MAX_READERS + 1];
+	worker_t workers[BENCH_MAX_READERS + 1];
+	int failures = 0;
+
+	if (readers < 1 || readers > BENCH_MAX_READERS || seconds < 1) {
+		fprintf(stderr, "Usage: %s [readers (1..%d)] [seconds]\n", argv[0], BENCH_MAX_READERS);
+		return EXIT_FAILURE;
+	}
+	printf("1 writer, %d readers, %d s per strategy\n", readers, seconds);
+
+	for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+		atomic_store(&running, true);
+		for (int i = 0; i <= readers; i++) {
+			workers[i] = (worker_t) { &STRATEGIES[s], 0, 0 };
+			if (pthread_create(&threads[i], NULL, (i == 0) ? writer_thread : reader_thread, &workers[i]) != 0) {
+				perror("pthread_create");
+				return EXIT_FAILURE;
+			}
+		}
+		struct timespec duration = { seconds, 0 };
+		nanosleep(&duration, NULL);
+		atomic_store(&running, false);
+
+		unsigned long reads = 0, torn = 0;
+		for (int i = 0; i <= readers; i++) {
+			pthread_join(threads[i], NULL);
+			if (i > 0) {
+				reads += workers[i].ops;
+				torn += workers[i].torn;
+			}
+		}
+		printf("%-15s writes %6.2f M/s, reads %7.2f M/s (%.2f M/s per reader), %lu torn reads\n",
+				STRATEGIES[s].name, workers[0].ops / 1e6 / seconds, reads / 1e6 / seconds,
+				reads / 1e6 / seconds / readers, torn);
+		failures += (torn > 0);
+	}
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# File: executive_compare.sh
+#
+# Descripcion: Compara el uso de CPU y la latencia de las tareas con un hilo por
+#              tarea y con el ejecutivo ciclico (CYCLIC_EXECUTIVE). Compila las dos
+#              versiones con el simulador en tiempo real y ejecuta en cada una el
+#              mismo guion de la botonera desde el mismo estado inicial (homing
+#              incluido). Hace falta ejecutarlo como root (SCHED_FIFO).
+#
+#              Uso: bench/executive_compare.sh [duracion en s]
+#
+# Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+# Version: 1.0
+# Date: dec-23
+#
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+DURATION=${1:-60}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+SOURCES="main.c sysfs_io.c periodic.c executive.c task_stats.c buttons_input.c lcd.c timebase.c \
+	calibration.c motion_profile.c kinematics.c program.c pid.c gravity.c job.c sim/ev3c_sim.c"
+
+cd "$ROOT"
+gcc -std=gnu11 -O2 -I. -Isim -o "$WORK/threads" $SOURCES -lpthread -lm
+gcc -std=gnu11 -O2 -I. -Isim -DCYCLIC_EXECUTIVE -o "$WORK/cyclic" $SOURCES -lpthread -lm
+
+printf "%-8s %10s %8s %10s %16s %16s\n" "build" "CPU (s)" "CPU %" "switches" "max latency ms" "max exec ms"
+for build in threads cyclic; do
+	mkdir "$WORK/run_$build"
+	(cd "$WORK/run_$build" && EV3_SIM_DURATION=$DURATION EV3_SIM_STATE= EV3_CALIBRATION=arm.cal \
+		"$WORK/$build" > output.txt 2>&1)
+	awk -v build=$build '
+		/^CPU usage:/ { cpu = $3; pct = $8; sub(/\(/, "", pct); switches = $10 }
+		/ activations, / {
+			for (i = 1; i <= NF; i++) {
+				if ($i == "latency" && $(i + 1) > latency) latency = $(i + 1)
+				if ($i == "exec" && $(i + 1) > exec) exec = $(i + 1)
+			}
+		}
+		/^Cyclic executive:/ { frames = $0 }
+		END {
+			printf "%-8s %10s %8s %10s %16.3f %16.3f\n", build, cpu, pct, switches, latency, exec
+			if (frames != "") print "         " frames
+		}' "$WORK/run_$build/output.txt"
+done
@@ -0,0 +1,123 @@
+/*
+ * File: kinematics_bench.c
+ *
+ * Descripcion: Mide las soluciones por segundo de la cinematica inversa
+ *              (kinematics_inverse) sobre puntos repartidos por el espacio de trabajo,
+ *              su error respecto a la misma inversa con libm y el error de ida y
+ *              vuelta con la directa. Mide la implementacion elegida al compilar
+ *              (KINEMATICS_FIXED_POINT), por lo que se compila una vez con cada una,
+ *              en el PC o para el brick (arm-linux-gnueabi-gcc, sin FPU):
+ *
+ *                  gcc -std=gnu11 -O2 -I. -DKINEMATICS_FIXED_POINT=1 \
+ *                      -o kinematics_bench_fixed bench/kinematics_bench.c kinematics.c -lm
+ *                  gcc -std=gnu11 -O2 -I. -DKINEMATICS_FIXED_POINT=0 \
+ *                      -o kinematics_bench_libm bench/kinematics_bench.c kinematics.c -lm
+ *                  ./kinematics_bench_fixed [soluciones]
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "kinematics.h"
+
+// Espacio de trabajo
+#define BENCH_AZIMUTH               120.0   // units: deg, +-
+#define BENCH_ELEVATION             40.0    // units: deg, +-
+#define BENCH_SOLVES                1000000
+
+/**
+ * @brief Inversa de referencia con libm en coma flotante, en grados de motor.
+ */
+static void inverse_reference(double y, double z, double *rotation, double *elevation) {
+	double elevation_angle = asin(fmax(-1.0, fmin(1.0, z / ARM_LENGTH)));
+	double radius = ARM_LENGTH * cos(elevation_angle);
+	double azimuth = (radius > 0.0) ? asin(fmax(-1.0, fmin(1.0, y / radius))) : 0.0;
+	*rotation = azimuth * 180.0 / M_PI * ARM_ROTATION_RATIO;
+	*elevation = (elevation_angle * 180.0 / M_PI - ARM_ELEVATION_HOME) * ARM_ELEVATION_RATIO;
+}
+
+static double elapsed_s(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	const kinematics_t kinematics = KINEMATICS_INIT(ARM_LENGTH, ARM_ROTATION_RATIO, ARM_ELEVATION_RATIO,
+			ARM_ELEVATION_HOME);
+	long solves = (argc > 1) ? atol(argv[1]) : BENCH_SOLVES;
+	if (solves <= 0) {
+		fprintf(stderr, "Usage: %s [solves]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	kinematics_init();
+	kin_point_t *points = malloc(solves * sizeof(kin_point_t));
+	if (points == NULL) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	// Puntos de la esfera (generador lineal congruencial, la secuencia es siempre
+	// la misma)
+	uint32_t seed = 1;
+	for (long i = 0; i < solves; i++) {
+		seed = seed * 1103515245u + 12345u;
+		double azimuth = ((seed >> 8) / 16777216.0 * 2.0 - 1.0) * BENCH_AZIMUTH * M_PI / 180.0;
+		seed = seed * 1103515245u + 12345u;
+		double elevation = ((seed >> 8) / 16777216.0 * 2.0 - 1.0) * BENCH_ELEVATION * M_PI / 180.0;
+		points[i].x = KIN_FROM_MM(ARM_LENGTH * cos(elevation) * cos(azimuth));
+		points[i].y = KIN_FROM_MM(ARM_LENGTH * cos(elevation) * sin(azimuth));
+		points[i].z = KIN_FROM_MM(ARM_LENGTH * sin(elevation));
+	}
+
+	struct timespec start, end;
+	volatile int32_t sink = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < solves; i++) {
+		int32_t rotation, elevation;
+		kinematics_inverse(&kinematics, &points[i], &rotation, &elevation);
+		sink += rotation + elevation;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = elapsed_s(&start, &end);
+
+	// Error respecto a libm (grados de motor) y de ida y vuelta (mm): las posiciones
+	// de los motores son enteras
+	double max_error = 0.0, max_motor_error = 0.0;
+	for (long i = 0; i < solves; i++) {
+		int32_t rotation, elevation;
+		double reference_rotation, reference_elevation;
+		kin_point_t tip;
+		kinematics_inverse(&kinematics, &points[i], &rotation, &elevation);
+		inverse_reference(KIN_TO_MM(points[i].y), KIN_TO_MM(points[i].z), &reference_rotation,
+				&reference_elevation);
+		if (KIN_TO_MM(points[i].x) < 0.0) {
+			reference_rotation = ((reference_rotation >= 0.0) ? 180.0 : -180.0) * ARM_ROTATION_RATIO -
+					reference_rotation;
+		}
+		double motor_error = fmax(fabs(rotation - reference_rotation), fabs(elevation - reference_elevation));
+		if (motor_error > max_motor_error) {
+			max_motor_error = motor_error;
+		}
+		kinematics_forward(&kinematics, rotation, elevation, &tip);
+		double error = sqrt(pow(KIN_TO_MM(tip.x - points[i].x), 2) + pow(KIN_TO_MM(tip.y - points[i].y), 2) +
+				pow(KIN_TO_MM(tip.z - points[i].z), 2));
+		if (error > max_error) {
+			max_error = error;
+		}
+	}
+
+	printf("Kinematics (%s): %ld solves in %.3f s, %.0f solves/s (%.3f us/solve), "
+			"error %.2f motor deg max against libm, round trip error %.2f mm max\n",
+			KINEMATICS_FIXED_POINT ? "fixed point" : "libm", solves, seconds, solves / seconds,
+			seconds * 1e6 / solves, max_motor_error, max_error);
+	free(points);
+	(void) sink;
+	return EXIT_SUCCESS;
+}
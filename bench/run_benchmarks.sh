@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# File: run_benchmarks.sh
+#
+# Descripcion: Compila y ejecuta los programas de medida de bench/ (el de la
+#              comparacion de hilos y ejecutivo ciclico, executive_compare.sh, va
+#              aparte porque necesita root y tarda un minuto).
+#
+#              Uso: bench/run_benchmarks.sh
+#
+# Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+# Version: 1.0
+# Date: dec-23
+#
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CFLAGS="-std=gnu11 -O2 -I$ROOT -I$ROOT/sim"
+
+cd "$ROOT"
+gcc $CFLAGS -DKINEMATICS_FIXED_POINT=1 -o "$WORK/kinematics_bench_fixed" bench/kinematics_bench.c kinematics.c -lm
+gcc $CFLAGS -DKINEMATICS_FIXED_POINT=0 -o "$WORK/kinematics_bench_libm" bench/kinematics_bench.c kinematics.c -lm
+gcc $CFLAGS -o "$WORK/sysfs_bench" bench/sysfs_bench.c sysfs_io.c timebase.c sim/ev3c_sim.c -lpthread -lm
+gcc $CFLAGS -o "$WORK/contention_bench" bench/contention_bench.c -lpthread
+
+"$WORK/kinematics_bench_fixed"
+"$WORK/kinematics_bench_libm"
+"$WORK/sysfs_bench"
+"$WORK/contention_bench"
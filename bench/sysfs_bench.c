@@ -0,0 +1,220 @@
+/*
+ * File: sysfs_bench.c
+ *
+ * Descripcion: Compara el acceso a los atributos sysfs con descriptores
+ *              persistentes (sysfs_io.h: pread/pwrite en el offset 0) frente al
+ *              ciclo open/read/close de cada llamada de ev3c. Crea en un tmpfs un
+ *              arbol con un motor (outA) y un sensor (in1) con la estructura de
+ *              ev3dev y lo usa como raiz de sysfs (EV3_SYSFS_ROOT), por lo que se
+ *              mide el coste de las llamadas al sistema y del VFS sin el del driver.
+ *              Se compila aparte:
+ *
+ *                  gcc -std=gnu11 -O2 -I. -Isim -o sysfs_bench bench/sysfs_bench.c \
+ *                      sysfs_io.c timebase.c sim/ev3c_sim.c -lpthread -lm
+ *                  ./sysfs_bench [iteraciones] [directorio tmpfs]
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ev3c.h"
+#include "sysfs_io.h"
+
+#define BENCH_ITERATIONS            200000
+#define BENCH_TMPFS                 "/dev/shm"
+#define PATH_SIZE                   256
+#define VALUE_SIZE                  64
+
+static char root[PATH_SIZE / 2];     // raiz de sysfs en el tmpfs
+
+static long long elapsed_ns(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Crea un atributo con su valor inicial.
+ */
+static int write_file(const char *dir, const char *name, const char *value) {
+	char path[PATH_SIZE];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return errno;
+	}
+	fputs(value, file);
+	fclose(file);
+	return 0;
+}
+
+/**
+ * @brief Arbol tacho-motor/motor0 (outA) y lego-sensor/sensor0 (in1) bajo root.
+ */
+static int create_tree(void) {
+	char motor[PATH_SIZE], sensor[PATH_SIZE];
+	int error = 0;
+
+	snprintf(motor, sizeof(motor), "%s/tacho-motor", root);
+	mkdir(motor, 0755);
+	strncat(motor, "/motor0", sizeof(motor) - strlen(motor) - 1);
+	mkdir(motor, 0755);
+	snprintf(sensor, sizeof(sensor), "%s/lego-sensor", root);
+	mkdir(sensor, 0755);
+	strncat(sensor, "/sensor0", sizeof(sensor) - strlen(sensor) - 1);
+	mkdir(sensor, 0755);
+
+	error |= write_file(motor, "address", "ev3-ports:outA\n");
+	error |= write_file(motor, "position", "-1234\n");
+	error |= write_file(motor, "state", "running\n");
+	error |= write_file(motor, "duty_cycle_sp", "0\n");
+	error |= write_file(motor, "command", "run-direct\n");
+	error |= write_file(sensor, "address", "ev3-ports:in1\n");
+	error |= write_file(sensor, "value0", "42\n");
+	return error;
+}
+
+static void remove_tree(void) {
+	const char *files[] = { "tacho-motor/motor0/address", "tacho-motor/motor0/position",
+		"tacho-motor/motor0/state", "tacho-motor/motor0/duty_cycle_sp", "tacho-motor/motor0/command",
+		"lego-sensor/sensor0/address", "lego-sensor/sensor0/value0", "tacho-motor/motor0",
+		"lego-sensor/sensor0", "tacho-motor", "lego-sensor", "" };
+	char path[PATH_SIZE];
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+		remove(path);
+	}
+}
+
+/**
+ * @brief Lectura como ev3c: open, read y close en cada llamada.
+ */
+static int32_t uncached_read(const char *path) {
+	char buffer[VALUE_SIZE];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	ssize_t len = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	buffer[(len > 0) ? len : 0] = '\0';
+	return (int32_t) strtol(buffer, NULL, 10);
+}
+
+/**
+ * @brief Escritura como ev3c: open, write y close en cada llamada.
+ */
+static void uncached_write(const char *path, int32_t value) {
+	char buffer[VALUE_SIZE];
+	int fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		return;
+	}
+	int len = snprintf(buffer, sizeof(buffer), "%d", value);
+	if (write(fd, buffer, len) < 0) {
+		perror("write");
+	}
+	close(fd);
+}
+
+static void print_result(const char *name, long iterations, long long cached_ns, long long uncached_ns) {
+	printf("%-14s cached %7.0f ns/op (1 syscall), uncached %7.0f ns/op (3 syscalls), %.1fx\n", name,
+			(double) cached_ns / iterations, (double) uncached_ns / iterations,
+			(cached_ns > 0) ? (double) uncached_ns / cached_ns : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+	long iterations = (argc > 1) ? atol(argv[1]) : BENCH_ITERATIONS;
+	const char *tmpfs = (argc > 2) ? argv[2] : BENCH_TMPFS;
+	struct ev3_motor_struct motor;
+	struct ev3_sensor_struct sensor;
+	sysfs_motor_t motor_io;
+	sysfs_sensor_t sensor_io;
+	struct timespec start, end;
+	volatile int32_t sink = 0;
+	char path[PATH_SIZE];
+
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations] [tmpfs directory]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	snprintf(root, sizeof(root), "%s/sysfs_bench.XXXXXX", tmpfs);
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	if (create_tree() != 0) {
+		fprintf(stderr, "Cannot create the attribute tree in %s\n", root);
+		remove_tree();
+		return EXIT_FAILURE;
+	}
+	setenv(SYSFS_ROOT_ENV, root, 1);
+
+	memset(&motor, 0, sizeof(motor));
+	memset(&sensor, 0, sizeof(sensor));
+	if (sysfs_open_motor(&motor_io, &motor, 'A') != 0 || sysfs_open_sensor(&sensor_io, &sensor, 1) != 0) {
+		fprintf(stderr, "Cannot open the attributes under %s\n", root);
+		remove_tree();
+		return EXIT_FAILURE;
+	}
+	printf("sysfs attributes in %s, %ld iterations\n", root, iterations);
+
+	// position (lectura del bucle de los ejes)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		sink += sysfs_get_position(&motor_io);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	long long cached_ns = elapsed_ns(&start, &end);
+	snprintf(path, sizeof(path), "%s/tacho-motor/motor0/position", root);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		sink += uncached_read(path);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_result("position", iterations, cached_ns, elapsed_ns(&start, &end));
+
+	// value0 (lectura de los sensores)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		sink += sysfs_update_sensor_val(&sensor_io);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cached_ns = elapsed_ns(&start, &end);
+	snprintf(path, sizeof(path), "%s/lego-sensor/sensor0/value0", root);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		sink += uncached_read(path);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_result("value0", iterations, cached_ns, elapsed_ns(&start, &end));
+
+	// duty_cycle_sp (escritura del bucle de posicion)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		sysfs_set_duty_cycle_sp(&motor_io, (int32_t) (i % 100));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cached_ns = elapsed_ns(&start, &end);
+	snprintf(path, sizeof(path), "%s/tacho-motor/motor0/duty_cycle_sp", root);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		uncached_write(path, (int32_t) (i % 100));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_result("duty_cycle_sp", iterations, cached_ns, elapsed_ns(&start, &end));
+
+	sysfs_close_motor(&motor_io);
+	sysfs_close_sensor(&sensor_io);
+	remove_tree();
+	(void) sink;
+	return EXIT_SUCCESS;
+}
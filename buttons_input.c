@@ -0,0 +1,228 @@
+/*
+ * File: buttons_input.c
+ *
+ * Descripcion: Implementacion de la lectura de la botonera con evdev.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "ev3c.h"
+#include "buttons_input.h"
+#include "periodic.h"
+#include "timebase.h"
+
+#define INPUT_DEV_PATTERN           "/dev/input/event%d"
+#define INPUT_DEV_MAX               32
+#define PATH_SIZE                   64
+
+// Cabeceras del kernel anteriores a 4.16
+#ifndef input_event_sec
+#define input_event_sec             time.tv_sec
+#define input_event_usec            time.tv_usec
+#endif
+
+// Eventos leidos en cada read()
+#define EVENTS_PER_READ             16
+
+#define BITS_PER_LONG               (8 * sizeof(unsigned long))
+#define TEST_BIT(bit, array)        ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+// Teclas del brick (gpio-keys de ev3dev) en el orden de los indices BUTTON_* de ev3c
+static const struct {
+	int button;
+	unsigned short code;
+} BUTTON_KEYS[BUTTONS_INPUT_COUNT] = {
+	{ BUTTON_LEFT, KEY_LEFT },
+	{ BUTTON_UP, KEY_UP },
+	{ BUTTON_RIGHT, KEY_RIGHT },
+	{ BUTTON_DOWN, KEY_DOWN },
+	{ BUTTON_CENTER, KEY_ENTER },
+	{ BUTTON_BACK, KEY_BACKSPACE },
+};
+
+/**
+ * @brief Indice BUTTON_* de una tecla o -1 si no es del brick.
+ */
+static int buttons_input_button(unsigned short code) {
+	for (int i = 0; i < BUTTONS_INPUT_COUNT; i++) {
+		if (BUTTON_KEYS[i].code == code) {
+			return BUTTON_KEYS[i].button;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Comprueba si el dispositivo tiene todas las teclas del brick.
+ */
+static int buttons_input_has_keys(int fd) {
+	unsigned long keys[KEY_MAX / BITS_PER_LONG + 1];
+
+	memset(keys, 0, sizeof(keys));
+	if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0) {
+		return 0;
+	}
+	for (int i = 0; i < BUTTONS_INPUT_COUNT; i++) {
+		if (!TEST_BIT(BUTTON_KEYS[i].code, keys)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Lee del kernel el estado actual de las teclas. Se usa al abrir y cuando
+ *        se han perdido eventos (SYN_DROPPED).
+ */
+static void buttons_input_sync(buttons_input_t *input) {
+	unsigned long keys[KEY_MAX / BITS_PER_LONG + 1];
+
+	memset(keys, 0, sizeof(keys));
+	if (ioctl(input->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+		return;
+	}
+	input->pressed = 0;
+	for (int i = 0; i < BUTTONS_INPUT_COUNT; i++) {
+		if (TEST_BIT(BUTTON_KEYS[i].code, keys)) {
+			input->pressed |= 1u << BUTTON_KEYS[i].button;
+		}
+	}
+}
+
+/**
+ * @brief Abre un dispositivo y comprueba que sea la botonera.
+ */
+static int buttons_input_try(buttons_input_t *input, const char *path) {
+	int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return errno;
+	}
+	if (!buttons_input_has_keys(fd)) {
+		close(fd);
+		return ENODEV;
+	}
+
+	// Marcas de tiempo en el mismo reloj que las tareas periodicas
+	int clock = CLOCK_MONOTONIC;
+	ioctl(fd, EVIOCSCLOCKID, &clock);
+
+	input->fd = fd;
+	buttons_input_sync(input);
+	return 0;
+}
+
+int buttons_input_open(buttons_input_t *input) {
+	char path[PATH_SIZE];
+
+	memset(input, 0, sizeof(*input));
+	input->fd = -1;
+
+	const char *device = getenv(BUTTONS_DEV_ENV);
+	if (device != NULL) {
+		return buttons_input_try(input, device);
+	}
+
+	for (int i = 0; i < INPUT_DEV_MAX; i++) {
+		snprintf(path, sizeof(path), INPUT_DEV_PATTERN, i);
+		if (buttons_input_try(input, path) == 0) {
+			return 0;
+		}
+	}
+	return ENODEV;
+}
+
+int buttons_input_wait(buttons_input_t *input) {
+	struct pollfd fds[2] = {
+		{ .fd = input->fd, .events = POLLIN },
+		{ .fd = periodic_shutdown_fd(), .events = POLLIN },
+	};
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (fds[1].revents & POLLIN) {
+			return 0;
+		}
+		if (fds[0].revents & POLLIN) {
+			return 1;
+		}
+		if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			errno = ENODEV;
+			return -1;
+		}
+	}
+}
+
+int buttons_input_read(buttons_input_t *input) {
+	struct input_event events[EVENTS_PER_READ];
+	int edges = 0;
+	ssize_t size;
+
+	while ((size = read(input->fd, events, sizeof(events))) > 0) {
+		int n_events = size / sizeof(struct input_event);
+		for (int i = 0; i < n_events; i++) {
+			const struct input_event *event = &events[i];
+			input->events++;
+			if (event->type == EV_SYN && event->code == SYN_DROPPED) {
+				// Se han perdido eventos: el estado se recupera del kernel
+				unsigned int previous = input->pressed;
+				buttons_input_sync(input);
+				edges += __builtin_popcount(previous ^ input->pressed);
+				continue;
+			}
+			if (event->type != EV_KEY || event->value == 2) { // 2: autorrepeticion
+				continue;
+			}
+			int button = buttons_input_button(event->code);
+			if (button < 0) {
+				continue;
+			}
+			if (event->value) {
+				input->pressed |= 1u << button;
+				input->presses[button]++;
+			} else {
+				input->pressed &= ~(1u << button);
+			}
+#ifdef VIRTUAL_TIME
+			// La marca del kernel no esta en el reloj virtual de las tareas
+			timebase_now(&input->last_event);
+#else
+			input->last_event.tv_sec = event->input_event_sec;
+			input->last_event.tv_nsec = event->input_event_usec * 1000;
+#endif
+			edges++;
+		}
+	}
+	if (size == 0) {
+		// evdev no devuelve fin de fichero mientras el dispositivo existe
+		errno = ENODEV;
+		return -1;
+	}
+	if (size < 0 && errno != EAGAIN && errno != EINTR) {
+		return -1;
+	}
+	return edges;
+}
+
+void buttons_input_close(buttons_input_t *input) {
+	if (input->fd >= 0) {
+		close(input->fd);
+		input->fd = -1;
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * File: buttons_input.h
+ *
+ * Descripcion: Lectura de la botonera del brick como dispositivo de entrada de
+ *              Linux (evdev). Cada pulsacion o liberacion llega como un
+ *              struct input_event con la marca de tiempo del kernel, por lo que
+ *              no hace falta muestrear los botones y no se pierden pulsaciones
+ *              cortas.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef BUTTONS_INPUT_H
+#define BUTTONS_INPUT_H
+
+#include <time.h>
+
+// Variable de entorno con la ruta del dispositivo (p.ej. un teclado uinput de
+// pruebas). Si no se define se busca el teclado del brick en /dev/input.
+#define BUTTONS_DEV_ENV             "EV3_BUTTONS_DEV"
+
+// Numero de botones del brick (indices BUTTON_* de ev3c)
+#define BUTTONS_INPUT_COUNT         6
+
+typedef struct buttons_input {
+	int fd;                                         // -1 si no hay dispositivo
+	unsigned int pressed;                           // mascara (1 << BUTTON_*) de botones pulsados
+	unsigned int presses[BUTTONS_INPUT_COUNT];      // flancos de pulsacion acumulados por boton
+	struct timespec last_event;                     // marca (timebase_now) del ultimo evento
+	unsigned long events;
+} buttons_input_t;
+
+/**
+ * @brief Abre el dispositivo de entrada de la botonera en modo no bloqueante y
+ *        lee el estado inicial de las teclas.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno). ENODEV si no se encuentra
+ *         ningun dispositivo con las teclas del brick.
+ */
+int buttons_input_open(buttons_input_t *input);
+
+/**
+ * @brief Bloquea hasta que haya eventos pendientes o hasta la orden de
+ *        finalizacion de las tareas (periodic_shutdown).
+ *
+ * @return 1 si hay eventos pendientes, 0 si ha despertado por finalizacion o -1 si
+ *         ha fallado poll() o el dispositivo (POLLERR, POLLHUP o POLLNVAL sin eventos,
+ *         p.ej. al desconectarlo, con errno ENODEV).
+ */
+int buttons_input_wait(buttons_input_t *input);
+
+/**
+ * @brief Procesa, sin bloquear, todos los eventos pendientes y actualiza pressed,
+ *        presses y last_event.
+ *
+ * @return Numero de flancos (pulsaciones y liberaciones) procesados o -1 si la
+ *         lectura ha fallado con un error distinto de EAGAIN (p.ej. ENODEV al
+ *         desconectar el dispositivo), con el codigo en errno.
+ */
+int buttons_input_read(buttons_input_t *input);
+
+/**
+ * @brief Cierra el dispositivo.
+ */
+void buttons_input_close(buttons_input_t *input);
+
+#endif
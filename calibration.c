@@ -0,0 +1,111 @@
+/*
+ * File: calibration.c
+ *
+ * Descripcion: Implementacion de la calibracion persistente.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calibration.h"
+
+#define CALIBRATION_MAGIC           0x41524d43u // "ARMC"
+#define CALIBRATION_VERSION         2
+
+#define PATH_SIZE                   256
+
+/**
+ * @brief Devuelve la ruta del fichero, teniendo en cuenta CALIBRATION_FILE_ENV.
+ */
+static const char* calibration_path() {
+	const char *path = getenv(CALIBRATION_FILE_ENV);
+	return (path != NULL) ? path : CALIBRATION_FILE_DEFAULT;
+}
+
+/**
+ * @brief FNV-1a de todos los campos salvo la propia suma de comprobacion.
+ */
+static uint32_t calibration_checksum(const calibration_t *calibration) {
+	const unsigned char *bytes = (const unsigned char *) calibration;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < offsetof(calibration_t, checksum); i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+int calibration_load(calibration_t *calibration) {
+	const char *path = calibration_path();
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	ssize_t n = read(fd, calibration, sizeof(calibration_t));
+	int error = (n < 0) ? errno : 0;
+	close(fd);
+
+	// Se consume aunque no sea valido: solo la proxima finalizacion limpia lo repone
+	unlink(path);
+
+	if (error != 0) {
+		return error;
+	}
+	if (n != sizeof(calibration_t) || calibration->magic != CALIBRATION_MAGIC ||
+			calibration->version != CALIBRATION_VERSION ||
+			calibration->checksum != calibration_checksum(calibration)) {
+		return EINVAL;
+	}
+	return calibration->clean_shutdown ? 0 : ESTALE;
+}
+
+int calibration_save(calibration_t *calibration, bool clean_shutdown) {
+	const char *path = calibration_path();
+	char tmp_path[PATH_SIZE];
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path)) {
+		return ENAMETOOLONG;
+	}
+
+	calibration->magic = CALIBRATION_MAGIC;
+	calibration->version = CALIBRATION_VERSION;
+	calibration->clean_shutdown = clean_shutdown;
+	calibration->checksum = calibration_checksum(calibration);
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return errno;
+	}
+	int error = 0;
+	if (write(fd, calibration, sizeof(calibration_t)) != sizeof(calibration_t)) {
+		error = (errno != 0) ? errno : EIO;
+	} else if (fsync(fd) != 0) {
+		error = errno;
+	}
+	close(fd);
+	if (error == 0 && rename(tmp_path, path) != 0) {
+		error = errno;
+	}
+	if (error != 0) {
+		unlink(tmp_path);
+	}
+	return error;
+}
+
+void calibration_store_gravity(calibration_t *calibration, const gravity_table_t *table) {
+	calibration->gravity_valid = table->valid;
+	memcpy(calibration->gravity, table->gravity, sizeof(calibration->gravity));
+	calibration->friction = table->friction;
+}
+
+bool calibration_plausible(const calibration_t *calibration, int32_t touch, int32_t reflection) {
+	return touch == calibration->touch &&
+			abs(reflection - calibration->reflection) <= CALIBRATION_REFLECTION_TOLERANCE;
+}
@@ -0,0 +1,92 @@
+/*
+ * File: calibration.h
+ *
+ * Descripcion: Calibracion persistente del brazo. Al terminar limpiamente (brazo
+ *              aparcado en la posicion inicial) se guarda la posicion de cada motor
+ *              respecto al origen del homing y la lectura de los sensores. Al
+ *              arrancar, si el fichero es valido y los sensores coinciden, se
+ *              restauran las posiciones y no hace falta repetir el homing.
+ *
+ *              Tambien se guarda la tabla de gravedad de la elevacion medida tras la
+ *              inicializacion. Es del mecanismo y no de la posicion, por lo que se usa
+ *              tambien en el arranque en frio y el barrido solo se repite si no hay
+ *              ninguna valida.
+ *
+ *              El fichero se borra al cargarlo, de modo que una ejecucion que no
+ *              termine limpiamente obliga a hacer el homing en la siguiente. Tras el
+ *              arranque se vuelve a guardar sin la marca de finalizacion limpia para
+ *              conservar la tabla aunque el programa no termine bien.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gravity.h"
+
+// Variable de entorno con la ruta del fichero de calibracion
+#define CALIBRATION_FILE_ENV        "EV3_CALIBRATION"
+#define CALIBRATION_FILE_DEFAULT    "robotic_arm.cal"
+
+// Diferencia maxima de luz reflejada para aceptar la calibracion
+#define CALIBRATION_REFLECTION_TOLERANCE 3
+
+// Ejes calibrados
+typedef enum calibration_axis_enum {
+	CALIBRATION_ROTATION, CALIBRATION_ELEVATION, CALIBRATION_CLAW, CALIBRATION_AXES
+} calibration_axis;
+
+typedef struct calibration {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t clean_shutdown;                // marca de finalizacion limpia
+	int32_t position[CALIBRATION_AXES];     // posicion al aparcar respecto al origen del homing
+	int32_t touch;                          // lecturas de los sensores al aparcar
+	int32_t reflection;
+	int32_t gravity_valid;                  // tabla de gravedad de la elevacion
+	double gravity[GRAVITY_BINS];           // units: %
+	double friction;                        // units: %
+	uint32_t checksum;                      // FNV-1a de los campos anteriores
+} calibration_t;
+
+/**
+ * @brief Lee el fichero de calibracion y lo borra.
+ *
+ * @return 0 si el fichero existe, esta completo, su cabecera y su suma de
+ *         comprobacion son correctas y tiene la marca de finalizacion limpia.
+ *         ESTALE si es correcto pero sin la marca (las posiciones no valen, la
+ *         tabla de gravedad si), ENOENT si no existe, EINVAL si no es valido o el
+ *         codigo de error (errno).
+ */
+int calibration_load(calibration_t *calibration);
+
+/**
+ * @brief Guarda la calibracion. Escribe un fichero temporal y lo renombra, por lo
+ *        que un corte a mitad no deja un fichero parcial.
+ *
+ * @param clean_shutdown Marca de finalizacion limpia: sin ella el siguiente
+ *        arranque solo aprovecha la tabla de gravedad.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int calibration_save(calibration_t *calibration, bool clean_shutdown);
+
+/**
+ * @brief Copia en la calibracion la tabla de gravedad (bins, rozamiento y validez).
+ */
+void calibration_store_gravity(calibration_t *calibration, const gravity_table_t *table);
+
+/**
+ * @brief Comprueba que los sensores confirman que el brazo sigue donde se dejo:
+ *        el fin de carrera en el mismo estado y la luz reflejada dentro de
+ *        CALIBRATION_REFLECTION_TOLERANCE.
+ */
+bool calibration_plausible(const calibration_t *calibration, int32_t touch, int32_t reflection);
+
+#endif
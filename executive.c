@@ -0,0 +1,256 @@
+/*
+ * File: executive.c
+ *
+ * Descripcion: Implementacion de la ejecucion de tareas en hilos o desde un
+ *              ejecutivo ciclico.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "executive.h"
+#include "periodic.h"
+#include "timebase.h"
+
+#define NSEC_PER_SEC                1000000000LL
+
+/**
+ * @brief Diferencia a - b en nanosegundos.
+ */
+static long long executive_diff_ns(const struct timespec *a, const struct timespec *b) {
+	return (a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+/**
+ * @brief Suma ns nanosegundos a un instante.
+ */
+static void executive_add_ns(struct timespec *time, long long ns) {
+	ns += time->tv_nsec;
+	time->tv_sec += ns / NSEC_PER_SEC;
+	time->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+/**
+ * @brief Periodo de la siguiente activacion de una tarea con rate (como minimo el
+ *        suyo).
+ */
+static long executive_rate(task_t *task) {
+	long period = task->rate(task->context);
+	return (period > task->period) ? period : task->period;
+}
+
+/**
+ * @brief Maximo comun divisor.
+ */
+static long executive_gcd(long a, long b) {
+	while (b != 0) {
+		long r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/**
+ * @brief Ejecuta una activacion de la tarea y registra su latencia y su tiempo de
+ *        ejecucion.
+ */
+static void executive_run(task_t *task, const struct timespec *release) {
+	struct timespec start, end;
+	timebase_now(&start);
+	task->step(task->context);
+	timebase_now(&end);
+	task_stats_record(&task->stats, executive_diff_ns(&start, release),
+			executive_diff_ns(&end, &start), task->period);
+}
+
+void* task_thread(void *params) {
+	task_t *task = (task_t *) params;
+	periodic_task_t timer;
+
+	int error = periodic_init(&timer, task->period);
+	if (error != 0) {
+		printf("Error on periodic_init with task %s.\n", task->name);
+		pthread_exit(NULL);
+	}
+
+	atomic_store(&task->timer, &timer);
+
+	int expirations;
+	long period = task->period;
+	do {
+		executive_run(task, &timer.release);
+		long next = (task->rate != NULL) ? executive_rate(task) : period;
+		if (next != period) {
+			period = next;
+			error = periodic_set_period(&timer, period);
+			if (error != 0) {
+				printf("Error on periodic_set_period with task %s.\n", task->name);
+				break;
+			}
+		}
+		expirations = periodic_wait(&timer);
+		if (expirations > 1) {
+			task_stats_skipped(&task->stats, expirations - 1);
+		}
+	} while (expirations > 0);
+
+	// Sin task_wake en curso no se vuelve a usar el temporizador
+	atomic_store(&task->timer, NULL);
+	while (atomic_load(&task->wakers) > 0) {
+		timebase_usleep(1000);
+	}
+	periodic_close(&timer);
+	pthread_exit(NULL);
+}
+
+void task_wake(task_t *task) {
+	atomic_store(&task->wake, true);
+	atomic_fetch_add(&task->wakers, 1);
+	periodic_task_t *timer = atomic_load(&task->timer);
+	if (timer != NULL) {
+		periodic_wake(timer);
+	}
+	atomic_fetch_sub(&task->wakers, 1);
+}
+
+int cyclic_executive(task_t *tasks, int n_tasks, executive_stats_t *stats) {
+	if (n_tasks <= 0 || n_tasks > EXECUTIVE_MAX_TASKS) {
+		return EINVAL;
+	}
+
+	// Marco secundario = mcd de los periodos, marco principal = mcm
+	long minor_frame = tasks[0].period;
+	long long major_frame = tasks[0].period;
+	for (int i = 1; i < n_tasks; i++) {
+		minor_frame = executive_gcd(minor_frame, tasks[i].period);
+		major_frame = major_frame / executive_gcd(major_frame, tasks[i].period) * tasks[i].period;
+	}
+
+	if (major_frame / minor_frame > EXECUTIVE_MAX_FRAMES) {
+		printf("Cyclic executive: minor frame %.3f ms and major frame %.3f s need %lld frames "
+				"(at most %d), choose commensurate periods.\n", minor_frame / 1e6, major_frame / 1e9,
+				major_frame / minor_frame, EXECUTIVE_MAX_FRAMES);
+		return EINVAL;
+	}
+
+	// Tabla estatica: mascara de tareas que se activan en cada marco secundario
+	long n_frames = (long) (major_frame / minor_frame);
+	uint32_t *schedule = calloc(n_frames, sizeof(uint32_t));
+	if (schedule == NULL) {
+		return ENOMEM;
+	}
+	for (long frame = 0; frame < n_frames; frame++) {
+		for (int i = 0; i < n_tasks; i++) {
+			if ((frame * minor_frame) % tasks[i].period == 0) {
+				schedule[frame] |= (uint32_t) 1 << i;
+			}
+		}
+	}
+
+	stats->minor_frame = minor_frame;
+	stats->major_frame = (long) major_frame;
+	stats->frames = 0;
+	stats->overruns = 0;
+	stats->missed_frames = 0;
+	stats->max_frame_jitter_ns = 0;
+	stats->stopped = false;
+
+	periodic_task_t timer;
+	int error = periodic_init(&timer, minor_frame);
+	if (error != 0) {
+		free(schedule);
+		return error;
+	}
+
+	// Siguiente activacion de las tareas con rate: sus huecos se saltan hasta entonces
+	struct timespec due[EXECUTIVE_MAX_TASKS] = { { 0, 0 } };
+
+	long frame = 0;
+	int expirations;
+	int consecutive_overruns = 0;
+	do {
+		if (timer.latency_ns > stats->max_frame_jitter_ns) {
+			stats->max_frame_jitter_ns = timer.latency_ns;
+		}
+		for (int i = 0; i < n_tasks; i++) {
+			if (!(schedule[frame] & ((uint32_t) 1 << i))) {
+				continue;
+			}
+			if (tasks[i].rate != NULL && !atomic_exchange(&tasks[i].wake, false) &&
+					executive_diff_ns(&timer.release, &due[i]) < 0) {
+				continue;
+			}
+			executive_run(&tasks[i], &timer.release);
+			if (tasks[i].rate != NULL) {
+				due[i] = timer.release;
+				executive_add_ns(&due[i], executive_rate(&tasks[i]));
+			}
+		}
+		stats->frames++;
+
+		expirations = periodic_wait(&timer);
+		if (expirations <= 1) {
+			consecutive_overruns = 0;
+		} else {
+			stats->overruns++;
+			stats->missed_frames += expirations - 1;
+			// Activaciones perdidas de cada tarea en los marcos descartados
+			for (int skipped = 1; skipped < expirations; skipped++) {
+				uint32_t mask = schedule[(frame + skipped) % n_frames];
+				for (int i = 0; i < n_tasks; i++) {
+					if (mask & ((uint32_t) 1 << i)) {
+						task_stats_skipped(&tasks[i].stats, 1);
+					}
+				}
+			}
+			// Sin volver a cumplir los plazos las tareas no pueden controlar el brazo
+			if (++consecutive_overruns >= EXECUTIVE_MAX_OVERRUNS) {
+				stats->stopped = true;
+				periodic_shutdown();
+				break;
+			}
+		}
+		frame = (frame + expirations) % n_frames;
+	} while (expirations > 0);
+
+	periodic_close(&timer);
+	free(schedule);
+	return stats->stopped ? ETIMEDOUT : 0;
+}
+
+void executive_mark(executive_mark_t *mark) {
+	struct rusage usage;
+	timebase_now(&mark->time);
+	getrusage(RUSAGE_SELF, &usage);
+	mark->cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+			usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	mark->context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+void executive_report(const task_t *tasks, int n_tasks, const executive_mark_t *start) {
+	executive_mark_t now;
+	executive_mark(&now);
+
+	double elapsed = executive_diff_ns(&now.time, &start->time) / 1e9;
+	double cpu = now.cpu_s - start->cpu_s;
+
+	printf("CPU usage: %.2f s in %.2f s (%.1f %%), %ld context switches\n", cpu, elapsed,
+			(elapsed > 0) ? 100.0 * cpu / elapsed : 0.0,
+			now.context_switches - start->context_switches);
+	executive_dump(tasks, n_tasks);
+}
+
+void executive_dump(const task_t *tasks, int n_tasks) {
+	for (int i = 0; i < n_tasks; i++) {
+		task_stats_print(tasks[i].name, &tasks[i].stats);
+	}
+}
@@ -0,0 +1,129 @@
+/*
+ * File: executive.h
+ *
+ * Descripcion: Ejecucion de las tareas periodicas del programa principal. Cada
+ *              tarea es una funcion de activacion con su estado y su periodo, y
+ *              puede ejecutarse en un hilo propio (task_thread) o, compilando con
+ *              CYCLIC_EXECUTIVE, desde un ejecutivo ciclico con una tabla estatica
+ *              monotonica en tasa.
+ *
+ *              Una tarea puede elegir el periodo de su siguiente activacion (rate):
+ *              period es entonces el mas corto, con el que se construye la tabla,
+ *              y el hilo reprograma su temporizador o el ejecutivo salta su hueco
+ *              mientras no venza. task_wake adelanta la siguiente activacion.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef EXECUTIVE_H
+#define EXECUTIVE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "periodic.h"
+#include "task_stats.h"
+
+// Numero maximo de tareas en la tabla del ejecutivo ciclico
+#define EXECUTIVE_MAX_TASKS         32
+
+// Numero maximo de marcos secundarios en el principal. Con periodos primos entre
+// si (p.ej. 7 ms junto a 5 ms) el mcd baja a 1 ms y el mcm sube a decenas de
+// segundos, y la tabla deja de tener sentido
+#define EXECUTIVE_MAX_FRAMES        4096
+
+// Marcos desbordados seguidos tras los que el ejecutivo se detiene
+#define EXECUTIVE_MAX_OVERRUNS      8
+
+// Tarea periodica. Las estadisticas las actualiza quien la ejecuta.
+typedef struct task {
+	const char *name;
+	void (*step)(void *context);
+	void *context;
+	long period;                    // units: nsecs
+	long (*rate)(void *context);    // periodo de la siguiente activacion (NULL: siempre period)
+	task_stats_t stats;
+	_Atomic(periodic_task_t *) timer; // temporizador del hilo de la tarea mientras se ejecuta
+	atomic_int wakers;              // task_wake en curso sobre timer
+	atomic_bool wake;               // activacion adelantada en el ejecutivo ciclico
+} task_t;
+
+// Estadisticas del ejecutivo ciclico
+typedef struct executive_stats {
+	long minor_frame;               // units: nsecs
+	long major_frame;               // units: nsecs
+	unsigned long frames;
+	unsigned long overruns;         // marcos que no terminaron antes del siguiente
+	unsigned long missed_frames;    // marcos descartados por los desbordamientos
+	long long max_frame_jitter_ns;
+	bool stopped;                   // detenido por EXECUTIVE_MAX_OVERRUNS desbordamientos seguidos
+} executive_stats_t;
+
+// Instante y consumo de CPU del proceso al arrancar las tareas
+typedef struct executive_mark {
+	struct timespec time;
+	double cpu_s;
+	long context_switches;
+} executive_mark_t;
+
+/**
+ * @brief Cuerpo de hilo que ejecuta una tarea con su periodo hasta la orden de
+ *        finalizacion (periodic_shutdown).
+ *
+ * @param params Puntero a task_t.
+ */
+void* task_thread(void *params);
+
+/**
+ * @brief Ejecutivo ciclico. Calcula el marco secundario (mcd de los periodos) y el
+ *        principal (mcm), construye la tabla de activaciones y la recorre hasta la
+ *        orden de finalizacion. Dentro de cada marco las tareas se ejecutan en el
+ *        orden del vector, que debe ser el monotonico en tasa. Si un marco se
+ *        desborda se descartan los marcos vencidos para no perder la fase, y tras
+ *        EXECUTIVE_MAX_OVERRUNS marcos desbordados seguidos da la orden de
+ *        finalizacion (periodic_shutdown) y se detiene.
+ *
+ * @param tasks Tareas a planificar.
+ * @param n_tasks Numero de tareas (como maximo EXECUTIVE_MAX_TASKS).
+ * @param stats Estadisticas del ejecutivo.
+ *
+ * @return 0 si tiene exito.
+ *         EINVAL si el numero de tareas no es valido o el marco principal tiene mas
+ *         de EXECUTIVE_MAX_FRAMES marcos secundarios.
+ *         ETIMEDOUT si se ha detenido por los desbordamientos (stats->stopped).
+ *         Otro codigo de error (errno) si falla el temporizador.
+ */
+int cyclic_executive(task_t *tasks, int n_tasks, executive_stats_t *stats);
+
+/**
+ * @brief Adelanta al instante actual (al siguiente hueco de la tarea con el
+ *        ejecutivo ciclico) la siguiente activacion de una tarea con rate. Puede
+ *        llamarse desde cualquier hilo.
+ */
+void task_wake(task_t *task);
+
+/**
+ * @brief Registra el instante y el consumo de CPU actuales.
+ */
+void executive_mark(executive_mark_t *mark);
+
+/**
+ * @brief Imprime el uso de CPU del proceso desde start y las estadisticas de cada
+ *        tarea.
+ *
+ * @param tasks Tareas ejecutadas.
+ * @param n_tasks Numero de tareas.
+ * @param start Marca tomada al arrancar las tareas.
+ */
+void executive_report(const task_t *tasks, int n_tasks, const executive_mark_t *start);
+
+/**
+ * @brief Imprime las estadisticas de cada tarea. Puede llamarse mientras las
+ *        tareas se ejecutan.
+ */
+void executive_dump(const task_t *tasks, int n_tasks);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * File: gravity.c
+ *
+ * Descripcion: Implementacion de la prealimentacion de la gravedad de la elevacion.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gravity.h"
+
+#define GRAVITY_ADAPT_MIN_DUTY      5.0     // units: %, por debajo no se estima la carga
+#define GRAVITY_ADAPT_RATE          0.3     // filtro del error de velocidad de cada sentido
+#define GRAVITY_ADAPT_GAIN          0.2     // correccion de la carga por activacion
+#define GRAVITY_MIN_GRAVITY         0.5     // units: %, tramos en los que no se estima
+#define GRAVITY_MIN_LOAD            0.5
+#define GRAVITY_MAX_LOAD            3.0
+
+/**
+ * @brief Gravedad interpolada linealmente entre los centros de los tramos.
+ */
+static double gravity_at(const gravity_table_t *table, int32_t position) {
+	double x = (double) (position - table->min_position) / table->bin_units - 0.5;
+	if (x <= 0.0) {
+		return table->gravity[0];
+	}
+	if (x >= GRAVITY_BINS - 1) {
+		return table->gravity[GRAVITY_BINS - 1];
+	}
+	int bin = (int) x;
+	double fraction = x - bin;
+	return table->gravity[bin] * (1.0 - fraction) + table->gravity[bin + 1] * fraction;
+}
+
+void gravity_init(gravity_table_t *table, int32_t min_position, int32_t max_position, double full_speed) {
+	memset(table, 0, sizeof(*table));
+	table->min_position = min_position;
+	table->bin_units = (max_position - min_position + GRAVITY_BINS - 1) / GRAVITY_BINS;
+	table->full_speed = full_speed;
+	table->load[false] = 1.0;
+	table->load[true] = 1.0;
+}
+
+void gravity_sweep_init(gravity_sweep_t *sweep, const gravity_table_t *table) {
+	memset(sweep, 0, sizeof(*sweep));
+	sweep->min_position = table->min_position;
+	sweep->bin_units = table->bin_units;
+}
+
+void gravity_sweep_record(gravity_sweep_t *sweep, int32_t position, double speed) {
+	if (speed == 0.0) {
+		return;
+	}
+	// Fuera de la tabla solo quedan los arranques y las frenadas
+	if (position < sweep->min_position || position >= sweep->min_position + GRAVITY_BINS * sweep->bin_units) {
+		return;
+	}
+	gravity_direction direction = (speed < 0.0) ? GRAVITY_UP : GRAVITY_DOWN;
+	int bin = (position - sweep->min_position) / sweep->bin_units;
+	sweep->total[direction][bin] += speed;
+	sweep->samples[direction][bin]++;
+}
+
+int gravity_build(gravity_table_t *table, const gravity_sweep_t *sweep, double power) {
+	double k = table->full_speed / 100.0;
+	double friction = 0.0;
+
+	table->valid = false;
+	for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+		if (sweep->samples[GRAVITY_UP][bin] == 0 || sweep->samples[GRAVITY_DOWN][bin] == 0) {
+			return ENODATA;
+		}
+		double up = sweep->total[GRAVITY_UP][bin] / sweep->samples[GRAVITY_UP][bin];
+		double down = sweep->total[GRAVITY_DOWN][bin] / sweep->samples[GRAVITY_DOWN][bin];
+		table->gravity[bin] = (down + up) / (2.0 * k);
+		friction += power - (down - up) / (2.0 * k);
+	}
+	table->friction = fmax(friction / GRAVITY_BINS, 0.0);
+	table->valid = true;
+	return 0;
+}
+
+double gravity_duty(const gravity_table_t *table, int32_t position, double speed) {
+	if (!table->valid) {
+		return 0.0;
+	}
+	double friction = (speed > 0.0) ? table->friction : (speed < 0.0) ? -table->friction : 0.0;
+	return friction - table->load[table->gripping] * gravity_at(table, position);
+}
+
+void gravity_set_gripping(gravity_table_t *table, bool gripping) {
+	if (gripping != table->gripping) {
+		table->gripping = gripping;
+		table->residual[GRAVITY_UP] = 0.0;
+		table->residual[GRAVITY_DOWN] = 0.0;
+	}
+}
+
+void gravity_adapt(gravity_table_t *table, int32_t position, double duty, double measured_speed) {
+	bool steady = duty == table->last_duty;
+	table->last_duty = duty;
+	if (!table->valid || !steady || fabs(duty) < GRAVITY_ADAPT_MIN_DUTY) {
+		return;
+	}
+
+	gravity_direction direction = (duty < 0.0) ? GRAVITY_UP : GRAVITY_DOWN;
+	int bin = (position - table->min_position) / table->bin_units;
+	if (position >= table->min_position && bin < GRAVITY_BINS) {
+		table->speed[direction].total[bin] += fabs(measured_speed);
+		table->speed[direction].samples[bin]++;
+	}
+
+	// Con la compensacion exacta la velocidad es k * duty. Lo que falta en los dos
+	// sentidos es gravedad; lo que cambia de signo con el sentido, rozamiento
+	double residual = 100.0 * measured_speed / table->full_speed - duty;
+	table->residual[direction] += GRAVITY_ADAPT_RATE * (residual - table->residual[direction]);
+	double gravity = gravity_at(table, position);
+	if (gravity < GRAVITY_MIN_GRAVITY) {
+		return;
+	}
+	double common = (table->residual[GRAVITY_UP] + table->residual[GRAVITY_DOWN]) / 2.0;
+	double *load = &table->load[table->gripping];
+	*load = fmin(fmax(*load + GRAVITY_ADAPT_GAIN * common / gravity, GRAVITY_MIN_LOAD), GRAVITY_MAX_LOAD);
+}
+
+void gravity_print(const gravity_table_t *table) {
+	if (!table->valid) {
+		printf("Gravity table: not available\n");
+		return;
+	}
+	printf("Gravity table: %d..%d deg, gravity", table->min_position,
+			table->min_position + GRAVITY_BINS * table->bin_units);
+	for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+		printf(" %.1f", table->gravity[bin]);
+	}
+	printf(" %%, friction %.1f %%, load %.2f empty / %.2f gripping\n", table->friction, table->load[false],
+			table->load[true]);
+	for (int direction = 0; direction < GRAVITY_DIRECTIONS; direction++) {
+		const gravity_speed_stats_t *stats = &table->speed[direction];
+		unsigned long samples = 0;
+		double total = 0.0, min = 0.0, max = 0.0;
+		for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+			if (stats->samples[bin] == 0) {
+				continue;
+			}
+			double speed = stats->total[bin] / stats->samples[bin];
+			min = (samples == 0 || speed < min) ? speed : min;
+			max = (samples == 0 || speed > max) ? speed : max;
+			samples += stats->samples[bin];
+			total += stats->total[bin];
+		}
+		if (samples > 0) {
+			printf("Elevation %s speed: %lu samples, %.1f deg/s mean, by position %.1f..%.1f deg/s\n",
+					(direction == GRAVITY_UP) ? "up" : "down", samples, total / samples, min, max);
+		}
+	}
+}
@@ -0,0 +1,121 @@
+/*
+ * File: gravity.h
+ *
+ * Descripcion: Prealimentacion de la gravedad y el rozamiento de la elevacion. Tras la
+ *              inicializacion, con el brazo en reposo, se recorre el eje en run-direct
+ *              subiendo y bajando con la misma potencia y se mide la velocidad en cada
+ *              tramo de posiciones. Con
+ *              la velocidad maxima del motor k, en cada tramo:
+ *
+ *                  v_bajando + v_subiendo = 2 k g        (gravedad, hacia abajo)
+ *                  v_bajando - v_subiendo = 2 k (P - F)  (rozamiento)
+ *
+ *              La potencia que se suma a la de la velocidad pedida es -load * g(pos),
+ *              interpolada entre tramos, mas F en el sentido del movimiento. La carga
+ *              (load) se estima durante el uso: la parte del error de velocidad comun
+ *              a la subida y a la bajada es gravedad no compensada. Como la carga
+ *              cambia al cerrar y abrir la garra, se estima por separado con la garra
+ *              vacia y agarrando.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GRAVITY_BINS                8
+
+// Sentido del movimiento (la elevacion sube con posiciones negativas)
+typedef enum gravity_direction_enum {GRAVITY_UP, GRAVITY_DOWN, GRAVITY_DIRECTIONS} gravity_direction;
+
+// Velocidades medidas en el barrido tras la inicializacion
+typedef struct gravity_sweep {
+	int32_t min_position;
+	int32_t bin_units;
+	double total[GRAVITY_DIRECTIONS][GRAVITY_BINS];    // units: deg/s
+	unsigned int samples[GRAVITY_DIRECTIONS][GRAVITY_BINS];
+} gravity_sweep_t;
+
+// Velocidad en regimen permanente en cada tramo durante el uso, para comprobar la
+// compensacion
+typedef struct gravity_speed_stats {
+	double total[GRAVITY_BINS];     // units: deg/s, en valor absoluto
+	unsigned long samples[GRAVITY_BINS];
+} gravity_speed_stats_t;
+
+typedef struct gravity_table {
+	bool valid;
+	int32_t min_position;           // inicio del primer tramo
+	int32_t bin_units;
+	double gravity[GRAVITY_BINS];   // units: %, positiva hacia abajo
+	double friction;                // units: %
+	double full_speed;              // units: deg/s con el 100 % (k)
+	double load[2];                 // escala de la gravedad estimada, vacia / agarrando
+	bool gripping;
+	double residual[GRAVITY_DIRECTIONS]; // error medio de velocidad en potencia (%)
+	double last_duty;               // potencia pedida en la activacion anterior
+	gravity_speed_stats_t speed[GRAVITY_DIRECTIONS];
+} gravity_table_t;
+
+/**
+ * @brief Deja la tabla sin compensacion para [min_position, max_position] en
+ *        GRAVITY_BINS tramos.
+ *
+ * @param full_speed Velocidad del motor con el 100 % de potencia (deg/s).
+ */
+void gravity_init(gravity_table_t *table, int32_t min_position, int32_t max_position, double full_speed);
+
+/**
+ * @brief Prepara un barrido con los tramos de la tabla.
+ */
+void gravity_sweep_init(gravity_sweep_t *sweep, const gravity_table_t *table);
+
+/**
+ * @brief Registra una velocidad medida en el barrido (el signo da el sentido). Se
+ *        descartan las posiciones fuera de la tabla.
+ */
+void gravity_sweep_record(gravity_sweep_t *sweep, int32_t position, double speed);
+
+/**
+ * @brief Calcula la tabla a partir del barrido hecho con potencia power.
+ *
+ * @return 0 si tiene exito o ENODATA si algun tramo no tiene medidas en los dos
+ *         sentidos (la tabla queda sin compensacion).
+ */
+int gravity_build(gravity_table_t *table, const gravity_sweep_t *sweep, double power);
+
+/**
+ * @brief Potencia de compensacion en la posicion indicada (fuera de la tabla, la del
+ *        tramo extremo). El rozamiento solo se compensa en el sentido de la velocidad
+ *        pedida speed (nada si es 0). 0 si la tabla no es valida.
+ */
+double gravity_duty(const gravity_table_t *table, int32_t position, double speed);
+
+/**
+ * @brief Indica si la garra esta agarrando, lo que selecciona la estimacion de la
+ *        carga.
+ */
+void gravity_set_gripping(gravity_table_t *table, bool gripping);
+
+/**
+ * @brief Actualiza la estimacion de la carga con la velocidad medida durante la
+ *        ultima activacion. Solo usa las activaciones en las que la potencia pedida
+ *        (sin compensacion) no ha cambiado respecto a la anterior.
+ *
+ * @param duty Potencia pedida sin compensacion (%).
+ * @param measured_speed Velocidad medida (deg/s).
+ */
+void gravity_adapt(gravity_table_t *table, int32_t position, double duty, double measured_speed);
+
+/**
+ * @brief Imprime la tabla, la carga estimada y, en cada sentido, la velocidad media en
+ *        regimen permanente y la de los tramos mas lento y mas rapido.
+ */
+void gravity_print(const gravity_table_t *table);
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * File: job.c
+ *
+ * Descripcion: Implementacion de los trabajos de pick-and-place: lectura del
+ *              fichero, cursor y cola de pasos planificados.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job.h"
+
+#define JOB_LINE_SIZE               128
+#define JOB_MAX_COLOR               (JOB_COLORS - 1)
+
+static const struct {
+	const char *name;
+	int n_args;                     // -1: uno opcional
+} JOB_SYNTAX[] = {
+	[JOB_MOVE_JOINT] = { "move-joint", 2 },
+	[JOB_MOVE_CARTESIAN] = { "move-cartesian", 2 },
+	[JOB_GRIP] = { "grip", 0 },
+	[JOB_RELEASE] = { "release", 0 },
+	[JOB_WAIT_COLOR] = { "wait-color", 1 },
+	[JOB_READ_COLOR] = { "read-color", 0 },
+	[JOB_MOVE_BIN] = { "move-bin", 0 },
+	[JOB_BIN] = { "bin", 3 },
+	[JOB_LOOP] = { "loop", -1 },
+	[JOB_END] = { "end", 0 },
+};
+
+#define JOB_OPCODES                 (sizeof(JOB_SYNTAX) / sizeof(JOB_SYNTAX[0]))
+
+/**
+ * @brief Interpreta una linea sin comentario. Devuelve 0 y deja n_args a -1 si esta
+ *        vacia.
+ */
+static int job_parse_line(char *text, job_command_t *command, int *n_args) {
+	char *token = strtok(text, " \t\r\n");
+	*n_args = -1;
+	if (token == NULL) {
+		return 0;
+	}
+
+	unsigned int opcode = 0;
+	while (opcode < JOB_OPCODES && strcmp(token, JOB_SYNTAX[opcode].name) != 0) {
+		opcode++;
+	}
+	if (opcode == JOB_OPCODES) {
+		return EINVAL;
+	}
+	command->opcode = (job_opcode) opcode;
+	memset(command->args, 0, sizeof(command->args));
+
+	*n_args = 0;
+	while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+		char *end;
+		long value = strtol(token, &end, 10);
+		if (*end != '\0' || *n_args == JOB_MAX_ARGS || value < INT16_MIN || value > INT16_MAX) {
+			return EINVAL;
+		}
+		command->args[(*n_args)++] = (int32_t) value;
+	}
+	int expected = JOB_SYNTAX[opcode].n_args;
+	if ((expected >= 0 && *n_args != expected) || (expected < 0 && *n_args > 1)) {
+		return EINVAL;
+	}
+	if ((command->opcode == JOB_WAIT_COLOR || command->opcode == JOB_BIN) &&
+			(command->args[0] < 0 || command->args[0] > JOB_MAX_COLOR)) {
+		return EINVAL;
+	}
+	if (command->opcode == JOB_LOOP && *n_args == 1 && command->args[0] < 1) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+int job_load(job_t *job, int *line) {
+	const char *path = getenv(JOB_FILE_ENV);
+	if (path == NULL) {
+		return ENOENT;
+	}
+	FILE *file = fopen(path, "r");
+	if (line != NULL) {
+		*line = 0;
+	}
+	if (file == NULL) {
+		return errno;
+	}
+
+	char text[JOB_LINE_SIZE];
+	int open[JOB_MAX_DEPTH];
+	int depth = 0, number = 0, error = 0, move_bin = 0;
+	job->n_commands = 0;
+	memset(job->has_bin, 0, sizeof(job->has_bin));
+	while (error == 0 && fgets(text, sizeof(text), file) != NULL) {
+		number++;
+		char *comment = strchr(text, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+
+		job_command_t command;
+		int n_args;
+		error = job_parse_line(text, &command, &n_args);
+		if (error != 0 || n_args < 0) {
+			continue;
+		}
+
+		// Cajas: tabla aparte, una por color
+		if (command.opcode == JOB_BIN) {
+			if (job->has_bin[command.args[0]]) {
+				error = EINVAL;
+				continue;
+			}
+			job->has_bin[command.args[0]] = true;
+			job->bins[command.args[0]][0] = command.args[1];
+			job->bins[command.args[0]][1] = command.args[2];
+			continue;
+		}
+		if (job->n_commands == JOB_MAX_COMMANDS) {
+			error = ENOSPC;
+			continue;
+		}
+		command.line = number;
+		if (command.opcode == JOB_MOVE_BIN && move_bin == 0) {
+			move_bin = number;
+		}
+
+		// Bucles: cada end apunta a su loop, que no puede estar vacio
+		if (command.opcode == JOB_LOOP) {
+			if (depth == JOB_MAX_DEPTH) {
+				error = EINVAL;
+				continue;
+			}
+			open[depth++] = job->n_commands;
+		} else if (command.opcode == JOB_END) {
+			if (depth == 0) {
+				error = EINVAL;
+				continue;
+			}
+			command.args[0] = open[--depth];
+			bool empty = true;
+			for (int i = command.args[0] + 1; i < job->n_commands; i++) {
+				if (job->commands[i].opcode != JOB_LOOP && job->commands[i].opcode != JOB_END) {
+					empty = false;
+				}
+			}
+			if (empty) {
+				error = EINVAL;
+				continue;
+			}
+		}
+		job->commands[job->n_commands++] = command;
+	}
+	if (error == 0 && ferror(file)) {
+		error = EIO;
+		number = 0;
+	}
+	fclose(file);
+
+	if (error == 0 && depth > 0) {
+		number = job->commands[open[depth - 1]].line;
+		error = EINVAL;
+	}
+	if (error == 0 && move_bin > 0 && !job->has_bin[0]) {
+		number = move_bin;
+		error = EINVAL;
+	}
+	if (error == 0 && job->n_commands == 0) {
+		error = ENODATA;
+		number = 0;
+	}
+	if (line != NULL) {
+		*line = number;
+	}
+	return error;
+}
+
+void job_cursor_init(job_cursor_t *cursor) {
+	memset(cursor, 0, sizeof(*cursor));
+}
+
+const job_command_t* job_next(const job_t *job, job_cursor_t *cursor) {
+	while (cursor->next < job->n_commands) {
+		const job_command_t *command = &job->commands[cursor->next];
+		switch (command->opcode) {
+			case JOB_LOOP:
+				cursor->remaining[cursor->depth++] = command->args[0];
+				cursor->next++;
+				break;
+			case JOB_END: {
+				int *remaining = &cursor->remaining[cursor->depth - 1];
+				if (cursor->depth == 1) {
+					cursor->iterations++;
+				}
+				if (*remaining == 0 || --*remaining > 0) {
+					cursor->next = command->args[0] + 1;
+				} else {
+					cursor->depth--;
+					cursor->next++;
+				}
+				break;
+			}
+			default:
+				cursor->next++;
+				return command;
+		}
+	}
+	return NULL;
+}
+
+void job_queue_init(job_queue_t *queue) {
+	atomic_store_explicit(&queue->head, 0, memory_order_relaxed);
+	atomic_store_explicit(&queue->tail, 0, memory_order_relaxed);
+}
+
+job_step_t* job_queue_reserve(job_queue_t *queue) {
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	if (head - tail == JOB_QUEUE_SIZE) {
+		return NULL;
+	}
+	return &queue->steps[head % JOB_QUEUE_SIZE];
+}
+
+void job_queue_push(job_queue_t *queue) {
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+job_step_t* job_queue_front(job_queue_t *queue) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	if (head == tail) {
+		return NULL;
+	}
+	return &queue->steps[tail % JOB_QUEUE_SIZE];
+}
+
+void job_queue_pop(job_queue_t *queue) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
@@ -0,0 +1,159 @@
+/*
+ * File: job.h
+ *
+ * Descripcion: Trabajos de pick-and-place. Un trabajo es un fichero de texto con
+ *              una orden por linea ('#' empieza un comentario):
+ *
+ *                  move-joint <rotacion> <elevacion>   posiciones de los motores (deg)
+ *                  move-cartesian <y> <z>              punta de la garra en linea recta (mm)
+ *                  grip                                cierra la garra
+ *                  release                             abre la garra
+ *                  wait-color <color>                  espera a leer el color (0..7)
+ *                  read-color                          lee el color de la pieza agarrada
+ *                  move-bin                            lleva la pieza a la caja de ese color
+ *                  bin <color> <rotacion> <elevacion>  caja de un color (declaracion)
+ *                  loop [veces]                        repite hasta su end (sin veces, siempre)
+ *                  end
+ *
+ *              Las piezas de un color sin caja van a la de color 0, que es obligatoria
+ *              si hay algun move-bin. El destino de move-bin depende de la lectura, por
+ *              lo que ese paso y el movimiento siguiente se planifican al empezarlos.
+ *
+ *              El ejecutor recorre las ordenes con un cursor que resuelve los bucles
+ *              y deja cada paso ya planificado en una cola sin cerrojos de un
+ *              productor y un consumidor: el reproductor sigue el paso del frente
+ *              mientras el ejecutor planifica los siguientes.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kinematics.h"
+#include "motion_profile.h"
+
+// Variable de entorno con la ruta del trabajo (sin definir, no hay trabajo)
+#define JOB_FILE_ENV                "EV3_JOB"
+
+#define JOB_MAX_COMMANDS            64
+#define JOB_MAX_DEPTH               4       // bucles anidados
+#define JOB_MAX_ARGS                3
+#define JOB_COLORS                  8       // colores del sensor en COL-COLOR (0: ninguno)
+
+// Pasos planificados por adelantado (potencia de 2). Con 1 no hay solapamiento:
+// el siguiente paso se planifica cuando termina el anterior
+#ifndef JOB_QUEUE_SIZE
+#define JOB_QUEUE_SIZE              8
+#endif
+
+typedef enum job_opcode_enum {JOB_MOVE_JOINT, JOB_MOVE_CARTESIAN, JOB_GRIP, JOB_RELEASE, JOB_WAIT_COLOR,
+		JOB_READ_COLOR, JOB_MOVE_BIN, JOB_BIN, JOB_LOOP, JOB_END} job_opcode;
+
+typedef struct job_command {
+	job_opcode opcode;
+	int line;
+	int32_t args[JOB_MAX_ARGS];     // JOB_LOOP: veces (0: siempre); JOB_END: indice de su loop
+} job_command_t;
+
+// Las declaraciones bin no son ordenes: se guardan en la tabla de cajas
+typedef struct job {
+	int n_commands;
+	job_command_t commands[JOB_MAX_COMMANDS];
+	bool has_bin[JOB_COLORS];
+	int32_t bins[JOB_COLORS][2];    // rotacion y elevacion de la caja de cada color
+} job_t;
+
+// Posicion del ejecutor en el trabajo
+typedef struct job_cursor {
+	int next;
+	int depth;
+	int remaining[JOB_MAX_DEPTH];   // vueltas que faltan de cada bucle abierto (0: siempre)
+	unsigned long iterations;       // vueltas completadas del bucle exterior
+} job_cursor_t;
+
+// Paso listo para ejecutar: las ordenes de movimiento llevan su perfil planificado
+// desde el final del paso anterior
+typedef struct job_step {
+	job_opcode opcode;
+	bool deferred;                  // se planifica al empezar (move-bin y el movimiento siguiente)
+	int32_t color;                  // JOB_WAIT_COLOR
+	int32_t target[2];              // posiciones finales de la rotacion y la elevacion
+	kin_point_t from;               // JOB_MOVE_CARTESIAN: recta de la punta
+	kin_point_t to;
+	motion_profile_t profiles[2];   // move-joint: uno por eje; move-cartesian: recorrido (mm)
+	double duration;
+} job_step_t;
+
+// Cola de un productor y un consumidor. Los indices crecen sin limite y el hueco es
+// el resto modulo JOB_QUEUE_SIZE; head solo lo escribe el productor y tail el
+// consumidor (release/acquire), por lo que un paso reservado o en el frente es
+// propiedad exclusiva de quien lo usa.
+typedef struct job_queue {
+	atomic_uint head;
+	atomic_uint tail;
+	job_step_t steps[JOB_QUEUE_SIZE];
+} job_queue_t;
+
+/**
+ * @brief Lee y comprueba el trabajo del fichero indicado en JOB_FILE_ENV.
+ *
+ * @param line Si no es NULL, devuelve la linea del primer error de sintaxis (0 si el
+ *             error no es de una linea).
+ *
+ * @return 0 si tiene exito, ENOENT si no esta definido JOB_FILE_ENV, EINVAL si hay
+ *         una orden invalida, un bucle sin cerrar o vacio o demasiado anidado, una
+ *         caja repetida o un move-bin sin caja de color 0,
+ *         ENOSPC si hay mas de JOB_MAX_COMMANDS ordenes, ENODATA si no hay ninguna o
+ *         el codigo de error (errno).
+ */
+int job_load(job_t *job, int *line);
+
+/**
+ * @brief Deja el cursor al principio del trabajo.
+ */
+void job_cursor_init(job_cursor_t *cursor);
+
+/**
+ * @brief Siguiente orden ejecutable (ni loop ni end), resolviendo los bucles.
+ *
+ * @return La orden o NULL si el trabajo ha terminado.
+ */
+const job_command_t* job_next(const job_t *job, job_cursor_t *cursor);
+
+/**
+ * @brief Deja la cola vacia.
+ */
+void job_queue_init(job_queue_t *queue);
+
+/**
+ * @brief Productor: hueco libre para preparar el siguiente paso.
+ *
+ * @return El hueco o NULL si la cola esta llena.
+ */
+job_step_t* job_queue_reserve(job_queue_t *queue);
+
+/**
+ * @brief Productor: publica el paso preparado en el hueco reservado.
+ */
+void job_queue_push(job_queue_t *queue);
+
+/**
+ * @brief Consumidor: paso del frente, que sigue en la cola hasta job_queue_pop.
+ *
+ * @return El paso o NULL si la cola esta vacia.
+ */
+job_step_t* job_queue_front(job_queue_t *queue);
+
+/**
+ * @brief Consumidor: libera el paso del frente.
+ */
+void job_queue_pop(job_queue_t *queue);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * File: kinematics.c
+ *
+ * Descripcion: Implementacion de la cinematica del brazo, en punto fijo o con libm
+ *              segun KINEMATICS_FIXED_POINT.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "kinematics.h"
+
+#if KINEMATICS_FIXED_POINT
+
+#define KIN_DEGREES(degrees)        ((degrees) * KIN_ANGLE_STEPS)
+#define KIN_TABLE_DIVISOR           (KIN_ANGLE_STEPS / KIN_TABLE_STEPS)
+
+// Seno del primer cuadrante en Q16.16
+static kin_fixed_t kin_sin_table[KIN_TABLE_SIZE];
+
+/**
+ * @brief Division entera redondeada al mas cercano.
+ */
+static int64_t kin_div_round(int64_t a, int64_t b) {
+	if ((a < 0) != (b < 0)) {
+		return (a - b / 2) / b;
+	}
+	return (a + b / 2) / b;
+}
+
+/**
+ * @brief Producto Q16.16.
+ */
+static kin_fixed_t kin_mul(kin_fixed_t a, kin_fixed_t b) {
+	return (kin_fixed_t) (((int64_t) a * b) >> KIN_FRAC_BITS);
+}
+
+/**
+ * @brief Recorta un valor Q16.16 a [-1, 1] para el arcoseno.
+ */
+static kin_fixed_t kin_clamp_unit(int64_t value, int *clamped) {
+	if (value > KIN_ONE) {
+		*clamped = 1;
+		return KIN_ONE;
+	}
+	if (value < -KIN_ONE) {
+		*clamped = 1;
+		return -KIN_ONE;
+	}
+	return (kin_fixed_t) value;
+}
+
+void kinematics_init(void) {
+	for (int i = 0; i < KIN_TABLE_SIZE; i++) {
+		kin_sin_table[i] = (kin_fixed_t) lround(sin(i * M_PI / (180.0 * KIN_TABLE_STEPS)) * KIN_ONE);
+	}
+}
+
+/**
+ * @brief Seno en Q16.16 de un angulo cualquiera.
+ */
+static kin_fixed_t kin_sin(kin_angle_t angle) {
+	int32_t a = angle % KIN_DEGREES(360);
+	if (a < 0) {
+		a += KIN_DEGREES(360);
+	}
+	int sign = 1;
+	if (a >= KIN_DEGREES(180)) {
+		a -= KIN_DEGREES(180);
+		sign = -1;
+	}
+	if (a > KIN_DEGREES(90)) {
+		a = KIN_DEGREES(180) - a;
+	}
+
+	int index = a / KIN_TABLE_DIVISOR;
+	int frac = a % KIN_TABLE_DIVISOR;
+	kin_fixed_t value = kin_sin_table[index];
+	if (frac != 0) {
+		value += (kin_sin_table[index + 1] - value) * frac / KIN_TABLE_DIVISOR;
+	}
+	return sign * value;
+}
+
+/**
+ * @brief Coseno en Q16.16 de un angulo cualquiera.
+ */
+static kin_fixed_t kin_cos(kin_angle_t angle) {
+	return kin_sin(angle + KIN_DEGREES(90));
+}
+
+/**
+ * @brief Arcoseno en [-90, 90] grados de un valor Q16.16 en [-1, 1].
+ */
+static kin_angle_t kin_asin(kin_fixed_t value) {
+	int sign = (value < 0) ? -1 : 1;
+	kin_fixed_t v = abs(value);
+	if (v >= KIN_ONE) {
+		return sign * KIN_DEGREES(90);
+	}
+
+	// Ultima entrada de la tabla que no supera v
+	int low = 0, high = KIN_TABLE_SIZE - 1;
+	while (high - low > 1) {
+		int middle = (low + high) / 2;
+		if (kin_sin_table[middle] <= v) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	kin_fixed_t step = kin_sin_table[high] - kin_sin_table[low];
+	int32_t frac = (step > 0) ? (int32_t) kin_div_round((int64_t) (v - kin_sin_table[low]) * KIN_TABLE_DIVISOR, step) : 0;
+	return sign * (low * KIN_TABLE_DIVISOR + frac);
+}
+
+void kinematics_forward(const kinematics_t *kinematics, int32_t rotation_position,
+		int32_t elevation_position, kin_point_t *tip) {
+	kin_angle_t azimuth = (kin_angle_t) kin_div_round(
+			((int64_t) rotation_position << KIN_FRAC_BITS) * KIN_ANGLE_STEPS, kinematics->rotation_ratio);
+	kin_angle_t elevation = kinematics->elevation_home + (kin_angle_t) kin_div_round(
+			((int64_t) elevation_position << KIN_FRAC_BITS) * KIN_ANGLE_STEPS, kinematics->elevation_ratio);
+
+	kin_fixed_t radius = kin_mul(kinematics->length, kin_cos(elevation));
+	tip->x = kin_mul(radius, kin_cos(azimuth));
+	tip->y = kin_mul(radius, kin_sin(azimuth));
+	tip->z = kin_mul(kinematics->length, kin_sin(elevation));
+}
+
+int kinematics_inverse(const kinematics_t *kinematics, const kin_point_t *tip,
+		int32_t *rotation_position, int32_t *elevation_position) {
+	int clamped = 0;
+
+	kin_angle_t elevation = kin_asin(kin_clamp_unit(
+			((int64_t) tip->z << KIN_FRAC_BITS) / kinematics->length, &clamped));
+	kin_fixed_t radius = kin_mul(kinematics->length, kin_cos(elevation));
+	kin_angle_t azimuth = 0;
+	if (radius > 0) {
+		azimuth = kin_asin(kin_clamp_unit(((int64_t) tip->y << KIN_FRAC_BITS) / radius, &clamped));
+	}
+	if (tip->x < 0) {
+		azimuth = ((azimuth >= 0) ? KIN_DEGREES(180) : -KIN_DEGREES(180)) - azimuth;
+	}
+
+	*rotation_position = (int32_t) kin_div_round((int64_t) azimuth * kinematics->rotation_ratio,
+			(int64_t) KIN_ANGLE_STEPS << KIN_FRAC_BITS);
+	*elevation_position = (int32_t) kin_div_round(
+			(int64_t) (elevation - kinematics->elevation_home) * kinematics->elevation_ratio,
+			(int64_t) KIN_ANGLE_STEPS << KIN_FRAC_BITS);
+	return clamped ? ERANGE : 0;
+}
+
+void kinematics_interpolate(const kin_point_t *from, const kin_point_t *to, double fraction, kin_point_t *tip) {
+	tip->x = to->x;
+	tip->y = from->y + (kin_coord_t) lround((to->y - from->y) * fraction);
+	tip->z = from->z + (kin_coord_t) lround((to->z - from->z) * fraction);
+}
+
+#else
+
+#define KIN_RADIANS(degrees)        ((degrees) * M_PI / 180.0)
+#define KIN_DEGREES(radians)        ((radians) * 180.0 / M_PI)
+
+/**
+ * @brief Recorta un valor a [-1, 1] para el arcoseno.
+ */
+static double kin_clamp_unit(double value, int *clamped) {
+	if (value > 1.0) {
+		*clamped = 1;
+		return 1.0;
+	}
+	if (value < -1.0) {
+		*clamped = 1;
+		return -1.0;
+	}
+	return value;
+}
+
+void kinematics_init(void) {
+	// Sin tabla con libm
+}
+
+void kinematics_forward(const kinematics_t *kinematics, int32_t rotation_position,
+		int32_t elevation_position, kin_point_t *tip) {
+	double azimuth = KIN_RADIANS(rotation_position / kinematics->rotation_ratio);
+	double elevation = KIN_RADIANS(kinematics->elevation_home + elevation_position / kinematics->elevation_ratio);
+
+	double radius = kinematics->length * cos(elevation);
+	tip->x = radius * cos(azimuth);
+	tip->y = radius * sin(azimuth);
+	tip->z = kinematics->length * sin(elevation);
+}
+
+int kinematics_inverse(const kinematics_t *kinematics, const kin_point_t *tip,
+		int32_t *rotation_position, int32_t *elevation_position) {
+	int clamped = 0;
+
+	double elevation = asin(kin_clamp_unit(tip->z / kinematics->length, &clamped));
+	double radius = kinematics->length * cos(elevation);
+	double azimuth = 0.0;
+	if (radius > 0.0) {
+		azimuth = asin(kin_clamp_unit(tip->y / radius, &clamped));
+	}
+	if (tip->x < 0.0) {
+		azimuth = ((azimuth >= 0.0) ? M_PI : -M_PI) - azimuth;
+	}
+
+	*rotation_position = (int32_t) lround(KIN_DEGREES(azimuth) * kinematics->rotation_ratio);
+	*elevation_position = (int32_t) lround((KIN_DEGREES(elevation) - kinematics->elevation_home) *
+			kinematics->elevation_ratio);
+	return clamped ? ERANGE : 0;
+}
+
+void kinematics_interpolate(const kin_point_t *from, const kin_point_t *to, double fraction, kin_point_t *tip) {
+	tip->x = to->x;
+	tip->y = from->y + (to->y - from->y) * fraction;
+	tip->z = from->z + (to->z - from->z) * fraction;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * File: kinematics.h
+ *
+ * Descripcion: Cinematica del brazo para el jog cartesiano. El brazo tiene dos
+ *              articulaciones: la rotacion de la base (azimut) y la elevacion del
+ *              brazo, por lo que la punta de la garra se mueve sobre una esfera de
+ *              radio la longitud del brazo:
+ *                  x = L cos(el) cos(az), y = L cos(el) sin(az), z = L sin(el)
+ *              Con dos grados de libertad la cinematica inversa resuelve (y, z) y x
+ *              queda determinada (el signo de x elige la solucion delante o detras
+ *              de la base).
+ *
+ *              Hay dos implementaciones, elegidas con KINEMATICS_FIXED_POINT:
+ *              - Punto fijo (1): todo el calculo es entero, longitudes y senos en
+ *                Q16.16, angulos en 1/16 de grado y una tabla del seno en el primer
+ *                cuadrante (interpolada linealmente) construida al arrancar. El
+ *                arcoseno se obtiene por busqueda binaria en la misma tabla.
+ *              - Coma flotante (0): libm en double.
+ *              Por defecto se usa el punto fijo en los procesadores sin FPU
+ *              (__SOFTFP__, como el ARM926 del EV3, donde libm se emula) y libm en
+ *              el resto. bench/kinematics_bench.c compara las dos en el brick.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <stdint.h>
+
+#ifndef KINEMATICS_FIXED_POINT
+#ifdef __SOFTFP__
+#define KINEMATICS_FIXED_POINT      1
+#else
+#define KINEMATICS_FIXED_POINT      0
+#endif
+#endif
+
+// Geometria del brazo (estimada, sin medir)
+#define ARM_LENGTH                  180     // units: mm, de la elevacion a la punta
+#define ARM_ROTATION_RATIO          3       // grados de motor por grado de azimut
+#define ARM_ELEVATION_RATIO         -5      // grados de motor por grado de elevacion
+#define ARM_ELEVATION_HOME          0       // units: deg, elevacion en la posicion 0
+
+#if KINEMATICS_FIXED_POINT
+
+// Punto fijo Q16.16
+#define KIN_FRAC_BITS               16
+#define KIN_ONE                     (1 << KIN_FRAC_BITS)
+
+// Angulos en 1/KIN_ANGLE_STEPS grados y tabla del seno cada 1/KIN_TABLE_STEPS grados
+#define KIN_ANGLE_STEPS             16
+#define KIN_TABLE_STEPS             4
+#define KIN_TABLE_SIZE              (90 * KIN_TABLE_STEPS + 1)
+
+typedef int32_t kin_fixed_t;        // Q16.16
+typedef int32_t kin_angle_t;        // 1/KIN_ANGLE_STEPS grados
+typedef kin_fixed_t kin_coord_t;    // units: mm (Q16.16)
+
+// Conversion entre mm y coordenadas (MM a coordenadas redondea hacia cero)
+#define KIN_FROM_MM(mm)             ((kin_coord_t) ((mm) * KIN_ONE))
+#define KIN_TO_MM(coord)            ((double) (coord) / KIN_ONE)
+
+// Inicializador de kinematics_t con mm, grados y relaciones enteras
+#define KINEMATICS_INIT(length, rotation_ratio, elevation_ratio, elevation_home) \
+	{ (length) * KIN_ONE, (rotation_ratio) * KIN_ONE, (elevation_ratio) * KIN_ONE, \
+	  (elevation_home) * KIN_ANGLE_STEPS }
+
+// Geometria del brazo y reduccion entre motor y articulacion
+typedef struct kinematics {
+	kin_fixed_t length;             // units: mm (Q16.16), de la elevacion a la punta
+	kin_fixed_t rotation_ratio;     // grados de motor por grado de azimut (Q16.16)
+	kin_fixed_t elevation_ratio;    // grados de motor por grado de elevacion (Q16.16)
+	kin_angle_t elevation_home;     // elevacion con el motor en la posicion 0
+} kinematics_t;
+
+#else
+
+typedef double kin_coord_t;         // units: mm
+
+#define KIN_FROM_MM(mm)             ((kin_coord_t) (mm))
+#define KIN_TO_MM(coord)            ((double) (coord))
+
+#define KINEMATICS_INIT(length, rotation_ratio, elevation_ratio, elevation_home) \
+	{ (length), (rotation_ratio), (elevation_ratio), (elevation_home) }
+
+typedef struct kinematics {
+	double length;                  // units: mm, de la elevacion a la punta
+	double rotation_ratio;          // grados de motor por grado de azimut
+	double elevation_ratio;         // grados de motor por grado de elevacion
+	double elevation_home;          // units: deg, elevacion con el motor en la posicion 0
+} kinematics_t;
+
+#endif
+
+// Posicion de la punta respecto al eje de la base a la altura de la elevacion
+typedef struct kin_point {
+	kin_coord_t x;
+	kin_coord_t y;
+	kin_coord_t z;
+} kin_point_t;
+
+/**
+ * @brief Construye la tabla del seno del punto fijo (sin efecto con libm). Debe
+ *        llamarse antes de usar el resto de funciones.
+ */
+void kinematics_init(void);
+
+/**
+ * @brief Cinematica directa: posicion de la punta con los motores en las posiciones
+ *        indicadas.
+ */
+void kinematics_forward(const kinematics_t *kinematics, int32_t rotation_position,
+		int32_t elevation_position, kin_point_t *tip);
+
+/**
+ * @brief Cinematica inversa: posiciones de los motores que llevan la punta a (y, z).
+ *        La solucion es la del lado de la base indicado por el signo de tip->x. Si
+ *        el punto esta fuera de la esfera se usa el mas cercano alcanzable.
+ *
+ * @return 0 si el punto es alcanzable o ERANGE si se ha recortado.
+ */
+int kinematics_inverse(const kinematics_t *kinematics, const kin_point_t *tip,
+		int32_t *rotation_position, int32_t *elevation_position);
+
+/**
+ * @brief Punto de la recta de from a to en la fraccion indicada (0: from, 1: to).
+ *        x es la de to, que solo indica el lado de la base.
+ */
+void kinematics_interpolate(const kin_point_t *from, const kin_point_t *to, double fraction, kin_point_t *tip);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * File: lcd.c
+ *
+ * Descripcion: Implementacion del dibujo retenido sobre el framebuffer del LCD.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "lcd.h"
+
+// Colores xrgb8888
+#define XRGB_BLACK                  0x00000000u
+#define XRGB_WHITE                  0x00ffffffu
+
+// Valor inicial del framebuffer sombra: no coincide con ninguna fila valida, por lo
+// que el primer volcado escribe la pantalla completa
+#define SHADOW_UNKNOWN              0x5a
+
+// Fuente 5x7 por columnas (bit 0 arriba) para los caracteres ' ' a 'Z'
+#define FONT_FIRST                  ' '
+#define FONT_LAST                   'Z'
+static const uint8_t FONT[FONT_LAST - FONT_FIRST + 1][5] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+	{0x14, 0x7f, 0x14, 0x7f, 0x14}, {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+	{0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1c, 0x22, 0x41, 0x00},
+	{0x00, 0x41, 0x22, 0x1c, 0x00}, {0x08, 0x2a, 0x1c, 0x2a, 0x08}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+	{0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+	{0x20, 0x10, 0x08, 0x04, 0x02}, {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+	{0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31}, {0x18, 0x14, 0x12, 0x7f, 0x10},
+	{0x27, 0x45, 0x45, 0x45, 0x39}, {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+	{0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e}, {0x00, 0x36, 0x36, 0x00, 0x00},
+	{0x00, 0x56, 0x36, 0x00, 0x00}, {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14},
+	{0x41, 0x22, 0x14, 0x08, 0x00}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3e},
+	{0x7e, 0x11, 0x11, 0x11, 0x7e}, {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+	{0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41}, {0x7f, 0x09, 0x09, 0x01, 0x01},
+	{0x3e, 0x41, 0x41, 0x51, 0x32}, {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+	{0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41}, {0x7f, 0x40, 0x40, 0x40, 0x40},
+	{0x7f, 0x02, 0x04, 0x02, 0x7f}, {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+	{0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e}, {0x7f, 0x09, 0x19, 0x29, 0x46},
+	{0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+	{0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x7f, 0x20, 0x18, 0x20, 0x7f}, {0x63, 0x14, 0x08, 0x14, 0x63},
+	{0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43},
+};
+
+/**
+ * @brief Columnas del glifo de un caracter (minusculas como mayusculas; los que no
+ *        estan en la fuente como espacio).
+ */
+static const uint8_t* lcd_glyph(char c) {
+	c = toupper((unsigned char) c);
+	if (c < FONT_FIRST || c > FONT_LAST) {
+		c = ' ';
+	}
+	return FONT[c - FONT_FIRST];
+}
+
+/**
+ * @brief Escribe un pixel del lienzo marcando la fila solo si cambia.
+ */
+static inline void lcd_set_pixel(lcd_t *lcd, int x, int y, uint8_t value) {
+	if (x < 0 || y < 0 || x >= EV3_X_LCD || y >= EV3_Y_LCD) {
+		return;
+	}
+	if (lcd->canvas[y][x] != value) {
+		lcd->canvas[y][x] = value;
+		lcd->dirty[y] = true;
+	}
+}
+
+int lcd_open(lcd_t *lcd) {
+	struct fb_var_screeninfo var_info;
+	struct fb_fix_screeninfo fix_info;
+
+	memset(lcd, 0, sizeof(*lcd));
+	lcd->fd = -1;
+	const char *device = getenv(LCD_FB_ENV);
+	int fd = open((device != NULL) ? device : LCD_FB_DEFAULT, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		return errno;
+	}
+
+	if (ioctl(fd, FBIOGET_VSCREENINFO, &var_info) < 0 ||
+			ioctl(fd, FBIOGET_FSCREENINFO, &fix_info) < 0) {
+		int error = errno;
+		close(fd);
+		return error;
+	}
+	if (var_info.xres < EV3_X_LCD || var_info.yres < EV3_Y_LCD) {
+		close(fd);
+		return ENOTSUP;
+	}
+	return lcd_open_fd(lcd, fd, var_info.bits_per_pixel, fix_info.line_length);
+}
+
+int lcd_open_fd(lcd_t *lcd, int fd, int bits_per_pixel, int line_length) {
+	memset(lcd, 0, sizeof(*lcd));
+	lcd->fd = fd;
+	lcd->bits_per_pixel = bits_per_pixel;
+	lcd->line_length = line_length;
+	if (bits_per_pixel != 1 && bits_per_pixel != 32) {
+		lcd_close(lcd);
+		return ENOTSUP;
+	}
+	if (line_length < (EV3_X_LCD * bits_per_pixel + 7) / 8) {
+		lcd_close(lcd);
+		return EINVAL;
+	}
+
+	lcd->shadow = malloc((size_t) lcd->line_length * EV3_Y_LCD);
+	lcd->row = malloc(lcd->line_length);
+	if (lcd->shadow == NULL || lcd->row == NULL) {
+		lcd_close(lcd);
+		return ENOMEM;
+	}
+	memset(lcd->shadow, SHADOW_UNKNOWN, (size_t) lcd->line_length * EV3_Y_LCD);
+	for (int y = 0; y < EV3_Y_LCD; y++) {
+		lcd->dirty[y] = true;
+	}
+	return 0;
+}
+
+void lcd_close(lcd_t *lcd) {
+	if (lcd->fd >= 0) {
+		close(lcd->fd);
+		lcd->fd = -1;
+	}
+	free(lcd->shadow);
+	free(lcd->row);
+	lcd->shadow = NULL;
+	lcd->row = NULL;
+}
+
+void lcd_clear(lcd_t *lcd) {
+	for (int y = 0; y < EV3_Y_LCD; y++) {
+		for (int x = 0; x < EV3_X_LCD; x++) {
+			lcd_set_pixel(lcd, x, y, 0);
+		}
+	}
+}
+
+void lcd_draw_sprite(lcd_t *lcd, int x, int y, const lcd_sprite_t *sprite) {
+	for (int j = 0; j < sprite->height; j++) {
+		for (int i = 0; i < sprite->width; i++) {
+			lcd_set_pixel(lcd, x + i, y + j, sprite->pixels[j * sprite->width + i]);
+		}
+	}
+}
+
+void lcd_draw_text(lcd_t *lcd, int x, int y, const char *text) {
+	for (; *text != '\0'; text++, x += LCD_CHAR_WIDTH) {
+		const uint8_t *glyph = lcd_glyph(*text);
+		for (int i = 0; i < LCD_CHAR_WIDTH; i++) {
+			uint8_t column = (i < 5) ? glyph[i] : 0;
+			for (int j = 0; j < LCD_CHAR_HEIGHT; j++) {
+				lcd_set_pixel(lcd, x + i, y + j, (column >> j) & 1);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Convierte una fila del lienzo al formato del dispositivo.
+ */
+static void lcd_convert_row(lcd_t *lcd, int y) {
+	memset(lcd->row, 0, lcd->line_length);
+	if (lcd->bits_per_pixel == 1) {
+		// Monocromo, 1 = negro, pixel de la izquierda en el bit menos significativo
+		for (int x = 0; x < EV3_X_LCD; x++) {
+			if (lcd->canvas[y][x]) {
+				lcd->row[x / 8] |= 1 << (x % 8);
+			}
+		}
+	} else {
+		uint32_t *pixels = (uint32_t *) lcd->row;
+		for (int x = 0; x < EV3_X_LCD; x++) {
+			pixels[x] = lcd->canvas[y][x] ? XRGB_BLACK : XRGB_WHITE;
+		}
+	}
+}
+
+void lcd_flush(lcd_t *lcd) {
+	if (lcd->fd < 0) {
+		return;
+	}
+	lcd->flushes++;
+	for (int y = 0; y < EV3_Y_LCD; y++) {
+		if (!lcd->dirty[y]) {
+			continue;
+		}
+		lcd->dirty[y] = false;
+		lcd_convert_row(lcd, y);
+
+		// Tramo de la fila que difiere del contenido del dispositivo
+		uint8_t *shadow = lcd->shadow + (size_t) y * lcd->line_length;
+		int first = 0;
+		int last = lcd->line_length - 1;
+		while (first <= last && lcd->row[first] == shadow[first]) {
+			first++;
+		}
+		if (first > last) {
+			continue;
+		}
+		while (lcd->row[last] == shadow[last]) {
+			last--;
+		}
+
+		size_t size = last - first + 1;
+		off_t offset = (off_t) y * lcd->line_length + first;
+		if (pwrite(lcd->fd, lcd->row + first, size, offset) == (ssize_t) size) {
+			memcpy(shadow + first, lcd->row + first, size);
+			lcd->writes++;
+			lcd->bytes += size;
+		} else {
+			// Se reintenta en el siguiente volcado
+			lcd->dirty[y] = true;
+		}
+	}
+}
+
+/**
+ * @brief Reserva un sprite en blanco.
+ */
+static int lcd_sprite_alloc(lcd_sprite_t *sprite, int width, int height) {
+	sprite->width = width;
+	sprite->height = height;
+	sprite->pixels = calloc((size_t) width * height, 1);
+	return (sprite->pixels == NULL) ? ENOMEM : 0;
+}
+
+int lcd_sprite_text(lcd_sprite_t *sprite, const char *text) {
+	int length = strlen(text);
+	int error = lcd_sprite_alloc(sprite, length * LCD_CHAR_WIDTH, LCD_CHAR_HEIGHT);
+	if (error != 0) {
+		return error;
+	}
+	for (int c = 0; c < length; c++) {
+		const uint8_t *glyph = lcd_glyph(text[c]);
+		for (int i = 0; i < 5; i++) {
+			for (int j = 0; j < LCD_CHAR_HEIGHT; j++) {
+				sprite->pixels[j * sprite->width + c * LCD_CHAR_WIDTH + i] = (glyph[i] >> j) & 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int lcd_sprite_circle(lcd_sprite_t *sprite, int r, bool filled) {
+	int error = lcd_sprite_alloc(sprite, 2 * r + 1, 2 * r + 1);
+	if (error != 0) {
+		return error;
+	}
+	// Pixeles dentro del disco de radio r; la circunferencia excluye el disco r - 1
+	for (int j = -r; j <= r; j++) {
+		for (int i = -r; i <= r; i++) {
+			int d2 = i * i + j * j;
+			bool inside = d2 <= r * r + r;
+			bool inner = d2 <= (r - 1) * (r - 1) + (r - 1);
+			sprite->pixels[(j + r) * sprite->width + (i + r)] = inside && (filled || !inner);
+		}
+	}
+	return 0;
+}
+
+void lcd_sprite_free(lcd_sprite_t *sprite) {
+	free(sprite->pixels);
+	sprite->pixels = NULL;
+}
+
+void lcd_print_stats(const lcd_t *lcd) {
+	printf("LCD: %lu flushes, %lu writes, %lu bytes (%.1f bytes/flush)\n", lcd->flushes,
+			lcd->writes, lcd->bytes, (lcd->flushes > 0) ? (double) lcd->bytes / lcd->flushes : 0.0);
+}
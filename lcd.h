@@ -0,0 +1,121 @@
+/*
+ * File: lcd.h
+ *
+ * Descripcion: Capa de dibujo retenido sobre el framebuffer del LCD. Se dibuja en
+ *              un lienzo en memoria y lcd_flush solo escribe en el dispositivo los
+ *              bytes de las filas que han cambiado respecto al ultimo volcado
+ *              (framebuffer sombra). Los elementos fijos se renderizan una vez como
+ *              sprites, de modo que redibujarlos sin cambios no escribe nada.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef LCD_H
+#define LCD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ev3c.h"
+
+// Dispositivo framebuffer. La variable de entorno permite usar otro.
+#define LCD_FB_DEFAULT              "/dev/fb0"
+#define LCD_FB_ENV                  "EV3_FB"
+
+// Fuente 5x7 con un pixel de separacion
+#define LCD_CHAR_WIDTH              6
+#define LCD_CHAR_HEIGHT             8
+
+// Imagen pre-renderizada (un byte por pixel, 1 = negro)
+typedef struct lcd_sprite {
+	int width;
+	int height;
+	uint8_t *pixels;
+} lcd_sprite_t;
+
+typedef struct lcd {
+	int fd;                                 // -1 si no hay framebuffer
+	int bits_per_pixel;                     // 1 (monocromo) o 32 (xrgb8888)
+	int line_length;                        // bytes por fila en el dispositivo
+	uint8_t canvas[EV3_Y_LCD][EV3_X_LCD];   // escena actual (1 = negro)
+	bool dirty[EV3_Y_LCD];                  // filas modificadas desde el ultimo volcado
+	uint8_t *shadow;                        // contenido actual del dispositivo
+	uint8_t *row;                           // fila convertida al formato del dispositivo
+	unsigned long flushes;
+	unsigned long writes;
+	unsigned long bytes;
+} lcd_t;
+
+/**
+ * @brief Abre el framebuffer. El primer volcado escribe la pantalla completa.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno). ENOTSUP si el formato
+ *         de pixel no esta soportado.
+ */
+int lcd_open(lcd_t *lcd);
+
+/**
+ * @brief Usa como framebuffer un descriptor ya abierto con el formato indicado (lo
+ *        usa lcd_open y permite probar los volcados sobre un fichero). lcd_close
+ *        cierra el descriptor, tambien si hay un error.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno). ENOTSUP si el formato
+ *         de pixel no esta soportado y EINVAL si la fila no cabe en line_length.
+ */
+int lcd_open_fd(lcd_t *lcd, int fd, int bits_per_pixel, int line_length);
+
+/**
+ * @brief Cierra el framebuffer y libera el framebuffer sombra.
+ */
+void lcd_close(lcd_t *lcd);
+
+/**
+ * @brief Borra el lienzo.
+ */
+void lcd_clear(lcd_t *lcd);
+
+/**
+ * @brief Copia un sprite al lienzo. Solo marca las filas que cambian.
+ */
+void lcd_draw_sprite(lcd_t *lcd, int x, int y, const lcd_sprite_t *sprite);
+
+/**
+ * @brief Dibuja un texto (fuente 5x7) en el lienzo sobre fondo blanco. Solo marca
+ *        las filas que cambian.
+ */
+void lcd_draw_text(lcd_t *lcd, int x, int y, const char *text);
+
+/**
+ * @brief Escribe en el dispositivo los tramos de las filas modificadas que
+ *        difieren del framebuffer sombra.
+ */
+void lcd_flush(lcd_t *lcd);
+
+/**
+ * @brief Renderiza un texto como sprite.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int lcd_sprite_text(lcd_sprite_t *sprite, const char *text);
+
+/**
+ * @brief Renderiza una circunferencia (filled = false) o un circulo de radio r
+ *        como sprite de lado 2r + 1.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int lcd_sprite_circle(lcd_sprite_t *sprite, int r, bool filled);
+
+/**
+ * @brief Libera un sprite.
+ */
+void lcd_sprite_free(lcd_sprite_t *sprite);
+
+/**
+ * @brief Imprime el numero de volcados, escrituras y bytes escritos.
+ */
+void lcd_print_stats(const lcd_t *lcd);
+
+#endif
@@ -9,15 +9,32 @@
  * Date: dec-23
  */
 
+#include <errno.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include <error_checks.h>
 #include <timespec_operations.h>
 
 #include "ev3c.h"
+#include "sysfs_io.h"
+#include "periodic.h"
+#include "executive.h"
+#include "buttons_input.h"
+#include "lcd.h"
+#include "timebase.h"
+#include "calibration.h"
+#include "motion_profile.h"
+#include "kinematics.h"
+#include "program.h"
+#include "pid.h"
+#include "gravity.h"
+#include "job.h"
 
 // Puertos de motores
 #define LARGE_ROTATION_MOTOR_PORT   'C'
@@ -32,17 +49,18 @@
 #define FULL_SPEED_LARGE_MOTOR      900     // units: deg/seg
 #define FULL_SPEED_MEDIUM_MOTOR     1200    // units: deg/seg
 
-// Tiempo para mandar comandos a los motores y comprobar su estado
+// Tiempo para mandar comandos a los motores y espera maxima de fin de movimiento
 #define SUSPENSION_TIME             2000    // units: usecs
-#define CHECK_STATE_TIME            1000    // units: nsecs
+#define MOTION_TIMEOUT              5000    // units: msecs
 
 // Numero de botones (ev3 brick)
 #define BUTTONS                     6
 
 // Run-Direct Potencia
 #define ROTATION_POWER              30
-#define ELEVATION_UP_POWER         -30
+#define ELEVATION_UP_POWER         -30     // sin tabla de gravedad
 #define ELEVATION_DOWN_POWER        20
+#define ELEVATION_SPEED             20      // units: % de FULL_SPEED_LARGE_MOTOR, con tabla
 #define CLAW_POWER                  40
 
 // Unidades de movimiento de los motores para alcanzzar posicion inicial
@@ -50,6 +68,23 @@
 #define ELEVATION_INIT_UNITS        100
 #define CLAW_INIT_UNITS             90
 
+// Homing en dos fases: aproximacion rapida, retroceso y reaproximacion lenta
+#define ROTATION_FAST_POWER         85
+#define ROTATION_SLOW_POWER         20
+#define ELEVATION_FAST_UP_POWER    -85
+#define ELEVATION_SLOW_UP_POWER    -20
+#define CLAW_FAST_POWER             60
+#define CLAW_SLOW_POWER             25
+#define ROTATION_BACK_OFF_UNITS     -15
+#define ELEVATION_BACK_OFF_UNITS    15
+#define CLAW_BACK_OFF_UNITS         25
+#define HOMING_MOVE_POWER           90
+#define HOMING_BACK_OFF_POWER       40
+#define HOMING_BRAKE_UNITS          30
+#define HOMING_SETTLED_UNITS        1       // por HOMING_FAST_PERIOD
+#define HOMING_FAST_PERIOD          10000000 // units: nsecs
+#define HOMING_SLOW_PERIOD          5000000  // units: nsecs
+
 // Touch Sensor
 #define TOUCH_SENSOR_ACTIVE         1
 #define TOUCH_SENSOR_INACTIVE       0
@@ -57,11 +92,80 @@
 // Valor limite de reflejo - Color sensor
 #define REFLECTION_LIMIT            30
 
+// Lectura del color de una pieza: tras un cambio de modo el sensor da valores del
+// modo anterior durante COLOR_MODE_SETTLE. Solo se pasa a COL_COLOR con la elevacion
+// parada en su consigna (a menos de COLOR_STILL_UNITS)
+#define COLOR_MODE_SETTLE           50000000 // units: nsecs
+#define COLOR_STILL_UNITS           2        // units: deg
+
+// Barrido de la elevacion tras la inicializacion para la tabla de gravedad: se
+// descartan las muestras del arranque de cada tramo y se frena antes del destino. La
+// tabla deja fuera ELEVATION_SWEEP_MARGIN en cada extremo, donde el eje arranca y frena
+#define ELEVATION_SWEEP_POWER       40
+#define ELEVATION_SWEEP_SETTLE      100     // units: msecs
+#define ELEVATION_SWEEP_BRAKE_UNITS 15
+#define ELEVATION_SWEEP_MARGIN      40
+
+// Con el eje parado, realimentacion por debajo de la cual no se compensa el rozamiento
+#define AXIS_FRICTION_DEADBAND      2.0     // units: %
+
 // Velocidad usando comandos de movimiento relativo y absoluto
 #define STEP_ROTATION_SPEED         40
 #define STEP_ELEVATION_SPEED        20
 #define STEP_CLAW_SPEED             40
 
+// Perfiles de movimiento de rotacion y elevacion (jog y correcciones)
+#define PROFILE_ROTATION_SPEED      70      // units: % de FULL_SPEED_LARGE_MOTOR
+#define PROFILE_ELEVATION_SPEED     50      // units: % de FULL_SPEED_LARGE_MOTOR
+#define PROFILE_CLAW_SPEED          50      // units: % de FULL_SPEED_MEDIUM_MOTOR
+#define PROFILE_ACCEL               3000    // units: deg/seg^2
+#define PROFILE_JERK                20000   // units: deg/seg^3
+#define PROFILE_KP                  1.0     // units: % de potencia por grado de error
+#define PROFILE_TOLERANCE           2       // units: deg
+#ifdef TRAPEZOIDAL_PROFILE
+#define PROFILE_TYPE                MOTION_TRAPEZOIDAL
+#else
+#define PROFILE_TYPE                MOTION_SCURVE
+#endif
+
+// Jog cartesiano (EV3_JOG_MODE=cartesian): los botones mueven la punta de la garra
+// en linea recta (izquierda/derecha en y, arriba/abajo en z)
+#define JOG_MODE_ENV                "EV3_JOG_MODE"
+#define JOG_MODE_CARTESIAN          "cartesian"
+#define CARTESIAN_SPEED             150     // units: mm/seg
+
+// Teach-and-repeat (EV3_PROGRAM_MODE): se graba un punto al soltar los botones con el
+// brazo quieto (variacion por periodo como mucho PROGRAM_STILL_UNITS) o al cambiar la
+// garra, salvo que repita el anterior (PROGRAM_DUPLICATE_UNITS)
+#define PROGRAM_STILL_UNITS         1
+#define PROGRAM_DUPLICATE_UNITS     2
+
+// Trabajos de pick-and-place: limites de la punta en las rectas de move-cartesian
+// (la velocidad es CARTESIAN_SPEED)
+#define JOB_CARTESIAN_ACCEL         600     // units: mm/seg^2
+#define JOB_CARTESIAN_JERK          6000    // units: mm/seg^3
+
+// Pasos de color (wait-color, read-color): sin el color pedido en JOB_COLOR_TIMEOUT
+// se aborta el trabajo
+#define JOB_COLOR_TIMEOUT           10000   // units: msecs
+
+// Bucle de posicion en espacio de usuario (EV3_SERVO_PERIOD, en ms): PID sobre
+// run-direct para las correcciones, la apertura de la garra y el aparcado, sin cambiar
+// de comando del driver. EV3_SERVO_LOG guarda el error de seguimiento de cada periodo.
+#define SERVO_PERIOD_ENV            "EV3_SERVO_PERIOD"
+#define SERVO_LOG_ENV               "EV3_SERVO_LOG"
+#define SERVO_MIN_PERIOD            5       // units: msecs
+#define SERVO_MAX_PERIOD            10      // units: msecs
+#define SERVO_KP                    5.0     // units: % de potencia por grado de error
+#define SERVO_KI                    50.0    // units: % por grado y segundo
+#define SERVO_KD                    0.01    // units: % por grado/seg
+#define SERVO_MAX_DUTY              100.0   // units: %
+
+// Movimientos coordinados (espacio articular): ejes y periodo de las consignas
+#define JOINT_MAX_AXES              3
+#define JOINT_MOVE_PERIOD           10000000 // units: nsecs
+#define JOINT_MOVE_KP               3.0     // units: % de potencia por grado de error
+
 // Estado de motor sobrecargado (RUNNING + STALLED)
 #define MOTOR_LIMIT                 9
 
@@ -69,8 +173,28 @@
 #define TOP_BOTTOM_POS              200
 #define TOP_LEFT_POS                -400
 
-// Tiempo de espera para cortar la potencia a la garra en el cierre
+// Limites blandos: el jog y las consignas externas frenan a tiempo para detenerse en
+// ellos, SOFT_LIMIT_MARGIN antes de los limites anteriores y de los sensores (a las
+// unidades de inicializacion del origen del homing)
+#define SOFT_LIMIT_MARGIN           10
+#define SOFT_LIMIT_LAG              40      // units: msecs, respuesta del motor a un cambio de potencia
+#define SOFT_LIMIT_MIN_SPEED        50      // units: deg/seg, minima para estimar la ganancia
+#define SOFT_LIMIT_MAX_GAIN         1.5
+#define ROTATION_SOFT_MIN           (TOP_LEFT_POS + SOFT_LIMIT_MARGIN)
+#define ROTATION_SOFT_MAX           (-ROTATION_INIT_UNITS - SOFT_LIMIT_MARGIN)
+#define ELEVATION_SOFT_MIN          (-ELEVATION_INIT_UNITS + SOFT_LIMIT_MARGIN)
+#define ELEVATION_SOFT_MAX          (TOP_BOTTOM_POS - SOFT_LIMIT_MARGIN)
+
+// Aparcado al terminar: los tres ejes con un movimiento coordinado
+#define PARK_MOTORS                 3
+
+// Cierre de la garra: se corta la potencia al detectar el contacto (velocidad del
+// encoder por debajo de CLAW_CONTACT_SPEED tras haberla superado, o motor
+// bloqueado) o, como mucho, a los CLAW_CLOSE_TIME
 #define CLAW_CLOSE_TIME             500000 // usec
+#define CLAW_GRIP_PERIOD            5000000 // units: nsecs
+#define CLAW_GRIP_WINDOW            4       // muestras para estimar la velocidad
+#define CLAW_CONTACT_SPEED          100     // units: deg/seg
 
 // LCD
 #define X_TITLE                     20
@@ -85,11 +209,23 @@
 
 // Periodos (nsec)
 #define BUTTON_PERIOD               180000000
-#define COLOR_PERIOD                200000000
-#define TOUCH_PERIOD                200000000
+#define COLOR_PERIOD                20000000 // minimo, ver SENSOR_*
+#define TOUCH_PERIOD                20000000 // minimo, ver SENSOR_*
 #define MOTOR_PERIOD                90000000 // Rotation, elevation & claw
 #define LED_PERIOD                  40000000
 #define REPORTER_PERIOD             500000000
+#define JOB_EXECUTOR_PERIOD         180000000
+
+// Muestreo adaptativo de los sensores de limite (nsec): cada lectura programa la
+// siguiente segun el movimiento de su eje: SENSOR_IDLE_PERIOD parado,
+// SENSOR_MOVING_PERIOD alejandose y, acercandose al limite, la fraccion
+// SENSOR_APPROACH_FRACTION del tiempo que tardaria en llegar acelerando al maximo
+// (como minimo COLOR_PERIOD / TOUCH_PERIOD). El eje despierta a la tarea al
+// arrancar o cambiar de sentido. Con FIXED_SENSOR_PERIOD se lee siempre con
+// SENSOR_MOVING_PERIOD
+#define SENSOR_IDLE_PERIOD          1000000000
+#define SENSOR_MOVING_PERIOD        200000000
+#define SENSOR_APPROACH_FRACTION    0.5
 
 // Stop modes
 typedef enum stop_mode_enum {COAST, BRAKE, HOLD} stop_mode;
@@ -100,12 +236,24 @@ typedef enum commands_enum {RUN_FOREVER, RUN_ABS_POS, RUN_REL_POS, RUN_TIMED, RU
 static char *COMMANDS_STRING[] = {"run-forever", "run-to-abs-pos", "run-to-rel-pos", "run-timed", "run-direct",
                                   "stop", "reset"};
 
+// Fases del homing
+typedef enum homing_phase_enum {HOMING_FAST, HOMING_BACK_OFF, HOMING_SLOW, HOMING_HOME, HOMING_PHASES} homing_phase;
+static char *HOMING_PHASE_STRING[] = {"fast", "back-off", "slow", "home"};
+
 // Rotation actions
 typedef enum {ROTATE_RIGHT, ROTATE_LEFT, ROTATE_STOP} actions_rotation;
 
 // Elevation actions
 typedef enum actions_elevation_enum{RISE, LOWER, ELEVATE_STOP} actions_elevation;
 
+// Estados de los controladores de rotacion y elevacion. Cada activacion avanza
+// como mucho un paso, de modo que una correccion nunca bloquea la tarea.
+typedef enum axis_state_enum {AXIS_IDLE, AXIS_JOGGING, AXIS_CORRECTING, AXIS_SETTLING} axis_state;
+
+// Estados de la reproduccion de un programa: planificar el tramo hasta el siguiente
+// cambio de la garra, seguirlo y esperar a la garra
+typedef enum playback_state_enum {PLAYBACK_PLAN, PLAYBACK_MOVING, PLAYBACK_CLAW} playback_state;
+
 // Claw actions
 typedef enum actions_claw_enum {ACTIVE, INACTIVE} actions_claw;
 
@@ -115,62 +263,383 @@ typedef enum color_command_enum
     COL_REFLECT, COL_AMBIENT, COL_COLOR
 } color_command;
 
-// Nuevas instrucciones para los motores
+// Nuevas instrucciones para los motores. Se publican con un seqlock: la secuencia
+// es impar mientras la botonera escribe y los lectores reintentan si cambia.
 struct new_motors_status {
-	pthread_mutex_t mutex;
+	atomic_uint sequence;
+	atomic_int rotation;
+	atomic_int elevation;
+	atomic_int claw;
+	atomic_uint claw_presses;       // pulsaciones acumuladas del boton central
+} new_motors_status;
+
+// Copia consistente de new_motors_status
+typedef struct motors_status_snapshot {
 	actions_rotation rotation;
 	actions_elevation elevation;
 	actions_claw claw;
-} new_motors_status;
+	unsigned int claw_presses;
+	unsigned int sequence;
+} motors_status_snapshot_t;
+
+// Resultado del homing de un eje: duracion de cada fase y posicion del motor al
+// detectar el limite en cada aproximacion
+typedef struct homing_report {
+	long long phase_ns[HOMING_PHASES];
+	int32_t fast_limit_position;
+	int32_t slow_limit_position;
+	struct timespec phase_start;
+} homing_report_t;
 
 // Parametros para inicializar el motor de rotacion
 typedef struct rotation_init_params {
-	ev3_motor_ptr rotation_motor;
-	ev3_sensor_ptr touch_sensor;
-	struct timespec period;
+	sysfs_motor_t *rotation_motor;
+	sysfs_sensor_t *touch_sensor;
+	homing_report_t homing;
 } rotation_init_params_t;
 
 // Parametros para inicializar el motor de elevacion
 typedef struct elevation_init_params {
-	ev3_motor_ptr elevation_motor;
-	ev3_sensor_ptr color_sensor;
-	struct timespec period;
+	sysfs_motor_t *elevation_motor;
+	sysfs_sensor_t *color_sensor;
+	homing_report_t homing;
 } elevation_init_params_t;
 
+// Barrido de la gravedad de la elevacion tras la inicializacion, con el brazo en
+// reposo. Mientras dura cuenta como una correccion en curso (los trabajos, los
+// programas y el jog cartesiano esperan) y el controlador de la elevacion no mueve
+// el motor; solo se cancela al llegar al limite superior
+typedef struct gravity_sweeper {
+	sysfs_motor_t *elevation_motor;
+	gravity_table_t *gravity;
+	calibration_t *calibration;     // se guarda con la tabla al terminar
+	atomic_bool active;             // el barrido controla la elevacion (release/acquire)
+	atomic_bool cancel;             // limite superior alcanzado (relaxed)
+	int error;                      // 0, ENODATA (tramo sin medidas) o ECANCELED
+	long long sweep_ns;
+} gravity_sweeper_t;
+
 // Parametros para inicializar el motor de la garra
 typedef struct claw_init_params {
-	ev3_motor_ptr claw_motor;
-	struct timespec period;
+	sysfs_motor_t *claw_motor;
+	homing_report_t homing;
 } claw_init_params_t;
 
-// Flag - color sensor with mutex
+// Movimiento de un eje en run-direct: rampa del jog, correccion en curso y
+// estadisticas de las correcciones
+typedef struct axis_motion {
+	const char *name;
+	const motion_limits_t *limits;
+	int full_speed;                 // velocidad con potencia 100 (deg/seg)
+	int duty_cycle;                 // ultima potencia escrita
+	motion_ramp_t jog;
+	motion_profile_t profile;
+	struct timespec start;          // inicio de la correccion
+	long long profile_end_ns;       // fin del perfil respecto a start, 0 si no ha terminado
+	bool tracking;                  // siguiendo una consigna externa
+	int32_t target;                 // ultima consigna externa
+	int32_t soft_min;               // limites blandos
+	int32_t soft_max;
+	int32_t overshoot;              // maximo rebase de los limites blandos
+	int32_t last_position;          // posicion y velocidad pedida en la activacion anterior
+	double last_speed;
+	motion_stats_t stats;
+	bool servo;                     // movimientos con el bucle de posicion (servo_controller)
+	atomic_bool servo_active;       // el bucle controla el motor (release/acquire)
+	pid_controller_t pid;
+	pid_stats_t servo_error;
+	gravity_table_t *gravity;       // compensacion de la gravedad (NULL: sin compensacion)
+	atomic_int activity_position;   // ultima posicion y velocidad pedida (deg/seg, 0: parado)
+	atomic_int activity_speed;      // -> muestreo de los sensores de limite (relaxed)
+	task_t *sensor_task;            // tarea del sensor de limite del eje (NULL: ninguna)
+} axis_motion_t;
+
+// Resultado de un movimiento coordinado: duracion comun planificada y llegada de
+// cada eje (primera consigna dentro de PROFILE_TOLERANCE tras el final del perfil)
+typedef struct joint_move_report {
+	long long planned_ns;
+	long long arrival_ns[JOINT_MAX_AXES];
+	int n_axes;
+} joint_move_report_t;
+
+// Bucle de posicion: ejes que atiende y registro del error de seguimiento
+typedef struct servo_controller {
+	bool enabled;
+	long period;                    // units: nsecs
+	int n_axes;
+	sysfs_motor_t *motors[JOINT_MAX_AXES];
+	axis_motion_t *motions[JOINT_MAX_AXES];
+	FILE *log;                      // CSV, NULL si no se registra
+	struct timespec log_start;
+} servo_controller_t;
+
+// Estado del jog cartesiano: consigna de la punta mientras hay botones pulsados
+typedef struct cartesian_controller {
+	bool enabled;
+	const kinematics_t *kinematics;
+	sysfs_motor_t *rotation_motor;
+	sysfs_motor_t *elevation_motor;
+	bool active;
+	kin_point_t tip;
+	unsigned long solves;
+	unsigned long clamped;          // consignas fuera del alcance del brazo
+} cartesian_controller_t;
+
+// Estado del teach-and-repeat. En teach graba los puntos en program; en repeat los
+// reproduce en bucle con trayectorias mezcladas publicadas en axis_setpoint.
+typedef struct program_controller {
+	program_mode mode;
+	program_t *program;
+	sysfs_motor_t *rotation_motor;
+	sysfs_motor_t *elevation_motor;
+	motion_limits_t limits[MOTION_PATH_MAX_AXES];
+	// Teach
+	bool moved;                     // movimiento desde el ultimo punto grabado
+	bool claw_closed;
+	int32_t last_position[MOTION_PATH_MAX_AXES];
+	unsigned long dropped;          // puntos que no caben en el programa
+	// Repeat
+	playback_state state;
+	int next;                       // primer punto del siguiente tramo
+	int end;                        // ultimo punto del tramo en curso
+	motion_path_t path;
+	struct timespec start;          // inicio del tramo en curso
+	bool cycle_started;
+	struct timespec cycle_start;
+	unsigned long cycles;
+	long long cycle_total_ns;
+	double blended_s;               // movimiento de un ciclo con mezclas
+	double stop_s;                  // movimiento de un ciclo deteniendose en cada punto
+} program_controller_t;
+
+// Estado de un trabajo de pick-and-place. El ejecutor planifica los pasos desde el
+// final del anterior y los encola; el reproductor sigue el del frente publicando sus
+// consignas en axis_setpoint y las pulsaciones de la garra, como en repeat.
+typedef struct job_controller {
+	bool enabled;
+	const job_t *job;
+	job_queue_t queue;
+	const kinematics_t *kinematics;
+	sysfs_motor_t *rotation_motor;
+	sysfs_motor_t *elevation_motor;
+	motion_limits_t limits[MOTION_PATH_MAX_AXES];
+	motion_limits_t cartesian_limits;
+	atomic_bool planned;            // el ultimo paso ya esta en la cola (release/acquire)
+	// Ejecutor
+	job_cursor_t cursor;
+	int32_t end[MOTION_PATH_MAX_AXES];      // posicion al terminar el ultimo paso encolado
+	unsigned long plans;
+	long long plan_total_ns;        // tiempo de CPU del hilo ejecutor planificando
+	long long plan_max_ns;
+	unsigned long clamped;          // destinos fuera de los limites o del alcance
+	// Reproductor
+	bool started;                   // paso del frente en curso
+	bool replan;                    // una correccion ha movido el brazo
+	bool done;
+	struct timespec start;          // inicio del paso en curso
+	struct timespec job_start;
+	struct timespec last_end;       // fin del ultimo paso terminado
+	unsigned long steps;
+	unsigned long underruns;        // pasos que no estaban en la cola al terminar el anterior
+	long long idle_total_ns;
+	long long idle_max_ns;
+	unsigned long replans;
+	unsigned long timeouts;
+	bool aborted;                   // un paso de color no ha terminado en JOB_COLOR_TIMEOUT
+	job_opcode aborted_opcode;
+	int32_t aborted_color;          // color esperado por wait-color
+	// Clasificacion por colores
+	bool end_known;                 // ejecutor: end no depende de un color por leer
+	int32_t color;                  // ultimo color leido por read-color
+	unsigned long deferred_plans;   // movimientos planificados al empezarlos
+	unsigned long color_reads;
+	long long color_wait_total_ns;  // desde la peticion hasta el color leido
+	long long color_wait_max_ns;
+	unsigned long sorted[JOB_COLORS];   // piezas llevadas a la caja de cada color
+} job_controller_t;
+
+// Estado del controlador de rotacion
+typedef struct rotation_controller {
+	sysfs_motor_t *rotation_motor;
+	actions_rotation rotation_actual;
+	axis_state state;
+	bool sensor_limit;              // correccion provocada por el fin de carrera
+	axis_motion_t motion;
+} rotation_controller_t;
+
+// Estado del controlador de elevacion
+typedef struct elevation_controller {
+	sysfs_motor_t *elevation_motor;
+	actions_elevation elevation_actual;
+	axis_state state;
+	bool sensor_limit;              // correccion provocada por el sensor de color
+	axis_motion_t motion;
+	gravity_sweeper_t *sweeper;     // barrido en segundo plano (el motor es suyo si esta activo)
+} elevation_controller_t;
+
+// Cierres de la garra: tiempo hasta el contacto y apertura agarrada (grados de motor
+// respecto a la garra cerrada del todo, 0 si no hay objeto)
+typedef struct claw_grip_stats {
+	unsigned long grips;
+	unsigned long stalls;           // detectados por el estado del motor
+	unsigned long timeouts;         // sin contacto en CLAW_CLOSE_TIME
+	long long total_ns;
+	long long max_ns;
+	long long width_total;
+	int32_t width_min;
+	int32_t width_max;
+	int32_t last_width;
+} claw_grip_stats_t;
+
+// Estados de la garra. El cierre y la apertura avanzan una muestra por activacion
+typedef enum claw_state {
+	CLAW_OPEN, CLAW_CLOSING, CLAW_CLOSED, CLAW_OPENING
+} claw_state_t;
+
+// Muestreo del encoder durante el cierre
+typedef struct claw_grip {
+	int32_t window[CLAW_GRIP_WINDOW];
+	int samples;
+	bool moving;                    // velocidad por encima de CLAW_CONTACT_SPEED
+} claw_grip_t;
+
+// Estado del controlador de la garra
+typedef struct claw_controller {
+	sysfs_motor_t *claw_motor;
+	claw_state_t state;
+	unsigned int last_presses;
+	bool follow_setpoint;           // pulsaciones de axis_setpoint (repeat) en lugar de la botonera
+	claw_grip_stats_t grip;
+	axis_motion_t *motion;          // apertura con el bucle de posicion
+	claw_grip_t sampling;
+	struct timespec start;          // inicio del cierre o de la apertura en curso
+} claw_controller_t;
+
+// Estado del controlador de los leds
+typedef struct leds_controller_state {
+	bool previous;
+} leds_controller_t;
+
+// Estado de la botonera. Con dispositivo evdev se procesan los eventos del kernel;
+// sin el (o si falla) se muestrean los botones con ev3c y se detectan los flancos aqui.
+typedef struct buttons_controller_state {
+	buttons_input_t input;
+	unsigned int previous;          // mascara de la activacion anterior (muestreo)
+	unsigned int claw_presses;      // pulsaciones del boton central (muestreo)
+	unsigned int back_presses;      // pulsaciones de BACK (muestreo)
+} buttons_controller_t;
+
+// Regimen de muestreo de un sensor de limite segun el movimiento de su eje
+typedef enum sensor_regime_enum {SENSOR_IDLE, SENSOR_MOVING, SENSOR_APPROACHING, SENSOR_REGIMES} sensor_regime;
+
+// Muestreo adaptativo de un sensor de limite con la actividad publicada por su eje
+typedef struct sensor_sampling {
+	const axis_motion_t *motion;
+	int32_t limit_position;         // posicion del eje en el limite
+	int direction;                  // 1: limite en posiciones crecientes, -1: decrecientes
+	long min_period;                // periodo de la tarea (nsec)
+	bool at_limit;                  // ultima lectura en el limite
+	struct timespec last_read;
+	sensor_regime regime;           // desde la ultima lectura
+	long long time_to_limit_ns;     // acercandose, estimado en la ultima lectura
+	long next_period;               // hasta la siguiente lectura (nsec)
+	// Estadisticas
+	struct timespec first_wakeup;
+	struct timespec last_wakeup;
+	unsigned long wakeups;
+	unsigned long reads[SENSOR_REGIMES];
+	unsigned long detections;
+	long long exposed_max_ns;       // latencia maxima de deteccion acercandose al limite
+	double exposed_ratio_max;       // maximo del tiempo sin lectura / tiempo hasta el limite
+	long long detect_gap_max_ns;    // mayor intervalo entre lecturas antes de una deteccion
+} sensor_sampling_t;
+
+// Estado del sensor de color. Cada lectura espera a que el modo este asentado y el
+// sensor solo pasa a COL_COLOR con el brazo parado: la lectura del color sustituye a
+// las del limite superior hasta que el sensor vuelve a COL_REFLECT.
+typedef struct color_controller {
+	sysfs_sensor_t *color_sensor;
+	sysfs_motor_t *elevation_motor;
+	sensor_sampling_t sampling;
+	bool color_mode;                // sensor en COL_COLOR: la siguiente lectura es el color
+	struct timespec switched;       // ultimo cambio de modo
+	long next_period;               // hasta la siguiente activacion (nsec)
+	int32_t still_position;         // elevacion al pasar a COL_COLOR
+	// Estadisticas
+	unsigned long color_reads;
+	unsigned long postponed;        // lecturas con el color pedido y la elevacion en movimiento
+	unsigned long settling;         // lecturas aplazadas con el modo sin asentar
+	unsigned long blind_rises;      // elevacion subida sin lectura del limite (debe ser 0)
+} color_controller_t;
+
+// Estado del fin de carrera
+typedef struct touch_controller {
+	sysfs_sensor_t *touch_sensor;
+	sensor_sampling_t sampling;
+} touch_controller_t;
+
+// Estado del reportero: LCD con los elementos fijos pre-renderizados y tareas cuyas
+// estadisticas vuelca al recibir SIGUSR1
+typedef struct reporter_state {
+	lcd_t *lcd;
+	lcd_sprite_t title;
+	lcd_sprite_t claw_closed;
+	lcd_sprite_t claw_open;
+	const task_t *tasks;
+	int n_tasks;
+} reporter_t;
+
+// Tareas del programa principal, en orden monotonico en tasa (menor periodo primero)
+enum task_id {
+	SERVO_TASK, CLAW_TASK, COLOR_TASK, TOUCH_TASK, LEDS_TASK, PROGRAM_TASK, JOB_TASK, CARTESIAN_TASK, ROTATION_TASK,
+	ELEVATION_TASK, BUTTONS_TASK, EXECUTOR_TASK, REPORTER_TASK, N_TASKS
+};
+
+// Flag - color sensor (release/acquire)
 struct top_limit {
-	bool top_limit_reached;
-	pthread_mutex_t top_mutex;
+	atomic_bool top_limit_reached;
 } top_limit;
 
-// Flag - touch sensor with mutex
+// Flag - touch sensor (release/acquire)
 struct clockwise_limit {
-	bool clockwise_limit_reached;
-	pthread_mutex_t clockwise_mutex;
+	atomic_bool clockwise_limit_reached;
 } clockwise_limit;
 
-// Flag - back button with mutex
+// Flag - back button (release/acquire) e instante de la pulsacion
 struct close_condition {
-	bool close;
-	pthread_mutex_t close_mutex;
+	atomic_bool close;
+	struct timespec time;
 } close_condition;
 
-// Flag - motors running to stable position with mutex
+// Contador - motors running to stable position -> leds (relaxed). Los dos ejes
+// pueden corregir a la vez, por lo que se cuenta en lugar de usar un flag.
 struct correction {
-	bool correction_in_progress;
-	pthread_mutex_t correction_mutex;
+	atomic_int corrections_in_progress;
 } correction;
 
-// Flag - claw being used -> reporter
+// Consignas externas (jog cartesiano o reproduccion de un programa) -> rotacion y
+// elevacion: posiciones de los motores (relaxed) publicadas con el flag active
+// (release/acquire). La reproduccion acciona la garra con sus propias pulsaciones.
+struct axis_setpoint {
+	atomic_bool enabled;
+	atomic_bool active;
+	atomic_int rotation;
+	atomic_int elevation;
+	atomic_uint claw_presses;
+} axis_setpoint;
+
+// Lectura del color pedida por un trabajo: el reproductor activa requested (release)
+// y despierta a task; la tarea del sensor de color lo desactiva (release) tras
+// publicar color (relaxed)
+struct color_reading {
+	atomic_bool requested;
+	atomic_int color;
+	task_t *task;
+} color_reading;
+
+// Flag - claw being used -> reporter (relaxed)
 struct claw_used {
-	bool status;
-	pthread_mutex_t claw_used_mutex;
+	atomic_bool status;
 } claw_used;
 
 /*
@@ -178,101 +647,344 @@ struct claw_used {
  */
 
 /**
- * @brief Inicializa el motor de rotacion. Para ello, rota hasta alcanzar el fin de carrera
- *        (touch sensor). Desde ahi, rota en sentido contrario un numero de posiciones determinado
- *        para fijar la posición inicial.
+ * @brief Inicializa el motor de rotacion. Para ello, rota rapido hasta alcanzar el fin de
+ *        carrera (touch sensor), retrocede un poco y vuelve a buscarlo despacio y con un
+ *        muestreo mas frecuente. Desde ahi, rota en sentido contrario un numero de posiciones
+ *        determinado para fijar la posición inicial.
  *
- * @param rotation_init_params_t Estructura con el motor de rotacion, el fin de carrera y los
- *                               periodos de muestreo.
+ * @param rotation_init_params_t Estructura con el motor de rotacion y el fin de carrera.
+ *                               Devuelve en homing la duracion de cada fase.
  */
 void* rotation_motor_initializer (void *params);
 
 /**
  * @brief Inicializa el motor de elevacion. Para ello, eleva hasta alcanzar el valor limite
- *        de luz reflejada y detectada por el sensor de color. Desde ahi, baja un numero de
- *        posiciones determinado para fijar la posicion inicial.
+ *        de luz reflejada y detectada por el sensor de color, con las mismas fases que la
+ *        rotacion. Desde ahi, baja un numero de posiciones determinado para fijar la posicion
+ *        inicial.
  *
- * @param elevation_init_params_t Estructura con el motor de elevacion, el sensor de color y los
- *                                periodos de muestreo.
+ * @param elevation_init_params_t Estructura con el motor de elevacion y el sensor de color.
+ *                                Devuelve en homing la duracion de cada fase.
  */
 void* elevation_motor_initializer (void *params);
 
 /**
- * @brief Inicializa el motor de la garra. Para ello, cierra el motor por completo y vuelve
- *        a abrirlo hasta una posicion inicial un numero de posiciones determinado.
+ * @brief Barrido de la gravedad tras la inicializacion: sube hasta el limite blando
+ *        superior, recorre todo el eje bajando y subiendo, vuelve a la posicion inicial
+ *        y construye la tabla. Si la tabla es valida la guarda en la calibracion (sin la
+ *        marca de finalizacion limpia). Al terminar devuelve la elevacion a su
+ *        controlador.
+ *
+ * @param gravity_sweeper_t Estructura con el motor, la tabla y la calibracion. Devuelve
+ *                          el resultado y la duracion.
+ */
+void* elevation_gravity_sweeper (void *params);
+
+/**
+ * @brief Un tramo del barrido de la gravedad: run-direct con ELEVATION_SWEEP_POWER hacia
+ *        target registrando la velocidad de cada HOMING_FAST_PERIOD, salvo las primeras
+ *        ELEVATION_SWEEP_SETTLE, y stop con hold a ELEVATION_SWEEP_BRAKE_UNITS del destino
+ *        o al pedirse cancel.
  *
- * @param claw_init_params_t Estructura con el motor de la garra y el periodo de muestreo.
+ * @param sweep Barrido en el que se registran las velocidades (NULL: solo se mueve).
+ *
+ * @return false si se ha cancelado.
+ */
+bool elevation_sweep(sysfs_motor_t *motor, gravity_sweep_t *sweep, int32_t target, atomic_bool *cancel);
+
+/**
+ * @brief Inicializa el motor de la garra. Para ello, cierra el motor por completo (rapido,
+ *        retroceso y de nuevo despacio) y vuelve a abrirlo hasta una posicion inicial un numero
+ *        de posiciones determinado.
+ *
+ * @param claw_init_params_t Estructura con el motor de la garra. Devuelve en homing la
+ *                           duracion de cada fase.
  */
 void* claw_motor_initializer (void *params);
 
+/**
+ * @brief Deja el motor listo para los controladores sin homing (arranque en caliente):
+ *        hold al detenerse, velocidad de los movimientos de correccion, run-direct con
+ *        potencia nula y la posicion guardada en la calibracion.
+ *
+ * @param motor Motor del eje.
+ * @param step_speed Velocidad de los movimientos relativos y absolutos (% de la maxima).
+ * @param position Posicion actual respecto al origen del homing.
+ */
+void restore_motor_position(sysfs_motor_t *motor, int step_speed, int32_t position);
+
+/**
+ * @brief Mueve el motor en run-direct con la potencia indicada hasta que se cumple la
+ *        condicion de limite, comprobandola con el periodo indicado. Deja el motor en marcha.
+ *
+ * @param motor Motor del eje.
+ * @param power Potencia (run-direct).
+ * @param period Periodo de muestreo (nsecs).
+ * @param limit Condicion de limite, evaluada sobre device.
+ * @param device Sensor o motor que se consulta.
+ *
+ * @return Posicion del motor al detectar el limite.
+ */
+int32_t homing_approach(sysfs_motor_t *motor, int power, long period, bool (*limit)(void *),
+		void *device);
+
+/**
+ * @brief Movimiento relativo durante el homing en run-direct, sin el ajuste fino de
+ *        run-to-rel-pos: la posicion final solo es aproximada, el origen se fija respecto
+ *        al limite detectado.
+ *
+ * @param motor Motor del eje.
+ * @param units Desplazamiento (posiciones).
+ * @param stop Si es true, se mueve a HOMING_MOVE_POWER, frena (stop con hold) a
+ *             HOMING_BRAKE_UNITS del destino y espera a que se detenga. Si es false, se
+ *             mueve a HOMING_BACK_OFF_POWER y vuelve al recorrer units con el motor en
+ *             marcha (retroceso antes de la aproximacion lenta).
+ */
+void homing_move(sysfs_motor_t *motor, int units, bool stop);
+
+/**
+ * @brief Fija el origen de posiciones del motor a init_units del limite detectado en la
+ *        aproximacion lenta, independientemente de donde se haya detenido.
+ */
+void homing_set_origin(sysfs_motor_t *motor, const homing_report_t *report, int init_units);
+
+/**
+ * @brief Cierra la fase en curso del homing: guarda su duracion y marca el inicio de la
+ *        siguiente.
+ */
+void homing_phase_end(homing_report_t *report, homing_phase phase);
+
+/**
+ * @brief Muestra la duracion de cada fase y las posiciones de deteccion del limite.
+ */
+void homing_print(const char *name, const homing_report_t *report);
+
+/**
+ * @brief Condiciones de limite del homing: fin de carrera pulsado, reflejo por encima de
+ *        REFLECTION_LIMIT y motor bloqueado (MOTOR_LIMIT).
+ */
+bool is_touch_limit(void *touch_sensor);
+bool is_reflection_limit(void *color_sensor);
+bool is_claw_stalled(void *claw_motor);
+
 /*
  * FUNCIONES PRINCIPALES
+ *
+ * Cada funcion ejecuta una activacion de su tarea. Las tareas se ejecutan en hilos
+ * propios o, compilando con CYCLIC_EXECUTIVE, desde un ejecutivo ciclico (executive.h).
+ */
+
+/**
+ * @brief Jog cartesiano: mientras hay botones de movimiento pulsados desplaza la
+ *        consigna de la punta a CARTESIAN_SPEED, la resuelve con la cinematica
+ *        inversa y publica las posiciones de los motores en axis_setpoint. Al
+ *        empezar cada pulsacion (y tras una correccion) la consigna parte de la
+ *        posicion actual de la punta (cinematica directa).
+ *
+ * @param cartesian_controller_t Estado del jog cartesiano.
+ */
+void cartesian_controller(void *param);
+
+/**
+ * @brief Bucle de posicion en espacio de usuario. En cada periodo (EV3_SERVO_PERIOD)
+ *        envia a cada eje con un movimiento en curso la potencia del PID (axis_servo)
+ *        y lo suelta con potencia nula al llegar (axis_move_done), sin cambiar nunca
+ *        de comando del driver.
+ *
+ * @param servo_controller_t Estado del bucle de posicion.
+ */
+void servo_controller(void *param);
+
+/**
+ * @brief Teach-and-repeat. En teach graba un punto de paso (posiciones y garra) al
+ *        detenerse el brazo tras soltar los botones y en cada cambio de la garra. En
+ *        repeat reproduce el programa en bucle: une los puntos hasta el siguiente
+ *        cambio de la garra en una trayectoria mezclada (motion_path_plan), sin
+ *        detenerse en los intermedios, publica sus consignas en axis_setpoint y
+ *        acciona la garra al final del tramo. Una correccion interrumpe el tramo,
+ *        que se replanifica desde la posicion alcanzada.
+ *
+ * @param program_controller_t Estado del teach-and-repeat.
+ */
+void program_controller(void *param);
+
+/**
+ * @brief Ejecutor de un trabajo (EV3_JOB), que ocupa el lugar de la botonera: recorre
+ *        las ordenes resolviendo los bucles y, mientras haya hueco en la cola, planifica
+ *        cada paso desde el final del anterior (job_plan_move) y lo encola. Asi el
+ *        siguiente movimiento ya esta planificado cuando termina el actual. Los que
+ *        dependen de un color aun por leer (move-bin y el siguiente) se encolan sin
+ *        planificar.
+ *
+ * @param job_controller_t Estado del trabajo.
+ */
+void job_executor(void *param);
+
+/**
+ * @brief Reproductor de un trabajo: sigue el paso del frente de la cola (consignas de
+ *        los movimientos en axis_setpoint, pulsaciones de la garra o lectura del color)
+ *        y, al terminarlo, empieza el siguiente en la misma activacion. Una correccion
+ *        suspende el paso, que se replanifica desde la posicion alcanzada. Al acabar el
+ *        trabajo termina el programa como BACK.
+ *
+ * @param job_controller_t Estado del trabajo.
  */
+void job_player(void *param);
 
 /**
  * @brief Controla el motor de rotacion, atendiendo las ordenes recibidas desde la botonera
  *        y teniendo en cuenta los limites (posicion fija + fin de carrera). Si se alcanza
- *        un limite, se rota a la posicion inicial.
+ *        un limite, se rota a la posicion inicial. Es una maquina de estados
+ *        (AXIS_IDLE, AXIS_JOGGING, AXIS_CORRECTING, AXIS_SETTLING) que avanza un paso por
+ *        activacion sin esperar nunca al motor.
  *
- * @param ev3_motor_ptr Motor de rotacion.
+ * @param rotation_controller_t Estado del controlador con el motor de rotacion.
  */
-void* rotation_motor_controller (void *param);
+void rotation_motor_controller (void *param);
 
 /**
  * @brief Controla el motor de elevacion, atendiendo las ordenes recibidas desde la botonera
  *        y teniendo en cuenta los limites (posicion fija + sensor de color). Si se alcanza
- *        un limite, se mueve a la posicion inicial.
+ *        un limite, se mueve a la posicion inicial. Misma maquina de estados que la rotacion.
  *
- * @param ev3_motor_ptr Motor de elevacion.
+ * @param elevation_controller_t Estado del controlador con el motor de elevacion.
  */
-void* elevation_motor_controller (void *param);
+void elevation_motor_controller (void *param);
 
 /**
  * @brief Controla el motor de la garra, atendiendo las ordenes recibidas desde la botonera.
  *        El cierre de la garra se adapta al tamaño del objeto agarrado cortando la potencia
- *        despues de un tiempo concreto.
+ *        al detectar el contacto (claw_grip_sample). El cierre y la apertura son estados
+ *        que avanzan una muestra por activacion, sin esperar dentro de la tarea.
+ *
+ * @param claw_controller_t Estado del controlador con el motor de la garra.
+ */
+void claw_motor_controller (void *param);
+
+/**
+ * @brief Periodo de la siguiente activacion de la garra: CLAW_GRIP_PERIOD mientras se
+ *        cierra o se abre con los comandos del driver y MOTOR_PERIOD en el resto.
  *
- * @param ev3_motor_ptr Motor de la garra.
+ * @param claw_controller_t Estado del controlador con el motor de la garra.
  */
-void* claw_motor_controller (void *param);
+long claw_motor_rate (void *param);
 
 /**
  * @brief Controla la botonera del brick. Mediante una estructura compartida, puede indicar
  *        las acciones solicitadas por el usuario a los motores. Se permiten pulsaciones
- *        simultaneas para movimientos diagonales.
+ *        simultaneas para movimientos diagonales. Con dispositivo evdev procesa los
+ *        eventos pendientes sin bloquear y solo publica si ha habido flancos.
+ *
+ * @param buttons_controller_t Estado de la botonera.
+ */
+void buttons_controller (void *params);
+
+/**
+ * @brief Cuerpo de hilo de la botonera con dispositivo evdev. Bloquea hasta que llega
+ *        un evento del kernel y publica los flancos inmediatamente. En las estadisticas
+ *        de la tarea la latencia es el retraso desde la marca de tiempo del evento. Si
+ *        el dispositivo falla sigue muestreando los botones como task_thread.
+ *
+ * @param task_t Tarea de la botonera.
+ */
+void* buttons_event_thread (void *params);
+
+/**
+ * @brief Cierra el dispositivo evdev tras un error y pasa a muestrear los botones
+ *        con ev3c, continuando los contadores de pulsaciones.
+ */
+void buttons_fallback(buttons_controller_t *controller);
+
+/**
+ * @brief Periodo de muestreo del sensor segun la ultima actividad publicada por su eje
+ *        (sin E/S). Deja en sampling->regime el regimen correspondiente.
+ *
+ * @return Periodo (nsec).
+ */
+long sensor_period(sensor_sampling_t *sampling);
+
+/**
+ * @brief Registra una activacion de la tarea del sensor.
+ */
+void sensor_sample_wakeup(sensor_sampling_t *sampling, const struct timespec *now);
+
+/**
+ * @brief Registra una lectura del sensor (limit indica si esta en el limite) y el
+ *        tiempo que el eje ha pasado acercandose al limite desde la anterior, y
+ *        programa la siguiente en sampling->next_period.
+ */
+void sensor_sample_record(sensor_sampling_t *sampling, const struct timespec *now, bool limit);
+
+/**
+ * @brief Imprime las lecturas por segundo, por regimen y la latencia maxima de
+ *        deteccion del limite.
  */
-void* buttons_controller (void *params);
+void sensor_sampling_print(const char *name, const sensor_sampling_t *sampling);
 
 /**
  * @brief Controla el sensor de color. Activa una flag cuando se detecta un reflejo superior
  *        a REFLECTION_LIMIT, lo cual significa que el brazo ha alcanzado el limite de altura.
+ *        Cada activacion lee el reflejo y programa la siguiente con el periodo de
+ *        muestreo de la elevacion.
+ *        Si un trabajo pide el color (y despierta a la tarea) y la elevacion esta parada
+ *        en su consigna (el reproductor la mantiene asi hasta tener el color), tras la
+ *        lectura del reflejo pasa el sensor a COL_COLOR; la activacion siguiente, una vez
+ *        asentado el modo, lee el color, lo publica en color_reading y devuelve el
+ *        sensor a COL_REFLECT. Asi el limite solo deja de vigilarse con el brazo quieto.
+ *
+ * @param color_controller_t Estado del sensor de color.
+ */
+void color_sensor_controller (void *param);
+
+/**
+ * @brief Periodo de la siguiente activacion del sensor de color (rate de su tarea).
  *
- * @param ev3_sensor_ptr Sensor de color.
+ * @param color_controller_t Estado del sensor de color.
  */
-void* color_sensor_controller (void *param);
+long color_sensor_rate (void *param);
+
+/**
+ * @brief Pide el color a la tarea del sensor de color y la despierta.
+ */
+void request_color(void);
 
 /**
  * @brief Controla el fin de carrera o sensor de pulsacion. Activa una flag cuando se detecta
  *        la pulsacion, lo cual significa que el brazo ha alcanzado el limite de giro en sentido
- *        horario.
+ *        horario. Cada activacion programa la siguiente con el periodo de muestreo de la
+ *        rotacion.
+ *
+ * @param touch_controller_t Estado del fin de carrera.
+ */
+void touch_sensor_controller (void *param);
+
+/**
+ * @brief Periodo de la siguiente activacion del fin de carrera (rate de su tarea).
  *
- * @param ev3_sensor_ptr Sensor de pulsacion o fin de carrera.
+ * @param touch_controller_t Estado del fin de carrera.
  */
-void* touch_sensor_controller (void *param);
+long touch_sensor_rate (void *param);
 
 /**
  * @brief Controla los leds del brick. Estos se establecen en color verde durante un funcionamiento
  *        normal y en color rojo cuando uno de los motores esta retornando a la posicion inicial
  *        segura por sobrepasar un limite.
+ *
+ * @param leds_controller_t Estado del controlador.
  */
-void* leds_controller(void *params);
+void leds_controller(void *params);
 
 /**
  * @brief Reportero sencillo de informacion. Imprime por pantalla el titulo del programa, una
  *        circunferencia (garra abierta) o un circulo (garra cerrada) y la hora con una precision
- *        de segundos.
+ *        de segundos. Con framebuffer dibuja sobre el lienzo de lcd.h y solo se escriben
+ *        los bytes que cambian (normalmente los digitos de los segundos); si no, redibuja
+ *        la pantalla completa con ev3c. Si se ha recibido SIGUSR1 vuelca por la salida
+ *        estandar las estadisticas de temporizacion de las tareas.
+ *
+ * @param reporter_t Estado del reportero con el LCD y las tareas.
  */
-void* reporter(void *params);
+void reporter(void *params);
 
 /*
  * FUNCIONES AUXILIARES
@@ -304,11 +1016,276 @@ bool is_clockwise_limit_reached();
  */
 bool is_close_pressed();
 
+/**
+ * @brief Publica las nuevas instrucciones para los motores. Solo la botonera escribe,
+ *        por lo que el seqlock no necesita exclusion entre escritores.
+ *
+ * @param rotation Accion de rotacion.
+ * @param elevation Accion de elevacion.
+ * @param claw Accion de la garra.
+ * @param claw_presses Pulsaciones acumuladas del boton de la garra.
+ */
+void publish_motors_status(actions_rotation rotation, actions_elevation elevation, actions_claw claw,
+		unsigned int claw_presses);
+
+/**
+ * @brief Obtiene una copia consistente de las instrucciones para los motores sin
+ *        bloquear a la botonera.
+ *
+ * @param snapshot Copia leida. Su numero de secuencia identifica la publicacion.
+ */
+void read_motors_status(motors_status_snapshot_t *snapshot);
+
+/**
+ * @brief Escribe la potencia correspondiente a una velocidad, solo si cambia. Si el eje
+ *        tiene tabla de gravedad, le suma la compensacion en la posicion actual.
+ */
+void axis_set_speed(sysfs_motor_t *motor, axis_motion_t *motion, double speed, double feedback);
+
+/**
+ * @brief Limita la velocidad hacia un limite blando a la maxima desde la que el eje
+ *        se detiene en el limite: la que, tras avanzar un periodo (MOTOR_PERIOD)
+ *        hasta la siguiente activacion, frena a la aceleracion maxima en la distancia
+ *        que queda. Con la posicion actual, cada activacion corrige la anterior.
+ *        Registra ademas el rebase de los limites.
+ *
+ * @param speed Velocidad pedida (deg/seg).
+ *
+ * @return Velocidad permitida.
+ */
+double axis_govern(sysfs_motor_t *motor, axis_motion_t *motion, double speed);
+
+/**
+ * @brief Publica la posicion y la velocidad pedida del eje para el muestreo de los
+ *        sensores de limite (axis_govern, correcciones). Si el eje arranca o cambia
+ *        de sentido despierta a la tarea de su sensor.
+ */
+void axis_publish_activity(axis_motion_t *motion, int32_t position, double speed);
+
+/**
+ * @brief Avanza un periodo la rampa del jog hacia la velocidad pedida, de modo que
+ *        la potencia no salta de 0 a la de jog en un paso. La velocidad de la rampa
+ *        se limita con axis_govern.
+ *
+ * @param speed Velocidad pedida (deg/seg), 0 para parar.
+ *
+ * @return true mientras el eje se mueve.
+ */
+bool axis_jog(sysfs_motor_t *motor, axis_motion_t *motion, double speed);
+
+/**
+ * @brief Envia la consigna del perfil del eje en el instante elapsed_ns: la potencia
+ *        de la velocidad media del perfil hasta la siguiente consigna (period_ns)
+ *        mas kp por el error de posicion (con consignas mas frecuentes admite una
+ *        ganancia mayor).
+ *
+ * @return Error de posicion respecto a la referencia (grados).
+ */
+double axis_track(sysfs_motor_t *motor, axis_motion_t *motion, long long elapsed_ns, long period_ns,
+		double kp);
+
+/**
+ * @brief Sigue la consigna externa del eje (axis_setpoint), recortada a los limites
+ *        blandos: la velocidad entre dos consignas (limitada con axis_govern) mas
+ *        PROFILE_KP por el error respecto a la anterior. Sin consigna frena con la
+ *        rampa del jog.
+ *
+ * @return true mientras el eje se mueve.
+ */
+bool axis_follow_setpoint(sysfs_motor_t *motor, axis_motion_t *motion, atomic_int *target);
+
+/**
+ * @brief Un periodo del bucle de posicion: potencia del PID (prealimentacion de la
+ *        velocidad del perfil, anti-windup) para el error respecto al perfil en el
+ *        instante elapsed_ns. Registra el error en motion->servo_error y, si hay
+ *        registro, una linea por periodo.
+ *
+ * @return Error de posicion respecto a la referencia (grados).
+ */
+double axis_servo(const servo_controller_t *servo, sysfs_motor_t *motor, axis_motion_t *motion,
+		long long elapsed_ns);
+
+/**
+ * @brief Comprueba el final de un movimiento con el error del ultimo periodo: el
+ *        perfil ha terminado y el error esta dentro de PROFILE_TOLERANCE (se
+ *        registra en las estadisticas), o se ha superado MOTION_TIMEOUT. Al terminar
+ *        deja la potencia nula.
+ *
+ * @return true si ha terminado.
+ */
+bool axis_move_done(sysfs_motor_t *motor, axis_motion_t *motion, long long elapsed_ns, double error);
+
+/**
+ * @brief Planifica un movimiento del eje hasta target y se lo entrega al bucle de
+ *        posicion.
+ */
+void servo_start(sysfs_motor_t *motor, axis_motion_t *motion, int32_t target);
+
+/**
+ * @brief Planifica el movimiento de correccion de un eje desde su posicion actual
+ *        hasta una posicion segura. No espera a que termine: las consignas se
+ *        envian en cada activacion desde is_correction_finished o, con el bucle de
+ *        posicion, desde servo_controller.
+ *
+ * @param motor Motor del eje.
+ * @param motion Movimiento del eje.
+ * @param target Posicion absoluta de destino.
+ */
+void start_correction(sysfs_motor_t *motor, axis_motion_t *motion, int32_t target);
+
+/**
+ * @brief Envia la consigna de la correccion en curso: potencia de la velocidad del
+ *        perfil mas una correccion proporcional al error de posicion. La correccion
+ *        termina cuando el perfil ha terminado y el error esta dentro de
+ *        PROFILE_TOLERANCE, o cuando se supera MOTION_TIMEOUT. Con el bucle de
+ *        posicion solo comprueba si este ha soltado el eje.
+ *
+ * @param motor Motor del eje.
+ * @param motion Movimiento del eje.
+ *
+ * @return true si ha terminado.
+ *         false en caso contrario.
+ */
+bool is_correction_finished(sysfs_motor_t *motor, axis_motion_t *motion);
+
+/**
+ * @brief Empieza a cerrar la garra en run-direct con -CLAW_POWER.
+ *
+ * @param controller Estado del controlador de la garra.
+ */
+void claw_grip_start(claw_controller_t *controller);
+
+/**
+ * @brief Toma una muestra del encoder durante el cierre (una por activacion, cada
+ *        CLAW_GRIP_PERIOD) y corta la potencia en cuanto detecta el contacto: la
+ *        velocidad (sobre CLAW_GRIP_WINDOW muestras) cae por debajo de
+ *        CLAW_CONTACT_SPEED despues de haberla superado, o el motor esta bloqueado
+ *        (MOTOR_LIMIT). Si no hay contacto corta a los CLAW_CLOSE_TIME. Al terminar
+ *        registra el tiempo y la apertura agarrada (grados de motor desde la garra
+ *        cerrada del todo) en controller->grip.
+ *
+ * @param controller Estado del controlador de la garra.
+ *
+ * @return true si el cierre ha terminado.
+ */
+bool claw_grip_sample(claw_controller_t *controller);
+
+/**
+ * @brief Imprime el numero de cierres, el tiempo hasta el contacto y la apertura
+ *        agarrada.
+ */
+void claw_grip_print(const claw_grip_stats_t *stats);
+
+/**
+ * @brief Devuelve el motor de un eje corregido a run-direct con potencia nula.
+ */
+void finish_correction(sysfs_motor_t *motor, axis_motion_t *motion);
+
+/**
+ * @brief Movimiento coordinado en espacio articular: lleva cada eje a su posicion
+ *        de destino con una duracion comun (motion_profile_plan_sync), enviando las
+ *        consignas de todos los ejes cada JOINT_MOVE_PERIOD desde el mismo instante
+ *        de inicio, de modo que llegan a la vez. Cada eje se detiene (stop con hold)
+ *        al llegar. Bloquea hasta que llegan todos o se supera MOTION_TIMEOUT.
+ *        Con el bucle de posicion las consignas son las del PID cada servo->period
+ *        y los ejes que llegan mantienen la posicion con el PID hasta que llegan
+ *        todos, sin stop.
+ *
+ * @param motors Motores de los ejes.
+ * @param motions Limites y estado de run-direct de cada eje.
+ * @param targets Posicion absoluta de destino de cada eje.
+ * @param n Numero de ejes (como mucho JOINT_MAX_AXES).
+ * @param servo Bucle de posicion (sin usar si no esta activado).
+ * @param report Duracion planificada y llegada de cada eje.
+ *
+ * @return Numero de ejes que no han llegado en MOTION_TIMEOUT.
+ */
+int joint_move(sysfs_motor_t *motors[], axis_motion_t *motions[], const int32_t targets[], int n,
+		const servo_controller_t *servo, joint_move_report_t *report);
+
+/**
+ * @brief Imprime la duracion planificada de un movimiento coordinado, la llegada de
+ *        cada eje y la diferencia entre la primera y la ultima.
+ */
+void joint_move_print(const char *name, const joint_move_report_t *report);
+
+/**
+ * @brief Teach: graba un punto en cada cambio de la garra y al quedar quieto el brazo
+ *        tras un movimiento con los botones soltados.
+ */
+void program_teach(program_controller_t *controller);
+
+/**
+ * @brief Repeat: avanza la reproduccion un periodo. Al terminar cada tramo acciona la
+ *        garra si el ultimo punto la cambia y espera a que termine.
+ */
+void program_repeat(program_controller_t *controller);
+
+/**
+ * @brief Planifica el tramo de un programa que empieza en start y recorre los puntos
+ *        desde next hasta el primero que cambia la garra respecto a claw_closed o el
+ *        ultimo del programa.
+ *
+ * @param stop_s Si no es NULL, devuelve la duracion del mismo recorrido deteniendose
+ *               en cada punto (perfiles trapezoidales sincronizados con los mismos
+ *               limites).
+ *
+ * @return Indice del ultimo punto del tramo.
+ */
+int program_plan_stroke(const program_t *program, const motion_limits_t limits[], const double start[],
+		int next, bool claw_closed, motion_path_t *path, double *stop_s);
+
+/**
+ * @brief Recorta a los limites blandos un destino de rotacion y elevacion.
+ *
+ * @return true si se ha recortado.
+ */
+bool job_clamp_target(int32_t target[]);
+
+/**
+ * @brief Planifica un movimiento de un trabajo que empieza en start. En move-joint (y
+ *        move-bin) el
+ *        destino (target) se recorta a los limites blandos y los dos ejes llegan a la
+ *        vez; en move-cartesian la punta sigue la recta en (y, z) desde su posicion en
+ *        start hasta to, con un perfil sobre la longitud de la recta, y el destino es la
+ *        cinematica inversa de to (el punto alcanzable mas cercano si no lo es).
+ *
+ * @return 0 si tiene exito o ERANGE si se ha recortado el destino.
+ */
+int job_plan_move(const job_controller_t *controller, job_step_t *step, const int32_t start[]);
+
+/**
+ * @brief Empieza el paso del frente: cuenta el tiempo sin paso desde el anterior y
+ *        acciona la garra o pide el color. Planifica los movimientos que dependen de
+ *        un color leido desde la posicion actual; move-bin va a la caja del ultimo
+ *        color leido (a la de color 0 si ese color no tiene caja).
+ */
+void job_step_start(job_controller_t *controller, job_step_t *step, const struct timespec *now);
+
+/**
+ * @brief Avanza el paso en curso un periodo (consigna de los movimientos para la
+ *        siguiente activacion de los ejes). Si un paso de color no termina en
+ *        JOB_COLOR_TIMEOUT marca el trabajo como abortado (controller->aborted).
+ *
+ * @return true si ha terminado: movimiento con los dos ejes en el destino tras el
+ *         perfil (o MOTION_TIMEOUT), garra en el estado pedido o color leido.
+ */
+bool job_step_done(job_controller_t *controller, job_step_t *step, const struct timespec *now);
+
+/**
+ * @brief Termina el trabajo: suelta las consignas de los ejes y da la orden de
+ *        finalizacion, con lo que el brazo se aparca como con BACK.
+ */
+void job_stop(void);
+
 /*
  * MAIN
  */
 
 int main(void) {
+	// Reloj real o, compilando con VIRTUAL_TIME, virtual
+	timebase_init();
+
 	/*
 	 * CARGA MOTORES Y SENSORES.
 	 */
@@ -398,38 +1375,69 @@ int main(void) {
 	}
 	ev3_mode_sensor(color_sensor, COL_REFLECT);
 
-	// Botonera
+	/* Descriptores sysfs persistentes */
+	sysfs_motor_t rotation_io, elevation_io, claw_io;
+	sysfs_sensor_t touch_io, color_io;
+
+	if (sysfs_open_motor(&rotation_io, rotation_motor, LARGE_ROTATION_MOTOR_PORT) != 0) {
+		printf("Warning: sysfs cache not available for rotation motor, using ev3c.\n");
+	}
+	if (sysfs_open_motor(&elevation_io, elevation_motor, LARGE_ELEVATION_MOTOR_PORT) != 0) {
+		printf("Warning: sysfs cache not available for elevation motor, using ev3c.\n");
+	}
+	if (sysfs_open_motor(&claw_io, claw_motor, MEDIUM_CLAW_MOTOR_PORT) != 0) {
+		printf("Warning: sysfs cache not available for claw motor, using ev3c.\n");
+	}
+	if (sysfs_open_sensor(&touch_io, touch_sensor, TOUCH_SENSOR_PORT) != 0) {
+		printf("Warning: sysfs cache not available for touch sensor, using ev3c.\n");
+	}
+	if (sysfs_open_sensor(&color_io, color_sensor, COLOR_SENSOR_PORT) != 0) {
+		printf("Warning: sysfs cache not available for color sensor, using ev3c.\n");
+	}
+
+	// Botonera: eventos del kernel si hay dispositivo de entrada, muestreo si no
 	ev3_init_button();
+	buttons_controller_t buttons_state;
+	if (buttons_input_open(&buttons_state.input) != 0) {
+		printf("Warning: keypad input device not available, polling buttons.\n");
+	}
+	buttons_state.previous = 0;
+	buttons_state.claw_presses = 0;
+	buttons_state.back_presses = 0;
 
 	// Leds
 	ev3_init_led();
 
-	// LCD
+	// LCD: framebuffer con volcado de regiones modificadas si esta disponible
 	ev3_init_lcd();
+	lcd_t lcd;
+	if (lcd_open(&lcd) != 0) {
+		printf("Warning: LCD framebuffer not available, using ev3c.\n");
+	}
 
 	/*
 	 * INICIALIZA ROTACION, ELEVACION Y GARRA
+	 *
+	 * Si la ejecucion anterior termino limpiamente y los sensores confirman que el
+	 * brazo sigue aparcado, se restauran las posiciones guardadas sin homing.
 	 */
 
 	// Rotation params
 	rotation_init_params_t rotation_init_params;
-	rotation_init_params.rotation_motor = rotation_motor;
-	rotation_init_params.touch_sensor = touch_sensor;
-	rotation_init_params.period.tv_sec =  0;
-	rotation_init_params.period.tv_nsec = MOTOR_PERIOD;
+	rotation_init_params.rotation_motor = &rotation_io;
+	rotation_init_params.touch_sensor = &touch_io;
 
 	// Elevation params
 	elevation_init_params_t elevation_init_params;
-	elevation_init_params.elevation_motor = elevation_motor;
-	elevation_init_params.color_sensor = color_sensor;
-	elevation_init_params.period.tv_sec = 0;
-	elevation_init_params.period.tv_nsec = MOTOR_PERIOD;
+	elevation_init_params.elevation_motor = &elevation_io;
+	elevation_init_params.color_sensor = &color_io;
+	gravity_table_t gravity;
+	gravity_init(&gravity, ELEVATION_SOFT_MIN + ELEVATION_SWEEP_MARGIN, ELEVATION_SOFT_MAX - ELEVATION_SWEEP_MARGIN,
+			elevation_io.motor->max_speed);
 
 	// Claw params
 	claw_init_params_t claw_init_params;
-	claw_init_params.claw_motor = claw_motor;
-	claw_init_params.period.tv_sec = 0;
-	claw_init_params.period.tv_nsec = MOTOR_PERIOD;
+	claw_init_params.claw_motor = &claw_io;
 
 	// Prepare thread attributes
 	pthread_t th_init_rotation, th_init_elevation, th_init_claw;
@@ -459,57 +1467,375 @@ int main(void) {
 	CHK(pthread_attr_setschedparam(&th_init_claw_attr, &sch_param_init_claw));
 	CHK(pthread_attr_setdetachstate (&th_init_claw_attr, PTHREAD_CREATE_JOINABLE));
 
-	// Create threads
-	CHK(pthread_create(&th_init_rotation, &th_init_rotation_attr, rotation_motor_initializer,
-			&rotation_init_params));
-	CHK(pthread_create(&th_init_elevation, &th_init_elevation_attr, elevation_motor_initializer,
-			&elevation_init_params));
-	CHK(pthread_create(&th_init_claw, &th_init_claw_attr, claw_motor_initializer,
-			&claw_init_params));
-
-	// Espera la finalizacion de todos
-	CHK(pthread_join(th_init_rotation, NULL));
-	CHK(pthread_join(th_init_elevation, NULL));
-	CHK(pthread_join(th_init_claw, NULL));
+	struct timespec init_start, init_end;
+	timebase_now(&init_start);
+
+	calibration_t calibration;
+	int calibration_error = calibration_load(&calibration);
+	bool warm_start = calibration_error == 0 &&
+			calibration_plausible(&calibration, sysfs_update_sensor_val(&touch_io),
+					sysfs_update_sensor_val(&color_io));
+
+	// La tabla de gravedad es del mecanismo: sirve aunque haya que repetir el homing
+	if ((calibration_error == 0 || calibration_error == ESTALE) && calibration.gravity_valid) {
+		memcpy(gravity.gravity, calibration.gravity, sizeof(gravity.gravity));
+		gravity.friction = calibration.friction;
+		gravity.valid = true;
+	}
+
+	if (warm_start) {
+		restore_motor_position(&rotation_io, STEP_ROTATION_SPEED,
+				calibration.position[CALIBRATION_ROTATION]);
+		restore_motor_position(&elevation_io, STEP_ELEVATION_SPEED,
+				calibration.position[CALIBRATION_ELEVATION]);
+		restore_motor_position(&claw_io, STEP_CLAW_SPEED, calibration.position[CALIBRATION_CLAW]);
+		printf("Warm start: homing skipped\n");
+	} else {
+		// Create threads
+		CHK(timebase_thread_create(&th_init_rotation, &th_init_rotation_attr, rotation_motor_initializer,
+				&rotation_init_params));
+		CHK(timebase_thread_create(&th_init_elevation, &th_init_elevation_attr, elevation_motor_initializer,
+				&elevation_init_params));
+		CHK(timebase_thread_create(&th_init_claw, &th_init_claw_attr, claw_motor_initializer,
+				&claw_init_params));
+
+		// Espera la finalizacion de todos
+		CHK(timebase_thread_join(th_init_rotation));
+		CHK(timebase_thread_join(th_init_elevation));
+		CHK(timebase_thread_join(th_init_claw));
+
+		homing_print("rotation", &rotation_init_params.homing);
+		homing_print("elevation", &elevation_init_params.homing);
+		homing_print("claw", &claw_init_params.homing);
+	}
 
 	// Destruye atributos
 	CHK(pthread_attr_destroy(&th_init_rotation_attr));
 	CHK(pthread_attr_destroy(&th_init_elevation_attr));
 	CHK(pthread_attr_destroy(&th_init_claw_attr));
 
-	// START MAIN PROGRAM
-
-	// Prepare thread attributes
-	pthread_t th_rotation, th_elevation, th_claw, th_buttons, th_color_sensor, th_touch_sensor, th_leds, th_reporter;
-	pthread_attr_t th_rotation_attr, th_elevation_attr, th_claw_attr, th_buttons_attr, th_color_sensor_attr,
-		th_touch_sensor_attr, th_leds_attr, th_reporter_attr;
+	timebase_now(&init_end);
 
-	CHK(pthread_attr_init(&th_buttons_attr));
-	CHK(pthread_attr_setinheritsched(&th_buttons_attr, PTHREAD_EXPLICIT_SCHED));
-	CHK(pthread_attr_setschedpolicy(&th_buttons_attr, SCHED_FIFO));
-	struct sched_param sch_param_buttons;
-	sch_param_buttons.sched_priority = sched_get_priority_max(SCHED_FIFO) - 5; // Max = 99
-	CHK(pthread_attr_setschedparam(&th_buttons_attr, &sch_param_buttons));
-	CHK(pthread_attr_setdetachstate (&th_buttons_attr, PTHREAD_CREATE_JOINABLE));
+	// El fichero se ha consumido al cargarlo: se repone sin la marca de finalizacion
+	// limpia para que la tabla de gravedad sobreviva a una finalizacion brusca
+	if (gravity.valid) {
+		calibration_store_gravity(&calibration, &gravity);
+		int error = calibration_save(&calibration, false);
+		if (error != 0) {
+			printf("Warning: gravity table not saved (%s).\n", strerror(error));
+		}
+	}
+	printf("Initialization time: %.3f s\n", (init_end.tv_sec - init_start.tv_sec) +
+			(init_end.tv_nsec - init_start.tv_nsec) / 1e9);
 
-	CHK(pthread_attr_init(&th_color_sensor_attr));
-	CHK(pthread_attr_setinheritsched(&th_color_sensor_attr, PTHREAD_EXPLICIT_SCHED));
-	CHK(pthread_attr_setschedpolicy(&th_color_sensor_attr, SCHED_FIFO));
-	struct sched_param sch_param_color_sensor;
-	sch_param_color_sensor.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10; // Max = 99
-	CHK(pthread_attr_setschedparam(&th_color_sensor_attr, &sch_param_color_sensor));
-	CHK(pthread_attr_setdetachstate (&th_color_sensor_attr, PTHREAD_CREATE_JOINABLE));
+	// Sin tabla de gravedad se barre la elevacion despues, con el brazo en reposo
+	gravity_sweeper_t gravity_sweeper = { .elevation_motor = &elevation_io, .gravity = &gravity,
+			.calibration = &calibration };
+	atomic_store_explicit(&gravity_sweeper.active, !gravity.valid, memory_order_relaxed);
+	atomic_store_explicit(&gravity_sweeper.cancel, false, memory_order_relaxed);
 
-	CHK(pthread_attr_init(&th_touch_sensor_attr));
-	CHK(pthread_attr_setinheritsched(&th_touch_sensor_attr, PTHREAD_EXPLICIT_SCHED));
-	CHK(pthread_attr_setschedpolicy(&th_touch_sensor_attr, SCHED_FIFO));
-	struct sched_param sch_param_touch_sensor;
-	sch_param_touch_sensor.sched_priority = sched_get_priority_max(SCHED_FIFO) - 15; // Max = 99
-	CHK(pthread_attr_setschedparam(&th_touch_sensor_attr, &sch_param_touch_sensor));
-	CHK(pthread_attr_setdetachstate (&th_touch_sensor_attr, PTHREAD_CREATE_JOINABLE));
+	// START MAIN PROGRAM
 
-	CHK(pthread_attr_init(&th_rotation_attr));
-	CHK(pthread_attr_setinheritsched(&th_rotation_attr, PTHREAD_EXPLICIT_SCHED));
+	// Limites de los perfiles
+	const motion_limits_t rotation_limits = { PROFILE_ROTATION_SPEED * FULL_SPEED_LARGE_MOTOR / 100.0,
+			PROFILE_ACCEL, PROFILE_JERK };
+	const motion_limits_t elevation_limits = { PROFILE_ELEVATION_SPEED * FULL_SPEED_LARGE_MOTOR / 100.0,
+			PROFILE_ACCEL, PROFILE_JERK };
+	const motion_limits_t claw_limits = { PROFILE_CLAW_SPEED * FULL_SPEED_MEDIUM_MOTOR / 100.0,
+			PROFILE_ACCEL, PROFILE_JERK };
+
+	// Bucle de posicion (EV3_SERVO_PERIOD en ms)
+	servo_controller_t servo_state = { .enabled = false, .period = MOTOR_PERIOD, .log = NULL };
+	const char *servo_period = getenv(SERVO_PERIOD_ENV);
+	if (servo_period != NULL && *servo_period != '\0') {
+		char *end;
+		long period_ms = strtol(servo_period, &end, 10);
+		if (*end != '\0' || period_ms < SERVO_MIN_PERIOD || period_ms > SERVO_MAX_PERIOD) {
+			printf("Warning: %s must be %d-%d ms, position loop disabled.\n", SERVO_PERIOD_ENV,
+					SERVO_MIN_PERIOD, SERVO_MAX_PERIOD);
+		} else {
+			servo_state.enabled = true;
+			servo_state.period = period_ms * 1000000L;
+		}
+	}
+	const char *servo_log = getenv(SERVO_LOG_ENV);
+	if (servo_state.enabled && servo_log != NULL) {
+		servo_state.log = fopen(servo_log, "w");
+		if (servo_state.log == NULL) {
+			printf("Warning: servo log not opened (%s).\n", strerror(errno));
+		} else {
+			fprintf(servo_state.log, "time_ms,axis,reference,position,error,duty\n");
+			timebase_now(&servo_state.log_start);
+		}
+	}
+
+	// Estado de los controladores
+	rotation_controller_t rotation_controller = { &rotation_io, ROTATE_STOP, AXIS_IDLE, false,
+			{ .name = "rotation", .limits = &rotation_limits, .full_speed = FULL_SPEED_LARGE_MOTOR,
+			.soft_min = ROTATION_SOFT_MIN, .soft_max = ROTATION_SOFT_MAX, .servo = servo_state.enabled } };
+	elevation_controller_t elevation_controller = { &elevation_io, ELEVATE_STOP, AXIS_IDLE, false,
+			{ .name = "elevation", .limits = &elevation_limits, .full_speed = FULL_SPEED_LARGE_MOTOR,
+			.soft_min = ELEVATION_SOFT_MIN, .soft_max = ELEVATION_SOFT_MAX, .servo = servo_state.enabled,
+			.gravity = &gravity }, &gravity_sweeper };
+	axis_motion_t claw_motion = { .name = "claw", .limits = &claw_limits, .full_speed = FULL_SPEED_MEDIUM_MOTOR,
+			.servo = servo_state.enabled };
+	claw_controller_t claw_controller = { &claw_io, CLAW_OPEN, 0, false, { 0 }, &claw_motion, { { 0 }, 0, false }, { 0, 0 } };
+	axis_motion_t *servo_motions[] = { &rotation_controller.motion, &elevation_controller.motion,
+			&claw_motion };
+	sysfs_motor_t *servo_motors[] = { &rotation_io, &elevation_io, &claw_io };
+	servo_state.n_axes = sizeof(servo_motions) / sizeof(servo_motions[0]);
+	for (int i = 0; i < servo_state.n_axes; i++) {
+		servo_state.motors[i] = servo_motors[i];
+		servo_state.motions[i] = servo_motions[i];
+		pid_init(&servo_motions[i]->pid, SERVO_KP, SERVO_KI, SERVO_KD, SERVO_MAX_DUTY);
+		atomic_store_explicit(&servo_motions[i]->servo_active, false, memory_order_relaxed);
+	}
+	if (servo_state.enabled) {
+		printf("Position loop: %ld ms\n", servo_state.period / 1000000);
+	}
+	const kinematics_t kinematics = KINEMATICS_INIT(ARM_LENGTH, ARM_ROTATION_RATIO, ARM_ELEVATION_RATIO,
+			ARM_ELEVATION_HOME);
+	const char *jog_mode = getenv(JOG_MODE_ENV);
+	cartesian_controller_t cartesian_state = {
+		.enabled = (jog_mode != NULL && strcmp(jog_mode, JOG_MODE_CARTESIAN) == 0),
+		.kinematics = &kinematics, .rotation_motor = &rotation_io, .elevation_motor = &elevation_io
+	};
+	kinematics_init();
+
+	// Teach-and-repeat: en repeat los ejes y la garra solo siguen al programa
+	program_t program = { 0 };
+	program_controller_t program_state = {
+		.mode = program_get_mode(), .program = &program, .rotation_motor = &rotation_io,
+		.elevation_motor = &elevation_io, .limits = { rotation_limits, elevation_limits },
+		.last_position = { sysfs_get_position(&rotation_io), sysfs_get_position(&elevation_io) },
+		.state = PLAYBACK_PLAN
+	};
+	if (program_state.mode == PROGRAM_REPEAT) {
+		int error = program_load(&program);
+		if (error == 0 && program.n_waypoints == 0) {
+			error = ENODATA;
+		}
+		if (error != 0) {
+			printf("Warning: program not loaded (%s), repeat disabled.\n", strerror(error));
+			program_state.mode = PROGRAM_OFF;
+		} else {
+			// Movimiento de un ciclo completo (del ultimo punto al ultimo)
+			const program_waypoint_t *last = &program.waypoints[program.n_waypoints - 1];
+			double start[MOTION_PATH_MAX_AXES] = { last->rotation, last->elevation };
+			bool claw_closed = last->claw_closed;
+			int end = -1;
+			while (end != program.n_waypoints - 1) {
+				double stop_s;
+				end = program_plan_stroke(&program, program_state.limits, start, end + 1, claw_closed,
+						&program_state.path, &stop_s);
+				program_state.blended_s += program_state.path.duration;
+				program_state.stop_s += stop_s;
+				start[0] = program.waypoints[end].rotation;
+				start[1] = program.waypoints[end].elevation;
+				claw_closed = program.waypoints[end].claw_closed;
+			}
+			cartesian_state.enabled = false;
+			claw_controller.follow_setpoint = true;
+			printf("Program: repeat, %d waypoints\n", program.n_waypoints);
+		}
+	} else if (program_state.mode == PROGRAM_TEACH) {
+		printf("Program: teach\n");
+	}
+
+	// Trabajo de pick-and-place: en lugar de la botonera (salvo BACK), del jog
+	// cartesiano y de los programas
+	job_t job;
+	job_controller_t job_state = {
+		.enabled = false, .job = &job, .kinematics = &kinematics, .rotation_motor = &rotation_io,
+		.elevation_motor = &elevation_io, .limits = { rotation_limits, elevation_limits },
+		.cartesian_limits = { CARTESIAN_SPEED, JOB_CARTESIAN_ACCEL, JOB_CARTESIAN_JERK },
+		.end = { sysfs_get_position(&rotation_io), sysfs_get_position(&elevation_io) }, .end_known = true
+	};
+	job_cursor_init(&job_state.cursor);
+	job_queue_init(&job_state.queue);
+	atomic_store_explicit(&job_state.planned, false, memory_order_relaxed);
+	if (getenv(JOB_FILE_ENV) != NULL) {
+		int line;
+		int error = job_load(&job, &line);
+		if (error != 0 && line > 0) {
+			printf("Warning: job not loaded (%s at line %d), job disabled.\n", strerror(error), line);
+		} else if (error != 0) {
+			printf("Warning: job not loaded (%s), job disabled.\n", strerror(error));
+		} else {
+			job_state.enabled = true;
+			program_state.mode = PROGRAM_OFF;
+			cartesian_state.enabled = false;
+			claw_controller.follow_setpoint = true;
+			printf("Job: %d commands, %d steps planned ahead\n", job.n_commands, JOB_QUEUE_SIZE);
+		}
+	}
+	if (cartesian_state.enabled) {
+		printf("Jog mode: cartesian\n");
+	}
+	color_controller_t color_state = { .color_sensor = &color_io, .elevation_motor = &elevation_io,
+			.sampling = { .motion = &elevation_controller.motion, .limit_position = -ELEVATION_INIT_UNITS,
+			.direction = -1, .min_period = COLOR_PERIOD } };
+	touch_controller_t touch_state = { .touch_sensor = &touch_io,
+			.sampling = { .motion = &rotation_controller.motion, .limit_position = -ROTATION_INIT_UNITS,
+			.direction = 1, .min_period = TOUCH_PERIOD } };
+	leds_controller_t leds_state = { false };
+	reporter_t reporter_state = { .lcd = &lcd, .tasks = NULL, .n_tasks = N_TASKS };
+	CHK(lcd_sprite_text(&reporter_state.title, TITLE));
+	CHK(lcd_sprite_circle(&reporter_state.claw_closed, RADIUS, true));
+	CHK(lcd_sprite_circle(&reporter_state.claw_open, RADIUS, false));
+	lcd_clear(&lcd);
+
+	// Tareas
+	task_t tasks[N_TASKS] = {
+		[SERVO_TASK] = { "servo", servo_controller, &servo_state, servo_state.period },
+		[CLAW_TASK] = { "claw", claw_motor_controller, &claw_controller, CLAW_GRIP_PERIOD, claw_motor_rate },
+		[COLOR_TASK] = { "color", color_sensor_controller, &color_state, COLOR_PERIOD, color_sensor_rate },
+		[TOUCH_TASK] = { "touch", touch_sensor_controller, &touch_state, TOUCH_PERIOD, touch_sensor_rate },
+		[LEDS_TASK] = { "leds", leds_controller, &leds_state, LED_PERIOD },
+		[PROGRAM_TASK] = { "program", program_controller, &program_state, MOTOR_PERIOD },
+		[JOB_TASK] = { "job", job_player, &job_state, MOTOR_PERIOD },
+		[CARTESIAN_TASK] = { "cartesian", cartesian_controller, &cartesian_state, MOTOR_PERIOD },
+		[ROTATION_TASK] = { "rotation", rotation_motor_controller, &rotation_controller, MOTOR_PERIOD },
+		[ELEVATION_TASK] = { "elevation", elevation_motor_controller, &elevation_controller, MOTOR_PERIOD },
+		[BUTTONS_TASK] = { "buttons", buttons_controller, &buttons_state, BUTTON_PERIOD },
+		[EXECUTOR_TASK] = { "executor", job_executor, &job_state, JOB_EXECUTOR_PERIOD },
+		[REPORTER_TASK] = { "reporter", reporter, &reporter_state, REPORTER_PERIOD },
+	};
+	reporter_state.tasks = tasks;
+	rotation_controller.motion.sensor_task = &tasks[TOUCH_TASK];
+	elevation_controller.motion.sensor_task = &tasks[COLOR_TASK];
+	color_reading.task = &tasks[COLOR_TASK];
+
+	// Difusion de la finalizacion a las tareas periodicas
+	CHK(periodic_shutdown_init());
+
+	// Volcado de estadisticas de las tareas bajo demanda (kill -USR1)
+	CHK(task_stats_signal_init());
+
+	// Inicializa algunas variables globales
+	publish_motors_status(ROTATE_STOP, ELEVATE_STOP, INACTIVE, 0);
+	atomic_store_explicit(&axis_setpoint.enabled,
+			cartesian_state.enabled || program_state.mode == PROGRAM_REPEAT || job_state.enabled,
+			memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.active, false, memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.claw_presses, 0, memory_order_relaxed);
+	atomic_store_explicit(&claw_used.status, false, memory_order_relaxed);
+	atomic_store_explicit(&color_reading.requested, false, memory_order_relaxed);
+
+	// Barrido de la gravedad: cuenta como una correccion hasta que termina
+	pthread_t th_sweeper;
+	pthread_attr_t th_sweeper_attr;
+	struct sched_param sch_param_sweeper;
+
+	CHK(pthread_attr_init(&th_sweeper_attr));
+	CHK(pthread_attr_setinheritsched(&th_sweeper_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_sweeper_attr, SCHED_FIFO));
+	sch_param_sweeper.sched_priority = sched_get_priority_max(SCHED_FIFO) - 5; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_sweeper_attr, &sch_param_sweeper));
+	CHK(pthread_attr_setdetachstate (&th_sweeper_attr, PTHREAD_CREATE_JOINABLE));
+
+	bool sweep_started = atomic_load_explicit(&gravity_sweeper.active, memory_order_relaxed);
+	if (sweep_started) {
+		atomic_fetch_add_explicit(&correction.corrections_in_progress, 1, memory_order_relaxed);
+		CHK(timebase_thread_create(&th_sweeper, &th_sweeper_attr, elevation_gravity_sweeper, &gravity_sweeper));
+		printf("Gravity sweep: after the initialization\n");
+	} else {
+		printf("Gravity sweep: skipped, table from the calibration\n");
+	}
+
+	executive_mark_t start_mark;
+	executive_mark(&start_mark);
+
+#ifdef CYCLIC_EXECUTIVE
+	// Todas las tareas desde el hilo principal con una tabla estatica
+	struct sched_param sch_param_executive;
+	sch_param_executive.sched_priority = sched_get_priority_max(SCHED_FIFO) - 5; // Max = 99
+	CHK(pthread_setschedparam(pthread_self(), SCHED_FIFO, &sch_param_executive));
+
+	executive_stats_t executive_stats;
+	int executive_error = cyclic_executive(tasks, N_TASKS, &executive_stats);
+	if (executive_error == ETIMEDOUT) {
+		// Se aparca como con BACK
+		printf("Cyclic executive stopped after %d consecutive overruns.\n", EXECUTIVE_MAX_OVERRUNS);
+		if (!is_close_pressed()) {
+			timebase_now(&close_condition.time);
+			atomic_store_explicit(&close_condition.close, true, memory_order_release);
+		}
+	} else {
+		CHK(executive_error);
+	}
+
+	printf("Cyclic executive: minor frame %ld ms, major frame %ld ms, %lu frames, "
+			"%lu overruns (%lu frames missed), max frame jitter %.3f ms\n",
+			executive_stats.minor_frame / 1000000, executive_stats.major_frame / 1000000,
+			executive_stats.frames, executive_stats.overruns, executive_stats.missed_frames,
+			executive_stats.max_frame_jitter_ns / 1e6);
+#else
+	// Prepare thread attributes
+	pthread_t th_servo, th_program, th_job, th_cartesian, th_rotation, th_elevation, th_claw, th_buttons, th_executor,
+		th_color_sensor, th_touch_sensor, th_leds, th_reporter;
+	pthread_attr_t th_servo_attr, th_program_attr, th_job_attr, th_cartesian_attr, th_rotation_attr, th_elevation_attr,
+		th_claw_attr, th_buttons_attr, th_executor_attr, th_color_sensor_attr, th_touch_sensor_attr, th_leds_attr,
+		th_reporter_attr;
+
+	CHK(pthread_attr_init(&th_servo_attr));
+	CHK(pthread_attr_setinheritsched(&th_servo_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_servo_attr, SCHED_FIFO));
+	struct sched_param sch_param_servo;
+	sch_param_servo.sched_priority = sched_get_priority_max(SCHED_FIFO) - 5; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_servo_attr, &sch_param_servo));
+	CHK(pthread_attr_setdetachstate (&th_servo_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_buttons_attr));
+	CHK(pthread_attr_setinheritsched(&th_buttons_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_buttons_attr, SCHED_FIFO));
+	struct sched_param sch_param_buttons;
+	sch_param_buttons.sched_priority = sched_get_priority_max(SCHED_FIFO) - 5; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_buttons_attr, &sch_param_buttons));
+	CHK(pthread_attr_setdetachstate (&th_buttons_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_color_sensor_attr));
+	CHK(pthread_attr_setinheritsched(&th_color_sensor_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_color_sensor_attr, SCHED_FIFO));
+	struct sched_param sch_param_color_sensor;
+	sch_param_color_sensor.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_color_sensor_attr, &sch_param_color_sensor));
+	CHK(pthread_attr_setdetachstate (&th_color_sensor_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_touch_sensor_attr));
+	CHK(pthread_attr_setinheritsched(&th_touch_sensor_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_touch_sensor_attr, SCHED_FIFO));
+	struct sched_param sch_param_touch_sensor;
+	sch_param_touch_sensor.sched_priority = sched_get_priority_max(SCHED_FIFO) - 15; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_touch_sensor_attr, &sch_param_touch_sensor));
+	CHK(pthread_attr_setdetachstate (&th_touch_sensor_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_program_attr));
+	CHK(pthread_attr_setinheritsched(&th_program_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_program_attr, SCHED_FIFO));
+	struct sched_param sch_param_program;
+	sch_param_program.sched_priority = sched_get_priority_max(SCHED_FIFO) - 20; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_program_attr, &sch_param_program));
+	CHK(pthread_attr_setdetachstate (&th_program_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_job_attr));
+	CHK(pthread_attr_setinheritsched(&th_job_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_job_attr, SCHED_FIFO));
+	struct sched_param sch_param_job;
+	sch_param_job.sched_priority = sched_get_priority_max(SCHED_FIFO) - 20; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_job_attr, &sch_param_job));
+	CHK(pthread_attr_setdetachstate (&th_job_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_cartesian_attr));
+	CHK(pthread_attr_setinheritsched(&th_cartesian_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_cartesian_attr, SCHED_FIFO));
+	struct sched_param sch_param_cartesian;
+	sch_param_cartesian.sched_priority = sched_get_priority_max(SCHED_FIFO) - 20; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_cartesian_attr, &sch_param_cartesian));
+	CHK(pthread_attr_setdetachstate (&th_cartesian_attr, PTHREAD_CREATE_JOINABLE));
+
+	CHK(pthread_attr_init(&th_rotation_attr));
+	CHK(pthread_attr_setinheritsched(&th_rotation_attr, PTHREAD_EXPLICIT_SCHED));
 	CHK(pthread_attr_setschedpolicy(&th_rotation_attr, SCHED_FIFO));
 	struct sched_param sch_param_rotation;
 	sch_param_rotation.sched_priority = sched_get_priority_max(SCHED_FIFO) - 20; // Max = 99
@@ -528,10 +1854,20 @@ int main(void) {
 	CHK(pthread_attr_setinheritsched(&th_claw_attr, PTHREAD_EXPLICIT_SCHED));
 	CHK(pthread_attr_setschedpolicy(&th_claw_attr, SCHED_FIFO));
 	struct sched_param sch_param_claw;
-	sch_param_claw.sched_priority = sched_get_priority_max(SCHED_FIFO) - 25; // Max = 99
+	sch_param_claw.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10; // Max = 99
 	CHK(pthread_attr_setschedparam(&th_claw_attr, &sch_param_claw));
 	CHK(pthread_attr_setdetachstate (&th_claw_attr, PTHREAD_CREATE_JOINABLE));
 
+	// La planificacion va por delante de la ejecucion: el ejecutor no necesita
+	// adelantarse a los ejes
+	CHK(pthread_attr_init(&th_executor_attr));
+	CHK(pthread_attr_setinheritsched(&th_executor_attr, PTHREAD_EXPLICIT_SCHED));
+	CHK(pthread_attr_setschedpolicy(&th_executor_attr, SCHED_FIFO));
+	struct sched_param sch_param_executor;
+	sch_param_executor.sched_priority = sched_get_priority_max(SCHED_FIFO) - 30; // Max = 99
+	CHK(pthread_attr_setschedparam(&th_executor_attr, &sch_param_executor));
+	CHK(pthread_attr_setdetachstate (&th_executor_attr, PTHREAD_CREATE_JOINABLE));
+
 	CHK(pthread_attr_init(&th_leds_attr));
 	CHK(pthread_attr_setinheritsched(&th_leds_attr, PTHREAD_EXPLICIT_SCHED));
 	CHK(pthread_attr_setschedpolicy(&th_leds_attr, SCHED_FIFO));
@@ -548,111 +1884,209 @@ int main(void) {
 	CHK(pthread_attr_setschedparam(&th_reporter_attr, &sch_param_reporter));
 	CHK(pthread_attr_setdetachstate (&th_reporter_attr, PTHREAD_CREATE_JOINABLE));
 
-	// Inicializa mutex
-	pthread_mutexattr_t top_attr, clock_attr, close_attr, motor_attr, correction_attr, claw_attr;
-
-	CHK(pthread_mutexattr_init(&top_attr));
-	CHK(pthread_mutexattr_setprotocol(&top_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&top_limit.top_mutex, &top_attr));
-
-	CHK(pthread_mutexattr_init(&clock_attr));
-	CHK(pthread_mutexattr_setprotocol(&clock_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&clockwise_limit.clockwise_mutex, &clock_attr));
-
-	CHK(pthread_mutexattr_init(&close_attr));
-	CHK(pthread_mutexattr_setprotocol(&close_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&close_condition.close_mutex, &close_attr));
-
-	CHK(pthread_mutexattr_init(&motor_attr));
-	CHK(pthread_mutexattr_setprotocol(&motor_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&new_motors_status.mutex, &motor_attr));
-
-	CHK(pthread_mutexattr_init(&correction_attr));
-	CHK(pthread_mutexattr_setprotocol(&correction_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&correction.correction_mutex, &correction_attr));
-
-	CHK(pthread_mutexattr_init(&claw_attr));
-	CHK(pthread_mutexattr_setprotocol(&claw_attr, PTHREAD_PRIO_NONE))
-	CHK(pthread_mutex_init(&claw_used.claw_used_mutex, &claw_attr));
-
-	// Inicializa algunas variables globales
-	new_motors_status.claw = INACTIVE;
-	new_motors_status.elevation = ELEVATE_STOP;
-	new_motors_status.rotation = ROTATE_STOP;
-	claw_used.status = false;
-
 	// Create threads
-	CHK(pthread_create(&th_buttons, &th_buttons_attr, buttons_controller, (void *) NULL));
-	CHK(pthread_create(&th_color_sensor, &th_color_sensor_attr, color_sensor_controller,
-			(void *) &color_sensor));
-	CHK(pthread_create(&th_touch_sensor, &th_touch_sensor_attr, touch_sensor_controller,
-			(void *) &touch_sensor));
-	CHK(pthread_create(&th_rotation, &th_rotation_attr, rotation_motor_controller,
-			(void *) &rotation_motor));
-	CHK(pthread_create(&th_elevation, &th_elevation_attr, elevation_motor_controller,
-			(void *) &elevation_motor));
-	CHK(pthread_create(&th_claw, &th_claw_attr, claw_motor_controller,
-			(void *) &claw_motor));
-	CHK(pthread_create(&th_leds, &th_leds_attr, leds_controller, (void *) NULL));
-	CHK(pthread_create(&th_reporter, &th_reporter_attr, reporter, (void *) NULL));
+	CHK(timebase_thread_create(&th_servo, &th_servo_attr, task_thread, &tasks[SERVO_TASK]));
+	if (buttons_state.input.fd >= 0) {
+		CHK(timebase_thread_create(&th_buttons, &th_buttons_attr, buttons_event_thread,
+				&tasks[BUTTONS_TASK]));
+	} else {
+		CHK(timebase_thread_create(&th_buttons, &th_buttons_attr, task_thread, &tasks[BUTTONS_TASK]));
+	}
+	CHK(timebase_thread_create(&th_color_sensor, &th_color_sensor_attr, task_thread,
+			&tasks[COLOR_TASK]));
+	CHK(timebase_thread_create(&th_touch_sensor, &th_touch_sensor_attr, task_thread,
+			&tasks[TOUCH_TASK]));
+	CHK(timebase_thread_create(&th_program, &th_program_attr, task_thread,
+			&tasks[PROGRAM_TASK]));
+	CHK(timebase_thread_create(&th_job, &th_job_attr, task_thread, &tasks[JOB_TASK]));
+	CHK(timebase_thread_create(&th_executor, &th_executor_attr, task_thread, &tasks[EXECUTOR_TASK]));
+	CHK(timebase_thread_create(&th_cartesian, &th_cartesian_attr, task_thread,
+			&tasks[CARTESIAN_TASK]));
+	CHK(timebase_thread_create(&th_rotation, &th_rotation_attr, task_thread,
+			&tasks[ROTATION_TASK]));
+	CHK(timebase_thread_create(&th_elevation, &th_elevation_attr, task_thread,
+			&tasks[ELEVATION_TASK]));
+	CHK(timebase_thread_create(&th_claw, &th_claw_attr, task_thread,
+			&tasks[CLAW_TASK]));
+	CHK(timebase_thread_create(&th_leds, &th_leds_attr, task_thread, &tasks[LEDS_TASK]));
+	CHK(timebase_thread_create(&th_reporter, &th_reporter_attr, task_thread, &tasks[REPORTER_TASK]));
 
 	// Finalizacion ordenada
-	CHK(pthread_join(th_buttons, NULL));
-	CHK(pthread_join(th_color_sensor, NULL));
-	CHK(pthread_join(th_touch_sensor, NULL));
-	CHK(pthread_join(th_rotation, NULL));
-	CHK(pthread_join(th_elevation, NULL));
-	CHK(pthread_join(th_claw, NULL));
-	CHK(pthread_join(th_leds, NULL));
-	CHK(pthread_join(th_reporter, NULL));
-
-	// Destruye atributos y mutex
+	CHK(timebase_thread_join(th_servo));
+	CHK(timebase_thread_join(th_buttons));
+	CHK(timebase_thread_join(th_color_sensor));
+	CHK(timebase_thread_join(th_touch_sensor));
+	CHK(timebase_thread_join(th_program));
+	CHK(timebase_thread_join(th_job));
+	CHK(timebase_thread_join(th_executor));
+	CHK(timebase_thread_join(th_cartesian));
+	CHK(timebase_thread_join(th_rotation));
+	CHK(timebase_thread_join(th_elevation));
+	CHK(timebase_thread_join(th_claw));
+	CHK(timebase_thread_join(th_leds));
+	CHK(timebase_thread_join(th_reporter));
+
+	// Destruye atributos
+	CHK(pthread_attr_destroy(&th_servo_attr));
 	CHK(pthread_attr_destroy(&th_buttons_attr));
 	CHK(pthread_attr_destroy(&th_color_sensor_attr));
 	CHK(pthread_attr_destroy(&th_touch_sensor_attr));
+	CHK(pthread_attr_destroy(&th_program_attr));
+	CHK(pthread_attr_destroy(&th_job_attr));
+	CHK(pthread_attr_destroy(&th_executor_attr));
+	CHK(pthread_attr_destroy(&th_cartesian_attr));
 	CHK(pthread_attr_destroy(&th_rotation_attr));
 	CHK(pthread_attr_destroy(&th_elevation_attr));
 	CHK(pthread_attr_destroy(&th_claw_attr));
 	CHK(pthread_attr_destroy(&th_leds_attr));
 	CHK(pthread_attr_destroy(&th_reporter_attr));
+#endif
 
-	CHK(pthread_mutex_destroy(&top_limit.top_mutex));
-	CHK(pthread_mutex_destroy(&clockwise_limit.clockwise_mutex));
-	CHK(pthread_mutex_destroy(&close_condition.close_mutex));
-	CHK(pthread_mutex_destroy(&new_motors_status.mutex));
-	CHK(pthread_mutex_destroy(&correction.correction_mutex));
-	CHK(pthread_mutex_destroy(&claw_used.claw_used_mutex));
-
-	CHK(pthread_mutexattr_destroy(&top_attr));
-	CHK(pthread_mutexattr_destroy(&clock_attr));
-	CHK(pthread_mutexattr_destroy(&close_attr));
-	CHK(pthread_mutexattr_destroy(&motor_attr));
-	CHK(pthread_mutexattr_destroy(&correction_attr));
-	CHK(pthread_mutexattr_destroy(&claw_attr));
+	// Un barrido en curso termina antes de aparcar: sin la tabla la elevacion puede
+	// quedarse fuera de la tolerancia del aparcado
+	if (sweep_started) {
+		CHK(timebase_thread_join(th_sweeper));
+	}
+	CHK(pthread_attr_destroy(&th_sweeper_attr));
 
-	// Move to initial position
-	ev3_set_position_sp (rotation_motor, 0);
-	ev3_command_motor_by_name (rotation_motor, COMMANDS_STRING[RUN_ABS_POS]);
-	usleep (SUSPENSION_TIME);
-	while ((ev3_motor_state (rotation_motor) & MOTOR_RUNNING)) {
-		usleep(CHECK_STATE_TIME);
+	// Terminado durante una lectura del color: el sensor vuelve a la luz reflejada
+	if (color_state.color_mode) {
+		ev3_mode_sensor(color_sensor, COL_REFLECT);
 	}
 
-	ev3_set_position_sp (elevation_motor, 0);
-	ev3_command_motor_by_name (elevation_motor, COMMANDS_STRING[RUN_ABS_POS]);
-	usleep (SUSPENSION_TIME);
-	while ((ev3_motor_state (elevation_motor) & MOTOR_RUNNING)) {
-		usleep(CHECK_STATE_TIME);
+	// Latencia desde la pulsacion de BACK hasta el aparcado
+	struct timespec park_time;
+	timebase_now(&park_time);
+	printf("Shutdown latency (BACK -> park): %.1f ms\n",
+			(park_time.tv_sec - close_condition.time.tv_sec) * 1e3 +
+			(park_time.tv_nsec - close_condition.time.tv_nsec) / 1e6);
+
+	// Uso de CPU y estadisticas de temporizacion de las tareas
+	executive_report(tasks, N_TASKS, &start_mark);
+	lcd_print_stats(&lcd);
+	timebase_print_stats();
+
+	// Move to initial position: los tres ejes a la vez
+	sysfs_motor_t *park_ios[PARK_MOTORS] = { &rotation_io, &elevation_io, &claw_io };
+	axis_motion_t *park_motions[PARK_MOTORS] = { &rotation_controller.motion,
+			&elevation_controller.motion, &claw_motion };
+	const int32_t park_targets[PARK_MOTORS] = { 0, 0, 0 };
+	joint_move_report_t park_report;
+	struct timespec parked_time;
+	int park_timeouts = joint_move(park_ios, park_motions, park_targets, PARK_MOTORS, &servo_state,
+			&park_report);
+	timebase_now(&parked_time);
+	printf("Park time: %.1f ms, shutdown (BACK -> parked): %.1f ms\n",
+			(parked_time.tv_sec - park_time.tv_sec) * 1e3 +
+			(parked_time.tv_nsec - park_time.tv_nsec) / 1e6,
+			(parked_time.tv_sec - close_condition.time.tv_sec) * 1e3 +
+			(parked_time.tv_nsec - close_condition.time.tv_nsec) / 1e6);
+
+	// Calibracion para el siguiente arranque, solo si el brazo ha quedado aparcado
+	if (park_timeouts == 0) {
+		calibration.position[CALIBRATION_ROTATION] = sysfs_get_position(&rotation_io);
+		calibration.position[CALIBRATION_ELEVATION] = sysfs_get_position(&elevation_io);
+		calibration.position[CALIBRATION_CLAW] = sysfs_get_position(&claw_io);
+		calibration.touch = sysfs_update_sensor_val(&touch_io);
+		calibration.reflection = sysfs_update_sensor_val(&color_io);
+		calibration_store_gravity(&calibration, &gravity);
+		int error = calibration_save(&calibration, true);
+		if (error != 0) {
+			printf("Warning: calibration not saved (%s).\n", strerror(error));
+		}
+	} else {
+		printf("Warning: arm not parked, calibration not saved.\n");
 	}
 
-	ev3_set_position_sp (claw_motor, 0);
-	ev3_command_motor_by_name (claw_motor, COMMANDS_STRING[RUN_ABS_POS]);
-	usleep (SUSPENSION_TIME);
-	while ((ev3_motor_state (claw_motor) & MOTOR_RUNNING)) {
-		usleep(CHECK_STATE_TIME);
+	// Llegada de los ejes al aparcar
+	joint_move_print("Park", &park_report);
+	claw_grip_print(&claw_controller.grip);
+	motion_stats_print("Rotation corrections", &rotation_controller.motion.stats);
+	motion_stats_print("Elevation corrections", &elevation_controller.motion.stats);
+	printf("Soft limits: rotation [%d, %d] max overshoot %d deg, elevation [%d, %d] max overshoot %d deg\n",
+			ROTATION_SOFT_MIN, ROTATION_SOFT_MAX, rotation_controller.motion.overshoot,
+			ELEVATION_SOFT_MIN, ELEVATION_SOFT_MAX, elevation_controller.motion.overshoot);
+	if (gravity_sweeper.error == ECANCELED) {
+		printf("Gravity sweep: cancelled at the top limit after %.3f s, elevation without gravity compensation\n",
+				gravity_sweeper.sweep_ns / 1e9);
+	} else if (gravity_sweeper.error != 0) {
+		printf("Warning: gravity sweep incomplete, elevation without gravity compensation.\n");
+	} else if (gravity_sweeper.sweep_ns > 0) {
+		printf("Gravity sweep: %.3f s\n", gravity_sweeper.sweep_ns / 1e9);
+	}
+	gravity_print(&gravity);
+	if (servo_state.enabled) {
+		pid_stats_print("Rotation tracking", &rotation_controller.motion.servo_error);
+		pid_stats_print("Elevation tracking", &elevation_controller.motion.servo_error);
+		pid_stats_print("Claw tracking", &claw_motion.servo_error);
+	}
+	if (servo_state.log != NULL) {
+		fclose(servo_state.log);
+	}
+	if (cartesian_state.enabled) {
+		printf("Cartesian jog: %lu solves, %lu out of reach\n", cartesian_state.solves,
+				cartesian_state.clamped);
+	}
+	if (program_state.mode == PROGRAM_TEACH) {
+		int error = program_save(&program);
+		if (error != 0) {
+			printf("Warning: program not saved (%s).\n", strerror(error));
+		} else {
+			printf("Program: %d waypoints recorded (%zu bytes), %lu dropped\n", program.n_waypoints,
+					program_size(&program), program_state.dropped);
+		}
+	} else if (program_state.mode == PROGRAM_REPEAT) {
+		printf("Playback: %lu cycles, cycle %.1f ms mean, motion planned blended %.1f ms vs "
+				"stopping at every waypoint %.1f ms\n", program_state.cycles,
+				(program_state.cycles > 0) ? program_state.cycle_total_ns / 1e6 / program_state.cycles : 0.0,
+				program_state.blended_s * 1e3, program_state.stop_s * 1e3);
+	}
+	if (job_state.enabled) {
+		if (job_state.aborted && job_state.aborted_opcode == JOB_WAIT_COLOR) {
+			printf("Error: job aborted, wait-color %d not read in %d ms.\n", job_state.aborted_color,
+					JOB_COLOR_TIMEOUT);
+		} else if (job_state.aborted) {
+			printf("Error: job aborted, read-color without a reading in %d ms.\n", JOB_COLOR_TIMEOUT);
+		}
+		printf("Job: %s, %lu steps in %.1f s, %lu loop iterations, %lu replans, %lu clamped, %lu timeouts\n",
+				job_state.done ? "completed" : (job_state.aborted ? "aborted" : "stopped"), job_state.steps,
+				(job_state.steps > 0) ? (job_state.last_end.tv_sec - job_state.job_start.tv_sec) +
+				(job_state.last_end.tv_nsec - job_state.job_start.tv_nsec) / 1e9 : 0.0,
+				job_state.cursor.iterations, job_state.replans, job_state.clamped, job_state.timeouts);
+		printf("Job pipeline: %lu moves planned, %.1f us mean / %.1f us max CPU, %lu underruns, "
+				"idle between steps %.1f ms total / %.1f ms max\n", job_state.plans,
+				(job_state.plans > 0) ? job_state.plan_total_ns / 1e3 / job_state.plans : 0.0,
+				job_state.plan_max_ns / 1e3, job_state.underruns, job_state.idle_total_ns / 1e6,
+				job_state.idle_max_ns / 1e6);
 	}
+	if (job_state.color_reads > 0) {
+		unsigned long sorted = 0;
+		double job_s = (job_state.last_end.tv_sec - job_state.job_start.tv_sec) +
+				(job_state.last_end.tv_nsec - job_state.job_start.tv_nsec) / 1e9;
+		printf("Sorting: %lu color reads, %.0f ms mean / %.0f ms max, bins", job_state.color_reads,
+				job_state.color_wait_total_ns / 1e6 / job_state.color_reads, job_state.color_wait_max_ns / 1e6);
+		for (int color = 0; color < JOB_COLORS; color++) {
+			if (job_state.sorted[color] > 0) {
+				printf(" %d:%lu", color, job_state.sorted[color]);
+			}
+			sorted += job_state.sorted[color];
+		}
+		printf(", %lu objects, %.1f objects/min, %lu moves planned at start\n", sorted,
+				(job_s > 0.0) ? sorted * 60.0 / job_s : 0.0, job_state.deferred_plans);
+	}
+	sensor_sampling_print("Touch sensor", &touch_state.sampling);
+	sensor_sampling_print("Color sensor", &color_state.sampling);
+	printf("Color sensor: %lu color reads, %lu postponed, %lu settling, %lu blind rises\n", color_state.color_reads,
+			color_state.postponed, color_state.settling, color_state.blind_rises);
 
 	// Finaliza
+	periodic_shutdown_close();
+	sysfs_close_motor(&rotation_io);
+	sysfs_close_motor(&elevation_io);
+	sysfs_close_motor(&claw_io);
+	sysfs_close_sensor(&touch_io);
+	sysfs_close_sensor(&color_io);
+	buttons_input_close(&buttons_state.input);
 	ev3_reset_motor(rotation_motor);
 	ev3_reset_motor(elevation_motor);
 	ev3_reset_motor(claw_motor);
@@ -662,499 +2096,1717 @@ int main(void) {
 	ev3_close_sensor(touch_sensor);
 	ev3_quit_button();
 	ev3_quit_led();
+	lcd_sprite_free(&reporter_state.title);
+	lcd_sprite_free(&reporter_state.claw_closed);
+	lcd_sprite_free(&reporter_state.claw_open);
+	lcd_close(&lcd);
 	ev3_clear_lcd();
 	ev3_quit_lcd();
 
-	return EXIT_SUCCESS;
+	return job_state.aborted ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 bool is_close_pressed() {
-	bool close_pressed;
-	pthread_mutex_lock(&close_condition.close_mutex);
-	close_pressed = close_condition.close;
-	pthread_mutex_unlock(&close_condition.close_mutex);
-	return close_pressed;
+	return atomic_load_explicit(&close_condition.close, memory_order_acquire);
 }
 
 bool is_clockwise_limit_reached() {
-	pthread_mutex_lock(&clockwise_limit.clockwise_mutex);
-	bool limit_reached = clockwise_limit.clockwise_limit_reached;
-	pthread_mutex_unlock(&clockwise_limit.clockwise_mutex);
-	return limit_reached;
+	return atomic_load_explicit(&clockwise_limit.clockwise_limit_reached, memory_order_acquire);
 }
 
 bool is_top_limit_reached() {
-	bool limit_reached;
-	pthread_mutex_lock(&top_limit.top_mutex);
-	limit_reached = top_limit.top_limit_reached;
-	pthread_mutex_unlock(&top_limit.top_mutex);
-	return limit_reached;
+	return atomic_load_explicit(&top_limit.top_limit_reached, memory_order_acquire);
 }
 
+void publish_motors_status(actions_rotation rotation, actions_elevation elevation, actions_claw claw,
+		unsigned int claw_presses) {
+	unsigned int sequence = atomic_load_explicit(&new_motors_status.sequence, memory_order_relaxed);
 
-void* rotation_motor_initializer(void *params) {
-	rotation_init_params_t *rot_params = (rotation_init_params_t *) params;
-	struct timespec next_time;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
+	// Secuencia impar: escritura en curso
+	atomic_store_explicit(&new_motors_status.sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
 
-	ev3_stop_action_motor_by_name(rot_params->rotation_motor, STOP_MODE_STRING[HOLD]);
-	ev3_set_duty_cycle_sp(rot_params->rotation_motor, ROTATION_POWER);
-	ev3_command_motor_by_name(rot_params->rotation_motor, COMMANDS_STRING[RUN_DIRECT]);
+	atomic_store_explicit(&new_motors_status.rotation, rotation, memory_order_relaxed);
+	atomic_store_explicit(&new_motors_status.elevation, elevation, memory_order_relaxed);
+	atomic_store_explicit(&new_motors_status.claw, claw, memory_order_relaxed);
+	atomic_store_explicit(&new_motors_status.claw_presses, claw_presses, memory_order_relaxed);
 
-	int touch_data;
+	atomic_store_explicit(&new_motors_status.sequence, sequence + 2, memory_order_release);
+}
 
-	// Rota hasta alcanzar sensor
+void read_motors_status(motors_status_snapshot_t *snapshot) {
+	unsigned int begin, end;
 	do {
-		ev3_update_sensor_val(rot_params->touch_sensor);
-		touch_data = rot_params->touch_sensor->val_data[0].s32;
+		begin = atomic_load_explicit(&new_motors_status.sequence, memory_order_acquire);
+		snapshot->rotation = atomic_load_explicit(&new_motors_status.rotation, memory_order_relaxed);
+		snapshot->elevation = atomic_load_explicit(&new_motors_status.elevation, memory_order_relaxed);
+		snapshot->claw = atomic_load_explicit(&new_motors_status.claw, memory_order_relaxed);
+		snapshot->claw_presses = atomic_load_explicit(&new_motors_status.claw_presses,
+				memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		end = atomic_load_explicit(&new_motors_status.sequence, memory_order_relaxed);
+	} while ((begin & 1) || begin != end);
+	snapshot->sequence = begin;
+}
 
-		incr_timespec(&next_time, &rot_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while (touch_data == TOUCH_SENSOR_INACTIVE);
+void axis_set_speed(sysfs_motor_t *motor, axis_motion_t *motion, double speed, double feedback) {
+	double duty = 100.0 * speed / motion->full_speed + feedback;
+	if (motion->gravity != NULL) {
+		// Sin velocidad pedida, el rozamiento se vence en el sentido de la realimentacion
+		// si supera AXIS_FRICTION_DEADBAND (para no oscilar alrededor de la consigna)
+		double direction = (speed != 0.0 || fabs(feedback) < AXIS_FRICTION_DEADBAND) ? speed : feedback;
+		duty += gravity_duty(motion->gravity, sysfs_get_position(motor), direction);
+	}
+	int duty_cycle = (int) lround((duty > 100.0) ? 100.0 : (duty < -100.0) ? -100.0 : duty);
+	if (duty_cycle != motion->duty_cycle) {
+		sysfs_set_duty_cycle_sp(motor, duty_cycle);
+		motion->duty_cycle = duty_cycle;
+	}
+}
 
-	// Rotar 90º (aprox.) counterclockwise
-	ev3_set_speed_sp(rot_params->rotation_motor, (STEP_ROTATION_SPEED *
-			rot_params->rotation_motor->max_speed) / 100);
-	ev3_set_position_sp(rot_params->rotation_motor, ROTATION_INIT_UNITS);
-	ev3_command_motor_by_name(rot_params->rotation_motor, COMMANDS_STRING[RUN_REL_POS]);
-	usleep(SUSPENSION_TIME);
+double axis_govern(sysfs_motor_t *motor, axis_motion_t *motion, double speed) {
+	int32_t position = sysfs_get_position(motor);
+	int32_t beyond = (position > motion->soft_max) ? position - motion->soft_max : motion->soft_min - position;
+	if (beyond > motion->overshoot) {
+		motion->overshoot = beyond;
+	}
 
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	do {
-		incr_timespec(&next_time, &rot_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while ((ev3_motor_state (rot_params->rotation_motor) & MOTOR_RUNNING));
+	// Velocidad estimada con el encoder respecto a la pedida en la activacion anterior:
+	// si el eje va mas rapido de lo pedido se frena antes en la misma proporcion. Con
+	// ella se estima tambien la carga de la tabla de gravedad
+	double gain = 1.0;
+	double measured = (position - motion->last_position) / (MOTOR_PERIOD / 1e9);
+	if (fabs(motion->last_speed) >= SOFT_LIMIT_MIN_SPEED) {
+		gain = fmin(fmax(measured / motion->last_speed, 1.0), SOFT_LIMIT_MAX_GAIN);
+	}
+	if (motion->gravity != NULL) {
+		gravity_adapt(motion->gravity, position, 100.0 * motion->last_speed / motion->full_speed, measured);
+	}
+	motion->last_position = position;
+	motion->last_speed = 0.0;
+
+	double distance = (speed > 0.0) ? motion->soft_max - position : position - motion->soft_min;
+	if (speed != 0.0 && distance > 0.0) {
+		// v * T + v^2 / (2 a) = distance
+		double period = MOTOR_PERIOD / 1e9 + SOFT_LIMIT_LAG / 1e3, accel = motion->limits->max_accel;
+		double allowed = accel * (sqrt(period * period + 2.0 * distance / accel) - period) / gain;
+		motion->last_speed = (fabs(speed) > allowed) ? copysign(allowed, speed) : speed;
+	}
+	axis_publish_activity(motion, position, motion->last_speed);
+	return motion->last_speed;
+}
 
-	ev3_set_duty_cycle_sp(rot_params->rotation_motor, 0);
-	ev3_command_motor_by_name(rot_params->rotation_motor, COMMANDS_STRING[RUN_DIRECT]);
-	ev3_set_position(rot_params->rotation_motor, 0);
+void axis_publish_activity(axis_motion_t *motion, int32_t position, double speed) {
+	int current = (int) lround(speed);
+	atomic_store_explicit(&motion->activity_position, position, memory_order_relaxed);
+	int previous = atomic_exchange_explicit(&motion->activity_speed, current, memory_order_relaxed);
 
-	pthread_exit(NULL);
+	// Parado o en sentido contrario, el sensor puede estar durmiendo un periodo largo
+	if (motion->sensor_task != NULL && current != 0 && (previous == 0 || (previous > 0) != (current > 0))) {
+		task_wake(motion->sensor_task);
+	}
 }
 
-void* elevation_motor_initializer(void *params) {
-	elevation_init_params_t *elev_params = (elevation_init_params_t *) params;
+bool axis_jog(sysfs_motor_t *motor, axis_motion_t *motion, double speed) {
+	double ramp_speed = motion_ramp_step(&motion->jog, PROFILE_TYPE, motion->limits, speed,
+			MOTOR_PERIOD / 1e9);
+	double governed = axis_govern(motor, motion, ramp_speed);
+	if (governed != ramp_speed) {
+		motion->jog.speed = governed;
+		motion->jog.accel = 0.0;
+	}
+	axis_set_speed(motor, motion, governed, 0.0);
+	return governed != 0.0;
+}
+
+bool axis_follow_setpoint(sysfs_motor_t *motor, axis_motion_t *motion, atomic_int *target) {
+	if (!atomic_load_explicit(&axis_setpoint.active, memory_order_acquire)) {
+		motion->tracking = false;
+		return axis_jog(motor, motion, 0.0);
+	}
+
+	// Consigna dentro de los limites blandos
+	int32_t position_sp = atomic_load_explicit(target, memory_order_relaxed);
+	position_sp = (position_sp < motion->soft_min) ? motion->soft_min :
+			(position_sp > motion->soft_max) ? motion->soft_max : position_sp;
+	if (!motion->tracking) {
+		motion->target = sysfs_get_position(motor);
+		motion->tracking = true;
+	}
+	double speed = axis_govern(motor, motion, (position_sp - motion->target) / (MOTOR_PERIOD / 1e9));
+	axis_set_speed(motor, motion, speed, PROFILE_KP * (motion->target - sysfs_get_position(motor)));
+	motion->target = position_sp;
+
+	// Al soltar, la rampa frena desde la velocidad actual
+	motion->jog.speed = speed;
+	motion->jog.accel = 0.0;
+	return true;
+}
+
+void start_correction(sysfs_motor_t *motor, axis_motion_t *motion, int32_t target) {
+	atomic_fetch_add_explicit(&correction.corrections_in_progress, 1, memory_order_relaxed);
+	motion->jog.speed = 0.0;
+	motion->jog.accel = 0.0;
+	motion->tracking = false;
+	if (motion->servo) {
+		servo_start(motor, motion, target);
+	} else {
+		motion_profile_plan(&motion->profile, PROFILE_TYPE, motion->limits, sysfs_get_position(motor),
+				target);
+		motion->profile_end_ns = 0;
+		timebase_now(&motion->start);
+		axis_set_speed(motor, motion, 0.0, 0.0);
+	}
+	axis_publish_activity(motion, (int32_t) motion->profile.start,
+			copysign(motion->profile.peak_speed, motion->profile.target - motion->profile.start));
+}
+
+void servo_start(sysfs_motor_t *motor, axis_motion_t *motion, int32_t target) {
+	motion_profile_plan(&motion->profile, PROFILE_TYPE, motion->limits, sysfs_get_position(motor),
+			target);
+	motion->profile_end_ns = 0;
+	pid_reset(&motion->pid);
+	timebase_now(&motion->start);
+	axis_set_speed(motor, motion, 0.0, 0.0);
+	atomic_store_explicit(&motion->servo_active, true, memory_order_release);
+}
+
+double axis_servo(const servo_controller_t *servo, sysfs_motor_t *motor, axis_motion_t *motion,
+		long long elapsed_ns) {
+	double reference, speed;
+	bool saturated;
+
+	motion_profile_sample(&motion->profile, elapsed_ns / 1e9, &reference, &speed);
+	int32_t position = sysfs_get_position(motor);
+	double error = reference - position;
+	double duty = pid_update(&motion->pid, error, 100.0 * speed / motion->full_speed, servo->period / 1e9,
+			&saturated);
+	axis_set_speed(motor, motion, 0.0, duty);
+	pid_stats_record(&motion->servo_error, error, saturated);
+
+	if (servo->log != NULL) {
+		struct timespec now;
+		timebase_now(&now);
+		fprintf(servo->log, "%.3f,%s,%.2f,%d,%.2f,%d\n", (now.tv_sec - servo->log_start.tv_sec) * 1e3 +
+				(now.tv_nsec - servo->log_start.tv_nsec) / 1e6, motion->name, reference, position, error,
+				motion->duty_cycle);
+	}
+	return error;
+}
+
+bool axis_move_done(sysfs_motor_t *motor, axis_motion_t *motion, long long elapsed_ns, double error) {
+	if (elapsed_ns >= motion->profile.duration * 1e9 && motion->profile_end_ns == 0) {
+		motion->profile_end_ns = elapsed_ns;
+	}
+	if (motion->profile_end_ns != 0 && fabs(error) <= PROFILE_TOLERANCE) {
+		motion_stats_record(&motion->stats, motion->profile_end_ns, elapsed_ns - motion->profile_end_ns);
+		axis_set_speed(motor, motion, 0.0, 0.0);
+		return true;
+	}
+	if (elapsed_ns >= MOTION_TIMEOUT * 1000000LL) {
+		axis_set_speed(motor, motion, 0.0, 0.0);
+		return true;
+	}
+	return false;
+}
+
+double axis_track(sysfs_motor_t *motor, axis_motion_t *motion, long long elapsed_ns, long period_ns,
+		double kp) {
+	double reference, next_reference, speed;
+
+	// La potencia se mantiene hasta la siguiente consigna: se pide la velocidad
+	// media del perfil en ese intervalo
+	motion_profile_sample(&motion->profile, elapsed_ns / 1e9, &reference, &speed);
+	motion_profile_sample(&motion->profile, (elapsed_ns + period_ns) / 1e9, &next_reference, &speed);
+	speed = (next_reference - reference) / (period_ns / 1e9);
+	double error = reference - sysfs_get_position(motor);
+	axis_set_speed(motor, motion, speed, kp * error);
+	return error;
+}
+
+bool is_correction_finished(sysfs_motor_t *motor, axis_motion_t *motion) {
+	struct timespec now;
+
+	if (motion->servo) {
+		return !atomic_load_explicit(&motion->servo_active, memory_order_acquire);
+	}
+
+	timebase_now(&now);
+	long long elapsed_ns = (now.tv_sec - motion->start.tv_sec) * 1000000000LL +
+			(now.tv_nsec - motion->start.tv_nsec);
+	double error = axis_track(motor, motion, elapsed_ns, MOTOR_PERIOD, PROFILE_KP);
+	return axis_move_done(motor, motion, elapsed_ns, error);
+}
+
+void finish_correction(sysfs_motor_t *motor, axis_motion_t *motion) {
+	// El bucle de posicion ya ha dejado la potencia nula sin salir de run-direct
+	if (!motion->servo) {
+		sysfs_set_duty_cycle_sp(motor, 0);
+		motion->duty_cycle = 0;
+		sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	}
+	axis_publish_activity(motion, (int32_t) motion->profile.target, 0.0);
+	atomic_fetch_sub_explicit(&correction.corrections_in_progress, 1, memory_order_relaxed);
+}
+
+void servo_controller(void *param) {
+	servo_controller_t *servo = (servo_controller_t *) param;
+	struct timespec now;
+
+	if (!servo->enabled) {
+		return;
+	}
+	for (int i = 0; i < servo->n_axes; i++) {
+		sysfs_motor_t *motor = servo->motors[i];
+		axis_motion_t *motion = servo->motions[i];
+		if (!atomic_load_explicit(&motion->servo_active, memory_order_acquire)) {
+			continue;
+		}
+		timebase_now(&now);
+		long long elapsed_ns = (now.tv_sec - motion->start.tv_sec) * 1000000000LL +
+				(now.tv_nsec - motion->start.tv_nsec);
+		double error = axis_servo(servo, motor, motion, elapsed_ns);
+		if (axis_move_done(motor, motion, elapsed_ns, error)) {
+			atomic_store_explicit(&motion->servo_active, false, memory_order_release);
+		}
+	}
+}
+
+
+int32_t homing_approach(sysfs_motor_t *motor, int power, long period, bool (*limit)(void *),
+		void *device) {
 	struct timespec next_time;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
+	struct timespec sample_period = {0, period};
+	timebase_now(&next_time);
 
-	ev3_stop_action_motor_by_name (elev_params->elevation_motor, STOP_MODE_STRING[HOLD]);
-	ev3_set_duty_cycle_sp (elev_params->elevation_motor, ELEVATION_UP_POWER);
-	ev3_command_motor_by_name (elev_params->elevation_motor, COMMANDS_STRING[RUN_DIRECT]);
+	sysfs_set_duty_cycle_sp(motor, power);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+
+	while (!limit(device)) {
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+	}
+	return sysfs_get_position(motor);
+}
 
-	int reflection_data;
+void homing_move(sysfs_motor_t *motor, int units, bool stop) {
+	struct timespec next_time;
+	struct timespec sample_period = {0, HOMING_FAST_PERIOD};
+	int32_t target = sysfs_get_position(motor) + units;
+	int direction = (units > 0) ? 1 : -1;
+	int margin = stop ? HOMING_BRAKE_UNITS : 0;
+
+	timebase_now(&next_time);
+	sysfs_set_duty_cycle_sp(motor, direction * (stop ? HOMING_MOVE_POWER : HOMING_BACK_OFF_POWER));
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	while (direction * (target - sysfs_get_position(motor)) > margin) {
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+	}
+	if (!stop) {
+		return;
+	}
 
-	// Elevar hasta que se pasa el limite de REFLECTION_LIMIT
+	// Espera a que el hold lo detenga
+	sysfs_command_motor(motor, COMMANDS_STRING[STOP]);
+	int32_t position, last_position = sysfs_get_position(motor);
 	do {
-		ev3_update_sensor_val(elev_params->color_sensor);
-		reflection_data = elev_params->color_sensor->val_data[0].s32;
-		incr_timespec(&next_time, &elev_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while (reflection_data < REFLECTION_LIMIT);
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+		position = last_position;
+		last_position = sysfs_get_position(motor);
+	} while (abs(position - last_position) > HOMING_SETTLED_UNITS);
+}
 
-	// Lower 45º (aprox.)
-	ev3_set_speed_sp(elev_params->elevation_motor, (STEP_ELEVATION_SPEED *
-			elev_params->elevation_motor->max_speed) / 100);
-	ev3_set_position_sp(elev_params->elevation_motor, ELEVATION_INIT_UNITS);
-	ev3_command_motor_by_name(elev_params->elevation_motor, COMMANDS_STRING[RUN_REL_POS]);
-	usleep(SUSPENSION_TIME);
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
+void homing_set_origin(sysfs_motor_t *motor, const homing_report_t *report, int init_units) {
+	ev3_set_position(motor->motor, sysfs_get_position(motor) - (report->slow_limit_position + init_units));
+}
 
-	do {
-		incr_timespec(&next_time, &elev_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while ((ev3_motor_state (elev_params->elevation_motor) & MOTOR_RUNNING));
+int joint_move(sysfs_motor_t *motors[], axis_motion_t *motions[], const int32_t targets[], int n,
+		const servo_controller_t *servo, joint_move_report_t *report) {
+	motion_profile_t profiles[JOINT_MAX_AXES];
+	motion_limits_t limits[JOINT_MAX_AXES] = { 0 };
+	double start[JOINT_MAX_AXES] = { 0 }, target[JOINT_MAX_AXES] = { 0 };
+	bool arrived[JOINT_MAX_AXES];
+	struct timespec start_time, next_time, now;
+	struct timespec sample_period = {0, servo->enabled ? servo->period : JOINT_MOVE_PERIOD};
+
+	for (int i = 0; i < n; i++) {
+		limits[i] = *motions[i]->limits;
+		start[i] = sysfs_get_position(motors[i]);
+		target[i] = targets[i];
+	}
+	CHK(motion_profile_plan_sync(profiles, n, PROFILE_TYPE, limits, start, target));
+
+	// Un eje sin recorrido tiene un perfil de duracion nula
+	report->planned_ns = 0;
+	report->n_axes = n;
+	for (int i = 0; i < n; i++) {
+		if (profiles[i].duration * 1e9 > report->planned_ns) {
+			report->planned_ns = (long long) (profiles[i].duration * 1e9);
+		}
+		motions[i]->profile = profiles[i];
+		motions[i]->duty_cycle = 0;
+		pid_reset(&motions[i]->pid);
+		report->arrival_ns[i] = 0;
+		arrived[i] = false;
+		sysfs_set_duty_cycle_sp(motors[i], 0);
+		sysfs_command_motor(motors[i], COMMANDS_STRING[RUN_DIRECT]);
+	}
+
+	// Todos los ejes muestrean su perfil respecto al mismo instante de inicio
+	int pending = n;
+	timebase_now(&start_time);
+	next_time = start_time;
+	while (true) {
+		timebase_now(&now);
+		long long elapsed_ns = (now.tv_sec - start_time.tv_sec) * 1000000000LL +
+				(now.tv_nsec - start_time.tv_nsec);
+		for (int i = 0; i < n; i++) {
+			// Con el bucle de posicion los ejes que han llegado mantienen la posicion
+			if (arrived[i] && !servo->enabled) {
+				continue;
+			}
+			double error = servo->enabled ? axis_servo(servo, motors[i], motions[i], elapsed_ns) :
+					axis_track(motors[i], motions[i], elapsed_ns, JOINT_MOVE_PERIOD, JOINT_MOVE_KP);
+			if (!arrived[i] && elapsed_ns >= report->planned_ns && fabs(error) <= PROFILE_TOLERANCE) {
+				if (!servo->enabled) {
+					sysfs_command_motor(motors[i], COMMANDS_STRING[STOP]);
+				}
+				report->arrival_ns[i] = elapsed_ns;
+				arrived[i] = true;
+				pending--;
+			}
+		}
+		if (pending == 0 || elapsed_ns >= MOTION_TIMEOUT * 1000000LL) {
+			break;
+		}
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (servo->enabled) {
+			axis_set_speed(motors[i], motions[i], 0.0, 0.0);
+		} else if (!arrived[i]) {
+			sysfs_command_motor(motors[i], COMMANDS_STRING[STOP]);
+		}
+	}
+	return pending;
+}
+
+void joint_move_print(const char *name, const joint_move_report_t *report) {
+	long long first = report->arrival_ns[0], last = report->arrival_ns[0];
+	printf("%s: planned %.1f ms, arrival", name, report->planned_ns / 1e6);
+	for (int i = 0; i < report->n_axes; i++) {
+		printf(" %.1f", report->arrival_ns[i] / 1e6);
+		if (report->arrival_ns[i] < first) {
+			first = report->arrival_ns[i];
+		}
+		if (report->arrival_ns[i] > last) {
+			last = report->arrival_ns[i];
+		}
+	}
+	printf(" ms (spread %.1f ms)\n", (last - first) / 1e6);
+}
+
+int program_plan_stroke(const program_t *program, const motion_limits_t limits[], const double start[],
+		int next, bool claw_closed, motion_path_t *path, double *stop_s) {
+	double points[MOTION_PATH_MAX_POINTS][MOTION_PATH_MAX_AXES];
+	int n_points = 1, end = next;
+
+	points[0][0] = start[0];
+	points[0][1] = start[1];
+	for (int i = next; i < program->n_waypoints && n_points < MOTION_PATH_MAX_POINTS; i++) {
+		points[n_points][0] = program->waypoints[i].rotation;
+		points[n_points][1] = program->waypoints[i].elevation;
+		n_points++;
+		end = i;
+		if (program->waypoints[i].claw_closed != claw_closed) {
+			break;
+		}
+	}
+	CHK(motion_path_plan(path, MOTION_PATH_MAX_AXES, limits, points, n_points));
+
+	if (stop_s != NULL) {
+		motion_profile_t profiles[MOTION_PATH_MAX_AXES];
+		*stop_s = 0.0;
+		for (int i = 1; i < n_points; i++) {
+			CHK(motion_profile_plan_sync(profiles, MOTION_PATH_MAX_AXES, MOTION_TRAPEZOIDAL, limits,
+					points[i - 1], points[i]));
+			*stop_s += fmax(profiles[0].duration, profiles[1].duration);
+		}
+	}
+	return end;
+}
+
+void restore_motor_position(sysfs_motor_t *motor, int step_speed, int32_t position) {
+	ev3_stop_action_motor_by_name(motor->motor, STOP_MODE_STRING[HOLD]);
+	ev3_set_speed_sp(motor->motor, (step_speed * motor->motor->max_speed) / 100);
+	sysfs_set_duty_cycle_sp(motor, 0);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	ev3_set_position(motor->motor, position);
+}
+
+void homing_phase_end(homing_report_t *report, homing_phase phase) {
+	struct timespec now;
+	timebase_now(&now);
+	report->phase_ns[phase] = (now.tv_sec - report->phase_start.tv_sec) * 1000000000LL +
+			(now.tv_nsec - report->phase_start.tv_nsec);
+	report->phase_start = now;
+}
+
+void homing_print(const char *name, const homing_report_t *report) {
+	printf("Homing %s:", name);
+	for (int phase = 0; phase < HOMING_PHASES; phase++) {
+		printf(" %s %.3f s", HOMING_PHASE_STRING[phase], report->phase_ns[phase] / 1e9);
+	}
+	printf(" (limit at %d fast, %d slow)\n", report->fast_limit_position, report->slow_limit_position);
+}
+
+bool is_touch_limit(void *touch_sensor) {
+	return sysfs_update_sensor_val((sysfs_sensor_t *) touch_sensor) != TOUCH_SENSOR_INACTIVE;
+}
+
+bool is_reflection_limit(void *color_sensor) {
+	return sysfs_update_sensor_val((sysfs_sensor_t *) color_sensor) >= REFLECTION_LIMIT;
+}
+
+bool is_claw_stalled(void *claw_motor) {
+	return sysfs_motor_state((sysfs_motor_t *) claw_motor) == MOTOR_LIMIT;
+}
+
+void* rotation_motor_initializer(void *params) {
+	rotation_init_params_t *rot_params = (rotation_init_params_t *) params;
+	sysfs_motor_t *motor = rot_params->rotation_motor;
+	homing_report_t *homing = &rot_params->homing;
+	timebase_now(&homing->phase_start);
+
+	ev3_stop_action_motor_by_name(motor->motor, STOP_MODE_STRING[HOLD]);
+
+	// Rota rapido hasta alcanzar el sensor; el muestreo se ajusta a la velocidad
+	homing->fast_limit_position = homing_approach(motor, ROTATION_FAST_POWER, HOMING_FAST_PERIOD,
+			is_touch_limit, rot_params->touch_sensor);
+	homing_phase_end(homing, HOMING_FAST);
+
+	// Se separa del sensor y lo vuelve a buscar despacio: la posicion de deteccion
+	// depende de esta ultima aproximacion
+	homing_move(motor, ROTATION_BACK_OFF_UNITS, false);
+	homing_phase_end(homing, HOMING_BACK_OFF);
+	homing->slow_limit_position = homing_approach(motor, ROTATION_SLOW_POWER, HOMING_SLOW_PERIOD,
+			is_touch_limit, rot_params->touch_sensor);
+	homing_phase_end(homing, HOMING_SLOW);
+
+	// Rotar 90º (aprox.) counterclockwise
+	homing_move(motor, ROTATION_INIT_UNITS, true);
+	homing_phase_end(homing, HOMING_HOME);
+
+	ev3_set_speed_sp(motor->motor, (STEP_ROTATION_SPEED * motor->motor->max_speed) / 100);
+	sysfs_set_duty_cycle_sp(motor, 0);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	homing_set_origin(motor, homing, ROTATION_INIT_UNITS);
 
-	ev3_set_duty_cycle_sp(elev_params->elevation_motor, 0);
-	ev3_command_motor_by_name(elev_params->elevation_motor, COMMANDS_STRING[RUN_DIRECT]);
-	ev3_set_position(elev_params->elevation_motor, 0);
 	pthread_exit(NULL);
 }
 
-void* claw_motor_initializer(void* params) {
-	claw_init_params_t *claw_params = (claw_init_params_t *) params;
-	struct timespec next_time;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
+void* elevation_motor_initializer(void *params) {
+	elevation_init_params_t *elev_params = (elevation_init_params_t *) params;
+	sysfs_motor_t *motor = elev_params->elevation_motor;
+	homing_report_t *homing = &elev_params->homing;
+	timebase_now(&homing->phase_start);
+
+	ev3_stop_action_motor_by_name(motor->motor, STOP_MODE_STRING[HOLD]);
+
+	// Elevar hasta que se pasa el limite de REFLECTION_LIMIT, rapido y despues despacio
+	homing->fast_limit_position = homing_approach(motor, ELEVATION_FAST_UP_POWER, HOMING_FAST_PERIOD,
+			is_reflection_limit, elev_params->color_sensor);
+	homing_phase_end(homing, HOMING_FAST);
+	homing_move(motor, ELEVATION_BACK_OFF_UNITS, false);
+	homing_phase_end(homing, HOMING_BACK_OFF);
+	homing->slow_limit_position = homing_approach(motor, ELEVATION_SLOW_UP_POWER, HOMING_SLOW_PERIOD,
+			is_reflection_limit, elev_params->color_sensor);
+	homing_phase_end(homing, HOMING_SLOW);
 
-	ev3_stop_action_motor_by_name(claw_params->claw_motor, STOP_MODE_STRING[HOLD]);
-	ev3_set_duty_cycle_sp(claw_params->claw_motor, -CLAW_POWER);
-	ev3_command_motor_by_name(claw_params->claw_motor, COMMANDS_STRING[RUN_DIRECT]);
+	// Lower 45º (aprox.)
+	homing_move(motor, ELEVATION_INIT_UNITS, true);
+	homing_phase_end(homing, HOMING_HOME);
 
-	int claw_status;
+	ev3_set_speed_sp(motor->motor, (STEP_ELEVATION_SPEED * motor->motor->max_speed) / 100);
+	sysfs_set_duty_cycle_sp(motor, 0);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	homing_set_origin(motor, homing, ELEVATION_INIT_UNITS);
 
-	do {
-		claw_status = ev3_motor_state(claw_params->claw_motor);
-		incr_timespec(&next_time, &claw_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while (claw_status != MOTOR_LIMIT);
+	pthread_exit(NULL);
+}
 
-	ev3_set_speed_sp(claw_params->claw_motor, (STEP_CLAW_SPEED * claw_params->claw_motor->max_speed) / 100);
-	ev3_set_position_sp(claw_params->claw_motor, CLAW_INIT_UNITS);
-	ev3_command_motor_by_name(claw_params->claw_motor, COMMANDS_STRING[RUN_REL_POS]);
-	usleep(SUSPENSION_TIME);
+void* elevation_gravity_sweeper(void *params) {
+	gravity_sweeper_t *sweeper = (gravity_sweeper_t *) params;
+	sysfs_motor_t *motor = sweeper->elevation_motor;
+	struct timespec sweep_start, sweep_end;
+	gravity_sweep_t sweep;
+
+	timebase_now(&sweep_start);
+	gravity_sweep_init(&sweep, sweeper->gravity);
+	bool done = elevation_sweep(motor, NULL, ELEVATION_SOFT_MIN, &sweeper->cancel) &&
+			elevation_sweep(motor, &sweep, ELEVATION_SOFT_MAX, &sweeper->cancel) &&
+			elevation_sweep(motor, &sweep, ELEVATION_SOFT_MIN, &sweeper->cancel) &&
+			elevation_sweep(motor, NULL, 0, &sweeper->cancel);
+	sweeper->error = done ? gravity_build(sweeper->gravity, &sweep, ELEVATION_SWEEP_POWER) : ECANCELED;
+	sysfs_set_duty_cycle_sp(motor, 0);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	timebase_now(&sweep_end);
+	sweeper->sweep_ns = (sweep_end.tv_sec - sweep_start.tv_sec) * 1000000000LL +
+			(sweep_end.tv_nsec - sweep_start.tv_nsec);
+
+	// Sin la marca de finalizacion limpia, para que la tabla sobreviva a una
+	// finalizacion brusca
+	if (sweeper->error == 0) {
+		calibration_store_gravity(sweeper->calibration, sweeper->gravity);
+		int error = calibration_save(sweeper->calibration, false);
+		if (error != 0) {
+			printf("Warning: gravity table not saved (%s).\n", strerror(error));
+		}
+	}
 
+	atomic_fetch_sub_explicit(&correction.corrections_in_progress, 1, memory_order_relaxed);
+	atomic_store_explicit(&sweeper->active, false, memory_order_release);
+	pthread_exit(NULL);
+}
+
+bool elevation_sweep(sysfs_motor_t *motor, gravity_sweep_t *sweep, int32_t target, atomic_bool *cancel) {
+	struct timespec start_time, next_time;
+	struct timespec sample_period = {0, HOMING_FAST_PERIOD};
+	int32_t position = sysfs_get_position(motor), last_position;
+	int direction = (target > position) ? 1 : -1;
+
+	timebase_now(&start_time);
+	next_time = start_time;
+	sysfs_set_duty_cycle_sp(motor, direction * ELEVATION_SWEEP_POWER);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	while (direction * (target - position) > ELEVATION_SWEEP_BRAKE_UNITS &&
+			!atomic_load_explicit(cancel, memory_order_relaxed)) {
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+		last_position = position;
+		position = sysfs_get_position(motor);
+		long long elapsed_ns = (next_time.tv_sec - start_time.tv_sec) * 1000000000LL +
+				(next_time.tv_nsec - start_time.tv_nsec);
+		if (sweep != NULL && elapsed_ns > ELEVATION_SWEEP_SETTLE * 1000000LL) {
+			gravity_sweep_record(sweep, (position + last_position) / 2,
+					(position - last_position) / (HOMING_FAST_PERIOD / 1e9));
+		}
+	}
+
+	// Espera a que el hold lo detenga
+	sysfs_command_motor(motor, COMMANDS_STRING[STOP]);
 	do {
-		incr_timespec(&next_time, &claw_params->period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
-	} while ((ev3_motor_state (claw_params->claw_motor) & MOTOR_RUNNING));
+		incr_timespec(&next_time, &sample_period);
+		CHK(timebase_sleep_until(&next_time, false));
+		last_position = position;
+		position = sysfs_get_position(motor);
+	} while (abs(position - last_position) > HOMING_SETTLED_UNITS);
+	return !atomic_load_explicit(cancel, memory_order_relaxed);
+}
 
-	ev3_set_duty_cycle_sp(claw_params->claw_motor, 0);
-	ev3_command_motor_by_name(claw_params->claw_motor, COMMANDS_STRING[RUN_DIRECT]);
-	ev3_set_position(claw_params->claw_motor, 0);
+void* claw_motor_initializer(void* params) {
+	claw_init_params_t *claw_params = (claw_init_params_t *) params;
+	sysfs_motor_t *motor = claw_params->claw_motor;
+	homing_report_t *homing = &claw_params->homing;
+	timebase_now(&homing->phase_start);
+
+	ev3_stop_action_motor_by_name(motor->motor, STOP_MODE_STRING[HOLD]);
+
+	// Cierra hasta bloquear el motor, rapido y despues despacio
+	homing->fast_limit_position = homing_approach(motor, -CLAW_FAST_POWER, HOMING_FAST_PERIOD,
+			is_claw_stalled, motor);
+	homing_phase_end(homing, HOMING_FAST);
+	homing_move(motor, CLAW_BACK_OFF_UNITS, false);
+	homing_phase_end(homing, HOMING_BACK_OFF);
+	homing->slow_limit_position = homing_approach(motor, -CLAW_SLOW_POWER, HOMING_SLOW_PERIOD,
+			is_claw_stalled, motor);
+	homing_phase_end(homing, HOMING_SLOW);
+
+	homing_move(motor, CLAW_INIT_UNITS, true);
+	homing_phase_end(homing, HOMING_HOME);
+
+	ev3_set_speed_sp(motor->motor, (STEP_CLAW_SPEED * motor->motor->max_speed) / 100);
+	sysfs_set_duty_cycle_sp(motor, 0);
+	sysfs_command_motor(motor, COMMANDS_STRING[RUN_DIRECT]);
+	homing_set_origin(motor, homing, CLAW_INIT_UNITS);
 
 	pthread_exit(NULL);
 }
 
-void* buttons_controller(void *params) {
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = BUTTON_PERIOD;
-
-	while(!is_close_pressed()) {
-		pthread_mutex_lock(&new_motors_status.mutex);
-		// Rotation buttons
-		if (ev3_button_pressed(BUTTON_LEFT)) { // If left pressed
-			if (ev3_button_pressed(BUTTON_RIGHT)) { // And right at the same time
-				new_motors_status.rotation = ROTATE_STOP;
-			} else { // Only left
-				new_motors_status.rotation = ROTATE_LEFT;
+void buttons_controller(void *params) {
+	buttons_controller_t *controller = (buttons_controller_t *) params;
+	actions_rotation rotation;
+	actions_elevation elevation;
+	actions_claw claw;
+	unsigned int pressed;
+	unsigned int claw_presses;
+	unsigned int back_presses;
+
+	if (controller->input.fd >= 0) {
+		int edges = buttons_input_read(&controller->input);
+		if (edges < 0) {
+			buttons_fallback(controller);
+		} else if (edges == 0) {
+			return;
+		}
+	}
+	if (controller->input.fd >= 0) {
+		pressed = controller->input.pressed;
+		claw_presses = controller->input.presses[BUTTON_CENTER];
+		back_presses = controller->input.presses[BUTTON_BACK];
+	} else {
+		pressed = 0;
+		for (int button = 0; button < BUTTONS; button++) {
+			if (ev3_button_pressed(button)) {
+				pressed |= 1u << button;
 			}
-		} else if (ev3_button_pressed(BUTTON_RIGHT)) { // Only right
-				new_motors_status.rotation = ROTATE_RIGHT;
-		} else { // No button pressed
-			new_motors_status.rotation = ROTATE_STOP;
 		}
+		unsigned int edges = pressed & ~controller->previous;
+		if (edges & (1u << BUTTON_CENTER)) {
+			controller->claw_presses++;
+		}
+		if (edges & (1u << BUTTON_BACK)) {
+			controller->back_presses++;
+		}
+		controller->previous = pressed;
+		claw_presses = controller->claw_presses;
+		back_presses = controller->back_presses;
+	}
 
-		// Elevation buttons
-		if (ev3_button_pressed(BUTTON_UP)) {
-			if (ev3_button_pressed(BUTTON_DOWN)) {
-				new_motors_status.elevation = ELEVATE_STOP;
-			} else {
-				new_motors_status.elevation = RISE;
-			}
-		} else if (ev3_button_pressed(BUTTON_DOWN)) {
-			new_motors_status.elevation = LOWER;
-		} else {
-			new_motors_status.elevation = ELEVATE_STOP;
+	// Rotation buttons
+	if (pressed & (1u << BUTTON_LEFT)) { // If left pressed
+		if (pressed & (1u << BUTTON_RIGHT)) { // And right at the same time
+			rotation = ROTATE_STOP;
+		} else { // Only left
+			rotation = ROTATE_LEFT;
 		}
+	} else if (pressed & (1u << BUTTON_RIGHT)) { // Only right
+			rotation = ROTATE_RIGHT;
+	} else { // No button pressed
+		rotation = ROTATE_STOP;
+	}
 
-		// Claw button
-		if (ev3_button_pressed(BUTTON_CENTER)) {
-			new_motors_status.claw = ACTIVE;
+	// Elevation buttons
+	if (pressed & (1u << BUTTON_UP)) {
+		if (pressed & (1u << BUTTON_DOWN)) {
+			elevation = ELEVATE_STOP;
 		} else {
-			new_motors_status.claw = INACTIVE;
+			elevation = RISE;
 		}
+	} else if (pressed & (1u << BUTTON_DOWN)) {
+		elevation = LOWER;
+	} else {
+		elevation = ELEVATE_STOP;
+	}
+
+	// Claw button
+	if (pressed & (1u << BUTTON_CENTER)) {
+		claw = ACTIVE;
+	} else {
+		claw = INACTIVE;
+	}
 
-		pthread_mutex_unlock(&new_motors_status.mutex);
+	publish_motors_status(rotation, elevation, claw, claw_presses);
 
-		// Cancel button
-		pthread_mutex_lock(&close_condition.close_mutex);
-		if (ev3_button_pressed(BUTTON_BACK)) {
-			close_condition.close = true;
-		}
-		pthread_mutex_unlock(&close_condition.close_mutex);
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+	// Cancel button: cualquier pulsacion, aunque ya se haya liberado
+	if (back_presses > 0 && !is_close_pressed()) {
+		timebase_now(&close_condition.time);
+		atomic_store_explicit(&close_condition.close, true, memory_order_release);
+		periodic_shutdown();
+	}
+}
+
+void* buttons_event_thread(void *params) {
+	task_t *task = (task_t *) params;
+	buttons_controller_t *controller = (buttons_controller_t *) task->context;
+	struct timespec start, end;
+
+	int ready = 0;
+	while (controller->input.fd >= 0 && (ready = buttons_input_wait(&controller->input)) > 0) {
+		timebase_now(&start);
+		buttons_controller(controller);
+		timebase_now(&end);
+		task_stats_record(&task->stats,
+				(start.tv_sec - controller->input.last_event.tv_sec) * 1000000000LL +
+				(start.tv_nsec - controller->input.last_event.tv_nsec),
+				(end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec),
+				task->period);
+	}
+	if (controller->input.fd >= 0 && ready < 0) {
+		buttons_fallback(controller);
+	}
+
+	// Sin dispositivo se sigue muestreando con el periodo de la tarea
+	if (controller->input.fd < 0 && !is_close_pressed()) {
+		return task_thread(task);
 	}
 	pthread_exit(NULL);
 }
 
-void* color_sensor_controller (void *param) {
-	ev3_sensor_ptr color_sensor = *((ev3_sensor_ptr *) param);
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = COLOR_PERIOD;
+void buttons_fallback(buttons_controller_t *controller) {
+	printf("Warning: keypad input device failed (%s), polling buttons.\n", strerror(errno));
+	controller->previous = controller->input.pressed;
+	controller->claw_presses = controller->input.presses[BUTTON_CENTER];
+	controller->back_presses = controller->input.presses[BUTTON_BACK];
+	buttons_input_close(&controller->input);
+}
+
+long sensor_period(sensor_sampling_t *sampling) {
+	int32_t position = atomic_load_explicit(&sampling->motion->activity_position, memory_order_relaxed);
+	int speed = atomic_load_explicit(&sampling->motion->activity_speed, memory_order_relaxed);
+
+	long period;
+
+	if (speed == 0) {
+		sampling->regime = SENSOR_IDLE;
+		period = SENSOR_IDLE_PERIOD;
+	} else if (speed * sampling->direction < 0) {
+		sampling->regime = SENSOR_MOVING;
+		period = SENSOR_MOVING_PERIOD;
+	} else {
+		// Tiempo hasta el limite acelerando al maximo (v t + a t^2 / 2 = distancia),
+		// descontando la actividad publicada con hasta un periodo de retraso
+		sampling->regime = SENSOR_APPROACHING;
+		double distance = fmax((double) (sampling->limit_position - position) * sampling->direction, 0.0);
+		double accel = sampling->motion->limits->max_accel, v = abs(speed);
+		sampling->time_to_limit_ns = (long long) ((sqrt(v * v + 2.0 * accel * distance) - v) / accel * 1e9);
+		double ahead = SENSOR_APPROACH_FRACTION * (sampling->time_to_limit_ns - MOTOR_PERIOD);
+		period = (long) fmin(fmax(ahead, sampling->min_period), SENSOR_MOVING_PERIOD);
+	}
+#ifdef FIXED_SENSOR_PERIOD
+	period = SENSOR_MOVING_PERIOD;
+#endif
+	return period;
+}
+
+void sensor_sample_wakeup(sensor_sampling_t *sampling, const struct timespec *now) {
+	if (sampling->wakeups == 0) {
+		sampling->first_wakeup = *now;
+	}
+	sampling->wakeups++;
+	sampling->last_wakeup = *now;
+}
+
+void sensor_sample_record(sensor_sampling_t *sampling, const struct timespec *now, bool limit) {
+	unsigned long reads = sampling->reads[SENSOR_IDLE] + sampling->reads[SENSOR_MOVING] +
+			sampling->reads[SENSOR_APPROACHING];
+	long long gap_ns = (now->tv_sec - sampling->last_read.tv_sec) * 1000000000LL +
+			(now->tv_nsec - sampling->last_read.tv_nsec);
+
+	// Tiempo sin lectura acercandose, tambien respecto al que se estimo hasta el limite
+	if (reads > 0 && sampling->regime == SENSOR_APPROACHING) {
+		if (gap_ns > sampling->exposed_max_ns) {
+			sampling->exposed_max_ns = gap_ns;
+		}
+		double ratio = (double) gap_ns / fmax(sampling->time_to_limit_ns, sampling->min_period);
+		if (ratio > sampling->exposed_ratio_max) {
+			sampling->exposed_ratio_max = ratio;
+		}
+	}
+	if (limit && !sampling->at_limit) {
+		sampling->detections++;
+		if (reads > 0 && gap_ns > sampling->detect_gap_max_ns) {
+			sampling->detect_gap_max_ns = gap_ns;
+		}
+	}
+	sampling->at_limit = limit;
+	sampling->last_read = *now;
+	sampling->next_period = sensor_period(sampling);
+	sampling->reads[sampling->regime]++;
+}
+
+void sensor_sampling_print(const char *name, const sensor_sampling_t *sampling) {
+	unsigned long reads = sampling->reads[SENSOR_IDLE] + sampling->reads[SENSOR_MOVING] +
+			sampling->reads[SENSOR_APPROACHING];
+	double seconds = (sampling->last_wakeup.tv_sec - sampling->first_wakeup.tv_sec) +
+			(sampling->last_wakeup.tv_nsec - sampling->first_wakeup.tv_nsec) / 1e9;
+	if (seconds <= 0.0) {
+		printf("%s: no samples\n", name);
+		return;
+	}
+	printf("%s: %lu reads, %.1f reads/s (%.1f wakeups/s), idle/moving/approaching %lu/%lu/%lu, "
+			"limit latency %.0f ms max (%.0f %% of the time to the limit), %lu detections (%.0f ms since "
+			"previous read max)\n", name, reads, reads / seconds, sampling->wakeups / seconds,
+			sampling->reads[SENSOR_IDLE], sampling->reads[SENSOR_MOVING], sampling->reads[SENSOR_APPROACHING],
+			sampling->exposed_max_ns / 1e6, 100.0 * sampling->exposed_ratio_max, sampling->detections,
+			sampling->detect_gap_max_ns / 1e6);
+}
+
+void color_sensor_controller (void *param) {
+	color_controller_t *controller = (color_controller_t *) param;
+	sysfs_sensor_t *color_sensor = controller->color_sensor;
+	struct timespec now;
 	int color_data;
 
-	while (!is_close_pressed()) {
-		ev3_update_sensor_val(color_sensor);
-		color_data = color_sensor->val_data[0].s32;
-		if (color_data >= REFLECTION_LIMIT) {
-			pthread_mutex_lock(&top_limit.top_mutex);
-			top_limit.top_limit_reached = true;
-			pthread_mutex_unlock(&top_limit.top_mutex);
+	timebase_now(&now);
+	sensor_sample_wakeup(&controller->sampling, &now);
+
+	// Con el modo recien cambiado el valor aun es del modo anterior
+	long long settle_ns = COLOR_MODE_SETTLE - ((now.tv_sec - controller->switched.tv_sec) * 1000000000LL +
+			(now.tv_nsec - controller->switched.tv_nsec));
+	if (settle_ns > 0) {
+		controller->settling++;
+		controller->next_period = (long) settle_ns;
+		return;
+	}
+
+	if (controller->color_mode) {
+		// Sin lectura del limite: la elevacion no debe haber subido (posiciones negativas)
+		if (sysfs_get_position(controller->elevation_motor) < controller->still_position - COLOR_STILL_UNITS) {
+			controller->blind_rises++;
 		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+		atomic_store_explicit(&color_reading.color, sysfs_update_sensor_val(color_sensor), memory_order_relaxed);
+		ev3_mode_sensor(color_sensor->sensor, COL_REFLECT);
+		controller->color_mode = false;
+		controller->switched = now;
+		controller->color_reads++;
+		atomic_store_explicit(&color_reading.requested, false, memory_order_release);
+		// El limite vuelve a vigilarse en cuanto se asienta el modo
+		controller->next_period = COLOR_MODE_SETTLE;
+		return;
 	}
 
-	pthread_exit(NULL);
+	color_data = sysfs_update_sensor_val(color_sensor);
+	if (color_data >= REFLECTION_LIMIT) {
+		atomic_store_explicit(&top_limit.top_limit_reached, true, memory_order_release);
+	}
+	sensor_sample_record(&controller->sampling, &now, color_data >= REFLECTION_LIMIT);
+	controller->next_period = controller->sampling.next_period;
+
+	// Color pedido por un trabajo: hasta la siguiente lectura no se vigila el limite,
+	// por lo que solo se cambia de modo lejos de el y con la elevacion parada
+	if (atomic_load_explicit(&color_reading.requested, memory_order_acquire)) {
+		int32_t position = sysfs_get_position(controller->elevation_motor);
+		if (color_data < REFLECTION_LIMIT &&
+				atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) == 0 &&
+				abs(position - atomic_load_explicit(&axis_setpoint.elevation, memory_order_relaxed)) <=
+				COLOR_STILL_UNITS) {
+			ev3_mode_sensor(color_sensor->sensor, COL_COLOR);
+			controller->color_mode = true;
+			controller->switched = now;
+			controller->still_position = position;
+			controller->next_period = COLOR_MODE_SETTLE;
+		} else {
+			// Se reintenta con el periodo mas corto: la elevacion esta llegando
+			controller->postponed++;
+			controller->next_period = controller->sampling.min_period;
+		}
+	}
 }
 
-void* touch_sensor_controller (void *param) {
-	ev3_sensor_ptr touch_sensor = *((ev3_sensor_ptr *) param);
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = TOUCH_PERIOD;
+long color_sensor_rate (void *param) {
+	return ((color_controller_t *) param)->next_period;
+}
 
+void request_color(void) {
+	atomic_store_explicit(&color_reading.requested, true, memory_order_release);
+	if (color_reading.task != NULL) {
+		task_wake(color_reading.task);
+	}
+}
+
+void touch_sensor_controller (void *param) {
+	touch_controller_t *controller = (touch_controller_t *) param;
+	struct timespec now;
 	int touch_data;
 
-	while (!is_close_pressed()) {
-		ev3_update_sensor_val(touch_sensor);
-		touch_data = touch_sensor->val_data[0].s32;
-		if (touch_data == TOUCH_SENSOR_ACTIVE) {
-			pthread_mutex_lock(&clockwise_limit.clockwise_mutex);
-			clockwise_limit.clockwise_limit_reached = true;
-			pthread_mutex_unlock(&clockwise_limit.clockwise_mutex);
-		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+	timebase_now(&now);
+	sensor_sample_wakeup(&controller->sampling, &now);
+	touch_data = sysfs_update_sensor_val(controller->touch_sensor);
+	if (touch_data == TOUCH_SENSOR_ACTIVE) {
+		atomic_store_explicit(&clockwise_limit.clockwise_limit_reached, true, memory_order_release);
 	}
+	sensor_sample_record(&controller->sampling, &now, touch_data == TOUCH_SENSOR_ACTIVE);
+}
 
-	pthread_exit(NULL);
+long touch_sensor_rate (void *param) {
+	return ((touch_controller_t *) param)->sampling.next_period;
 }
 
-void* rotation_motor_controller (void *param) {
-	ev3_motor_ptr rotation_motor = *((ev3_motor_ptr *) param);
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = MOTOR_PERIOD;
+void cartesian_controller(void *param) {
+	cartesian_controller_t *controller = (cartesian_controller_t *) param;
+	motors_status_snapshot_t status;
+
+	if (!controller->enabled) {
+		return;
+	}
+
+	read_motors_status(&status);
+	if ((status.rotation == ROTATE_STOP && status.elevation == ELEVATE_STOP) ||
+			atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) > 0) {
+		controller->active = false;
+		atomic_store_explicit(&axis_setpoint.active, false, memory_order_release);
+		return;
+	}
+	if (!controller->active) {
+		kinematics_forward(controller->kinematics, sysfs_get_position(controller->rotation_motor),
+				sysfs_get_position(controller->elevation_motor), &controller->tip);
+		controller->active = true;
+	}
+
+	// Desplazamiento de la punta en un periodo
+	kin_coord_t step = KIN_FROM_MM(CARTESIAN_SPEED * (MOTOR_PERIOD / 1e9));
+	if (status.rotation == ROTATE_RIGHT) {
+		controller->tip.y += step;
+	} else if (status.rotation == ROTATE_LEFT) {
+		controller->tip.y -= step;
+	}
+	if (status.elevation == RISE) {
+		controller->tip.z += step;
+	} else if (status.elevation == LOWER) {
+		controller->tip.z -= step;
+	}
+
+	int32_t rotation, elevation;
+	controller->solves++;
+	if (kinematics_inverse(controller->kinematics, &controller->tip, &rotation, &elevation) == ERANGE) {
+		// Fuera de alcance: la consigna se queda en el punto alcanzable mas cercano
+		controller->clamped++;
+		kinematics_forward(controller->kinematics, rotation, elevation, &controller->tip);
+	}
+	atomic_store_explicit(&axis_setpoint.rotation, rotation, memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.elevation, elevation, memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.active, true, memory_order_release);
+}
+
+void program_teach(program_controller_t *controller) {
+	motors_status_snapshot_t status;
+	int32_t position[MOTION_PATH_MAX_AXES] = { sysfs_get_position(controller->rotation_motor),
+			sysfs_get_position(controller->elevation_motor) };
+	bool claw_closed = atomic_load_explicit(&claw_used.status, memory_order_relaxed);
+	bool still = true;
+
+	for (int j = 0; j < MOTION_PATH_MAX_AXES; j++) {
+		if (abs(position[j] - controller->last_position[j]) > PROGRAM_STILL_UNITS) {
+			still = false;
+		}
+		controller->last_position[j] = position[j];
+	}
+	if (!still) {
+		controller->moved = true;
+	}
 
-	actions_rotation rotation_actual = ROTATE_STOP;
-	actions_rotation rotation_next = ROTATE_STOP;
+	read_motors_status(&status);
+	bool record = false;
+	if (claw_closed != controller->claw_closed) {
+		controller->claw_closed = claw_closed;
+		record = true;
+	} else if (controller->moved && still && status.rotation == ROTATE_STOP && status.elevation == ELEVATE_STOP &&
+			atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) == 0) {
+		record = true;
+	}
+	if (!record) {
+		return;
+	}
+	controller->moved = false;
+
+	// Sin repetir el punto anterior
+	program_t *program = controller->program;
+	if (program->n_waypoints > 0) {
+		const program_waypoint_t *last = &program->waypoints[program->n_waypoints - 1];
+		if (last->claw_closed == claw_closed && abs(last->rotation - position[0]) <= PROGRAM_DUPLICATE_UNITS &&
+				abs(last->elevation - position[1]) <= PROGRAM_DUPLICATE_UNITS) {
+			return;
+		}
+	}
+	if (program_add(program, position[0], position[1], claw_closed) != 0) {
+		controller->dropped++;
+	}
+}
 
-	while(!is_close_pressed()) {
-		pthread_mutex_lock(&new_motors_status.mutex);
-		rotation_next = new_motors_status.rotation;
-		pthread_mutex_unlock(&new_motors_status.mutex);
+void program_repeat(program_controller_t *controller) {
+	const program_t *program = controller->program;
+	struct timespec now;
 
-		if (is_clockwise_limit_reached()) {
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = true;
-			pthread_mutex_unlock(&correction.correction_mutex);
-			ev3_set_position_sp(rotation_motor, ROTATION_INIT_UNITS);
-			ev3_command_motor_by_name(rotation_motor, COMMANDS_STRING[RUN_REL_POS]);
-			usleep (SUSPENSION_TIME);
+	// Una correccion interrumpe el tramo: se replanifica cuando termine
+	if (atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) > 0) {
+		if (controller->state == PLAYBACK_MOVING) {
+			atomic_store_explicit(&axis_setpoint.active, false, memory_order_release);
+			controller->state = PLAYBACK_PLAN;
+		}
+		return;
+	}
 
-			while ((ev3_motor_state(rotation_motor) & MOTOR_RUNNING)) {
-				usleep(CHECK_STATE_TIME);
+	const program_waypoint_t *end;
+	switch (controller->state) {
+		case PLAYBACK_PLAN: {
+			double start[MOTION_PATH_MAX_AXES] = { sysfs_get_position(controller->rotation_motor),
+					sysfs_get_position(controller->elevation_motor) };
+			controller->end = program_plan_stroke(program, controller->limits, start, controller->next,
+					atomic_load_explicit(&claw_used.status, memory_order_relaxed), &controller->path, NULL);
+			timebase_now(&controller->start);
+			controller->state = PLAYBACK_MOVING;
+		}
+		// fall through
+		case PLAYBACK_MOVING: {
+			timebase_now(&now);
+			double elapsed = (now.tv_sec - controller->start.tv_sec) +
+					(now.tv_nsec - controller->start.tv_nsec) / 1e9;
+			double position[MOTION_PATH_MAX_AXES], speed[MOTION_PATH_MAX_AXES];
+
+			// Consigna para la siguiente activacion de los ejes
+			motion_path_sample(&controller->path, elapsed + MOTOR_PERIOD / 1e9, position, speed);
+			atomic_store_explicit(&axis_setpoint.rotation, (int) lround(position[0]), memory_order_relaxed);
+			atomic_store_explicit(&axis_setpoint.elevation, (int) lround(position[1]), memory_order_relaxed);
+			atomic_store_explicit(&axis_setpoint.active, true, memory_order_release);
+
+			// Fin del tramo con los dos ejes en el ultimo punto (o MOTION_TIMEOUT)
+			end = &program->waypoints[controller->end];
+			bool arrived = abs(sysfs_get_position(controller->rotation_motor) - end->rotation) <= PROFILE_TOLERANCE &&
+					abs(sysfs_get_position(controller->elevation_motor) - end->elevation) <= PROFILE_TOLERANCE;
+			if (elapsed < controller->path.duration ||
+					(!arrived && (elapsed - controller->path.duration) * 1e3 < MOTION_TIMEOUT)) {
+				return;
+			}
+			if (end->claw_closed != atomic_load_explicit(&claw_used.status, memory_order_relaxed)) {
+				atomic_fetch_add_explicit(&axis_setpoint.claw_presses, 1, memory_order_relaxed);
 			}
+			controller->state = PLAYBACK_CLAW;
+		}
+		// fall through
+		case PLAYBACK_CLAW:
+			end = &program->waypoints[controller->end];
+			if (end->claw_closed != atomic_load_explicit(&claw_used.status, memory_order_relaxed)) {
+				return;
+			}
+			break;
+	}
+
+	// Tramo terminado: al pasar por el ultimo punto se cierra un ciclo
+	if (controller->end == program->n_waypoints - 1) {
+		timebase_now(&now);
+		if (controller->cycle_started) {
+			controller->cycle_total_ns += (now.tv_sec - controller->cycle_start.tv_sec) * 1000000000LL +
+					(now.tv_nsec - controller->cycle_start.tv_nsec);
+			controller->cycles++;
+		}
+		controller->cycle_start = now;
+		controller->cycle_started = true;
+	}
+	controller->next = (controller->end + 1) % program->n_waypoints;
+	controller->state = PLAYBACK_PLAN;
+}
+
+void program_controller(void *param) {
+	program_controller_t *controller = (program_controller_t *) param;
+
+	switch (controller->mode) {
+		case PROGRAM_TEACH:
+			program_teach(controller);
+			break;
+		case PROGRAM_REPEAT:
+			program_repeat(controller);
+			break;
+		default:
+			break;
+	}
+}
+
+bool job_clamp_target(int32_t target[]) {
+	const int32_t soft_min[MOTION_PATH_MAX_AXES] = { ROTATION_SOFT_MIN, ELEVATION_SOFT_MIN };
+	const int32_t soft_max[MOTION_PATH_MAX_AXES] = { ROTATION_SOFT_MAX, ELEVATION_SOFT_MAX };
+	bool clamped = false;
+	for (int i = 0; i < MOTION_PATH_MAX_AXES; i++) {
+		if (target[i] < soft_min[i] || target[i] > soft_max[i]) {
+			target[i] = (target[i] < soft_min[i]) ? soft_min[i] : soft_max[i];
+			clamped = true;
+		}
+	}
+	return clamped;
+}
 
-			pthread_mutex_lock(&clockwise_limit.clockwise_mutex);
-			clockwise_limit.clockwise_limit_reached = false;
-			pthread_mutex_unlock(&clockwise_limit.clockwise_mutex);
+int job_plan_move(const job_controller_t *controller, job_step_t *step, const int32_t start[]) {
+	int error = 0;
 
-			ev3_set_duty_cycle_sp(rotation_motor, 0);
-			ev3_command_motor_by_name(rotation_motor, COMMANDS_STRING[RUN_DIRECT]);
-			rotation_actual = ROTATE_STOP;
+	if (step->opcode == JOB_MOVE_CARTESIAN) {
+		// El lado de la base (signo de x) es el del punto de partida
+		kinematics_forward(controller->kinematics, start[0], start[1], &step->from);
+		step->to.x = (step->from.x < 0) ? KIN_FROM_MM(-1) : KIN_FROM_MM(1);
+		if (kinematics_inverse(controller->kinematics, &step->to, &step->target[0], &step->target[1]) != 0) {
+			error = ERANGE;
+		}
+	}
+	if (job_clamp_target(step->target)) {
+		error = ERANGE;
+	}
 
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = false;
-			pthread_mutex_unlock(&correction.correction_mutex);
+	if (step->opcode == JOB_MOVE_CARTESIAN) {
+		// Fuera de alcance: la recta termina en el punto alcanzable mas cercano
+		if (error != 0) {
+			kinematics_forward(controller->kinematics, step->target[0], step->target[1], &step->to);
+		}
+		double length = hypot(KIN_TO_MM(step->to.y - step->from.y), KIN_TO_MM(step->to.z - step->from.z));
+		CHK(motion_profile_plan(&step->profiles[0], PROFILE_TYPE, &controller->cartesian_limits, 0.0, length));
+		step->duration = step->profiles[0].duration;
+	} else {
+		double from[MOTION_PATH_MAX_AXES] = { start[0], start[1] };
+		double target[MOTION_PATH_MAX_AXES] = { step->target[0], step->target[1] };
+		CHK(motion_profile_plan_sync(step->profiles, MOTION_PATH_MAX_AXES, PROFILE_TYPE, controller->limits, from,
+				target));
+		step->duration = fmax(step->profiles[0].duration, step->profiles[1].duration);
+	}
+	return error;
+}
+
+void job_executor(void *param) {
+	job_controller_t *controller = (job_controller_t *) param;
+	struct timespec start, end;
+	job_step_t *step;
+
+	if (!controller->enabled || atomic_load_explicit(&controller->planned, memory_order_relaxed)) {
+		return;
+	}
+	while ((step = job_queue_reserve(&controller->queue)) != NULL) {
+		const job_command_t *command = job_next(controller->job, &controller->cursor);
+		if (command == NULL) {
+			atomic_store_explicit(&controller->planned, true, memory_order_release);
+			return;
+		}
+		step->opcode = command->opcode;
+		step->color = command->args[0];
+		step->duration = 0.0;
+		step->deferred = false;
+		if (command->opcode == JOB_MOVE_BIN) {
+			// La caja depende del color que aun no se ha leido
+			step->deferred = true;
+			controller->end_known = false;
+		} else if (command->opcode == JOB_MOVE_JOINT || command->opcode == JOB_MOVE_CARTESIAN) {
+			if (command->opcode == JOB_MOVE_JOINT) {
+				step->target[0] = command->args[0];
+				step->target[1] = command->args[1];
+			} else {
+				step->to.y = KIN_FROM_MM(command->args[0]);
+				step->to.z = KIN_FROM_MM(command->args[1]);
+			}
 
-		} else if (ev3_get_position(rotation_motor) < TOP_LEFT_POS) {
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = true;
-			pthread_mutex_unlock(&correction.correction_mutex);
-			ev3_set_position_sp(rotation_motor, 0);
-			ev3_command_motor_by_name(rotation_motor, COMMANDS_STRING[RUN_ABS_POS]);
-			usleep(SUSPENSION_TIME);
+			// Sin punto de partida conocido lo planifica el reproductor. En move-joint el
+			// destino no depende de la partida, en move-cartesian si (lado de la base)
+			if (!controller->end_known) {
+				step->deferred = true;
+				if (command->opcode == JOB_MOVE_JOINT) {
+					job_clamp_target(step->target);
+					controller->end[0] = step->target[0];
+					controller->end[1] = step->target[1];
+					controller->end_known = true;
+				}
+				job_queue_push(&controller->queue);
+				continue;
+			}
 
-			while ((ev3_motor_state (rotation_motor) & MOTOR_RUNNING)) {
-				usleep(CHECK_STATE_TIME);
+			// Coste de CPU de la planificacion: tiempo de CPU del hilo, que no cuenta las
+			// expropiaciones y tampoco depende del tiempo virtual
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+			if (job_plan_move(controller, step, controller->end) != 0) {
+				controller->clamped++;
 			}
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+			long long plan_ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+			controller->plans++;
+			controller->plan_total_ns += plan_ns;
+			if (plan_ns > controller->plan_max_ns) {
+				controller->plan_max_ns = plan_ns;
+			}
+			controller->end[0] = step->target[0];
+			controller->end[1] = step->target[1];
+		}
+		job_queue_push(&controller->queue);
+	}
+}
 
-			ev3_set_duty_cycle_sp(rotation_motor, 0);
-			ev3_command_motor_by_name(rotation_motor, COMMANDS_STRING[RUN_DIRECT]);
-			rotation_actual = ROTATE_STOP;
-
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = false;
-			pthread_mutex_unlock(&correction.correction_mutex);
-
-		} else if (rotation_actual != rotation_next) {
-			switch(rotation_next) {
-				case ROTATE_RIGHT:
-					ev3_set_duty_cycle_sp (rotation_motor, ROTATION_POWER);
-					break;
-				case ROTATE_LEFT:
-					ev3_set_duty_cycle_sp (rotation_motor, -ROTATION_POWER);
-					break;
-				default:
-					ev3_set_duty_cycle_sp(rotation_motor, 0);
-					break;
+void job_step_start(job_controller_t *controller, job_step_t *step, const struct timespec *now) {
+	if (controller->steps == 0) {
+		controller->job_start = *now;
+	} else {
+		long long idle_ns = (now->tv_sec - controller->last_end.tv_sec) * 1000000000LL +
+				(now->tv_nsec - controller->last_end.tv_nsec);
+		if (idle_ns > 0) {
+			controller->underruns++;
+			controller->idle_total_ns += idle_ns;
+			if (idle_ns > controller->idle_max_ns) {
+				controller->idle_max_ns = idle_ns;
 			}
-			rotation_actual = rotation_next;
 		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+	}
+	controller->start = *now;
+	controller->started = true;
+
+	if (step->deferred) {
+		if (step->opcode == JOB_MOVE_BIN) {
+			step->color = controller->job->has_bin[controller->color] ? controller->color : 0;
+			step->target[0] = controller->job->bins[step->color][0];
+			step->target[1] = controller->job->bins[step->color][1];
+		}
+		const int32_t start[MOTION_PATH_MAX_AXES] = { sysfs_get_position(controller->rotation_motor),
+				sysfs_get_position(controller->elevation_motor) };
+		job_plan_move(controller, step, start);
+		controller->deferred_plans++;
 	}
 
-	pthread_exit(NULL);
+	bool claw_closed = atomic_load_explicit(&claw_used.status, memory_order_relaxed);
+	switch (step->opcode) {
+		case JOB_GRIP:
+		case JOB_RELEASE:
+			if (claw_closed != (step->opcode == JOB_GRIP)) {
+				atomic_fetch_add_explicit(&axis_setpoint.claw_presses, 1, memory_order_relaxed);
+			}
+			break;
+		case JOB_WAIT_COLOR:
+		case JOB_READ_COLOR:
+			request_color();
+			break;
+		default:
+			break;
+	}
 }
 
-void* elevation_motor_controller (void *param) {
+bool job_step_done(job_controller_t *controller, job_step_t *step, const struct timespec *now) {
+	bool claw_closed = atomic_load_explicit(&claw_used.status, memory_order_relaxed);
+	long long step_ns = (now->tv_sec - controller->start.tv_sec) * 1000000000LL +
+			(now->tv_nsec - controller->start.tv_nsec);
+
+	if ((step->opcode == JOB_WAIT_COLOR || step->opcode == JOB_READ_COLOR) &&
+			step_ns >= JOB_COLOR_TIMEOUT * 1000000LL) {
+		controller->aborted = true;
+		controller->aborted_opcode = step->opcode;
+		controller->aborted_color = step->color;
+		return false;
+	}
+
+	switch (step->opcode) {
+		case JOB_GRIP:
+			return claw_closed;
+		case JOB_RELEASE:
+			return !claw_closed;
+		case JOB_WAIT_COLOR:
+			if (atomic_load_explicit(&color_reading.requested, memory_order_acquire)) {
+				return false;
+			}
+			if (atomic_load_explicit(&color_reading.color, memory_order_relaxed) == step->color) {
+				return true;
+			}
+			request_color();
+			return false;
+		case JOB_READ_COLOR: {
+			if (atomic_load_explicit(&color_reading.requested, memory_order_acquire)) {
+				return false;
+			}
+			int color = atomic_load_explicit(&color_reading.color, memory_order_relaxed);
+			controller->color = (color >= 0 && color < JOB_COLORS) ? color : 0;
+			controller->color_reads++;
+			controller->color_wait_total_ns += step_ns;
+			if (step_ns > controller->color_wait_max_ns) {
+				controller->color_wait_max_ns = step_ns;
+			}
+			return true;
+		}
+		default:
+			break;
+	}
 
-	ev3_motor_ptr elevation_motor = *((ev3_motor_ptr *) param);
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = MOTOR_PERIOD;
+	// Consigna para la siguiente activacion de los ejes
+	double elapsed = (now->tv_sec - controller->start.tv_sec) + (now->tv_nsec - controller->start.tv_nsec) / 1e9;
+	double t = elapsed + MOTOR_PERIOD / 1e9, position[MOTION_PATH_MAX_AXES], speed;
+	int32_t setpoint[MOTION_PATH_MAX_AXES];
+	if (step->opcode == JOB_MOVE_CARTESIAN) {
+		motion_profile_sample(&step->profiles[0], t, &position[0], &speed);
+		double fraction = (step->profiles[0].target > 0.0) ? position[0] / step->profiles[0].target : 1.0;
+		kin_point_t tip;
+		kinematics_interpolate(&step->from, &step->to, fraction, &tip);
+		kinematics_inverse(controller->kinematics, &tip, &setpoint[0], &setpoint[1]);
+	} else {
+		for (int i = 0; i < MOTION_PATH_MAX_AXES; i++) {
+			motion_profile_sample(&step->profiles[i], t, &position[i], &speed);
+			setpoint[i] = (int32_t) lround(position[i]);
+		}
+	}
+	atomic_store_explicit(&axis_setpoint.rotation, setpoint[0], memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.elevation, setpoint[1], memory_order_relaxed);
+	atomic_store_explicit(&axis_setpoint.active, true, memory_order_release);
 
-	actions_elevation elevation_actual = ELEVATE_STOP;
-	actions_elevation elevation_next = ELEVATE_STOP;
+	// Los dos ejes en el destino tras el perfil (o MOTION_TIMEOUT)
+	if (elapsed < step->duration) {
+		return false;
+	}
+	if (abs(sysfs_get_position(controller->rotation_motor) - step->target[0]) <= PROFILE_TOLERANCE &&
+			abs(sysfs_get_position(controller->elevation_motor) - step->target[1]) <= PROFILE_TOLERANCE) {
+		return true;
+	}
+	if ((elapsed - step->duration) * 1e3 >= MOTION_TIMEOUT) {
+		controller->timeouts++;
+		return true;
+	}
+	return false;
+}
 
-	while(!is_close_pressed()) {
-		pthread_mutex_lock(&new_motors_status.mutex);
-		elevation_next = new_motors_status.elevation;
-		pthread_mutex_unlock(&new_motors_status.mutex);
+void job_player(void *param) {
+	job_controller_t *controller = (job_controller_t *) param;
+	struct timespec now;
+	job_step_t *step;
 
-		if (is_top_limit_reached()) {
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = true;
-			pthread_mutex_unlock(&correction.correction_mutex);
-			ev3_set_position_sp(elevation_motor, ELEVATION_INIT_UNITS);
-			ev3_command_motor_by_name(elevation_motor, COMMANDS_STRING[RUN_REL_POS]);
-			usleep (SUSPENSION_TIME);
-
-			while ((ev3_motor_state (elevation_motor) & MOTOR_RUNNING)) {
-				usleep(CHECK_STATE_TIME);
-			}
+	if (!controller->enabled || controller->done || controller->aborted) {
+		return;
+	}
 
-			pthread_mutex_lock(&top_limit.top_mutex);
-			top_limit.top_limit_reached = false;
-			pthread_mutex_unlock(&top_limit.top_mutex);
+	// Una correccion suspende el paso: se replanifica cuando termine
+	if (atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) > 0) {
+		if (controller->started) {
+			atomic_store_explicit(&axis_setpoint.active, false, memory_order_release);
+			controller->replan = true;
+		}
+		return;
+	}
 
-			ev3_set_duty_cycle_sp (elevation_motor, 0);
-			ev3_command_motor_by_name (elevation_motor, COMMANDS_STRING[RUN_DIRECT]);
-			elevation_actual = ELEVATE_STOP;
+	timebase_now(&now);
+	while ((step = job_queue_front(&controller->queue)) != NULL) {
+		if (!controller->started) {
+			job_step_start(controller, step, &now);
+		} else if (controller->replan && (step->opcode == JOB_MOVE_JOINT || step->opcode == JOB_MOVE_CARTESIAN ||
+				step->opcode == JOB_MOVE_BIN)) {
+			const int32_t start[MOTION_PATH_MAX_AXES] = { sysfs_get_position(controller->rotation_motor),
+					sysfs_get_position(controller->elevation_motor) };
+			job_plan_move(controller, step, start);
+			controller->start = now;
+			controller->replans++;
+		}
+		controller->replan = false;
+		if (!job_step_done(controller, step, &now)) {
+			if (controller->aborted) {
+				job_stop();
+			}
+			return;
+		}
 
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = false;
-			pthread_mutex_unlock(&correction.correction_mutex);
+		if (step->opcode == JOB_MOVE_BIN) {
+			controller->sorted[step->color]++;
+		}
+
+		// Siguiente paso en la misma activacion, si ya esta en la cola
+		job_queue_pop(&controller->queue);
+		controller->started = false;
+		controller->steps++;
+		controller->last_end = now;
+	}
 
-		} else if (ev3_get_position(elevation_motor) > TOP_BOTTOM_POS) {
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = true;
-			pthread_mutex_unlock(&correction.correction_mutex);
+	// Cola vacia con todo planificado: fin del trabajo, como BACK
+	if (atomic_load_explicit(&controller->planned, memory_order_acquire) &&
+			job_queue_front(&controller->queue) == NULL) {
+		controller->done = true;
+		job_stop();
+	}
+}
 
-			ev3_set_position_sp(elevation_motor, 0);
-			ev3_command_motor_by_name(elevation_motor, COMMANDS_STRING[RUN_ABS_POS]);
+void job_stop(void) {
+	atomic_store_explicit(&axis_setpoint.active, false, memory_order_release);
+	if (!is_close_pressed()) {
+		timebase_now(&close_condition.time);
+		atomic_store_explicit(&close_condition.close, true, memory_order_release);
+		periodic_shutdown();
+	}
+}
 
-			usleep(SUSPENSION_TIME);
-			while ((ev3_motor_state(elevation_motor) & MOTOR_RUNNING)) {
-				usleep(CHECK_STATE_TIME);
+void rotation_motor_controller (void *param) {
+	rotation_controller_t *controller = (rotation_controller_t *) param;
+	sysfs_motor_t *rotation_motor = controller->rotation_motor;
+	actions_rotation rotation_next;
+	motors_status_snapshot_t status;
+	double speed;
+
+	switch (controller->state) {
+		case AXIS_CORRECTING:
+			if (is_correction_finished(rotation_motor, &controller->motion)) {
+				controller->state = AXIS_SETTLING;
+			}
+			return;
+		case AXIS_SETTLING:
+			if (controller->sensor_limit) {
+				atomic_store_explicit(&clockwise_limit.clockwise_limit_reached, false,
+						memory_order_release);
 			}
+			finish_correction(rotation_motor, &controller->motion);
+			controller->rotation_actual = ROTATE_STOP;
+			controller->state = AXIS_IDLE;
+			return;
+		default:
+			break;
+	}
+
+	// AXIS_IDLE o AXIS_JOGGING: primero los limites, despues la botonera
+	if (is_clockwise_limit_reached()) {
+		start_correction(rotation_motor, &controller->motion, sysfs_get_position(rotation_motor) + ROTATION_INIT_UNITS);
+		controller->sensor_limit = true;
+		controller->state = AXIS_CORRECTING;
+
+	} else if (sysfs_get_position(rotation_motor) < TOP_LEFT_POS) {
+		start_correction(rotation_motor, &controller->motion, 0);
+		controller->sensor_limit = false;
+		controller->state = AXIS_CORRECTING;
+
+	} else if (atomic_load_explicit(&axis_setpoint.enabled, memory_order_relaxed)) {
+		controller->state = axis_follow_setpoint(rotation_motor, &controller->motion, &axis_setpoint.rotation) ?
+				AXIS_JOGGING : AXIS_IDLE;
+
+	} else {
+		read_motors_status(&status);
+		rotation_next = status.rotation;
+		switch(rotation_next) {
+			case ROTATE_RIGHT:
+				speed = ROTATION_POWER * FULL_SPEED_LARGE_MOTOR / 100.0;
+				break;
+			case ROTATE_LEFT:
+				speed = -ROTATION_POWER * FULL_SPEED_LARGE_MOTOR / 100.0;
+				break;
+			default:
+				speed = 0.0;
+				break;
+		}
+		controller->rotation_actual = rotation_next;
+		controller->state = axis_jog(rotation_motor, &controller->motion, speed) ? AXIS_JOGGING : AXIS_IDLE;
+	}
+}
 
-			ev3_set_duty_cycle_sp(elevation_motor, 0);
-			ev3_command_motor_by_name(elevation_motor, COMMANDS_STRING[RUN_DIRECT]);
-			elevation_actual = ELEVATE_STOP;
-			pthread_mutex_lock(&correction.correction_mutex);
-			correction.correction_in_progress = false;
-			pthread_mutex_unlock(&correction.correction_mutex);
-
-		} else if (elevation_actual != elevation_next) {
-			switch(elevation_next) {
-				case RISE:
-					ev3_set_duty_cycle_sp (elevation_motor, ELEVATION_UP_POWER);
-					break;
-				case LOWER:
-					ev3_set_duty_cycle_sp (elevation_motor, ELEVATION_DOWN_POWER);
-					break;
-				default:
-					ev3_set_duty_cycle_sp(elevation_motor, 0);
-					break;
+void elevation_motor_controller (void *param) {
+	elevation_controller_t *controller = (elevation_controller_t *) param;
+	sysfs_motor_t *elevation_motor = controller->elevation_motor;
+	actions_elevation elevation_next;
+	motors_status_snapshot_t status;
+	double speed;
+
+	switch (controller->state) {
+		case AXIS_CORRECTING:
+			if (is_correction_finished(elevation_motor, &controller->motion)) {
+				controller->state = AXIS_SETTLING;
 			}
-			elevation_actual = elevation_next;
+			return;
+		case AXIS_SETTLING:
+			if (controller->sensor_limit) {
+				atomic_store_explicit(&top_limit.top_limit_reached, false, memory_order_release);
+			}
+			finish_correction(elevation_motor, &controller->motion);
+			controller->elevation_actual = ELEVATE_STOP;
+			controller->state = AXIS_IDLE;
+			return;
+		default:
+			break;
+	}
+
+	// El barrido de la gravedad mueve el motor y la botonera espera a que termine;
+	// solo se cancela al llegar al limite superior
+	if (atomic_load_explicit(&controller->sweeper->active, memory_order_acquire)) {
+		if (is_top_limit_reached()) {
+			atomic_store_explicit(&controller->sweeper->cancel, true, memory_order_relaxed);
 		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+		return;
 	}
 
-	pthread_exit(NULL);
+	// AXIS_IDLE o AXIS_JOGGING: primero los limites, despues la botonera
+	gravity_set_gripping(controller->motion.gravity, atomic_load_explicit(&claw_used.status, memory_order_relaxed));
+	if (is_top_limit_reached()) {
+		start_correction(elevation_motor, &controller->motion, sysfs_get_position(elevation_motor) + ELEVATION_INIT_UNITS);
+		controller->sensor_limit = true;
+		controller->state = AXIS_CORRECTING;
+
+	} else if (sysfs_get_position(elevation_motor) > TOP_BOTTOM_POS) {
+		start_correction(elevation_motor, &controller->motion, 0);
+		controller->sensor_limit = false;
+		controller->state = AXIS_CORRECTING;
+
+	} else if (atomic_load_explicit(&axis_setpoint.enabled, memory_order_relaxed)) {
+		controller->state = axis_follow_setpoint(elevation_motor, &controller->motion, &axis_setpoint.elevation) ?
+				AXIS_JOGGING : AXIS_IDLE;
+
+	} else {
+		read_motors_status(&status);
+		elevation_next = status.elevation;
+		switch(elevation_next) {
+			case RISE:
+				speed = (controller->motion.gravity->valid ? -ELEVATION_SPEED : ELEVATION_UP_POWER) *
+						FULL_SPEED_LARGE_MOTOR / 100.0;
+				break;
+			case LOWER:
+				speed = (controller->motion.gravity->valid ? ELEVATION_SPEED : ELEVATION_DOWN_POWER) *
+						FULL_SPEED_LARGE_MOTOR / 100.0;
+				break;
+			default:
+				speed = 0.0;
+				break;
+		}
+		controller->elevation_actual = elevation_next;
+		controller->state = axis_jog(elevation_motor, &controller->motion, speed) ? AXIS_JOGGING : AXIS_IDLE;
+	}
 }
 
-void* claw_motor_controller (void *param) {
-	ev3_motor_ptr claw_motor = *((ev3_motor_ptr *) param);
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = MOTOR_PERIOD;
-
-	bool claw_open = true;
-	actions_claw claw_status = INACTIVE;
-
-	while(!is_close_pressed()) {
-		pthread_mutex_lock(&new_motors_status.mutex);
-		claw_status = new_motors_status.claw;
-		pthread_mutex_unlock(&new_motors_status.mutex);
-
-		if (claw_status == ACTIVE) {
-			if (claw_open) {
-				ev3_set_duty_cycle_sp (claw_motor, -CLAW_POWER);
-				ev3_command_motor_by_name (claw_motor, COMMANDS_STRING[RUN_DIRECT]);
-				claw_open = false;
-
-				usleep(CLAW_CLOSE_TIME);
-				ev3_set_duty_cycle_sp (claw_motor, 0);
-				pthread_mutex_lock(&claw_used.claw_used_mutex);
-				claw_used.status = true;
-				pthread_mutex_unlock(&claw_used.claw_used_mutex);
-			} else {
-				ev3_set_position_sp (claw_motor, 0);
-				ev3_command_motor_by_name (claw_motor, COMMANDS_STRING[RUN_ABS_POS]);
-				usleep (SUSPENSION_TIME);
+void claw_motor_controller (void *param) {
+	claw_controller_t *controller = (claw_controller_t *) param;
+	sysfs_motor_t *claw_motor = controller->claw_motor;
+	motors_status_snapshot_t status;
+	struct timespec now;
 
-				while ((ev3_motor_state (claw_motor) & MOTOR_RUNNING)) {
-					usleep(CHECK_STATE_TIME);
-				}
+	unsigned int presses;
 
-				ev3_set_duty_cycle_sp (claw_motor, 0);
-				ev3_command_motor_by_name (claw_motor, COMMANDS_STRING[RUN_DIRECT]);
-				claw_open = true;
-				pthread_mutex_lock(&claw_used.claw_used_mutex);
-				claw_used.status = false;
-				pthread_mutex_unlock(&claw_used.claw_used_mutex);
+	switch (controller->state) {
+		case CLAW_CLOSING:
+			if (claw_grip_sample(controller)) {
+				controller->state = CLAW_CLOSED;
+				atomic_store_explicit(&claw_used.status, true, memory_order_relaxed);
+			}
+			return;
+		case CLAW_OPENING:
+			if (controller->motion->servo) {
+				if (atomic_load_explicit(&controller->motion->servo_active, memory_order_acquire)) {
+					return;
+				}
+			} else {
+				timebase_now(&now);
+				long long elapsed_ns = (now.tv_sec - controller->start.tv_sec) * 1000000000LL +
+						(now.tv_nsec - controller->start.tv_nsec);
+				if ((sysfs_motor_state(claw_motor) & MOTOR_RUNNING) &&
+						elapsed_ns < MOTION_TIMEOUT * 1000000LL) {
+					return;
+				}
+				sysfs_set_duty_cycle_sp (claw_motor, 0);
+				sysfs_command_motor (claw_motor, COMMANDS_STRING[RUN_DIRECT]);
 			}
-			pthread_mutex_lock(&new_motors_status.mutex);
-			new_motors_status.claw = INACTIVE;
-			pthread_mutex_unlock(&new_motors_status.mutex);
+			controller->state = CLAW_OPEN;
+			atomic_store_explicit(&claw_used.status, false, memory_order_relaxed);
+			break;
+		default:
+			break;
+	}
+
+	if (controller->follow_setpoint) {
+		presses = atomic_load_explicit(&axis_setpoint.claw_presses, memory_order_relaxed);
+	} else {
+		read_motors_status(&status);
+		presses = status.claw_presses;
+	}
+
+	// Cada pulsacion del boton central se atiende una sola vez, aunque haya sido
+	// tan corta que la botonera ya haya publicado la liberacion
+	if (presses != controller->last_presses) {
+		controller->last_presses = presses;
+		if (controller->state == CLAW_OPEN) {
+			claw_grip_start(controller);
+			controller->state = CLAW_CLOSING;
+		} else if (controller->motion->servo) {
+			// El bucle de posicion abre la garra
+			servo_start(claw_motor, controller->motion, 0);
+			controller->state = CLAW_OPENING;
+		} else {
+			// El driver abre la garra; las siguientes activaciones esperan a que pare
+			ev3_set_position_sp (claw_motor->motor, 0);
+			sysfs_command_motor (claw_motor, COMMANDS_STRING[RUN_ABS_POS]);
+			timebase_now(&controller->start);
+			controller->state = CLAW_OPENING;
 		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
 	}
-	pthread_exit(NULL);
 }
 
-void* leds_controller(void *params) {
-	bool previous = false;
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = LED_PERIOD;
-	bool actual;
+long claw_motor_rate (void *param) {
+	claw_controller_t *controller = (claw_controller_t *) param;
+
+	if (controller->state == CLAW_CLOSING ||
+			(controller->state == CLAW_OPENING && !controller->motion->servo)) {
+		return CLAW_GRIP_PERIOD;
+	}
+	return MOTOR_PERIOD;
+}
 
-	while(!is_close_pressed()) {
-		pthread_mutex_lock(&correction.correction_mutex);
-		actual =correction.correction_in_progress;
-		pthread_mutex_unlock(&correction.correction_mutex);
-		if (actual && !previous) {
-			ev3_set_led(LEFT_LED , RED_LED , 255);
-			ev3_set_led(RIGHT_LED, RED_LED, 255);
-			ev3_set_led(LEFT_LED , GREEN_LED , 0);
-			ev3_set_led(RIGHT_LED , GREEN_LED , 0);
-			previous = true;
-		} else if (!actual && previous) {
-			ev3_set_led(LEFT_LED , GREEN_LED , 255);
-			ev3_set_led(RIGHT_LED, GREEN_LED, 255);
-			ev3_set_led(LEFT_LED , RED_LED , 0);
-			ev3_set_led(RIGHT_LED, RED_LED, 0);
-			previous = false;
+void claw_grip_start(claw_controller_t *controller) {
+	timebase_now(&controller->start);
+	controller->sampling.samples = 0;
+	controller->sampling.moving = false;
+	sysfs_set_duty_cycle_sp(controller->claw_motor, -CLAW_POWER);
+	sysfs_command_motor(controller->claw_motor, COMMANDS_STRING[RUN_DIRECT]);
+}
+
+bool claw_grip_sample(claw_controller_t *controller) {
+	sysfs_motor_t *motor = controller->claw_motor;
+	claw_grip_t *sampling = &controller->sampling;
+	claw_grip_stats_t *stats = &controller->grip;
+	struct timespec now;
+	bool stalled = false, contact = false;
+
+	timebase_now(&now);
+	long long elapsed_ns = (now.tv_sec - controller->start.tv_sec) * 1000000000LL +
+			(now.tv_nsec - controller->start.tv_nsec);
+
+	// Velocidad sobre las ultimas CLAW_GRIP_WINDOW muestras
+	int32_t position = sysfs_get_position(motor);
+	if (sampling->samples >= CLAW_GRIP_WINDOW) {
+		double speed = abs(position - sampling->window[sampling->samples % CLAW_GRIP_WINDOW]) * 1e9 /
+				((double) CLAW_GRIP_WINDOW * CLAW_GRIP_PERIOD);
+		if (speed >= CLAW_CONTACT_SPEED) {
+			sampling->moving = true;
+		} else if (sampling->moving) {
+			contact = true;
 		}
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
 	}
-	pthread_exit(NULL);
+	sampling->window[sampling->samples % CLAW_GRIP_WINDOW] = position;
+	sampling->samples++;
+	if (!contact && is_claw_stalled(motor)) {
+		stalled = contact = true;
+	}
+	if (!contact && elapsed_ns < CLAW_CLOSE_TIME * 1000LL) {
+		return false;
+	}
+	sysfs_set_duty_cycle_sp(motor, 0);
+
+	int32_t width = sysfs_get_position(motor) + CLAW_INIT_UNITS;
+	if (stats->grips == 0 || width < stats->width_min) {
+		stats->width_min = width;
+	}
+	if (stats->grips == 0 || width > stats->width_max) {
+		stats->width_max = width;
+	}
+	stats->grips++;
+	stats->stalls += stalled;
+	stats->timeouts += !contact;
+	stats->total_ns += elapsed_ns;
+	if (elapsed_ns > stats->max_ns) {
+		stats->max_ns = elapsed_ns;
+	}
+	stats->width_total += width;
+	stats->last_width = width;
+	return true;
 }
 
-void* reporter(void *params) {
-	struct timespec next_time, period;
-	clock_gettime(CLOCK_MONOTONIC, &next_time);
-	period.tv_sec = 0;
-	period.tv_nsec = REPORTER_PERIOD;
+void claw_grip_print(const claw_grip_stats_t *stats) {
+	if (stats->grips == 0) {
+		printf("Claw grip: no grips\n");
+		return;
+	}
+	printf("Claw grip: %lu grips (%lu stalled, %lu timeouts), contact %.1f ms mean / %.1f ms max, "
+			"width %.1f deg mean / %d min / %d max / %d last\n", stats->grips, stats->stalls, stats->timeouts,
+			stats->total_ns / 1e6 / stats->grips, stats->max_ns / 1e6,
+			(double) stats->width_total / stats->grips, stats->width_min, stats->width_max, stats->last_width);
+}
+
+void leds_controller(void *params) {
+	leds_controller_t *controller = (leds_controller_t *) params;
+	bool actual;
+
+	actual = atomic_load_explicit(&correction.corrections_in_progress, memory_order_relaxed) > 0;
+	if (actual && !controller->previous) {
+		ev3_set_led(LEFT_LED , RED_LED , 255);
+		ev3_set_led(RIGHT_LED, RED_LED, 255);
+		ev3_set_led(LEFT_LED , GREEN_LED , 0);
+		ev3_set_led(RIGHT_LED , GREEN_LED , 0);
+		controller->previous = true;
+	} else if (!actual && controller->previous) {
+		ev3_set_led(LEFT_LED , GREEN_LED , 255);
+		ev3_set_led(RIGHT_LED, GREEN_LED, 255);
+		ev3_set_led(LEFT_LED , RED_LED , 0);
+		ev3_set_led(RIGHT_LED, RED_LED, 0);
+		controller->previous = false;
+	}
+}
+
+void reporter(void *params) {
+	reporter_t *state = (reporter_t *) params;
 	bool claw_status;
 	time_t now;
 	struct tm *now_tm;
@@ -1163,21 +3815,26 @@ void* reporter(void *params) {
 	int minute;
 	int second;
 
-	while(!is_close_pressed()) {
+	claw_status = atomic_load_explicit(&claw_used.status, memory_order_relaxed);
+
+	time(&now);
+	now = time(NULL);
+	now_tm = localtime(&now);
+
+	hour = now_tm->tm_hour;
+	minute = now_tm->tm_min;
+	second = now_tm->tm_sec;
+	sprintf(time_str, "%02d:%02d:%02d", hour, minute, second);
+
+	if (state->lcd->fd >= 0) {
+		// Los elementos sin cambios no modifican el lienzo ni se vuelven a escribir
+		lcd_draw_sprite(state->lcd, X_TITLE, Y_TITLE, &state->title);
+		lcd_draw_sprite(state->lcd, X_CIRCLE - RADIUS, Y_CIRCLE - RADIUS,
+				claw_status ? &state->claw_closed : &state->claw_open);
+		lcd_draw_text(state->lcd, X_TIME, Y_TIME, time_str);
+		lcd_flush(state->lcd);
+	} else {
 		ev3_clear_lcd();
-		pthread_mutex_lock(&claw_used.claw_used_mutex);
-		claw_status = claw_used.status;
-		pthread_mutex_unlock(&claw_used.claw_used_mutex);
-
-		time(&now);
-		now = time(NULL);
-		now_tm = localtime(&now);
-
-		hour = now_tm->tm_hour;
-		minute = now_tm->tm_min;
-		second = now_tm->tm_sec;
-		sprintf(time_str, "%02d:%02d:%02d", hour, minute, second);
-
 		ev3_text_lcd_normal(X_TITLE, Y_TITLE, TITLE);
 		if(claw_status) {
 			ev3_circle_lcd(X_CIRCLE, Y_CIRCLE, RADIUS, COLOR_CIRCLE);
@@ -1185,9 +3842,9 @@ void* reporter(void *params) {
 			ev3_circle_lcd_out(X_CIRCLE, Y_CIRCLE, RADIUS, COLOR_CIRCLE);
 		}
 		ev3_text_lcd_normal(X_TIME, Y_TIME, time_str);
+	}
 
-		incr_timespec(&next_time, &period);
-		CHK(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL));
+	if (task_stats_dump_requested()) {
+		executive_dump(state->tasks, state->n_tasks);
 	}
-	pthread_exit(NULL);
 }
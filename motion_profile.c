@@ -0,0 +1,337 @@
+/*
+ * File: motion_profile.c
+ *
+ * Descripcion: Implementacion de los perfiles de movimiento.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "motion_profile.h"
+
+// Iteraciones de la biseccion del pico de velocidad en recorridos cortos
+#define MOTION_PEAK_ITERATIONS      40
+
+/**
+ * @brief Fase de aceleracion de reposo a speed: duracion total, duracion de cada
+ *        tramo de jerk y aceleracion maxima alcanzada.
+ */
+static void motion_accel_phase(motion_profile_type type, const motion_limits_t *limits,
+		double speed, double *time, double *jerk_time, double *accel) {
+	if (type == MOTION_TRAPEZOIDAL) {
+		*jerk_time = 0.0;
+		*accel = limits->max_accel;
+		*time = speed / limits->max_accel;
+	} else if (speed * limits->max_jerk >= limits->max_accel * limits->max_accel) {
+		// Se alcanza la aceleracion maxima: rampa, tramo constante y rampa
+		*jerk_time = limits->max_accel / limits->max_jerk;
+		*accel = limits->max_accel;
+		*time = speed / limits->max_accel + *jerk_time;
+	} else {
+		// Solo rampas: la aceleracion no llega al maximo
+		*jerk_time = sqrt(speed / limits->max_jerk);
+		*accel = limits->max_jerk * *jerk_time;
+		*time = 2.0 * *jerk_time;
+	}
+}
+
+/**
+ * @brief Distancia recorrida al acelerar de reposo a speed (la fase es simetrica,
+ *        por lo que es la velocidad media por la duracion).
+ */
+static double motion_accel_distance(motion_profile_type type, const motion_limits_t *limits,
+		double speed) {
+	double time, jerk_time, accel;
+	motion_accel_phase(type, limits, speed, &time, &jerk_time, &accel);
+	return speed * time / 2.0;
+}
+
+static void motion_add_segment(motion_profile_t *profile, double duration, double accel,
+		double jerk) {
+	motion_segment_t *segment = &profile->segments[profile->n_segments++];
+	segment->duration = (duration > 0.0) ? duration : 0.0;
+	segment->accel = accel;
+	segment->jerk = jerk;
+	profile->duration += segment->duration;
+}
+
+int motion_profile_plan(motion_profile_t *profile, motion_profile_type type,
+		const motion_limits_t *limits, double start, double target) {
+	if (limits->max_speed <= 0.0 || limits->max_accel <= 0.0 ||
+			(type == MOTION_SCURVE && limits->max_jerk <= 0.0)) {
+		return EINVAL;
+	}
+
+	double distance = fabs(target - start);
+	double sign = (target >= start) ? 1.0 : -1.0;
+
+	// Pico de velocidad: el maximo si da tiempo a acelerar y frenar, si no el que
+	// consume exactamente el recorrido
+	double peak = limits->max_speed;
+	if (2.0 * motion_accel_distance(type, limits, peak) > distance) {
+		double low = 0.0, high = peak;
+		for (int i = 0; i < MOTION_PEAK_ITERATIONS; i++) {
+			double middle = (low + high) / 2.0;
+			if (2.0 * motion_accel_distance(type, limits, middle) > distance) {
+				high = middle;
+			} else {
+				low = middle;
+			}
+		}
+		peak = low;
+	}
+
+	double time, jerk_time, accel;
+	motion_accel_phase(type, limits, peak, &time, &jerk_time, &accel);
+	double cruise = (peak > 0.0) ? (distance - 2.0 * motion_accel_distance(type, limits, peak)) / peak : 0.0;
+
+	profile->start = start;
+	profile->target = target;
+	profile->duration = 0.0;
+	profile->peak_speed = sign * peak;
+	profile->n_segments = 0;
+
+	if (type == MOTION_TRAPEZOIDAL) {
+		motion_add_segment(profile, time, sign * accel, 0.0);
+		motion_add_segment(profile, cruise, 0.0, 0.0);
+		motion_add_segment(profile, time, -sign * accel, 0.0);
+	} else {
+		double jerk = sign * limits->max_jerk;
+		double constant = time - 2.0 * jerk_time;
+		motion_add_segment(profile, jerk_time, 0.0, jerk);
+		motion_add_segment(profile, constant, sign * accel, 0.0);
+		motion_add_segment(profile, jerk_time, sign * accel, -jerk);
+		motion_add_segment(profile, cruise, 0.0, 0.0);
+		motion_add_segment(profile, jerk_time, 0.0, -jerk);
+		motion_add_segment(profile, constant, -sign * accel, 0.0);
+		motion_add_segment(profile, jerk_time, -sign * accel, jerk);
+	}
+	return 0;
+}
+
+int motion_profile_plan_sync(motion_profile_t profiles[], int n, motion_profile_type type,
+		const motion_limits_t limits[], const double start[], const double target[]) {
+	double duration = 0.0;
+	for (int i = 0; i < n; i++) {
+		int error = motion_profile_plan(&profiles[i], type, &limits[i], start[i], target[i]);
+		if (error != 0) {
+			return error;
+		}
+		if (profiles[i].duration > duration) {
+			duration = profiles[i].duration;
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (profiles[i].duration <= 0.0 || profiles[i].duration >= duration) {
+			continue;
+		}
+		double k = duration / profiles[i].duration;
+		motion_limits_t scaled = {
+			limits[i].max_speed / k, limits[i].max_accel / (k * k), limits[i].max_jerk / (k * k * k)
+		};
+		motion_profile_plan(&profiles[i], type, &scaled, start[i], target[i]);
+	}
+	return 0;
+}
+
+void motion_profile_sample(const motion_profile_t *profile, double t, double *position,
+		double *speed) {
+	if (t <= 0.0) {
+		*position = profile->start;
+		*speed = 0.0;
+		return;
+	}
+	if (t >= profile->duration) {
+		*position = profile->target;
+		*speed = 0.0;
+		return;
+	}
+
+	double p = profile->start;
+	double v = 0.0;
+	for (int i = 0; i < profile->n_segments && t > 0.0; i++) {
+		const motion_segment_t *segment = &profile->segments[i];
+		double dt = (t < segment->duration) ? t : segment->duration;
+		p += v * dt + segment->accel * dt * dt / 2.0 + segment->jerk * dt * dt * dt / 6.0;
+		v += segment->accel * dt + segment->jerk * dt * dt / 2.0;
+		t -= dt;
+	}
+	*position = p;
+	*speed = v;
+}
+
+int motion_path_plan(motion_path_t *path, int n_axes, const motion_limits_t limits[],
+		const double points[][MOTION_PATH_MAX_AXES], int n_points) {
+	double duration[MOTION_PATH_MAX_POINTS];
+	double speed[MOTION_PATH_MAX_POINTS + 1][MOTION_PATH_MAX_AXES];
+
+	if (n_axes < 1 || n_axes > MOTION_PATH_MAX_AXES || n_points < 1 || n_points > MOTION_PATH_MAX_POINTS) {
+		return EINVAL;
+	}
+	for (int j = 0; j < n_axes; j++) {
+		if (limits[j].max_speed <= 0.0 || limits[j].max_accel <= 0.0) {
+			return EINVAL;
+		}
+	}
+
+	// Duracion minima de cada tramo: la del eje mas lento a velocidad maxima
+	for (int i = 0; i < n_points - 1; i++) {
+		duration[i] = 0.0;
+		for (int j = 0; j < n_axes; j++) {
+			double time = fabs(points[i + 1][j] - points[i][j]) / limits[j].max_speed;
+			if (time > duration[i]) {
+				duration[i] = time;
+			}
+		}
+	}
+
+	// Mezclas: cambio de velocidad en cada punto a la aceleracion maxima. Si dos
+	// mezclas no caben en su tramo se alarga y se recalcula (al alargar baja la
+	// velocidad y las mezclas se acortan)
+	for (int iteration = 0; iteration < MOTION_PATH_ITERATIONS; iteration++) {
+		for (int j = 0; j < n_axes; j++) {
+			speed[0][j] = 0.0;
+			speed[n_points][j] = 0.0;
+			for (int i = 0; i < n_points - 1; i++) {
+				speed[i + 1][j] = (duration[i] > 0.0) ? (points[i + 1][j] - points[i][j]) / duration[i] : 0.0;
+			}
+		}
+		for (int k = 0; k < n_points; k++) {
+			path->blend[k] = 0.0;
+			for (int j = 0; j < n_axes; j++) {
+				double time = fabs(speed[k + 1][j] - speed[k][j]) / limits[j].max_accel;
+				if (time > path->blend[k]) {
+					path->blend[k] = time;
+				}
+			}
+		}
+		bool fits = true;
+		for (int i = 0; i < n_points - 1; i++) {
+			double needed = (path->blend[i] + path->blend[i + 1]) / 2.0;
+			if (needed > duration[i] * (1.0 + 1e-9)) {
+				duration[i] = needed;
+				fits = false;
+			}
+		}
+		if (fits) {
+			break;
+		}
+	}
+
+	path->n_axes = n_axes;
+	path->n_points = n_points;
+	for (int j = 0; j < n_axes; j++) {
+		path->start[j] = points[0][j];
+	}
+	path->switch_time[0] = path->blend[0] / 2.0;
+	for (int k = 0; k < n_points; k++) {
+		if (k > 0) {
+			path->switch_time[k] = path->switch_time[k - 1] + duration[k - 1];
+		}
+		for (int j = 0; j < n_axes; j++) {
+			path->delta_speed[k][j] = speed[k + 1][j] - speed[k][j];
+		}
+	}
+	path->duration = path->switch_time[n_points - 1] + path->blend[n_points - 1] / 2.0;
+	return 0;
+}
+
+void motion_path_sample(const motion_path_t *path, double t, double position[], double speed[]) {
+	for (int j = 0; j < path->n_axes; j++) {
+		position[j] = path->start[j];
+		speed[j] = 0.0;
+	}
+
+	// La velocidad es la suma de los cambios de cada punto, cada uno aplicado con
+	// una rampa de duracion blend centrada en su paso. Una rampa simetrica recorre
+	// lo mismo que el cambio brusco, por lo que fuera de las mezclas la posicion es
+	// la del recorrido recto entre puntos.
+	for (int k = 0; k < path->n_points; k++) {
+		double begin = path->switch_time[k] - path->blend[k] / 2.0;
+		if (t <= begin) {
+			break;
+		}
+		double ramp, distance;
+		if (t >= begin + path->blend[k]) {
+			ramp = 1.0;
+			distance = t - path->switch_time[k];
+		} else {
+			ramp = (t - begin) / path->blend[k];
+			distance = (t - begin) * (t - begin) / (2.0 * path->blend[k]);
+		}
+		for (int j = 0; j < path->n_axes; j++) {
+			position[j] += path->delta_speed[k][j] * distance;
+			speed[j] += path->delta_speed[k][j] * ramp;
+		}
+	}
+}
+
+double motion_ramp_step(motion_ramp_t *ramp, motion_profile_type type,
+		const motion_limits_t *limits, double target_speed, double dt) {
+	double error = target_speed - ramp->speed;
+	if (error == 0.0 && ramp->accel == 0.0) {
+		return ramp->speed;
+	}
+	double direction = (error > 0.0) ? 1.0 : -1.0;
+
+	if (type == MOTION_TRAPEZOIDAL) {
+		double step = limits->max_accel * dt;
+		ramp->accel = direction * limits->max_accel;
+		if (fabs(error) <= step) {
+			ramp->speed = target_speed;
+			ramp->accel = 0.0;
+		} else {
+			ramp->speed += direction * step;
+		}
+		return ramp->speed;
+	}
+
+	// Cambio de velocidad si la aceleracion actual se lleva a cero a jerk maximo
+	double jerk_step = limits->max_jerk * dt;
+	double braking = ramp->accel * fabs(ramp->accel) / (2.0 * limits->max_jerk);
+	if (direction * (error - braking) > 0.0) {
+		ramp->accel += direction * jerk_step;
+		if (fabs(ramp->accel) > limits->max_accel) {
+			ramp->accel = direction * limits->max_accel;
+		}
+	} else if (fabs(ramp->accel) <= jerk_step) {
+		ramp->accel = 0.0;
+	} else {
+		ramp->accel -= ((ramp->accel > 0.0) ? 1.0 : -1.0) * jerk_step;
+	}
+
+	ramp->speed += ramp->accel * dt;
+	if ((target_speed - ramp->speed) * direction <= 0.0) {
+		ramp->speed = target_speed;
+		ramp->accel = 0.0;
+	}
+	return ramp->speed;
+}
+
+void motion_stats_record(motion_stats_t *stats, long long move_ns, long long settle_ns) {
+	stats->moves++;
+	stats->move_total_ns += move_ns;
+	stats->settle_total_ns += settle_ns;
+	if (move_ns > stats->move_max_ns) {
+		stats->move_max_ns = move_ns;
+	}
+	if (settle_ns > stats->settle_max_ns) {
+		stats->settle_max_ns = settle_ns;
+	}
+}
+
+void motion_stats_print(const char *name, const motion_stats_t *stats) {
+	if (stats->moves == 0) {
+		printf("%s: no moves\n", name);
+		return;
+	}
+	printf("%s: %lu moves, move %.1f ms mean / %.1f ms max, settle %.1f ms mean / %.1f ms max\n",
+			name, stats->moves, stats->move_total_ns / 1e6 / stats->moves, stats->move_max_ns / 1e6,
+			stats->settle_total_ns / 1e6 / stats->moves, stats->settle_max_ns / 1e6);
+}
@@ -0,0 +1,159 @@
+/*
+ * File: motion_profile.h
+ *
+ * Descripcion: Generador de perfiles de movimiento en espacio de usuario. Un
+ *              movimiento entre dos posiciones en reposo se planifica como una
+ *              sucesion de tramos de jerk constante:
+ *              - Trapezoidal: aceleracion maxima, crucero y deceleracion (el jerk
+ *                es infinito en los cambios de tramo).
+ *              - Curva S: ademas limita el jerk, por lo que la aceleracion crece y
+ *                decrece en rampa (hasta siete tramos).
+ *              Si el recorrido es corto no se alcanza la velocidad (o la aceleracion)
+ *              maxima y el perfil se recalcula con un pico menor.
+ *
+ *              Para el movimiento manual (jog) no hay posicion de destino: una rampa
+ *              de velocidad lleva la velocidad actual hacia la pedida con los mismos
+ *              limites.
+ *
+ *              Unidades: grados (posiciones del tacometro) y segundos.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stdbool.h>
+
+// Tramos de un perfil en curva S (el trapezoidal usa tres)
+#define MOTION_MAX_SEGMENTS         7
+
+typedef enum motion_profile_type_enum {MOTION_TRAPEZOIDAL, MOTION_SCURVE} motion_profile_type;
+
+// Limites del movimiento
+typedef struct motion_limits {
+	double max_speed;               // units: deg/s
+	double max_accel;               // units: deg/s^2
+	double max_jerk;                // units: deg/s^3 (solo curva S)
+} motion_limits_t;
+
+// Tramo con aceleracion inicial accel y jerk constante
+typedef struct motion_segment {
+	double duration;
+	double accel;
+	double jerk;
+} motion_segment_t;
+
+// Movimiento planificado
+typedef struct motion_profile {
+	double start;
+	double target;
+	double duration;
+	double peak_speed;
+	int n_segments;
+	motion_segment_t segments[MOTION_MAX_SEGMENTS];
+} motion_profile_t;
+
+// Trayectoria por varios puntos de paso sin detenerse en los intermedios: tramos
+// rectos entre puntos con una velocidad comun a todos los ejes y mezclas de
+// aceleracion constante (a la maxima del eje) centradas en cada punto
+#define MOTION_PATH_MAX_POINTS      64
+#define MOTION_PATH_MAX_AXES        2
+#define MOTION_PATH_ITERATIONS      4
+
+typedef struct motion_path {
+	int n_axes;
+	int n_points;
+	double start[MOTION_PATH_MAX_AXES];
+	double switch_time[MOTION_PATH_MAX_POINTS];     // paso por cada punto
+	double blend[MOTION_PATH_MAX_POINTS];           // duracion de la mezcla en cada punto
+	double delta_speed[MOTION_PATH_MAX_POINTS][MOTION_PATH_MAX_AXES];
+	double duration;
+} motion_path_t;
+
+// Rampa de velocidad para el movimiento manual
+typedef struct motion_ramp {
+	double speed;
+	double accel;
+} motion_ramp_t;
+
+// Duracion de los movimientos: hasta el final del perfil y desde ahi hasta entrar
+// en la tolerancia de posicion (asentamiento)
+typedef struct motion_stats {
+	unsigned long moves;
+	long long move_total_ns;
+	long long move_max_ns;
+	long long settle_total_ns;
+	long long settle_max_ns;
+} motion_stats_t;
+
+/**
+ * @brief Planifica un movimiento en reposo de start a target.
+ *
+ * @return 0 si tiene exito o EINVAL si algun limite no es positivo.
+ */
+int motion_profile_plan(motion_profile_t *profile, motion_profile_type type,
+		const motion_limits_t *limits, double start, double target);
+
+/**
+ * @brief Planifica un movimiento coordinado de n ejes con una duracion comun: cada
+ *        eje se planifica con sus limites y los que terminan antes se reescalan en
+ *        el tiempo (velocidad / k, aceleracion / k^2, jerk / k^3 con k = duracion
+ *        comun / duracion propia), de modo que todos llegan a la vez con la misma
+ *        forma de perfil.
+ *
+ * @return 0 si tiene exito o EINVAL si algun limite no es positivo.
+ */
+int motion_profile_plan_sync(motion_profile_t profiles[], int n, motion_profile_type type,
+		const motion_limits_t limits[], const double start[], const double target[]);
+
+/**
+ * @brief Posicion y velocidad de referencia en el instante t (segundos desde el
+ *        inicio). Antes de 0 y despues de duration devuelve los extremos en reposo.
+ */
+void motion_profile_sample(const motion_profile_t *profile, double t, double *position,
+		double *speed);
+
+/**
+ * @brief Planifica una trayectoria que parte en reposo del primer punto, pasa cerca
+ *        de los intermedios sin detenerse (la mezcla recorta la esquina) y termina
+ *        en reposo en el ultimo. Cada tramo dura lo que necesita el eje mas lento a
+ *        su velocidad maxima; si las mezclas de dos puntos consecutivos no caben en
+ *        el tramo, este se alarga.
+ *
+ * @param points Posiciones de los n_points puntos para los n_axes ejes.
+ *
+ * @return 0 si tiene exito o EINVAL si el numero de puntos o ejes o algun limite
+ *         no es valido.
+ */
+int motion_path_plan(motion_path_t *path, int n_axes, const motion_limits_t limits[],
+		const double points[][MOTION_PATH_MAX_AXES], int n_points);
+
+/**
+ * @brief Posicion y velocidad de referencia de cada eje en el instante t.
+ */
+void motion_path_sample(const motion_path_t *path, double t, double position[], double speed[]);
+
+/**
+ * @brief Avanza la rampa dt segundos hacia target_speed. Con MOTION_SCURVE la
+ *        aceleracion cambia como mucho max_jerk * dt y empieza a reducirse a tiempo
+ *        para llegar a la velocidad pedida sin pasarse.
+ *
+ * @return Velocidad de la rampa tras el paso.
+ */
+double motion_ramp_step(motion_ramp_t *ramp, motion_profile_type type,
+		const motion_limits_t *limits, double target_speed, double dt);
+
+/**
+ * @brief Acumula un movimiento terminado.
+ */
+void motion_stats_record(motion_stats_t *stats, long long move_ns, long long settle_ns);
+
+/**
+ * @brief Imprime el numero de movimientos y su duracion media y maxima.
+ */
+void motion_stats_print(const char *name, const motion_stats_t *stats);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * File: periodic.c
+ *
+ * Descripcion: Implementacion de las tareas periodicas con timerfd y eventfd.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "periodic.h"
+#include "timebase.h"
+
+#define NSEC_PER_SEC                1000000000L
+
+/**
+ * @brief Suma count periodos a un instante.
+ */
+static void periodic_advance(struct timespec *time, const struct timespec *period, uint64_t count) {
+	long long nsec = time->tv_nsec + (long long) period->tv_nsec * count;
+	time->tv_sec += period->tv_sec * count + nsec / NSEC_PER_SEC;
+	time->tv_nsec = nsec % NSEC_PER_SEC;
+}
+
+// eventfd de finalizacion. Nunca se lee, por lo que permanece legible para
+// todas las tareas una vez escrito.
+static int shutdown_fd = -1;
+
+// Orden de finalizacion para las esperas en tiempo virtual, que no usan descriptores
+static atomic_bool shutdown_requested = false;
+
+int periodic_shutdown_init(void) {
+	atomic_store(&shutdown_requested, false);
+	shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shutdown_fd < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+void periodic_shutdown(void) {
+	uint64_t value = 1;
+	atomic_store(&shutdown_requested, true);
+	if (write(shutdown_fd, &value, sizeof(value)) < 0) {
+		perror("periodic_shutdown");
+	}
+	timebase_interrupt();
+}
+
+int periodic_shutdown_fd(void) {
+	return shutdown_fd;
+}
+
+void periodic_shutdown_close(void) {
+	if (shutdown_fd >= 0) {
+		close(shutdown_fd);
+		shutdown_fd = -1;
+	}
+}
+
+#ifdef VIRTUAL_TIME
+
+// En tiempo virtual la tarea duerme en el planificador de timebase hasta su
+// siguiente activacion
+
+int periodic_init(periodic_task_t *task, long period_ns) {
+	task->period.tv_sec = period_ns / NSEC_PER_SEC;
+	task->period.tv_nsec = period_ns % NSEC_PER_SEC;
+	task->timer_fd = -1;
+	task->wake_fd = -1;
+	atomic_store(&task->wake, false);
+	task->owner = pthread_self();
+	timebase_now(&task->release);
+	task->latency_ns = 0;
+	return 0;
+}
+
+int periodic_wait(periodic_task_t *task) {
+	struct timespec next = task->release;
+	struct timespec now;
+
+	if (atomic_load(&shutdown_requested)) {
+		return 0;
+	}
+
+	// Un periodic_wake anterior a la espera adelanta la activacion sin dormir
+	bool woken = atomic_exchange(&task->wake, false);
+	if (!woken) {
+		periodic_advance(&next, &task->period, 1);
+		timebase_sleep_until(&next, true);
+		if (atomic_load(&shutdown_requested)) {
+			return 0;
+		}
+		woken = atomic_exchange(&task->wake, false);
+	}
+	if (woken) {
+		timebase_now(&task->release);
+		task->latency_ns = 0;
+		return 1;
+	}
+
+	// Activaciones vencidas desde la anterior
+	timebase_now(&now);
+	long long period = task->period.tv_sec * (long long) NSEC_PER_SEC + task->period.tv_nsec;
+	long long elapsed = (now.tv_sec - task->release.tv_sec) * (long long) NSEC_PER_SEC +
+			(now.tv_nsec - task->release.tv_nsec);
+	uint64_t expirations = elapsed / period;
+	periodic_advance(&task->release, &task->period, expirations);
+	task->latency_ns = (now.tv_sec - task->release.tv_sec) * (long long) NSEC_PER_SEC +
+			(now.tv_nsec - task->release.tv_nsec);
+	return (int) expirations;
+}
+
+int periodic_set_period(periodic_task_t *task, long period_ns) {
+	task->period.tv_sec = period_ns / NSEC_PER_SEC;
+	task->period.tv_nsec = period_ns % NSEC_PER_SEC;
+	return 0;
+}
+
+void periodic_wake(periodic_task_t *task) {
+	atomic_store(&task->wake, true);
+	timebase_interrupt_thread(task->owner);
+}
+
+#else
+
+/**
+ * @brief Programa el temporizador con el periodo de la tarea a partir de release.
+ */
+static int periodic_arm(periodic_task_t *task) {
+	struct itimerspec spec;
+
+	// Temporizador periodico absoluto: el kernel mantiene las activaciones sin deriva
+	spec.it_value = task->release;
+	periodic_advance(&spec.it_value, &task->period, 1);
+	spec.it_interval = task->period;
+	if (timerfd_settime(task->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int periodic_init(periodic_task_t *task, long period_ns) {
+	task->period.tv_sec = period_ns / NSEC_PER_SEC;
+	task->period.tv_nsec = period_ns % NSEC_PER_SEC;
+	atomic_store(&task->wake, false);
+	task->owner = pthread_self();
+
+	task->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (task->timer_fd < 0) {
+		return errno;
+	}
+	task->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (task->wake_fd < 0) {
+		int error = errno;
+		close(task->timer_fd);
+		task->timer_fd = -1;
+		return error;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &task->release);
+	task->latency_ns = 0;
+	int error = periodic_arm(task);
+	if (error != 0) {
+		periodic_close(task);
+	}
+	return error;
+}
+
+int periodic_wait(periodic_task_t *task) {
+	struct pollfd fds[3] = {
+		{ .fd = task->timer_fd, .events = POLLIN },
+		{ .fd = shutdown_fd, .events = POLLIN },
+		{ .fd = task->wake_fd, .events = POLLIN },
+	};
+	uint64_t expirations;
+	struct timespec now;
+
+	for (;;) {
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("periodic_wait");
+			return 0;
+		}
+		if (fds[1].revents & POLLIN) {
+			return 0;
+		}
+		// Activacion adelantada: el periodo vuelve a contarse desde ahora
+		if ((fds[2].revents & POLLIN) &&
+				read(task->wake_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			clock_gettime(CLOCK_MONOTONIC, &task->release);
+			task->latency_ns = 0;
+			int error = periodic_arm(task);
+			if (error != 0) {
+				fprintf(stderr, "periodic_wait: timerfd_settime: error %d\n", error);
+				return 0;
+			}
+			return 1;
+		}
+		if ((fds[0].revents & POLLIN) &&
+				read(task->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			periodic_advance(&task->release, &task->period, expirations);
+			task->latency_ns = (now.tv_sec - task->release.tv_sec) * (long long) NSEC_PER_SEC +
+					(now.tv_nsec - task->release.tv_nsec);
+			return (int) expirations;
+		}
+	}
+}
+
+int periodic_set_period(periodic_task_t *task, long period_ns) {
+	task->period.tv_sec = period_ns / NSEC_PER_SEC;
+	task->period.tv_nsec = period_ns % NSEC_PER_SEC;
+	return periodic_arm(task);
+}
+
+void periodic_wake(periodic_task_t *task) {
+	uint64_t value = 1;
+	if (write(task->wake_fd, &value, sizeof(value)) < 0) {
+		perror("periodic_wake");
+	}
+}
+
+#endif
+
+void periodic_close(periodic_task_t *task) {
+	if (task->timer_fd >= 0) {
+		close(task->timer_fd);
+		task->timer_fd = -1;
+	}
+	if (task->wake_fd >= 0) {
+		close(task->wake_fd);
+		task->wake_fd = -1;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ * File: periodic.h
+ *
+ * Descripcion: Activacion periodica de tareas con timerfd y difusion de la orden
+ *              de finalizacion. Cada tarea espera a la vez en su temporizador y en
+ *              un eventfd comun, de modo que al pulsar BACK todas las tareas
+ *              dormidas despiertan inmediatamente. El periodo puede cambiarse
+ *              entre activaciones y otro hilo puede adelantar la siguiente
+ *              (periodic_wake), de modo que una tarea con un periodo largo en
+ *              reposo atiende enseguida un cambio de situacion.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Tarea periodica basada en un timerfd. release es el instante teorico de la
+// activacion en curso y latency_ns el retraso con que la tarea ha despertado
+// respecto a el.
+typedef struct periodic_task {
+	int timer_fd;
+	int wake_fd;                    // eventfd de periodic_wake
+	atomic_bool wake;               // periodic_wake en tiempo virtual
+	pthread_t owner;
+	struct timespec period;
+	struct timespec release;
+	long long latency_ns;
+} periodic_task_t;
+
+/**
+ * @brief Crea el eventfd de finalizacion compartido por todas las tareas. Debe
+ *        llamarse antes de crear las tareas.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int periodic_shutdown_init(void);
+
+/**
+ * @brief Despierta a todas las tareas periodicas dormidas y hace que las esperas
+ *        posteriores retornen de inmediato.
+ */
+void periodic_shutdown(void);
+
+/**
+ * @brief Descriptor de la orden de finalizacion, para tareas que esperan en otros
+ *        descriptores (legible una vez dada la orden).
+ */
+int periodic_shutdown_fd(void);
+
+/**
+ * @brief Libera el eventfd de finalizacion.
+ */
+void periodic_shutdown_close(void);
+
+/**
+ * @brief Inicializa una tarea periodica. La llamada cuenta como activacion inicial
+ *        y la siguiente se produce un periodo despues.
+ *
+ * @param task Tarea a inicializar.
+ * @param period_ns Periodo de la tarea (nsec).
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int periodic_init(periodic_task_t *task, long period_ns);
+
+/**
+ * @brief Espera a la siguiente activacion de la tarea o a la orden de finalizacion.
+ *        Actualiza release y latency_ns.
+ *
+ * @return Numero de activaciones vencidas desde la ultima espera (mayor que 1 si la
+ *         tarea se ha retrasado) o 0 si ha despertado por finalizacion.
+ */
+int periodic_wait(periodic_task_t *task);
+
+/**
+ * @brief Cambia el periodo: la siguiente activacion se produce period_ns despues de
+ *        la activacion en curso. Solo debe llamarla la propia tarea.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int periodic_set_period(periodic_task_t *task, long period_ns);
+
+/**
+ * @brief Adelanta al instante actual la siguiente activacion de la tarea, que
+ *        devuelve 1 en periodic_wait. Las activaciones posteriores se cuentan desde
+ *        la adelantada. Puede llamarse desde cualquier hilo.
+ */
+void periodic_wake(periodic_task_t *task);
+
+/**
+ * @brief Libera el temporizador de la tarea.
+ */
+void periodic_close(periodic_task_t *task);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * File: pid.c
+ *
+ * Descripcion: Implementacion del controlador PID de posicion.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "pid.h"
+
+void pid_init(pid_controller_t *pid, double kp, double ki, double kd, double output_limit) {
+	pid->kp = kp;
+	pid->ki = ki;
+	pid->kd = kd;
+	pid->output_limit = output_limit;
+	pid_reset(pid);
+}
+
+void pid_reset(pid_controller_t *pid) {
+	pid->integral = 0.0;
+	pid->previous_error = 0.0;
+	pid->running = false;
+}
+
+double pid_update(pid_controller_t *pid, double error, double feedforward, double dt, bool *saturated) {
+	double derivative = pid->running ? (error - pid->previous_error) / dt : 0.0;
+	pid->previous_error = error;
+	pid->running = true;
+
+	// Integracion condicional: se descarta el paso si satura en el sentido del error
+	double integral = pid->integral + error * dt;
+	double output = feedforward + pid->kp * error + pid->ki * integral + pid->kd * derivative;
+	bool clipped = fabs(output) > pid->output_limit;
+	if (!clipped || (output > 0.0) != (error > 0.0)) {
+		pid->integral = integral;
+	} else {
+		output = feedforward + pid->kp * error + pid->ki * pid->integral + pid->kd * derivative;
+	}
+
+	if (saturated != NULL) {
+		*saturated = clipped;
+	}
+	return fmax(-pid->output_limit, fmin(pid->output_limit, output));
+}
+
+void pid_stats_record(pid_stats_t *stats, double error, bool saturated) {
+	stats->ticks++;
+	stats->square_total += error * error;
+	if (fabs(error) > stats->max_error) {
+		stats->max_error = fabs(error);
+	}
+	stats->saturated += saturated;
+}
+
+void pid_stats_print(const char *name, const pid_stats_t *stats) {
+	if (stats->ticks == 0) {
+		printf("%s: no ticks\n", name);
+		return;
+	}
+	printf("%s: %lu ticks, tracking error %.2f deg RMS / %.1f deg max, %lu saturated\n", name,
+			stats->ticks, sqrt(stats->square_total / stats->ticks), stats->max_error, stats->saturated);
+}
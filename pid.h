@@ -0,0 +1,70 @@
+/*
+ * File: pid.h
+ *
+ * Descripcion: Controlador PID de posicion para el bucle de los motores en
+ *              run-direct. La salida es la potencia (duty cycle): la prealimentacion
+ *              de velocidad mas la correccion PID del error de posicion, saturada a
+ *              output_limit. Para evitar el windup la integral solo acumula si la
+ *              salida no esta saturada o si el error la saca de la saturacion.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef PID_H
+#define PID_H
+
+#include <stdbool.h>
+
+typedef struct pid_controller {
+	double kp;                      // units: % por grado
+	double ki;                      // units: % por grado y segundo
+	double kd;                      // units: % por grado/seg
+	double output_limit;            // units: %
+	double integral;
+	double previous_error;
+	bool running;                   // hay error anterior para la derivada
+} pid_controller_t;
+
+// Error de seguimiento de un eje en cada periodo del bucle
+typedef struct pid_stats {
+	unsigned long ticks;
+	double square_total;
+	double max_error;
+	unsigned long saturated;        // periodos con la salida saturada
+} pid_stats_t;
+
+/**
+ * @brief Inicializa las ganancias y deja el controlador sin historia.
+ */
+void pid_init(pid_controller_t *pid, double kp, double ki, double kd, double output_limit);
+
+/**
+ * @brief Borra la integral y el error anterior (al empezar un movimiento).
+ */
+void pid_reset(pid_controller_t *pid);
+
+/**
+ * @brief Un periodo del bucle.
+ *
+ * @param error Referencia menos posicion (grados).
+ * @param feedforward Potencia correspondiente a la velocidad de referencia (%).
+ * @param dt Periodo (segundos).
+ * @param saturated Si no es NULL, devuelve si la salida se ha recortado.
+ *
+ * @return Potencia (%), en [-output_limit, output_limit].
+ */
+double pid_update(pid_controller_t *pid, double error, double feedforward, double dt, bool *saturated);
+
+/**
+ * @brief Registra el error de seguimiento de un periodo.
+ */
+void pid_stats_record(pid_stats_t *stats, double error, bool saturated);
+
+/**
+ * @brief Imprime el numero de periodos, el error cuadratico medio y el maximo.
+ */
+void pid_stats_print(const char *name, const pid_stats_t *stats);
+
+#endif
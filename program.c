@@ -0,0 +1,168 @@
+/*
+ * File: program.c
+ *
+ * Descripcion: Implementacion de los programas de teach-and-repeat.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "program.h"
+
+#define PROGRAM_MAGIC               0x50524d41u // "ARMP"
+#define PROGRAM_VERSION             1
+
+// Cabecera: magic (4), version (2), puntos (2), suma de comprobacion (4)
+#define PROGRAM_HEADER_SIZE         12
+#define PROGRAM_WAYPOINT_SIZE       5
+#define PROGRAM_MAX_SIZE            (PROGRAM_HEADER_SIZE + PROGRAM_MAX_WAYPOINTS * PROGRAM_WAYPOINT_SIZE)
+
+#define PATH_SIZE                   256
+
+static const char* program_path() {
+	const char *path = getenv(PROGRAM_FILE_ENV);
+	return (path != NULL) ? path : PROGRAM_FILE_DEFAULT;
+}
+
+static void program_put16(uint8_t *p, uint16_t value) {
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+static void program_put32(uint8_t *p, uint32_t value) {
+	program_put16(p, value & 0xffff);
+	program_put16(p + 2, value >> 16);
+}
+
+static uint16_t program_get16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t program_get32(const uint8_t *p) {
+	return program_get16(p) | ((uint32_t) program_get16(p + 2) << 16);
+}
+
+/**
+ * @brief FNV-1a de los puntos de paso.
+ */
+static uint32_t program_checksum(const uint8_t *bytes, size_t size) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+program_mode program_get_mode(void) {
+	const char *mode = getenv(PROGRAM_MODE_ENV);
+	if (mode == NULL) {
+		return PROGRAM_OFF;
+	}
+	if (strcmp(mode, "teach") == 0) {
+		return PROGRAM_TEACH;
+	}
+	if (strcmp(mode, "repeat") == 0) {
+		return PROGRAM_REPEAT;
+	}
+	return PROGRAM_OFF;
+}
+
+int program_add(program_t *program, int32_t rotation, int32_t elevation, bool claw_closed) {
+	if (program->n_waypoints >= PROGRAM_MAX_WAYPOINTS) {
+		return ENOSPC;
+	}
+	if (rotation < INT16_MIN || rotation > INT16_MAX || elevation < INT16_MIN || elevation > INT16_MAX) {
+		return ERANGE;
+	}
+	program_waypoint_t *waypoint = &program->waypoints[program->n_waypoints++];
+	waypoint->rotation = (int16_t) rotation;
+	waypoint->elevation = (int16_t) elevation;
+	waypoint->claw_closed = claw_closed;
+	return 0;
+}
+
+size_t program_size(const program_t *program) {
+	return PROGRAM_HEADER_SIZE + (size_t) program->n_waypoints * PROGRAM_WAYPOINT_SIZE;
+}
+
+int program_load(program_t *program) {
+	uint8_t buffer[PROGRAM_MAX_SIZE + 1];
+	int fd = open(program_path(), O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	ssize_t n = read(fd, buffer, sizeof(buffer));
+	int error = (n < 0) ? errno : 0;
+	close(fd);
+	if (error != 0) {
+		return error;
+	}
+
+	if (n < PROGRAM_HEADER_SIZE || program_get32(buffer) != PROGRAM_MAGIC ||
+			program_get16(buffer + 4) != PROGRAM_VERSION) {
+		return EINVAL;
+	}
+	int n_waypoints = program_get16(buffer + 6);
+	size_t size = (size_t) n_waypoints * PROGRAM_WAYPOINT_SIZE;
+	if (n_waypoints > PROGRAM_MAX_WAYPOINTS || n != (ssize_t) (PROGRAM_HEADER_SIZE + size) ||
+			program_get32(buffer + 8) != program_checksum(buffer + PROGRAM_HEADER_SIZE, size)) {
+		return EINVAL;
+	}
+
+	program->n_waypoints = n_waypoints;
+	for (int i = 0; i < n_waypoints; i++) {
+		const uint8_t *p = buffer + PROGRAM_HEADER_SIZE + i * PROGRAM_WAYPOINT_SIZE;
+		program->waypoints[i].rotation = (int16_t) program_get16(p);
+		program->waypoints[i].elevation = (int16_t) program_get16(p + 2);
+		program->waypoints[i].claw_closed = p[4] != 0;
+	}
+	return 0;
+}
+
+int program_save(const program_t *program) {
+	uint8_t buffer[PROGRAM_MAX_SIZE];
+	const char *path = program_path();
+	char tmp_path[PATH_SIZE];
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path)) {
+		return ENAMETOOLONG;
+	}
+
+	size_t size = (size_t) program->n_waypoints * PROGRAM_WAYPOINT_SIZE;
+	for (int i = 0; i < program->n_waypoints; i++) {
+		uint8_t *p = buffer + PROGRAM_HEADER_SIZE + i * PROGRAM_WAYPOINT_SIZE;
+		program_put16(p, (uint16_t) program->waypoints[i].rotation);
+		program_put16(p + 2, (uint16_t) program->waypoints[i].elevation);
+		p[4] = program->waypoints[i].claw_closed ? 1 : 0;
+	}
+	program_put32(buffer, PROGRAM_MAGIC);
+	program_put16(buffer + 4, PROGRAM_VERSION);
+	program_put16(buffer + 6, (uint16_t) program->n_waypoints);
+	program_put32(buffer + 8, program_checksum(buffer + PROGRAM_HEADER_SIZE, size));
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return errno;
+	}
+	int error = 0;
+	if (write(fd, buffer, PROGRAM_HEADER_SIZE + size) != (ssize_t) (PROGRAM_HEADER_SIZE + size)) {
+		error = (errno != 0) ? errno : EIO;
+	} else if (fsync(fd) != 0) {
+		error = errno;
+	}
+	close(fd);
+	if (error == 0 && rename(tmp_path, path) != 0) {
+		error = errno;
+	}
+	if (error != 0) {
+		unlink(tmp_path);
+	}
+	return error;
+}
@@ -0,0 +1,81 @@
+/*
+ * File: program.h
+ *
+ * Descripcion: Programas de teach-and-repeat. En modo teach se graban puntos de
+ *              paso (posicion de la rotacion y la elevacion respecto al origen
+ *              del homing y estado de la garra) mientras el operador mueve el brazo
+ *              con la botonera; en modo repeat se reproducen en bucle.
+ *
+ *              El fichero es binario y compacto: una cabecera de 12 bytes y 5 bytes
+ *              por punto (dos posiciones de 16 bits y la garra), en little-endian
+ *              con independencia de la maquina.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Variable de entorno con la ruta del programa
+#define PROGRAM_FILE_ENV            "EV3_PROGRAM"
+#define PROGRAM_FILE_DEFAULT        "robotic_arm.prg"
+
+// Variable de entorno con el modo: teach (graba) o repeat (reproduce)
+#define PROGRAM_MODE_ENV            "EV3_PROGRAM_MODE"
+
+#define PROGRAM_MAX_WAYPOINTS       64
+
+typedef enum program_mode_enum {PROGRAM_OFF, PROGRAM_TEACH, PROGRAM_REPEAT} program_mode;
+
+typedef struct program_waypoint {
+	int16_t rotation;
+	int16_t elevation;
+	bool claw_closed;
+} program_waypoint_t;
+
+typedef struct program {
+	int n_waypoints;
+	program_waypoint_t waypoints[PROGRAM_MAX_WAYPOINTS];
+} program_t;
+
+/**
+ * @brief Modo indicado por PROGRAM_MODE_ENV (PROGRAM_OFF si no esta definido o
+ *        no es valido).
+ */
+program_mode program_get_mode(void);
+
+/**
+ * @brief Anade un punto de paso al final del programa.
+ *
+ * @return 0 si tiene exito, ENOSPC si el programa esta lleno o ERANGE si alguna
+ *         posicion no cabe en 16 bits.
+ */
+int program_add(program_t *program, int32_t rotation, int32_t elevation, bool claw_closed);
+
+/**
+ * @brief Tamaño en bytes del programa en el fichero.
+ */
+size_t program_size(const program_t *program);
+
+/**
+ * @brief Lee el programa.
+ *
+ * @return 0 si tiene exito, EINVAL si el fichero no es un programa valido o el
+ *         codigo de error (errno).
+ */
+int program_load(program_t *program);
+
+/**
+ * @brief Guarda el programa (fichero temporal y renombrado, como la calibracion).
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int program_save(const program_t *program);
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * File: error_checks.h
+ *
+ * Descripcion: Comprobacion de errores de las llamadas POSIX para compilar con el
+ *              simulador fuera del entorno de la asignatura.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef ERROR_CHECKS_H
+#define ERROR_CHECKS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Termina el programa si la llamada devuelve un codigo de error
+#define CHK(p) { int ret; \
+		if ((ret = p)) { \
+			printf("Error: "#p": %s\n", strerror(ret)); \
+			exit(-1); \
+		} \
+	}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * File: ev3c.h
+ *
+ * Descripcion: Simulador del subconjunto de la API de ev3c que usa el programa
+ *              (motores, sensores, botonera, leds y LCD). Compilando con -Isim
+ *              esta cabecera sustituye a la de ev3c y el mismo main.c se ejecuta
+ *              en un PC sin el brick. Ver ev3c_sim.c para el modelo fisico.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef EV3C_H
+#define EV3C_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+// Indica a quien lo necesite que se compila contra el simulador
+#define EV3C_SIM                    1
+
+// Dimensiones del LCD
+#define EV3_X_LCD                   178
+#define EV3_Y_LCD                   128
+
+// Estado de los motores (mascara)
+#define MOTOR_RUNNING               1
+#define MOTOR_RAMPING               2
+#define MOTOR_HOLDING               4
+#define MOTOR_STALLED               8
+
+// Botones
+enum ev3_button_enum {BUTTON_LEFT, BUTTON_UP, BUTTON_RIGHT, BUTTON_DOWN, BUTTON_CENTER, BUTTON_BACK};
+
+// Leds
+enum ev3_led_enum {LEFT_LED, RIGHT_LED};
+enum ev3_led_color_enum {GREEN_LED, RED_LED};
+
+typedef union ev3_sensor_val_union {
+	int8_t s8;
+	uint8_t u8;
+	int16_t s16;
+	uint16_t u16;
+	int32_t s32;
+	uint32_t u32;
+	float f;
+} ev3_sensor_val;
+
+typedef struct ev3_sensor_struct {
+	int32_t driver_identifier;
+	int32_t port;
+	int32_t sensor_nr;
+	int32_t mode;
+	int32_t data_count;
+	ev3_sensor_val val_data[8];
+	struct ev3_sensor_struct *next;
+} ev3_sensor, *ev3_sensor_ptr;
+
+typedef struct ev3_motor_struct {
+	int32_t driver_identifier;
+	char port;
+	int32_t motor_nr;
+	int32_t max_speed;
+	struct ev3_motor_struct *next;
+} ev3_motor, *ev3_motor_ptr;
+
+/* Motores */
+ev3_motor_ptr ev3_load_motors(void);
+ev3_motor_ptr ev3_search_motor_by_port(ev3_motor_ptr motors, char port);
+ev3_motor_ptr ev3_open_motor(ev3_motor_ptr motor);
+void ev3_reset_motor(ev3_motor_ptr motor);
+void ev3_delete_motors(ev3_motor_ptr motors);
+int32_t ev3_motor_state(ev3_motor_ptr motor);
+int32_t ev3_get_position(ev3_motor_ptr motor);
+void ev3_set_position(ev3_motor_ptr motor, int32_t position);
+void ev3_set_position_sp(ev3_motor_ptr motor, int32_t position_sp);
+void ev3_set_speed_sp(ev3_motor_ptr motor, int32_t speed_sp);
+void ev3_set_duty_cycle_sp(ev3_motor_ptr motor, int32_t duty_cycle_sp);
+void ev3_command_motor_by_name(ev3_motor_ptr motor, char *command);
+void ev3_stop_action_motor_by_name(ev3_motor_ptr motor, char *stop_action);
+
+/* Sensores */
+ev3_sensor_ptr ev3_load_sensors(void);
+ev3_sensor_ptr ev3_search_sensor_by_port(ev3_sensor_ptr sensors, int32_t port);
+ev3_sensor_ptr ev3_open_sensor(ev3_sensor_ptr sensor);
+void ev3_close_sensor(ev3_sensor_ptr sensor);
+void ev3_delete_sensors(ev3_sensor_ptr sensors);
+void ev3_mode_sensor(ev3_sensor_ptr sensor, int32_t mode);
+ev3_sensor_ptr ev3_update_sensor_val(ev3_sensor_ptr sensor);
+
+/* Botonera */
+int32_t ev3_init_button(void);
+int32_t ev3_button_pressed(int32_t button);
+void ev3_quit_button(void);
+
+/* Leds */
+int32_t ev3_init_led(void);
+void ev3_set_led(int32_t led, int32_t color, int32_t value);
+void ev3_quit_led(void);
+
+/* LCD */
+int32_t ev3_init_lcd(void);
+void ev3_clear_lcd(void);
+void ev3_text_lcd_normal(int32_t x, int32_t y, const char *text);
+void ev3_circle_lcd(int32_t x, int32_t y, int32_t r, int32_t color);
+void ev3_circle_lcd_out(int32_t x, int32_t y, int32_t r, int32_t color);
+void ev3_quit_lcd(void);
+
+#endif
@@ -0,0 +1,961 @@
+/*
+ * File: ev3c_sim.c
+ *
+ * Descripcion: Simulador del brazo para ejecutar el programa sin el brick.
+ *
+ *              Cada motor se modela como un sistema de primer orden: el ciclo de
+ *              trabajo (run-direct) o el controlador de posicion (run-to-*-pos)
+ *              fija una velocidad objetivo a la que el motor converge con una
+ *              constante de tiempo, y la velocidad se integra en la posicion. Los
+ *              topes mecanicos detienen el eje y, si el motor sigue empujando, lo
+ *              marcan como bloqueado (stalled). El estado se integra en pasos de
+ *              1 ms cada vez que se llama a la API, por lo que no hace falta un
+ *              hilo de simulacion.
+ *
+ *              Geometria (en grados de eje respecto a la posicion de partida):
+ *              - Rotacion (puerto C): el fin de carrera (sensor de contacto en el
+ *                puerto 2) esta en el sentido horario, con el tope justo detras.
+ *              - Elevacion (puerto B): la luz reflejada (sensor de color en el
+ *                puerto 1) crece al acercarse al tope superior. En run-direct el
+ *                motor tiene rozamiento seco y la gravedad tira del brazo hacia
+ *                abajo con el coseno del angulo; con la garra cerrada la gravedad
+ *                crece en la fraccion EV3_SIM_LOAD (carga en la garra).
+ *              - Garra (puerto A): topes de cierre y apertura.
+ *              - Piezas (EV3_SIM_OBJECTS): colores de las piezas que llegan a la
+ *                mesa, en orden y repetidos, p.ej. "5 2 4". La garra coge la
+ *                siguiente al cerrarse a la altura de la mesa y la deja al abrirse
+ *                (en la mesa, en la rotacion de ese momento; mas arriba, se cae).
+ *                En COL-COLOR el sensor ve el color de la pieza agarrada cerca
+ *                del tope superior. Tras un cambio de modo el sensor sigue dando
+ *                valores del modo anterior durante SIM_MODE_SETTLE_NS.
+ *
+ *              La botonera sigue un guion (EV3_SIM_BUTTONS) con instantes en ms
+ *              desde la primera consulta de un boton, p.ej. "0:R+ 3000:R- 9000:B+".
+ *              Con EV3_SIM_DURATION (segundos) el guion se repite, sin sus
+ *              pulsaciones de BACK, hasta esa duracion y entonces se pulsa BACK.
+ *              La posicion de los ejes se guarda al terminar en EV3_SIM_STATE
+ *              (por defecto ev3c_sim.state; vacia para no guardarla) y se recupera
+ *              al arrancar, como en un brazo real.
+ *              Con EV3_SIM_TRACE se imprimen en stderr las ordenes a los motores,
+ *              los cambios de los leds y las pulsaciones.
+ *
+ *              El reloj es el de timebase.h, por lo que compilando con
+ *              VIRTUAL_TIME la simulacion avanza en tiempo virtual. Al terminar se
+ *              imprime un resumen de las ordenes recibidas por los motores que
+ *              permite comprobar que dos ejecuciones son identicas y, con piezas,
+ *              donde ha quedado cada color.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ev3c.h"
+#include "timebase.h"
+
+#define NSEC_PER_SEC                1000000000LL
+#define NSEC_PER_MSEC               1000000LL
+
+// Paso de integracion y maximo tiempo integrado de una vez
+#define SIM_STEP_NS                 1000000LL
+#define SIM_MAX_ADVANCE_NS          (10 * NSEC_PER_SEC)
+
+// Motores simulados
+#define SIM_MOTORS                  3
+#define SIM_LARGE_MAX_SPEED         1050    // units: deg/s
+#define SIM_MEDIUM_MAX_SPEED        1560    // units: deg/s
+#define SIM_LARGE_TAU               0.04    // units: s
+#define SIM_MEDIUM_TAU              0.025   // units: s
+
+// Controlador de posicion del driver
+#define SIM_POSITION_GAIN           8.0     // units: 1/s
+#define SIM_POSITION_TOLERANCE      1.5     // units: deg
+#define SIM_SETTLED_SPEED           30.0    // units: deg/s
+
+// Tiempo empujando contra un tope hasta marcar el motor como bloqueado
+#define SIM_STALL_TIME              0.1     // units: s
+
+// Geometria de la rotacion: fin de carrera horario y topes
+#define SIM_ROTATION_TOUCH          300.0
+#define SIM_ROTATION_CW_STOP        (SIM_ROTATION_TOUCH + 15.0)
+#define SIM_ROTATION_CCW_STOP       (SIM_ROTATION_TOUCH - 900.0)
+
+// Geometria de la elevacion (negativo hacia arriba) y luz reflejada
+#define SIM_ELEVATION_TOP_STOP      -200.0
+#define SIM_ELEVATION_BOTTOM_STOP   (SIM_ELEVATION_TOP_STOP + 400.0)
+#define SIM_REFLECTION_BASE         8
+#define SIM_REFLECTION_PEAK         60
+#define SIM_REFLECTION_RANGE        80.0    // distancia al tope en la que crece el reflejo
+
+// Gravedad y rozamiento de la elevacion, como potencia equivalente (%)
+#define SIM_GRAVITY_DUTY            6.0     // hacia abajo, con el brazo horizontal
+#define SIM_FRICTION_DUTY           8.0
+#define SIM_ELEVATION_HORIZONTAL    -50.0   // posicion con el brazo horizontal
+#define SIM_ELEVATION_RATIO         5.0     // grados de motor por grado del brazo
+#define SIM_LOAD_ENV                "EV3_SIM_LOAD"
+#define SIM_LOAD_GRIP_UNITS         20.0    // garra cerrada (con carga) cerca del tope
+
+// Geometria de la garra (negativo cierra)
+#define SIM_CLAW_CLOSED_STOP        -150.0
+#define SIM_CLAW_OPEN_STOP          (SIM_CLAW_CLOSED_STOP + 250.0)
+
+// Sensores simulados
+#define SIM_COLOR_PORT              1
+#define SIM_TOUCH_PORT              2
+#define SIM_COLOR_MODE_REFLECT      0
+#define SIM_COLOR_MODE_AMBIENT      1
+#define SIM_AMBIENT_VALUE           10
+#define SIM_MODE_SETTLE_NS          (50 * NSEC_PER_MSEC)
+
+// Piezas: mesa cerca del tope inferior y sensor que ve la pieza cerca del superior
+#define SIM_OBJECTS_ENV             "EV3_SIM_OBJECTS"
+#define SIM_MAX_OBJECTS             32
+#define SIM_COLORS                  8
+#define SIM_TABLE_HEIGHT            (SIM_ELEVATION_BOTTOM_STOP - 120.0)
+#define SIM_COLOR_RANGE             70.0    // distancia al tope en la que se ve la pieza
+
+// Guion de la botonera
+#define SIM_BUTTONS_ENV             "EV3_SIM_BUTTONS"
+#define SIM_TRACE_ENV               "EV3_SIM_TRACE"
+#define SIM_DURATION_ENV            "EV3_SIM_DURATION"
+
+// Estado mecanico (posicion de los ejes) que se conserva entre ejecuciones
+#define SIM_STATE_ENV               "EV3_SIM_STATE"
+#define SIM_STATE_DEFAULT           "ev3c_sim.state"
+#define SIM_SCRIPT_GAP_NS           (1000 * NSEC_PER_MSEC)  // pausa entre repeticiones
+#define SIM_MAX_BUTTON_EVENTS       64
+#define SIM_DEFAULT_BUTTONS         "0:R+ 3000:R- 3500:U+ 6000:U- 6500:C+ 6700:C- " \
+                                    "8000:C+ 8200:C- 9000:B+"
+
+typedef enum sim_mode_enum {SIM_STOPPED, SIM_DIRECT, SIM_FOREVER, SIM_POSITION} sim_mode;
+
+typedef struct sim_motor {
+	ev3_motor_ptr motor;
+	char port;
+	double tau;
+	double gravity;                 // potencia equivalente de la gravedad (0: sin gravedad)
+	double friction;                // potencia equivalente del rozamiento seco
+	double min_stop;                // topes mecanicos
+	double max_stop;
+
+	double position;                // posicion del eje (grados)
+	double speed;                   // velocidad del eje (grados/s)
+	double offset;                  // posicion del eje con tacometro a cero (entera: las
+	                                // marcas del encoder no se mueven al ponerlo a cero)
+	double hold_position;
+	double target;                  // objetivo de run-to-*-pos
+
+	sim_mode mode;
+	bool hold;                      // stop_action = hold
+	bool stopped_by_command;
+	int32_t duty_cycle_sp;
+	int32_t speed_sp;
+	int32_t position_sp;
+	double stall_time;
+	bool stalled;
+} sim_motor_t;
+
+typedef struct sim_button_event {
+	long long time_ns;
+	int button;
+	bool pressed;
+} sim_button_event_t;
+
+static pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sim_motor_t sim_motors[SIM_MOTORS];
+static long long sim_last_ns = -1;
+static bool sim_trace;
+static double sim_load;                     // gravedad adicional con la garra cerrada
+
+static sim_button_event_t sim_button_events[SIM_MAX_BUTTON_EVENTS];
+static int sim_n_button_events;
+static int sim_next_button_event;
+static long long sim_script_period_ns;      // 0: el guion no se repite
+static long long sim_script_offset_ns;      // inicio de la repeticion en curso
+static long long sim_duration_ns;
+static long long sim_buttons_start_ns = -1;
+static bool sim_buttons[BUTTON_BACK + 1];
+
+static int sim_leds[2][2];
+
+static int32_t sim_color_mode;              // modo del sensor de color ya asentado
+static long long sim_color_mode_ns = -1;    // instante del ultimo cambio de modo
+
+static int sim_objects[SIM_MAX_OBJECTS];
+static int sim_n_objects;
+static int sim_next_object;
+static bool sim_gripping;
+static int sim_held = -1;                   // color de la pieza agarrada (-1: ninguna)
+static unsigned long sim_placed[SIM_COLORS];
+static double sim_placed_min[SIM_COLORS];   // rotacion (tacometro) de las piezas dejadas
+static double sim_placed_max[SIM_COLORS];
+static unsigned long sim_dropped;
+
+// Resumen (FNV-1a) de las ordenes a los motores: instante, puerto, orden y posicion
+#define SIM_DIGEST_BASIS            0xcbf29ce484222325ULL
+#define SIM_DIGEST_PRIME            0x100000001b3ULL
+static unsigned long long sim_digest = SIM_DIGEST_BASIS;
+static unsigned long sim_commands;
+
+/**
+ * @brief Reloj del simulador.
+ */
+static long long sim_now_ns(void) {
+	struct timespec now;
+	timebase_now(&now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/**
+ * @brief Traza en stderr con el instante relativo al arranque del simulador.
+ */
+static void sim_log(const char *format, const char *a, const char *b) {
+	static long long start = -1;
+	if (!sim_trace) {
+		return;
+	}
+	long long now = sim_now_ns();
+	if (start < 0) {
+		start = now;
+	}
+	fprintf(stderr, "[sim %8.3f] ", (now - start) / 1e9);
+	fprintf(stderr, format, a, b);
+	fprintf(stderr, "\n");
+}
+
+static void sim_digest_bytes(const void *data, size_t size) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		sim_digest = (sim_digest ^ bytes[i]) * SIM_DIGEST_PRIME;
+	}
+}
+
+/**
+ * @brief Fichero del estado mecanico, teniendo en cuenta SIM_STATE_ENV. NULL si se
+ *        ha desactivado (variable vacia).
+ */
+static const char* sim_state_path(void) {
+	const char *path = getenv(SIM_STATE_ENV);
+	if (path == NULL) {
+		return SIM_STATE_DEFAULT;
+	}
+	return (path[0] != '\0') ? path : NULL;
+}
+
+/**
+ * @brief Recupera la posicion de los ejes de la ejecucion anterior, como un brazo
+ *        real que se queda donde se dejo. Llamar con sim_mutex.
+ */
+static void sim_load_state(void) {
+	const char *path = sim_state_path();
+	FILE *file = (path != NULL) ? fopen(path, "r") : NULL;
+	if (file == NULL) {
+		return;
+	}
+	double position[SIM_MOTORS];
+	if (fscanf(file, "%lf %lf %lf", &position[0], &position[1], &position[2]) == SIM_MOTORS) {
+		for (int i = 0; i < SIM_MOTORS; i++) {
+			sim_motor_t *m = &sim_motors[i];
+			m->position = (position[i] < m->min_stop) ? m->min_stop :
+					(position[i] > m->max_stop) ? m->max_stop : position[i];
+			m->offset = round(m->position);
+		}
+	}
+	fclose(file);
+}
+
+/**
+ * @brief Guarda la posicion de los ejes. Llamar con sim_mutex.
+ */
+static void sim_save_state(void) {
+	const char *path = sim_state_path();
+	FILE *file = (path != NULL) ? fopen(path, "w") : NULL;
+	if (file == NULL) {
+		return;
+	}
+	fprintf(file, "%.6f %.6f %.6f\n", sim_motors[0].position, sim_motors[1].position,
+			sim_motors[2].position);
+	fclose(file);
+}
+
+static double sim_clamp(double value, double min, double max) {
+	return (value < min) ? min : (value > max) ? max : value;
+}
+
+static sim_motor_t* sim_motor_by_port(char port);
+
+static double sim_tacho(const sim_motor_t *m) {
+	return m->position - m->offset;
+}
+
+/**
+ * @brief Velocidad de regimen en run-direct: la potencia mas la gravedad, menos el
+ *        rozamiento seco, que la detiene si no lo supera.
+ */
+static double sim_direct_speed(const sim_motor_t *m, double duty) {
+	if (m->gravity == 0.0 && m->friction == 0.0) {
+		return duty / 100.0 * m->motor->max_speed;
+	}
+	const sim_motor_t *claw = sim_motor_by_port('A');
+	bool loaded = claw != NULL && claw->position < SIM_CLAW_CLOSED_STOP + SIM_LOAD_GRIP_UNITS;
+	double angle = (m->position - SIM_ELEVATION_HORIZONTAL) / SIM_ELEVATION_RATIO * M_PI / 180.0;
+	double effective = duty + m->gravity * cos(angle) * (loaded ? 1.0 + sim_load : 1.0);
+	if (fabs(effective) <= m->friction) {
+		return 0.0;
+	}
+	return (effective - copysign(m->friction, effective)) / 100.0 * m->motor->max_speed;
+}
+
+/**
+ * @brief Un paso de integracion de un motor.
+ */
+static void sim_motor_step(sim_motor_t *m, double dt) {
+	double max_speed = m->motor->max_speed;
+	double target_speed = 0.0;
+	double drive = 0.0;             // sentido en el que empuja el motor
+
+	switch (m->mode) {
+		case SIM_DIRECT:
+			target_speed = sim_direct_speed(m, m->duty_cycle_sp);
+			drive = m->duty_cycle_sp;
+			break;
+		case SIM_FOREVER:
+			target_speed = sim_clamp(m->speed_sp, -max_speed, max_speed);
+			drive = m->speed_sp;
+			break;
+		case SIM_POSITION: {
+			double limit = fabs((double) m->speed_sp);
+			target_speed = sim_clamp(SIM_POSITION_GAIN * (m->target - m->position), -limit, limit);
+			drive = target_speed;
+			if (fabs(m->target - m->position) < SIM_POSITION_TOLERANCE &&
+					fabs(m->speed) < SIM_SETTLED_SPEED) {
+				m->mode = SIM_STOPPED;
+				m->stopped_by_command = false;
+				m->hold_position = m->target;
+			}
+			break;
+		}
+		case SIM_STOPPED:
+			if (m->hold) {
+				target_speed = sim_clamp(SIM_POSITION_GAIN * 4 * (m->hold_position - m->position),
+						-max_speed, max_speed);
+			} else {
+				target_speed = sim_direct_speed(m, 0.0);
+			}
+			break;
+	}
+
+	m->speed += (target_speed - m->speed) * fmin(1.0, dt / m->tau);
+	m->position += m->speed * dt;
+
+	// Topes mecanicos
+	bool blocked = false;
+	if (m->position <= m->min_stop) {
+		m->position = m->min_stop;
+		blocked = drive < 0;
+		if (m->speed < 0) {
+			m->speed = 0;
+		}
+	} else if (m->position >= m->max_stop) {
+		m->position = m->max_stop;
+		blocked = drive > 0;
+		if (m->speed > 0) {
+			m->speed = 0;
+		}
+	}
+	if (blocked && m->mode != SIM_STOPPED) {
+		m->stall_time += dt;
+	} else {
+		m->stall_time = 0;
+	}
+	m->stalled = m->stall_time >= SIM_STALL_TIME;
+}
+
+/**
+ * @brief Coge o deja una pieza cuando la garra se cierra o se abre. Llamar con
+ *        sim_mutex.
+ */
+static void sim_objects_step(void) {
+	const sim_motor_t *claw = sim_motor_by_port('A');
+	const sim_motor_t *elevation = sim_motor_by_port('B');
+	const sim_motor_t *rotation = sim_motor_by_port('C');
+	if (sim_n_objects == 0 || claw == NULL || elevation == NULL || rotation == NULL) {
+		return;
+	}
+	bool gripping = claw->position < SIM_CLAW_CLOSED_STOP + SIM_LOAD_GRIP_UNITS;
+	if (gripping == sim_gripping) {
+		return;
+	}
+	sim_gripping = gripping;
+	bool on_table = elevation->position >= SIM_TABLE_HEIGHT;
+	if (gripping && on_table) {
+		sim_held = sim_objects[sim_next_object];
+		sim_next_object = (sim_next_object + 1) % sim_n_objects;
+	} else if (!gripping && sim_held >= 0) {
+		if (on_table) {
+			double position = sim_tacho(rotation);
+			if (sim_placed[sim_held] == 0 || position < sim_placed_min[sim_held]) {
+				sim_placed_min[sim_held] = position;
+			}
+			if (sim_placed[sim_held] == 0 || position > sim_placed_max[sim_held]) {
+				sim_placed_max[sim_held] = position;
+			}
+			sim_placed[sim_held]++;
+		} else {
+			sim_dropped++;
+		}
+		sim_held = -1;
+	}
+}
+
+/**
+ * @brief Avanza el simulador hasta el instante actual. Llamar con sim_mutex.
+ */
+static void sim_update(void) {
+	long long now = sim_now_ns();
+	if (sim_last_ns < 0 || now - sim_last_ns > SIM_MAX_ADVANCE_NS) {
+		sim_last_ns = now;
+		return;
+	}
+	while (now - sim_last_ns >= SIM_STEP_NS) {
+		for (int i = 0; i < SIM_MOTORS; i++) {
+			if (sim_motors[i].motor != NULL) {
+				sim_motor_step(&sim_motors[i], SIM_STEP_NS / (double) NSEC_PER_SEC);
+			}
+		}
+		sim_objects_step();
+		sim_last_ns += SIM_STEP_NS;
+	}
+}
+
+static sim_motor_t* sim_motor_of(ev3_motor_ptr motor) {
+	for (int i = 0; i < SIM_MOTORS; i++) {
+		if (sim_motors[i].motor == motor) {
+			return &sim_motors[i];
+		}
+	}
+	return NULL;
+}
+
+static sim_motor_t* sim_motor_by_port(char port) {
+	for (int i = 0; i < SIM_MOTORS; i++) {
+		if (sim_motors[i].port == port) {
+			return &sim_motors[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Lee los colores de las piezas (0..7 separados por espacios o comas).
+ */
+static void sim_parse_objects(const char *colors) {
+	const char *p = colors;
+	sim_n_objects = 0;
+	while (p != NULL && *p != '\0' && sim_n_objects < SIM_MAX_OBJECTS) {
+		char *end;
+		long color = strtol(p, &end, 10);
+		if (end == p) {
+			break;
+		}
+		if (color >= 0 && color < SIM_COLORS) {
+			sim_objects[sim_n_objects++] = (int) color;
+		} else {
+			fprintf(stderr, "ev3c_sim: ignoring object color %ld\n", color);
+		}
+		p = end;
+		while (*p == ',' || *p == ' ') {
+			p++;
+		}
+	}
+	sim_next_object = 0;
+	sim_gripping = false;
+	sim_held = -1;
+	sim_dropped = 0;
+	memset(sim_placed, 0, sizeof(sim_placed));
+}
+
+/* Motores */
+
+ev3_motor_ptr ev3_load_motors(void) {
+	static const struct {
+		char port;
+		int32_t max_speed;
+		double tau, gravity, friction, min_stop, max_stop;
+	} layout[SIM_MOTORS] = {
+		{ 'A', SIM_MEDIUM_MAX_SPEED, SIM_MEDIUM_TAU, 0.0, 0.0, SIM_CLAW_CLOSED_STOP, SIM_CLAW_OPEN_STOP },
+		{ 'B', SIM_LARGE_MAX_SPEED, SIM_LARGE_TAU, SIM_GRAVITY_DUTY, SIM_FRICTION_DUTY,
+				SIM_ELEVATION_TOP_STOP, SIM_ELEVATION_BOTTOM_STOP },
+		{ 'C', SIM_LARGE_MAX_SPEED, SIM_LARGE_TAU, 0.0, 0.0, SIM_ROTATION_CCW_STOP, SIM_ROTATION_CW_STOP },
+	};
+	ev3_motor_ptr first = NULL;
+	const char *load = getenv(SIM_LOAD_ENV);
+
+	sim_trace = getenv(SIM_TRACE_ENV) != NULL;
+	sim_load = (load != NULL) ? atof(load) : 0.0;
+	sim_parse_objects(getenv(SIM_OBJECTS_ENV));
+	pthread_mutex_lock(&sim_mutex);
+	for (int i = SIM_MOTORS - 1; i >= 0; i--) {
+		ev3_motor_ptr motor = calloc(1, sizeof(ev3_motor));
+		if (motor == NULL) {
+			break;
+		}
+		motor->driver_identifier = i;
+		motor->port = layout[i].port;
+		motor->motor_nr = i;
+		motor->max_speed = layout[i].max_speed;
+		motor->next = first;
+		first = motor;
+
+		sim_motor_t *m = &sim_motors[i];
+		memset(m, 0, sizeof(*m));
+		m->motor = motor;
+		m->port = layout[i].port;
+		m->tau = layout[i].tau;
+		m->gravity = layout[i].gravity;
+		m->friction = layout[i].friction;
+		m->min_stop = layout[i].min_stop;
+		m->max_stop = layout[i].max_stop;
+	}
+	sim_last_ns = -1;
+	sim_load_state();
+	pthread_mutex_unlock(&sim_mutex);
+	return first;
+}
+
+ev3_motor_ptr ev3_search_motor_by_port(ev3_motor_ptr motors, char port) {
+	for (; motors != NULL; motors = motors->next) {
+		if (motors->port == port) {
+			return motors;
+		}
+	}
+	return NULL;
+}
+
+ev3_motor_ptr ev3_open_motor(ev3_motor_ptr motor) {
+	return motor;
+}
+
+void ev3_reset_motor(ev3_motor_ptr motor) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->mode = SIM_STOPPED;
+		m->hold = false;
+		m->duty_cycle_sp = 0;
+		m->speed_sp = 0;
+		m->position_sp = 0;
+		m->offset = round(m->position);
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_delete_motors(ev3_motor_ptr motors) {
+	pthread_mutex_lock(&sim_mutex);
+	printf("ev3c_sim: %.3f s, %lu motor commands, digest %016llx\n", sim_now_ns() / 1e9,
+			sim_commands, sim_digest);
+	sim_update();
+	for (int color = 0; color < SIM_COLORS; color++) {
+		if (sim_placed[color] > 0) {
+			printf("ev3c_sim: color %d: %lu objects placed at rotation %.0f..%.0f deg\n", color,
+					sim_placed[color], sim_placed_min[color], sim_placed_max[color]);
+		}
+	}
+	if (sim_dropped > 0) {
+		printf("ev3c_sim: %lu objects dropped\n", sim_dropped);
+	}
+	sim_save_state();
+	while (motors != NULL) {
+		ev3_motor_ptr next = motors->next;
+		sim_motor_t *m = sim_motor_of(motors);
+		if (m != NULL) {
+			m->motor = NULL;
+		}
+		free(motors);
+		motors = next;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+int32_t ev3_motor_state(ev3_motor_ptr motor) {
+	int32_t state = 0;
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		if (m->mode != SIM_STOPPED) {
+			state |= MOTOR_RUNNING;
+		} else if (m->hold) {
+			state |= MOTOR_HOLDING;
+		}
+		if (m->stalled) {
+			state |= MOTOR_STALLED;
+		}
+	}
+	pthread_mutex_unlock(&sim_mutex);
+	return state;
+}
+
+int32_t ev3_get_position(ev3_motor_ptr motor) {
+	int32_t position = 0;
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		position = (int32_t) lround(sim_tacho(m));
+	}
+	pthread_mutex_unlock(&sim_mutex);
+	return position;
+}
+
+void ev3_set_position(ev3_motor_ptr motor, int32_t position) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->offset = round(m->position) - position;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_set_position_sp(ev3_motor_ptr motor, int32_t position_sp) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->position_sp = position_sp;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_set_speed_sp(ev3_motor_ptr motor, int32_t speed_sp) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->speed_sp = speed_sp;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_set_duty_cycle_sp(ev3_motor_ptr motor, int32_t duty_cycle_sp) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->duty_cycle_sp = (int32_t) sim_clamp(duty_cycle_sp, -100, 100);
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_command_motor_by_name(ev3_motor_ptr motor, char *command) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		char port[2] = { m->port, '\0' };
+		long long now = sim_now_ns();
+		long long position = llround(m->position * 1000);
+		sim_log("motor %s: %s", port, command);
+		sim_digest_bytes(&now, sizeof(now));
+		sim_digest_bytes(port, 1);
+		sim_digest_bytes(command, strlen(command));
+		sim_digest_bytes(&position, sizeof(position));
+		sim_commands++;
+		m->stall_time = 0;
+		m->stalled = false;
+		if (strcmp(command, "run-direct") == 0) {
+			m->mode = SIM_DIRECT;
+		} else if (strcmp(command, "run-forever") == 0) {
+			m->mode = SIM_FOREVER;
+		} else if (strcmp(command, "run-to-abs-pos") == 0) {
+			m->target = m->position_sp + m->offset;
+			m->mode = SIM_POSITION;
+		} else if (strcmp(command, "run-to-rel-pos") == 0) {
+			m->target = m->position + m->position_sp;
+			m->mode = SIM_POSITION;
+		} else if (strcmp(command, "stop") == 0) {
+			m->mode = SIM_STOPPED;
+			m->hold_position = m->position;
+		} else if (strcmp(command, "reset") == 0) {
+			m->mode = SIM_STOPPED;
+			m->hold = false;
+			m->duty_cycle_sp = 0;
+			m->speed_sp = 0;
+			m->position_sp = 0;
+			m->offset = round(m->position);
+		}
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_stop_action_motor_by_name(ev3_motor_ptr motor, char *stop_action) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_motor_t *m = sim_motor_of(motor);
+	if (m != NULL) {
+		m->hold = strcmp(stop_action, "hold") == 0;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+/* Sensores */
+
+ev3_sensor_ptr ev3_load_sensors(void) {
+	ev3_sensor_ptr color = calloc(1, sizeof(ev3_sensor));
+	ev3_sensor_ptr touch = calloc(1, sizeof(ev3_sensor));
+	if (color == NULL || touch == NULL) {
+		free(color);
+		free(touch);
+		return NULL;
+	}
+	color->port = SIM_COLOR_PORT;
+	color->sensor_nr = 0;
+	color->data_count = 1;
+	color->next = touch;
+	touch->port = SIM_TOUCH_PORT;
+	touch->sensor_nr = 1;
+	touch->data_count = 1;
+	return color;
+}
+
+ev3_sensor_ptr ev3_search_sensor_by_port(ev3_sensor_ptr sensors, int32_t port) {
+	for (; sensors != NULL; sensors = sensors->next) {
+		if (sensors->port == port) {
+			return sensors;
+		}
+	}
+	return NULL;
+}
+
+ev3_sensor_ptr ev3_open_sensor(ev3_sensor_ptr sensor) {
+	return sensor;
+}
+
+void ev3_close_sensor(ev3_sensor_ptr sensor) {
+	(void) sensor;
+}
+
+void ev3_delete_sensors(ev3_sensor_ptr sensors) {
+	while (sensors != NULL) {
+		ev3_sensor_ptr next = sensors->next;
+		free(sensors);
+		sensors = next;
+	}
+}
+
+void ev3_mode_sensor(ev3_sensor_ptr sensor, int32_t mode) {
+	pthread_mutex_lock(&sim_mutex);
+	if (sensor->port == SIM_COLOR_PORT && mode != sensor->mode) {
+		sim_color_mode_ns = sim_now_ns();
+	}
+	sensor->mode = mode;
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+/**
+ * @brief Luz reflejada en funcion de la distancia de la elevacion al tope superior.
+ */
+static int32_t sim_reflection(const sim_motor_t *elevation) {
+	double distance = elevation->position - SIM_ELEVATION_TOP_STOP;
+	if (distance >= SIM_REFLECTION_RANGE) {
+		return SIM_REFLECTION_BASE;
+	}
+	return (int32_t) lround(SIM_REFLECTION_BASE + (SIM_REFLECTION_PEAK - SIM_REFLECTION_BASE) *
+			(1.0 - distance / SIM_REFLECTION_RANGE));
+}
+
+ev3_sensor_ptr ev3_update_sensor_val(ev3_sensor_ptr sensor) {
+	pthread_mutex_lock(&sim_mutex);
+	sim_update();
+	if (sensor->port == SIM_TOUCH_PORT) {
+		sim_motor_t *rotation = sim_motor_by_port('C');
+		sensor->val_data[0].s32 = (rotation != NULL && rotation->position >= SIM_ROTATION_TOUCH);
+	} else if (sensor->port == SIM_COLOR_PORT) {
+		sim_motor_t *elevation = sim_motor_by_port('B');
+		// Recien cambiado de modo, el valor es el ultimo del modo anterior
+		if (sim_color_mode_ns < 0 || sim_now_ns() - sim_color_mode_ns >= SIM_MODE_SETTLE_NS) {
+			sim_color_mode = sensor->mode;
+		}
+		switch (sim_color_mode) {
+			case SIM_COLOR_MODE_REFLECT:
+				sensor->val_data[0].s32 = (elevation != NULL) ? sim_reflection(elevation) : 0;
+				break;
+			case SIM_COLOR_MODE_AMBIENT:
+				sensor->val_data[0].s32 = SIM_AMBIENT_VALUE;
+				break;
+			default:
+				// Color de la pieza agarrada si esta delante del sensor, si no ninguno
+				sensor->val_data[0].s32 = (sim_held >= 0 && elevation != NULL &&
+						elevation->position - SIM_ELEVATION_TOP_STOP < SIM_COLOR_RANGE) ? sim_held : 0;
+				break;
+		}
+	}
+	pthread_mutex_unlock(&sim_mutex);
+	return sensor;
+}
+
+/* Botonera */
+
+/**
+ * @brief Interpreta el guion de la botonera ("ms:tecla+|-" separados por espacios o
+ *        comas; teclas L, U, R, D, C y B).
+ */
+static void sim_parse_buttons(const char *script) {
+	static const char KEYS[] = "LURDCB";
+	const char *p = script;
+
+	sim_n_button_events = 0;
+	while (*p != '\0' && sim_n_button_events < SIM_MAX_BUTTON_EVENTS) {
+		long ms;
+		char key, edge;
+		int consumed;
+		if (sscanf(p, " %ld:%c%c%n", &ms, &key, &edge, &consumed) != 3) {
+			break;
+		}
+		p += consumed;
+		while (*p == ',' || *p == ' ') {
+			p++;
+		}
+		const char *found = strchr(KEYS, key);
+		if (found == NULL || key == '\0' || (edge != '+' && edge != '-')) {
+			fprintf(stderr, "ev3c_sim: ignoring button event %ld:%c%c\n", ms, key, edge);
+			continue;
+		}
+		sim_button_events[sim_n_button_events].time_ns = ms * NSEC_PER_MSEC;
+		sim_button_events[sim_n_button_events].button = found - KEYS;
+		sim_button_events[sim_n_button_events].pressed = edge == '+';
+		sim_n_button_events++;
+	}
+}
+
+int32_t ev3_init_button(void) {
+	const char *script = getenv(SIM_BUTTONS_ENV);
+	const char *duration = getenv(SIM_DURATION_ENV);
+	pthread_mutex_lock(&sim_mutex);
+	sim_parse_buttons((script != NULL) ? script : SIM_DEFAULT_BUTTONS);
+
+	// Guion periodico: sin BACK y seguido de una pausa
+	sim_script_period_ns = 0;
+	sim_script_offset_ns = 0;
+	sim_duration_ns = 0;
+	if (duration != NULL && atof(duration) > 0) {
+		int n = 0;
+		for (int i = 0; i < sim_n_button_events; i++) {
+			if (sim_button_events[i].button != BUTTON_BACK) {
+				sim_button_events[n++] = sim_button_events[i];
+			}
+		}
+		sim_n_button_events = n;
+		sim_duration_ns = (long long) (atof(duration) * NSEC_PER_SEC);
+		sim_script_period_ns = ((n > 0) ? sim_button_events[n - 1].time_ns : 0) + SIM_SCRIPT_GAP_NS;
+	}
+	sim_next_button_event = 0;
+	sim_buttons_start_ns = -1;
+	memset(sim_buttons, 0, sizeof(sim_buttons));
+	pthread_mutex_unlock(&sim_mutex);
+	return 0;
+}
+
+int32_t ev3_button_pressed(int32_t button) {
+	static const char *NAMES[] = {"LEFT", "UP", "RIGHT", "DOWN", "CENTER", "BACK"};
+	int32_t pressed = 0;
+
+	if (button < BUTTON_LEFT || button > BUTTON_BACK) {
+		return 0;
+	}
+	pthread_mutex_lock(&sim_mutex);
+	long long now = sim_now_ns();
+	if (sim_buttons_start_ns < 0) {
+		sim_buttons_start_ns = now;
+	}
+	long long elapsed = now - sim_buttons_start_ns;
+	for (;;) {
+		if (sim_next_button_event < sim_n_button_events &&
+				sim_script_offset_ns + sim_button_events[sim_next_button_event].time_ns <= elapsed &&
+				(sim_duration_ns == 0 || elapsed < sim_duration_ns)) {
+			sim_button_event_t *event = &sim_button_events[sim_next_button_event++];
+			sim_buttons[event->button] = event->pressed;
+			sim_log("button %s %s", NAMES[event->button], event->pressed ? "pressed" : "released");
+		} else if (sim_script_period_ns > 0 && sim_next_button_event == sim_n_button_events &&
+				sim_script_offset_ns + sim_script_period_ns <= elapsed) {
+			sim_script_offset_ns += sim_script_period_ns;
+			sim_next_button_event = 0;
+		} else {
+			break;
+		}
+	}
+	if (sim_duration_ns > 0 && elapsed >= sim_duration_ns && !sim_buttons[BUTTON_BACK]) {
+		memset(sim_buttons, 0, sizeof(sim_buttons));
+		sim_buttons[BUTTON_BACK] = true;
+		sim_log("button %s %s", NAMES[BUTTON_BACK], "pressed");
+	}
+	pressed = sim_buttons[button];
+	pthread_mutex_unlock(&sim_mutex);
+	return pressed;
+}
+
+void ev3_quit_button(void) {
+}
+
+/* Leds */
+
+int32_t ev3_init_led(void) {
+	memset(sim_leds, 0, sizeof(sim_leds));
+	return 0;
+}
+
+void ev3_set_led(int32_t led, int32_t color, int32_t value) {
+	if (led < LEFT_LED || led > RIGHT_LED || color < GREEN_LED || color > RED_LED) {
+		return;
+	}
+	pthread_mutex_lock(&sim_mutex);
+	if (sim_leds[led][color] != value) {
+		sim_leds[led][color] = value;
+		sim_log("led %s %s", (led == LEFT_LED) ? "left" : "right",
+				(color == GREEN_LED) ? (value ? "green on" : "green off") :
+				(value ? "red on" : "red off"));
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+void ev3_quit_led(void) {
+}
+
+/* LCD: sin pantalla, las llamadas no tienen efecto */
+
+int32_t ev3_init_lcd(void) {
+	return 0;
+}
+
+void ev3_clear_lcd(void) {
+}
+
+void ev3_text_lcd_normal(int32_t x, int32_t y, const char *text) {
+	(void) x;
+	(void) y;
+	(void) text;
+}
+
+void ev3_circle_lcd(int32_t x, int32_t y, int32_t r, int32_t color) {
+	(void) x;
+	(void) y;
+	(void) r;
+	(void) color;
+}
+
+void ev3_circle_lcd_out(int32_t x, int32_t y, int32_t r, int32_t color) {
+	(void) x;
+	(void) y;
+	(void) r;
+	(void) color;
+}
+
+void ev3_quit_lcd(void) {
+}
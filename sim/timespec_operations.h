@@ -0,0 +1,36 @@
+/*
+ * File: timespec_operations.h
+ *
+ * Descripcion: Operaciones con struct timespec para compilar con el simulador
+ *              fuera del entorno de la asignatura.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef TIMESPEC_OPERATIONS_H
+#define TIMESPEC_OPERATIONS_H
+
+#include <time.h>
+
+static inline void incr_timespec(struct timespec *t, const struct timespec *incr) {
+	t->tv_sec += incr->tv_sec;
+	t->tv_nsec += incr->tv_nsec;
+	if (t->tv_nsec >= 1000000000) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000;
+	}
+}
+
+static inline void add_timespec(struct timespec *sum, const struct timespec *t1,
+		const struct timespec *t2) {
+	*sum = *t1;
+	incr_timespec(sum, t2);
+}
+
+static inline int smaller_timespec(const struct timespec *t1, const struct timespec *t2) {
+	return t1->tv_sec < t2->tv_sec || (t1->tv_sec == t2->tv_sec && t1->tv_nsec < t2->tv_nsec);
+}
+
+#endif
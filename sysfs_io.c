@@ -0,0 +1,243 @@
+/*
+ * File: sysfs_io.c
+ *
+ * Descripcion: Implementacion de la capa de E/S con descriptores sysfs
+ *              persistentes.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sysfs_io.h"
+
+// Clases sysfs de ev3dev
+#define TACHO_MOTOR_CLASS           "tacho-motor"
+#define LEGO_SENSOR_CLASS           "lego-sensor"
+
+#define PATH_SIZE                   256
+#define VALUE_SIZE                  64
+
+/**
+ * @brief Devuelve la raiz de sysfs, teniendo en cuenta SYSFS_ROOT_ENV.
+ */
+static const char* sysfs_root() {
+	const char *root = getenv(SYSFS_ROOT_ENV);
+	return (root != NULL) ? root : SYSFS_ROOT_DEFAULT;
+}
+
+/**
+ * @brief Busca dentro de una clase el dispositivo cuyo atributo address termina
+ *        en el puerto indicado (p.ej. "ev3-ports:outA" o "outA").
+ *
+ * @return 0 y la ruta del dispositivo en dev_path si se encuentra.
+ *         -1 en caso contrario.
+ */
+static int sysfs_find_device(const char *class_name, const char *port_name, char *dev_path) {
+	char class_path[PATH_SIZE];
+	char address_path[PATH_SIZE];
+	char address[VALUE_SIZE];
+	size_t port_len = strlen(port_name);
+	int found = -1;
+
+	snprintf(class_path, sizeof(class_path), "%s/%s", sysfs_root(), class_name);
+	DIR *dir = opendir(class_path);
+	if (dir == NULL) {
+		return -1;
+	}
+
+	struct dirent *entry;
+	while (found != 0 && (entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		if (snprintf(address_path, sizeof(address_path), "%s/%s/address", class_path,
+				entry->d_name) >= (int) sizeof(address_path)) {
+			continue;
+		}
+		int fd = open(address_path, O_RDONLY);
+		if (fd < 0) {
+			continue;
+		}
+		ssize_t len = pread(fd, address, sizeof(address) - 1, 0);
+		close(fd);
+		if (len <= 0) {
+			continue;
+		}
+		while (len > 0 && (address[len - 1] == '\n' || address[len - 1] == ' ')) {
+			len--;
+		}
+		address[len] = '\0';
+		if ((size_t) len >= port_len && strcmp(address + len - port_len, port_name) == 0 &&
+				snprintf(dev_path, PATH_SIZE, "%s/%s", class_path, entry->d_name) < PATH_SIZE) {
+			found = 0;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+/**
+ * @brief Abre un atributo del dispositivo.
+ *
+ * @return Descriptor abierto o -1.
+ */
+static int sysfs_open_attr(const char *dev_path, const char *attr, int flags) {
+	char path[PATH_SIZE];
+	if (snprintf(path, sizeof(path), "%s/%s", dev_path, attr) >= (int) sizeof(path)) {
+		return -1;
+	}
+	return open(path, flags | O_CLOEXEC);
+}
+
+/**
+ * @brief Lee el atributo completo en el offset 0.
+ *
+ * @return Numero de bytes leidos o -1.
+ */
+static ssize_t sysfs_read_attr(int fd, char *buffer, size_t size) {
+	ssize_t len = pread(fd, buffer, size - 1, 0);
+	if (len < 0) {
+		return -1;
+	}
+	buffer[len] = '\0';
+	return len;
+}
+
+/**
+ * @brief Escribe el atributo completo en el offset 0.
+ */
+static void sysfs_write_attr(int fd, const char *value) {
+	if (pwrite(fd, value, strlen(value), 0) < 0) {
+		perror("sysfs_write_attr");
+	}
+}
+
+/**
+ * @brief Cierra un descriptor si esta abierto y lo marca como no disponible.
+ */
+static void sysfs_close_fd(int *fd) {
+	if (*fd >= 0) {
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+int sysfs_open_motor(sysfs_motor_t *io, ev3_motor_ptr motor, char port) {
+	char dev_path[PATH_SIZE];
+	char port_name[] = "outX";
+	port_name[3] = port;
+
+	io->motor = motor;
+	io->position_fd = -1;
+	io->state_fd = -1;
+	io->duty_cycle_sp_fd = -1;
+	io->command_fd = -1;
+
+	if (sysfs_find_device(TACHO_MOTOR_CLASS, port_name, dev_path) != 0) {
+		return -1;
+	}
+
+	io->position_fd = sysfs_open_attr(dev_path, "position", O_RDONLY);
+	io->state_fd = sysfs_open_attr(dev_path, "state", O_RDONLY);
+	io->duty_cycle_sp_fd = sysfs_open_attr(dev_path, "duty_cycle_sp", O_WRONLY);
+	io->command_fd = sysfs_open_attr(dev_path, "command", O_WRONLY);
+
+	if (io->position_fd < 0 || io->state_fd < 0 || io->duty_cycle_sp_fd < 0 ||
+			io->command_fd < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int sysfs_open_sensor(sysfs_sensor_t *io, ev3_sensor_ptr sensor, int port) {
+	char dev_path[PATH_SIZE];
+	char port_name[8];
+	snprintf(port_name, sizeof(port_name), "in%d", port);
+
+	io->sensor = sensor;
+	io->value0_fd = -1;
+
+	if (sysfs_find_device(LEGO_SENSOR_CLASS, port_name, dev_path) != 0) {
+		return -1;
+	}
+
+	io->value0_fd = sysfs_open_attr(dev_path, "value0", O_RDONLY);
+	return (io->value0_fd < 0) ? -1 : 0;
+}
+
+void sysfs_close_motor(sysfs_motor_t *io) {
+	sysfs_close_fd(&io->position_fd);
+	sysfs_close_fd(&io->state_fd);
+	sysfs_close_fd(&io->duty_cycle_sp_fd);
+	sysfs_close_fd(&io->command_fd);
+}
+
+void sysfs_close_sensor(sysfs_sensor_t *io) {
+	sysfs_close_fd(&io->value0_fd);
+}
+
+int32_t sysfs_get_position(sysfs_motor_t *io) {
+	char buffer[VALUE_SIZE];
+	if (io->position_fd < 0 || sysfs_read_attr(io->position_fd, buffer, sizeof(buffer)) < 0) {
+		return ev3_get_position(io->motor);
+	}
+	return (int32_t) strtol(buffer, NULL, 10);
+}
+
+int32_t sysfs_motor_state(sysfs_motor_t *io) {
+	char buffer[VALUE_SIZE];
+	if (io->state_fd < 0 || sysfs_read_attr(io->state_fd, buffer, sizeof(buffer)) < 0) {
+		return ev3_motor_state(io->motor);
+	}
+
+	int32_t state = 0;
+	if (strstr(buffer, "running") != NULL) {
+		state |= MOTOR_RUNNING;
+	}
+	if (strstr(buffer, "ramping") != NULL) {
+		state |= MOTOR_RAMPING;
+	}
+	if (strstr(buffer, "holding") != NULL) {
+		state |= MOTOR_HOLDING;
+	}
+	if (strstr(buffer, "stalled") != NULL) {
+		state |= MOTOR_STALLED;
+	}
+	return state;
+}
+
+void sysfs_set_duty_cycle_sp(sysfs_motor_t *io, int32_t duty_cycle) {
+	char buffer[VALUE_SIZE];
+	if (io->duty_cycle_sp_fd < 0) {
+		ev3_set_duty_cycle_sp(io->motor, duty_cycle);
+		return;
+	}
+	snprintf(buffer, sizeof(buffer), "%d", duty_cycle);
+	sysfs_write_attr(io->duty_cycle_sp_fd, buffer);
+}
+
+void sysfs_command_motor(sysfs_motor_t *io, const char *command) {
+	if (io->command_fd < 0) {
+		ev3_command_motor_by_name(io->motor, (char *) command);
+		return;
+	}
+	sysfs_write_attr(io->command_fd, command);
+}
+
+int32_t sysfs_update_sensor_val(sysfs_sensor_t *io) {
+	char buffer[VALUE_SIZE];
+	if (io->value0_fd < 0 || sysfs_read_attr(io->value0_fd, buffer, sizeof(buffer)) < 0) {
+		ev3_update_sensor_val(io->sensor);
+		return io->sensor->val_data[0].s32;
+	}
+	io->sensor->val_data[0].s32 = (int32_t) strtol(buffer, NULL, 10);
+	return io->sensor->val_data[0].s32;
+}
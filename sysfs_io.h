@@ -0,0 +1,106 @@
+/*
+ * File: sysfs_io.h
+ *
+ * Descripcion: Capa de E/S sobre los atributos sysfs de motores y sensores.
+ *              Cada atributo de uso periodico (position, state, duty_cycle_sp,
+ *              command y value0) se abre una unica vez al arrancar y despues se
+ *              accede mediante pread/pwrite en el offset 0, evitando el ciclo
+ *              open/parse/close de cada llamada.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef SYSFS_IO_H
+#define SYSFS_IO_H
+
+#include <stdint.h>
+
+#include "ev3c.h"
+
+// Raiz de sysfs. Puede sustituirse con la variable de entorno SYSFS_ROOT_ENV
+// (por ejemplo, un tmpfs con la misma estructura de directorios).
+#define SYSFS_ROOT_DEFAULT          "/sys/class"
+#define SYSFS_ROOT_ENV              "EV3_SYSFS_ROOT"
+
+// Descriptores cacheados de un motor. Un descriptor a -1 indica que el atributo
+// no se pudo abrir y se usa la ruta de ev3c.
+typedef struct sysfs_motor {
+	ev3_motor_ptr motor;
+	int position_fd;
+	int state_fd;
+	int duty_cycle_sp_fd;
+	int command_fd;
+} sysfs_motor_t;
+
+// Descriptores cacheados de un sensor.
+typedef struct sysfs_sensor {
+	ev3_sensor_ptr sensor;
+	int value0_fd;
+} sysfs_sensor_t;
+
+/**
+ * @brief Abre los atributos del motor conectado al puerto indicado.
+ *
+ * @param io Estructura a rellenar.
+ * @param motor Motor ya abierto con ev3c.
+ * @param port Puerto de salida ('A'..'D').
+ *
+ * @return 0 si se han abierto todos los atributos.
+ *         -1 si alguno no esta disponible (se usara ev3c para ese atributo).
+ */
+int sysfs_open_motor(sysfs_motor_t *io, ev3_motor_ptr motor, char port);
+
+/**
+ * @brief Abre el atributo value0 del sensor conectado al puerto indicado.
+ *
+ * @param io Estructura a rellenar.
+ * @param sensor Sensor ya abierto con ev3c.
+ * @param port Puerto de entrada (1..4).
+ *
+ * @return 0 si se ha abierto el atributo.
+ *         -1 en caso contrario (se usara ev3c).
+ */
+int sysfs_open_sensor(sysfs_sensor_t *io, ev3_sensor_ptr sensor, int port);
+
+/**
+ * @brief Cierra los descriptores cacheados del motor.
+ */
+void sysfs_close_motor(sysfs_motor_t *io);
+
+/**
+ * @brief Cierra el descriptor cacheado del sensor.
+ */
+void sysfs_close_sensor(sysfs_sensor_t *io);
+
+/**
+ * @brief Equivalente a ev3_get_position.
+ */
+int32_t sysfs_get_position(sysfs_motor_t *io);
+
+/**
+ * @brief Equivalente a ev3_motor_state. Devuelve la mascara MOTOR_RUNNING,
+ *        MOTOR_RAMPING, MOTOR_HOLDING y MOTOR_STALLED.
+ */
+int32_t sysfs_motor_state(sysfs_motor_t *io);
+
+/**
+ * @brief Equivalente a ev3_set_duty_cycle_sp.
+ */
+void sysfs_set_duty_cycle_sp(sysfs_motor_t *io, int32_t duty_cycle);
+
+/**
+ * @brief Equivalente a ev3_command_motor_by_name.
+ */
+void sysfs_command_motor(sysfs_motor_t *io, const char *command);
+
+/**
+ * @brief Equivalente a ev3_update_sensor_val para el primer valor del sensor.
+ *        Actualiza tambien sensor->val_data[0].s32.
+ *
+ * @return Valor leido.
+ */
+int32_t sysfs_update_sensor_val(sysfs_sensor_t *io);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * File: task_stats.c
+ *
+ * Descripcion: Implementacion de las estadisticas de temporizacion de las tareas.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "task_stats.h"
+
+// Peticion de volcado pendiente (la escribe el manejador de SIGUSR1)
+static atomic_bool dump_requested = false;
+
+/**
+ * @brief Incremento de un contador con un unico escritor: no necesita una
+ *        operacion atomica de lectura-modificacion-escritura.
+ */
+static inline void task_stats_add(atomic_ulong *counter, unsigned long count) {
+	atomic_store_explicit(counter,
+			atomic_load_explicit(counter, memory_order_relaxed) + count, memory_order_relaxed);
+}
+
+static inline void task_stats_max(atomic_llong *max, long long value) {
+	if (value > atomic_load_explicit(max, memory_order_relaxed)) {
+		atomic_store_explicit(max, value, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Cubeta logaritmica (base 2, en microsegundos) de un valor en nsec.
+ */
+static inline int task_stats_bucket(long long value_ns) {
+	unsigned long long us = (value_ns > 0) ? (unsigned long long) value_ns / 1000 : 0;
+	if (us == 0) {
+		return 0;
+	}
+	int bucket = 64 - __builtin_clzll(us);
+	return (bucket < TASK_STATS_BUCKETS) ? bucket : TASK_STATS_BUCKETS - 1;
+}
+
+void task_stats_record(task_stats_t *stats, long long latency_ns, long long exec_ns,
+		long period_ns) {
+	task_stats_add(&stats->activations, 1);
+	task_stats_add(&stats->latency_hist[task_stats_bucket(latency_ns)], 1);
+	task_stats_add(&stats->exec_hist[task_stats_bucket(exec_ns)], 1);
+	task_stats_max(&stats->max_latency_ns, latency_ns);
+	task_stats_max(&stats->max_exec_ns, exec_ns);
+	if (latency_ns + exec_ns > period_ns) {
+		task_stats_add(&stats->deadline_misses, 1);
+	}
+}
+
+void task_stats_skipped(task_stats_t *stats, unsigned long count) {
+	task_stats_add(&stats->overruns, count);
+}
+
+/**
+ * @brief Imprime las cubetas no vacias de un histograma.
+ */
+static void task_stats_print_hist(const char *label, const atomic_ulong *hist) {
+	printf("    %-8s", label);
+	for (int i = 0; i < TASK_STATS_BUCKETS; i++) {
+		unsigned long count = atomic_load_explicit(&hist[i], memory_order_relaxed);
+		if (count == 0) {
+			continue;
+		}
+		if (i == 0) {
+			printf(" <1us:%lu", count);
+		} else if (i == TASK_STATS_BUCKETS - 1) {
+			printf(" >=%luus:%lu", 1UL << (i - 1), count);
+		} else {
+			printf(" <%luus:%lu", 1UL << i, count);
+		}
+	}
+	printf("\n");
+}
+
+void task_stats_print(const char *name, const task_stats_t *stats) {
+	printf("  %-10s %8lu activations, %lu deadline misses, %lu overruns, "
+			"max latency %.3f ms, max exec %.3f ms\n", name,
+			atomic_load_explicit(&stats->activations, memory_order_relaxed),
+			atomic_load_explicit(&stats->deadline_misses, memory_order_relaxed),
+			atomic_load_explicit(&stats->overruns, memory_order_relaxed),
+			atomic_load_explicit(&stats->max_latency_ns, memory_order_relaxed) / 1e6,
+			atomic_load_explicit(&stats->max_exec_ns, memory_order_relaxed) / 1e6);
+	task_stats_print_hist("latency", stats->latency_hist);
+	task_stats_print_hist("exec", stats->exec_hist);
+}
+
+/**
+ * @brief Manejador de SIGUSR1: solo marca la peticion, el volcado lo hace una tarea.
+ */
+static void task_stats_signal_handler(int signal) {
+	(void) signal;
+	atomic_store_explicit(&dump_requested, true, memory_order_relaxed);
+}
+
+int task_stats_signal_init(void) {
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = task_stats_signal_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGUSR1, &action, NULL) < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+bool task_stats_dump_requested(void) {
+	return atomic_exchange_explicit(&dump_requested, false, memory_order_relaxed);
+}
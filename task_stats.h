@@ -0,0 +1,68 @@
+/*
+ * File: task_stats.h
+ *
+ * Descripcion: Estadisticas de temporizacion de las tareas periodicas: latencia
+ *              de activacion, tiempo de ejecucion, plazos incumplidos y
+ *              activaciones perdidas. Cada bloque tiene un unico escritor (quien
+ *              ejecuta la tarea) y se actualiza sin cerrojos, por lo que puede
+ *              volcarse en cualquier momento desde otro hilo (SIGUSR1).
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Cubetas de los histogramas: la 0 cuenta valores menores de 1 us y la i valores
+// en [2^(i-1), 2^i) us. La ultima acumula todo lo que supera 2^(N-2) us (~262 ms).
+#define TASK_STATS_BUCKETS          20
+
+typedef struct task_stats {
+	atomic_ulong activations;
+	atomic_ulong deadline_misses;   // activaciones terminadas despues de su plazo (un periodo)
+	atomic_ulong overruns;          // activaciones perdidas por retrasos de la tarea
+	atomic_llong max_latency_ns;    // retraso maximo de inicio respecto a la activacion teorica
+	atomic_llong max_exec_ns;
+	atomic_ulong latency_hist[TASK_STATS_BUCKETS];
+	atomic_ulong exec_hist[TASK_STATS_BUCKETS];
+} task_stats_t;
+
+/**
+ * @brief Registra una activacion. Solo debe llamarla el escritor del bloque.
+ *
+ * @param stats Estadisticas de la tarea.
+ * @param latency_ns Retraso de inicio respecto a la activacion teorica.
+ * @param exec_ns Tiempo de ejecucion de la activacion.
+ * @param period_ns Periodo (y plazo) de la tarea.
+ */
+void task_stats_record(task_stats_t *stats, long long latency_ns, long long exec_ns,
+		long period_ns);
+
+/**
+ * @brief Registra count activaciones perdidas. Solo debe llamarla el escritor.
+ */
+void task_stats_skipped(task_stats_t *stats, unsigned long count);
+
+/**
+ * @brief Imprime las estadisticas y los histogramas no vacios de una tarea.
+ */
+void task_stats_print(const char *name, const task_stats_t *stats);
+
+/**
+ * @brief Instala el manejador de SIGUSR1 que solicita un volcado de estadisticas.
+ *
+ * @return 0 si tiene exito o el codigo de error (errno).
+ */
+int task_stats_signal_init(void);
+
+/**
+ * @brief Indica si se ha recibido SIGUSR1 desde la ultima llamada.
+ */
+bool task_stats_dump_requested(void);
+
+#endif
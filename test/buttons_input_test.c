@@ -0,0 +1,203 @@
+/*
+ * File: buttons_input_test.c
+ *
+ * Descripcion: Prueba de la botonera evdev (buttons_input.h) con un teclado
+ *              virtual de uinput con las teclas del brick. Comprueba que cada
+ *              pulsacion corta (pulsar y soltar en el mismo lote de eventos) se
+ *              cuenta una vez, mide la latencia desde que se emite el evento hasta
+ *              que buttons_input_read lo ha procesado y, al destruir el teclado,
+ *              que la espera y la lectura devuelven error en lugar de quedarse
+ *              girando. Necesita /dev/uinput (root); si no esta se salta (77).
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ev3c.h"
+#include "buttons_input.h"
+#include "periodic.h"
+
+#define TEST_SKIPPED                77
+#define TEST_PRESSES                200
+#define TEST_DEVICE_WAIT_MS         2000    // hasta que udev crea /dev/input/eventN
+#define TEST_HANGUP_TRIES           4       // esperas admitidas tras destruir el teclado
+#define PATH_SIZE                   512
+
+static const unsigned short KEYS[] = { KEY_LEFT, KEY_UP, KEY_RIGHT, KEY_DOWN, KEY_ENTER, KEY_BACKSPACE };
+
+static long long elapsed_ns(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Escribe un evento en el teclado virtual.
+ */
+static int emit(int fd, unsigned short type, unsigned short code, int value) {
+	struct input_event event;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.code = code;
+	event.value = value;
+	return (write(fd, &event, sizeof(event)) == sizeof(event)) ? 0 : errno;
+}
+
+/**
+ * @brief Pulsacion corta: pulsar, sincronizar, soltar y sincronizar sin esperar.
+ */
+static int tap(int fd, unsigned short code) {
+	int error = emit(fd, EV_KEY, code, 1);
+	if (error == 0) {
+		error = emit(fd, EV_SYN, SYN_REPORT, 0);
+	}
+	if (error == 0) {
+		error = emit(fd, EV_KEY, code, 0);
+	}
+	if (error == 0) {
+		error = emit(fd, EV_SYN, SYN_REPORT, 0);
+	}
+	return error;
+}
+
+/**
+ * @brief Crea el teclado virtual y deja en path su /dev/input/eventN.
+ */
+static int create_keyboard(int *fd, char *path) {
+	char sysname[32], sysdir[PATH_SIZE];
+	struct uinput_setup setup;
+
+	*fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (*fd < 0) {
+		return errno;
+	}
+	ioctl(*fd, UI_SET_EVBIT, EV_KEY);
+	for (size_t i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); i++) {
+		ioctl(*fd, UI_SET_KEYBIT, KEYS[i]);
+	}
+	memset(&setup, 0, sizeof(setup));
+	setup.id.bustype = BUS_VIRTUAL;
+	snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "ev3 keypad test");
+	if (ioctl(*fd, UI_DEV_SETUP, &setup) < 0 || ioctl(*fd, UI_DEV_CREATE) < 0 ||
+			ioctl(*fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+		return errno;
+	}
+
+	// El nodo eventN es un subdirectorio del dispositivo inputN
+	snprintf(sysdir, sizeof(sysdir), "/sys/devices/virtual/input/%s", sysname);
+	for (int waited = 0; waited < TEST_DEVICE_WAIT_MS; waited += 10) {
+		DIR *dir = opendir(sysdir);
+		struct dirent *entry;
+		while (dir != NULL && (entry = readdir(dir)) != NULL) {
+			if (strncmp(entry->d_name, "event", 5) == 0) {
+				snprintf(path, PATH_SIZE, "/dev/input/%s", entry->d_name);
+				if (access(path, R_OK) == 0) {
+					closedir(dir);
+					return 0;
+				}
+			}
+		}
+		if (dir != NULL) {
+			closedir(dir);
+		}
+		usleep(10000);
+	}
+	return ENODEV;
+}
+
+int main(void) {
+	char path[PATH_SIZE];
+	buttons_input_t input;
+	int uinput, failures = 0;
+
+	int error = create_keyboard(&uinput, path);
+	if (error == ENOENT || error == EACCES || error == EPERM || error == ENODEV) {
+		printf("buttons_input_test: skipped, no uinput keyboard (%s)\n", strerror(error));
+		return TEST_SKIPPED;
+	} else if (error != 0) {
+		printf("buttons_input_test: uinput: %s\n", strerror(error));
+		return EXIT_FAILURE;
+	}
+	if (periodic_shutdown_init() != 0) {
+		printf("buttons_input_test: periodic_shutdown_init failed\n");
+		return EXIT_FAILURE;
+	}
+	setenv(BUTTONS_DEV_ENV, path, 1);
+	error = buttons_input_open(&input);
+	if (error != 0) {
+		printf("buttons_input_test: buttons_input_open(%s): %s\n", path, strerror(error));
+		return EXIT_FAILURE;
+	}
+
+	// Pulsaciones cortas del boton central: cada una se cuenta una vez aunque el
+	// estado ya sea "suelto" al leerla
+	long long total_ns = 0, max_ns = 0;
+	for (int i = 0; i < TEST_PRESSES; i++) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (tap(uinput, KEY_ENTER) != 0) {
+			printf("buttons_input_test: write: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+		while (input.presses[BUTTON_CENTER] < (unsigned int) (i + 1)) {
+			if (buttons_input_wait(&input) <= 0 || buttons_input_read(&input) < 0) {
+				printf("buttons_input_test: device failed after %d presses\n", i);
+				return EXIT_FAILURE;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		long long latency = elapsed_ns(&start, &end);
+		total_ns += latency;
+		if (latency > max_ns) {
+			max_ns = latency;
+		}
+		if (input.presses[BUTTON_CENTER] != (unsigned int) (i + 1) || input.pressed != 0) {
+			printf("buttons_input_test: press %d counted %u times, pressed 0x%x\n", i + 1,
+					input.presses[BUTTON_CENTER], input.pressed);
+			failures++;
+			break;
+		}
+	}
+	printf("Buttons input: %d short presses, latency %.1f us mean / %.1f us max\n", TEST_PRESSES,
+			total_ns / 1e3 / TEST_PRESSES, max_ns / 1e3);
+
+	// BACK corto: el apagado se basa en el contador, no en el nivel
+	tap(uinput, KEY_BACKSPACE);
+	while (input.presses[BUTTON_BACK] == 0 && buttons_input_wait(&input) > 0 && buttons_input_read(&input) >= 0) {
+	}
+	if (input.presses[BUTTON_BACK] != 1) {
+		printf("buttons_input_test: BACK counted %u times\n", input.presses[BUTTON_BACK]);
+		failures++;
+	}
+
+	// Desconexion: la espera o la lectura fallan en pocas vueltas
+	ioctl(uinput, UI_DEV_DESTROY);
+	close(uinput);
+	int tries = 0, failed = 0;
+	while (!failed && tries < TEST_HANGUP_TRIES) {
+		tries++;
+		int ready = buttons_input_wait(&input);
+		failed = (ready < 0) || (ready > 0 && buttons_input_read(&input) < 0);
+	}
+	if (!failed) {
+		printf("buttons_input_test: no error after the device was removed (%d waits)\n", tries);
+		failures++;
+	} else {
+		printf("Buttons input: device removal reported after %d waits (%s)\n", tries, strerror(errno));
+	}
+
+	buttons_input_close(&input);
+	periodic_shutdown_close();
+	printf("buttons_input_test: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,157 @@
+/*
+ * File: calibration_test.c
+ *
+ * Descripcion: Prueba del fichero de calibracion. Guarda una calibracion con la
+ *              tabla de gravedad en un directorio temporal (EV3_CALIBRATION) y
+ *              comprueba que se lee igual con y sin la marca de finalizacion limpia
+ *              (ESTALE) y que la lectura consume el fichero. Despues aplica una tabla
+ *              de corrupciones: cada una debe rechazarse con EINVAL y consumir
+ *              tambien el fichero, para que el siguiente arranque haga el homing y el
+ *              barrido.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calibration.h"
+
+#define PATH_SIZE                   256
+
+// Corrupcion del fichero: byte offset con xor y cambio del tamaño
+typedef struct corruption {
+	const char *name;
+	size_t offset;
+	uint8_t xor;
+	int resize;
+} corruption_t;
+
+static const corruption_t CORRUPTIONS[] = {
+	{"magic", offsetof(calibration_t, magic), 0x01, 0},
+	{"version", offsetof(calibration_t, version), 0x04, 0},
+	{"clean shutdown", offsetof(calibration_t, clean_shutdown), 0x01, 0},
+	{"rotation position", offsetof(calibration_t, position), 0x10, 0},
+	{"reflection", offsetof(calibration_t, reflection), 0x01, 0},
+	{"gravity valid", offsetof(calibration_t, gravity_valid), 0x01, 0},
+	{"gravity bin", offsetof(calibration_t, gravity) + 3 * sizeof(double) + 7, 0x40, 0},
+	{"friction", offsetof(calibration_t, friction), 0x01, 0},
+	{"checksum", offsetof(calibration_t, checksum), 0x80, 0},
+	{"truncated", 0, 0x00, -1},
+	{"empty", 0, 0x00, -(int) sizeof(calibration_t)},
+};
+
+// Lecturas de los sensores al arrancar frente a las guardadas (touch 1, reflection 20)
+typedef struct plausible_case {
+	int32_t touch;
+	int32_t reflection;
+	bool plausible;
+} plausible_case_t;
+
+static const plausible_case_t PLAUSIBLE_CASES[] = {
+	{1, 20, true}, {1, 17, true}, {1, 23, true}, {1, 16, false}, {1, 24, false}, {0, 20, false},
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+static int write_file(const char *path, const void *bytes, size_t size) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return 1;
+	}
+	size_t written = fwrite(bytes, 1, size, file);
+	return (fclose(file) != 0 || written != size) ? 1 : 0;
+}
+
+/**
+ * @brief Compara los campos guardados de dos calibraciones.
+ */
+static bool same_calibration(const calibration_t *a, const calibration_t *b) {
+	return memcmp(a->position, b->position, sizeof(a->position)) == 0 && a->touch == b->touch &&
+			a->reflection == b->reflection && a->gravity_valid == b->gravity_valid &&
+			memcmp(a->gravity, b->gravity, sizeof(a->gravity)) == 0 && a->friction == b->friction;
+}
+
+int main(void) {
+	char dir[] = "/tmp/calibration_test.XXXXXX";
+	char path[PATH_SIZE];
+	calibration_t calibration, loaded;
+	gravity_table_t table;
+	int failed = 0;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/test.cal", dir);
+	setenv(CALIBRATION_FILE_ENV, path, 1);
+
+	memset(&calibration, 0, sizeof(calibration));
+	calibration.position[CALIBRATION_ROTATION] = -1234;
+	calibration.position[CALIBRATION_ELEVATION] = 56;
+	calibration.position[CALIBRATION_CLAW] = -78;
+	calibration.touch = 1;
+	calibration.reflection = 20;
+	gravity_init(&table, -800, 0, 1000.0);
+	for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+		table.gravity[bin] = 2.5 * bin;
+	}
+	table.friction = 6.25;
+	table.valid = true;
+	calibration_store_gravity(&calibration, &table);
+
+	// Ida y vuelta con y sin la marca; la lectura borra el fichero
+	for (int clean = 1; clean >= 0; clean--) {
+		int error = calibration_save(&calibration, clean);
+		if (error == 0) {
+			error = calibration_load(&loaded);
+		}
+		if (error != (clean ? 0 : ESTALE) || !same_calibration(&calibration, &loaded)) {
+			printf("save/load (clean %d): %s\n", clean, strerror(error));
+			failed = 1;
+		}
+		if (access(path, F_OK) == 0 || calibration_load(&loaded) != ENOENT) {
+			printf("load (clean %d): the file must be consumed\n", clean);
+			failed = 1;
+		}
+	}
+
+	for (int i = 0; i < N_CASES(CORRUPTIONS); i++) {
+		const corruption_t *test = &CORRUPTIONS[i];
+		uint8_t bytes[sizeof(calibration_t)];
+
+		calibration_save(&calibration, true);
+		memcpy(bytes, &calibration, sizeof(bytes));
+		bytes[test->offset] ^= test->xor;
+		if (write_file(path, bytes, sizeof(bytes) + test->resize) != 0) {
+			perror(path);
+			failed = 1;
+			break;
+		}
+
+		int error = calibration_load(&loaded);
+		printf("%-20s %s\n", test->name, (error == EINVAL) ? "rejected" : "accepted");
+		if (error != EINVAL || access(path, F_OK) == 0) {
+			failed = 1;
+		}
+	}
+
+	for (int i = 0; i < N_CASES(PLAUSIBLE_CASES); i++) {
+		const plausible_case_t *test = &PLAUSIBLE_CASES[i];
+		if (calibration_plausible(&calibration, test->touch, test->reflection) != test->plausible) {
+			printf("plausible: touch %d, reflection %d must be %s\n", test->touch, test->reflection,
+					test->plausible ? "accepted" : "rejected");
+			failed = 1;
+		}
+	}
+
+	rmdir(dir);
+	printf("calibration_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
@@ -0,0 +1,208 @@
+/*
+ * File: gravity_test.c
+ *
+ * Descripcion: Pruebas de la prealimentacion de la gravedad con tablas de casos.
+ *              Los barridos se generan con el modelo de gravity.h a partir de una
+ *              gravedad y un rozamiento conocidos, y gravity_build debe recuperarlos.
+ *              La estimacion de la carga se prueba con un motor simulado que responde
+ *              con el mismo modelo: gravity_adapt debe llevar la carga de la garra
+ *              indicada a la real (dentro de sus limites) sin tocar la otra.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "gravity.h"
+
+#define TEST_MIN_POSITION           -800
+#define TEST_MAX_POSITION           0
+#define TEST_BIN_UNITS              100
+#define TEST_FULL_SPEED             1000.0  // units: deg/s con el 100 %
+#define TEST_SAMPLES                5       // medidas por tramo y sentido
+#define TEST_TOLERANCE              1e-9
+
+#define TEST_ACTIVATIONS            400
+#define TEST_MOVE_ACTIVATIONS       20      // activaciones seguidas en cada sentido
+#define TEST_LOAD_TOLERANCE         0.01
+
+static const double GRAVITY[GRAVITY_BINS] = {4.0, 8.0, 12.0, 15.0, 16.0, 15.0, 12.0, 8.0};
+
+// Barrido con potencia power sobre un mecanismo con la gravedad de GRAVITY
+// escalada por scale y rozamiento friction
+typedef struct build_case {
+	const char *name;
+	double scale;
+	double friction;
+	double power;
+	int missing_bin;                // tramo sin medidas subiendo (-1 ninguno)
+	int error;
+	double table_friction;          // rozamiento esperado en la tabla
+} build_case_t;
+
+static const build_case_t BUILD_CASES[] = {
+	{"build", 1.0, 6.0, 40.0, -1, 0, 6.0},
+	{"build heavy", 2.0, 3.0, 60.0, -1, 0, 3.0},
+	// Un rozamiento negativo (ruido) se deja en 0
+	{"build no friction", 1.0, -1.0, 40.0, -1, 0, 0.0},
+	{"build missing bin", 1.0, 6.0, 40.0, 5, ENODATA, 0.0},
+};
+
+// Estimacion de la carga con la garra en el estado gripping y una carga real
+typedef struct adapt_case {
+	const char *name;
+	bool gripping;
+	double true_load;
+	double duty;                    // potencia pedida sin compensacion (%)
+	bool steady;                    // si no, la potencia cambia en cada activacion
+	double load;                    // carga estimada esperada
+} adapt_case_t;
+
+static const adapt_case_t ADAPT_CASES[] = {
+	{"adapt heavier", false, 1.5, 30.0, true, 1.5},
+	{"adapt lighter gripping", true, 0.8, 30.0, true, 0.8},
+	// Limitada a GRAVITY_MAX_LOAD
+	{"adapt clamped", false, 5.0, 30.0, true, 3.0},
+	// Potencias por debajo de GRAVITY_ADAPT_MIN_DUTY o sin regimen permanente no
+	// estiman nada
+	{"adapt small duty", false, 1.5, 2.0, true, 1.0},
+	{"adapt unsteady", false, 1.5, 30.0, false, 1.0},
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+static int32_t bin_center(int bin) {
+	return TEST_MIN_POSITION + bin * TEST_BIN_UNITS + TEST_BIN_UNITS / 2;
+}
+
+static int test_build(void) {
+	int failed = 0;
+	double k = TEST_FULL_SPEED / 100.0;
+
+	for (int i = 0; i < N_CASES(BUILD_CASES); i++) {
+		const build_case_t *test = &BUILD_CASES[i];
+		gravity_table_t table;
+		gravity_sweep_t sweep;
+
+		gravity_init(&table, TEST_MIN_POSITION, TEST_MAX_POSITION, TEST_FULL_SPEED);
+		gravity_sweep_init(&sweep, &table);
+		for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+			double g = test->scale * GRAVITY[bin];
+			for (int sample = 0; sample < TEST_SAMPLES; sample++) {
+				// v_bajando + v_subiendo = 2 k g, v_bajando - v_subiendo = 2 k (P - F)
+				gravity_sweep_record(&sweep, bin_center(bin), k * (g + test->power - test->friction));
+				if (bin != test->missing_bin) {
+					gravity_sweep_record(&sweep, bin_center(bin), k * (g - test->power + test->friction));
+				}
+			}
+		}
+		// Fuera de la tabla o parado no cuenta
+		gravity_sweep_record(&sweep, TEST_MIN_POSITION - 1, 1000.0);
+		gravity_sweep_record(&sweep, TEST_MAX_POSITION, 1000.0);
+		gravity_sweep_record(&sweep, bin_center(0), 0.0);
+
+		int error = gravity_build(&table, &sweep, test->power);
+		if (error != test->error || table.valid != (test->error == 0)) {
+			printf("%s: error %d (valid %d), expected %d\n", test->name, error, table.valid, test->error);
+			failed = 1;
+			continue;
+		}
+		if (error != 0) {
+			if (gravity_duty(&table, bin_center(0), 1.0) != 0.0) {
+				printf("%s: an invalid table must not compensate\n", test->name);
+				failed = 1;
+			}
+			continue;
+		}
+		for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+			if (fabs(table.gravity[bin] - test->scale * GRAVITY[bin]) > TEST_TOLERANCE) {
+				printf("%s: bin %d: gravity %.6f, expected %.6f\n", test->name, bin, table.gravity[bin],
+						test->scale * GRAVITY[bin]);
+				failed = 1;
+			}
+		}
+		if (fabs(table.friction - test->table_friction) > TEST_TOLERANCE) {
+			printf("%s: friction %.6f, expected %.6f\n", test->name, table.friction, test->table_friction);
+			failed = 1;
+		}
+
+		// Compensacion: en el centro de un tramo la de ese tramo, entre centros
+		// interpolada, fuera de la tabla la del extremo y el rozamiento a favor del
+		// movimiento
+		double g = test->scale;
+		struct {
+			int32_t position;
+			double speed;
+			double duty;
+		} duties[] = {
+			{bin_center(3), 0.0, -g * GRAVITY[3]},
+			{bin_center(3), 1.0, test->table_friction - g * GRAVITY[3]},
+			{bin_center(3), -1.0, -test->table_friction - g * GRAVITY[3]},
+			{bin_center(1) + TEST_BIN_UNITS / 4, 0.0, -g * (0.75 * GRAVITY[1] + 0.25 * GRAVITY[2])},
+			{TEST_MIN_POSITION - 500, 0.0, -g * GRAVITY[0]},
+			{TEST_MAX_POSITION + 500, 0.0, -g * GRAVITY[GRAVITY_BINS - 1]},
+		};
+		for (size_t j = 0; j < sizeof(duties) / sizeof(duties[0]); j++) {
+			double duty = gravity_duty(&table, duties[j].position, duties[j].speed);
+			if (fabs(duty - duties[j].duty) > TEST_TOLERANCE) {
+				printf("%s: duty at %d deg, %.0f deg/s: %.6f, expected %.6f\n", test->name,
+						duties[j].position, duties[j].speed, duty, duties[j].duty);
+				failed = 1;
+			}
+		}
+	}
+	return failed;
+}
+
+static int test_adapt(void) {
+	int failed = 0;
+	double k = TEST_FULL_SPEED / 100.0;
+	const double friction = 6.0;
+
+	for (int i = 0; i < N_CASES(ADAPT_CASES); i++) {
+		const adapt_case_t *test = &ADAPT_CASES[i];
+		gravity_table_t table;
+
+		gravity_init(&table, TEST_MIN_POSITION, TEST_MAX_POSITION, TEST_FULL_SPEED);
+		for (int bin = 0; bin < GRAVITY_BINS; bin++) {
+			table.gravity[bin] = GRAVITY[bin];
+		}
+		table.friction = friction;
+		table.valid = true;
+		gravity_set_gripping(&table, test->gripping);
+
+		// Subidas y bajadas alternas recorriendo los tramos; el motor responde a la
+		// potencia aplicada con la gravedad real (true_load) y el rozamiento
+		for (int activation = 0; activation < TEST_ACTIVATIONS; activation++) {
+			double sign = ((activation / TEST_MOVE_ACTIVATIONS) % 2 == 0) ? 1.0 : -1.0;
+			double duty = sign * test->duty;
+			if (!test->steady && activation % 2 == 1) {
+				duty *= 1.1;
+			}
+			int32_t position = bin_center(activation % GRAVITY_BINS);
+			double applied = duty + gravity_duty(&table, position, duty);
+			double speed = k * (applied + test->true_load * GRAVITY[activation % GRAVITY_BINS] -
+					sign * friction);
+			gravity_adapt(&table, position, duty, speed);
+		}
+
+		double other = table.load[!test->gripping];
+		if (fabs(table.load[test->gripping] - test->load) > TEST_LOAD_TOLERANCE || other != 1.0) {
+			printf("%s: load %.3f (other %.3f), expected %.3f (other 1.000)\n", test->name,
+					table.load[test->gripping], other, test->load);
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+int main(void) {
+	int failed = test_build();
+	failed |= test_adapt();
+	printf("gravity_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
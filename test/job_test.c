@@ -0,0 +1,152 @@
+/*
+ * File: job_test.c
+ *
+ * Descripcion: Prueba de la lectura de trabajos con una tabla de ficheros. Cada caso
+ *              se escribe en un directorio temporal (EV3_JOB) y job_load debe
+ *              devolver el error esperado y, si es de una linea, su numero. El
+ *              trabajo valido se recorre ademas con el cursor para comprobar la
+ *              resolucion de los bucles.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+#define PATH_SIZE                   256
+
+// Fichero (text repetido repeat veces), error y linea esperados
+typedef struct job_case {
+	const char *name;
+	const char *text;
+	int repeat;
+	int error;
+	int line;
+	int n_commands;                 // ordenes si es valido
+} job_case_t;
+
+static const job_case_t JOB_CASES[] = {
+	{"valid", "# pick\nbin 0 10 20\nbin 3 -90 40\nloop 2\n  move-joint 10 -20\n  grip  # cierra\n"
+		"  read-color\n  move-bin\n  release\nend\n", 1, 0, 0, 7},
+	{"valid max commands", "grip\n", JOB_MAX_COMMANDS, 0, 0, JOB_MAX_COMMANDS},
+	{"unknown command", "grip\nfoo\n", 1, EINVAL, 2, 0},
+	{"missing argument", "grip\nmove-joint 1\n", 1, EINVAL, 2, 0},
+	{"extra argument", "release 1\n", 1, EINVAL, 1, 0},
+	{"not a number", "\n\nmove-cartesian 1 2x\n", 1, EINVAL, 3, 0},
+	{"out of 16 bits", "move-joint 40000 0\n", 1, EINVAL, 1, 0},
+	{"color out of range", "wait-color 8\n", 1, EINVAL, 1, 0},
+	{"bin color out of range", "bin -1 0 0\n", 1, EINVAL, 1, 0},
+	{"zero loop count", "loop 0\n  grip\nend\n", 1, EINVAL, 1, 0},
+	{"empty loop", "grip\nloop 2\n  loop\n  end\nend\n", 1, EINVAL, 4, 0},
+	{"unclosed loop", "grip\nloop\n  grip\n", 1, EINVAL, 2, 0},
+	{"end without loop", "grip\nend\n", 1, EINVAL, 2, 0},
+	{"too deep", "loop\nloop\nloop\nloop\nloop\ngrip\nend\nend\nend\nend\nend\n", 1, EINVAL, 5, 0},
+	{"repeated bin", "bin 0 1 2\n# otra\nbin 0 3 4\n", 1, EINVAL, 3, 0},
+	{"move-bin without bin 0", "bin 1 1 2\ngrip\nread-color\nmove-bin\nmove-bin\n", 1, EINVAL, 4, 0},
+	{"too many commands", "grip\n", JOB_MAX_COMMANDS + 1, ENOSPC, JOB_MAX_COMMANDS + 1, 0},
+	{"only comments", "# nada\n\n   \n", 1, ENODATA, 0, 0},
+	{"only bins", "bin 0 1 2\n", 1, ENODATA, 0, 0},
+};
+
+// Ordenes del trabajo valido en el orden de ejecucion
+static const job_opcode VALID_SEQUENCE[] = {
+	JOB_MOVE_JOINT, JOB_GRIP, JOB_READ_COLOR, JOB_MOVE_BIN, JOB_RELEASE,
+	JOB_MOVE_JOINT, JOB_GRIP, JOB_READ_COLOR, JOB_MOVE_BIN, JOB_RELEASE,
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+static int write_job(const char *path, const job_case_t *test) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return 1;
+	}
+	for (int i = 0; i < test->repeat; i++) {
+		fputs(test->text, file);
+	}
+	return (fclose(file) != 0) ? 1 : 0;
+}
+
+/**
+ * @brief Recorre el trabajo valido con el cursor.
+ *
+ * @return 0 si sigue VALID_SEQUENCE y cuenta dos vueltas, 1 si no.
+ */
+static int check_cursor(const job_t *job) {
+	job_cursor_t cursor;
+	const job_command_t *command;
+	int n = 0;
+
+	if (!job->has_bin[0] || !job->has_bin[3] || job->bins[3][0] != -90 || job->bins[3][1] != 40) {
+		printf("valid: bins not recorded\n");
+		return 1;
+	}
+	job_cursor_init(&cursor);
+	while ((command = job_next(job, &cursor)) != NULL) {
+		if (n == N_CASES(VALID_SEQUENCE) || command->opcode != VALID_SEQUENCE[n]) {
+			printf("valid: step %d is opcode %d (line %d)\n", n, command->opcode, command->line);
+			return 1;
+		}
+		n++;
+	}
+	if (n != N_CASES(VALID_SEQUENCE) || cursor.iterations != 2) {
+		printf("valid: %d steps and %lu iterations, expected %d and 2\n", n, cursor.iterations,
+				N_CASES(VALID_SEQUENCE));
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	char dir[] = "/tmp/job_test.XXXXXX";
+	char path[PATH_SIZE];
+	job_t job;
+	int line, failed = 0;
+
+	unsetenv(JOB_FILE_ENV);
+	if (job_load(&job, &line) != ENOENT) {
+		printf("no job: expected ENOENT\n");
+		failed = 1;
+	}
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/test.job", dir);
+	setenv(JOB_FILE_ENV, path, 1);
+	if (job_load(&job, &line) != ENOENT || line != 0) {
+		printf("missing file: expected ENOENT at line 0\n");
+		failed = 1;
+	}
+
+	for (int i = 0; i < N_CASES(JOB_CASES); i++) {
+		const job_case_t *test = &JOB_CASES[i];
+		if (write_job(path, test) != 0) {
+			perror(path);
+			failed = 1;
+			break;
+		}
+
+		int error = job_load(&job, &line);
+		if (error != test->error || (error != 0 && line != test->line) ||
+				(error == 0 && job.n_commands != test->n_commands)) {
+			printf("%s: %s at line %d (%d commands), expected %s at line %d\n", test->name,
+					strerror(error), line, job.n_commands, strerror(test->error), test->line);
+			failed = 1;
+		} else if (i == 0) {
+			failed |= check_cursor(&job);
+		}
+	}
+
+	unlink(path);
+	rmdir(dir);
+	printf("job_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
@@ -0,0 +1,185 @@
+/*
+ * File: lcd_test.c
+ *
+ * Descripcion: Prueba del volcado de regiones modificadas del LCD. Abre lcd sobre
+ *              un memfd (lcd_open_fd) con el formato de un framebuffer de ev3dev,
+ *              dibuja la escena del reporter de main.c y comprueba para cada
+ *              formato las escrituras y los bytes de tres volcados:
+ *              - la pantalla completa (primer volcado);
+ *              - la misma escena sin cambios (no escribe nada);
+ *              - el cambio del digito de los segundos (solo sus filas y bytes).
+ *              Despues de cada volcado el memfd debe contener el lienzo en el
+ *              formato del dispositivo. En monocromo se comprueba ademas el orden de
+ *              los bits con un pixel conocido del titulo.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lcd.h"
+
+// Escena del reporter (main.c)
+#define X_TITLE                     20
+#define Y_TITLE                     10
+#define TITLE                       "LEGO - ROBOTIC ARM"
+#define X_CIRCLE                    EV3_X_LCD / 2
+#define Y_CIRCLE                    EV3_Y_LCD / 2
+#define RADIUS                      35
+#define X_TIME                      60
+#define Y_TIME                      EV3_Y_LCD - 20
+
+#define TIME_BEFORE                 "12:34:56"
+#define TIME_AFTER                  "12:34:57"
+
+// Formato del framebuffer y volcados esperados
+typedef struct lcd_test_case {
+	const char *name;
+	int bits_per_pixel;
+	int line_length;
+	unsigned long full_writes;      // primer volcado: todas las filas completas
+	unsigned long full_bytes;
+	unsigned long digit_writes;     // de '6' a '7': filas 0 a 6 del glifo
+	unsigned long digit_bytes;
+} lcd_test_case_t;
+
+/*
+ * El glifo de los segundos ocupa x = 102..107. Entre '6' y '7' cambian las filas 0 a
+ * 6 con tramos de x = 102..106 (filas 0, 4 y 5), 103..106 (1), 102..105 (2 y 3) y
+ * 104..105 (6): en monocromo son los bytes 12 y 13 salvo la fila 6 (byte 13) y en
+ * xrgb8888 4 bytes por pixel menos el ultimo, el byte x (0 en blanco y en negro).
+ */
+static const lcd_test_case_t CASES[] = {
+	// ev3dev: 178 pixeles en filas de 24 bytes
+	{"mono", 1, 24, EV3_Y_LCD, EV3_Y_LCD * 24, 7, 6 * 2 + 1},
+	{"xrgb8888", 32, EV3_X_LCD * 4, EV3_Y_LCD, EV3_Y_LCD * EV3_X_LCD * 4,
+		7, 4 * (5 + 4 + 4 + 4 + 5 + 5 + 2) - 7},
+};
+
+static lcd_sprite_t title;
+static lcd_sprite_t claw_open;
+static uint8_t *device;
+
+static void draw_scene(lcd_t *lcd, const char *time_str) {
+	lcd_draw_sprite(lcd, X_TITLE, Y_TITLE, &title);
+	lcd_draw_sprite(lcd, X_CIRCLE - RADIUS, Y_CIRCLE - RADIUS, &claw_open);
+	lcd_draw_text(lcd, X_TIME, Y_TIME, time_str);
+}
+
+/**
+ * @brief Vuelca la escena y comprueba las escrituras y bytes del volcado.
+ *
+ * @return 0 si coinciden con los esperados, 1 si no.
+ */
+static int check_flush(lcd_t *lcd, const char *name, const char *frame,
+		unsigned long expected_writes, unsigned long expected_bytes) {
+	unsigned long writes = lcd->writes;
+	unsigned long bytes = lcd->bytes;
+	lcd_flush(lcd);
+	writes = lcd->writes - writes;
+	bytes = lcd->bytes - bytes;
+	printf("%s %s: %lu writes, %lu bytes\n", name, frame, writes, bytes);
+	if (writes != expected_writes || bytes != expected_bytes) {
+		printf("%s %s: expected %lu writes, %lu bytes\n", name, frame,
+				expected_writes, expected_bytes);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Comprueba que el dispositivo contiene el lienzo en su formato.
+ *
+ * @return 0 si coincide, 1 si no.
+ */
+static int check_device(const lcd_t *lcd, const char *name) {
+	size_t size = (size_t) lcd->line_length * EV3_Y_LCD;
+	if (pread(lcd->fd, device, size, 0) != (ssize_t) size) {
+		perror("pread");
+		return 1;
+	}
+	for (int y = 0; y < EV3_Y_LCD; y++) {
+		const uint8_t *row = device + (size_t) y * lcd->line_length;
+		for (int x = 0; x < EV3_X_LCD; x++) {
+			int black;
+			if (lcd->bits_per_pixel == 1) {
+				black = (row[x / 8] >> (x % 8)) & 1;
+			} else {
+				uint32_t pixel;
+				memcpy(&pixel, row + 4 * x, sizeof(pixel));
+				black = (pixel == 0x00000000u) ? 1 : (pixel == 0x00ffffffu) ? 0 : -1;
+			}
+			if (black != lcd->canvas[y][x]) {
+				printf("%s: pixel (%d, %d) is %d in the device, %d in the canvas\n",
+						name, x, y, black, lcd->canvas[y][x]);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int run_case(const lcd_test_case_t *test) {
+	lcd_t lcd;
+	int failed = 0;
+
+	int fd = memfd_create(test->name, MFD_CLOEXEC);
+	if (fd < 0 || ftruncate(fd, (off_t) test->line_length * EV3_Y_LCD) < 0) {
+		perror("memfd_create");
+		return 1;
+	}
+	int error = lcd_open_fd(&lcd, fd, test->bits_per_pixel, test->line_length);
+	if (error != 0) {
+		printf("%s: lcd_open_fd: %s\n", test->name, strerror(error));
+		return 1;
+	}
+
+	draw_scene(&lcd, TIME_BEFORE);
+	failed |= check_flush(&lcd, test->name, "full frame", test->full_writes, test->full_bytes);
+	failed |= check_device(&lcd, test->name);
+
+	// Pixel (20, 10): primera columna de la 'L' del titulo, sola en su byte
+	if (test->bits_per_pixel == 1 && device[Y_TITLE * test->line_length + X_TITLE / 8] != 0x10) {
+		printf("%s: title byte is 0x%02x, expected 0x10 (leftmost pixel in bit 0)\n",
+				test->name, device[Y_TITLE * test->line_length + X_TITLE / 8]);
+		failed = 1;
+	}
+
+	draw_scene(&lcd, TIME_BEFORE);
+	failed |= check_flush(&lcd, test->name, "unchanged frame", 0, 0);
+
+	draw_scene(&lcd, TIME_AFTER);
+	failed |= check_flush(&lcd, test->name, "seconds digit", test->digit_writes, test->digit_bytes);
+	failed |= check_device(&lcd, test->name);
+
+	lcd_close(&lcd);
+	return failed;
+}
+
+int main(void) {
+	int failed = 0;
+
+	device = malloc((size_t) EV3_X_LCD * 4 * EV3_Y_LCD);
+	if (device == NULL || lcd_sprite_text(&title, TITLE) != 0 ||
+			lcd_sprite_circle(&claw_open, RADIUS, false) != 0) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+		failed |= run_case(&CASES[i]);
+	}
+	lcd_sprite_free(&title);
+	lcd_sprite_free(&claw_open);
+	free(device);
+
+	printf("lcd_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
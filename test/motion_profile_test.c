@@ -0,0 +1,294 @@
+/*
+ * File: motion_profile_test.c
+ *
+ * Descripcion: Pruebas de los perfiles de movimiento con tablas de casos. Para cada
+ *              perfil se comprueba la duracion esperada, que termina en el destino
+ *              con velocidad cero y que el muestreo no supera la velocidad maxima
+ *              ni se sale del recorrido. Los movimientos coordinados deben durar
+ *              todos lo mismo que el eje mas lento. Las trayectorias con mezclas
+ *              deben salir y llegar en reposo, pasar a menos del recorte de la
+ *              mezcla de cada punto intermedio y no superar los limites de ningun
+ *              eje.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "motion_profile.h"
+
+#define TEST_SAMPLES                1000
+#define TEST_END_DT                 1e-9    // units: s, antes del final del perfil
+#define TEST_TIME_TOLERANCE         1e-6    // units: s
+#define TEST_POSITION_TOLERANCE     1e-6    // units: deg
+#define TEST_SPEED_TOLERANCE        1e-3    // units: deg/s
+
+#define LIMITS_INIT                 {200.0, 400.0, 4000.0}
+static const motion_limits_t LIMITS = LIMITS_INIT;
+
+// Movimiento en reposo de start a target y su duracion calculada a mano
+typedef struct profile_case {
+	const char *name;
+	motion_profile_type type;
+	double start;
+	double target;
+	double duration;
+} profile_case_t;
+
+static const profile_case_t PROFILE_CASES[] = {
+	// 0.5 s acelerando (50 deg), 1.3 s de crucero y 0.5 s frenando
+	{"trapezoidal long", MOTION_TRAPEZOIDAL, 0.0, 360.0, 2.3},
+	{"trapezoidal reverse", MOTION_TRAPEZOIDAL, 100.0, -260.0, 2.3},
+	// Sin crucero: 2 sqrt(d / a)
+	{"trapezoidal short", MOTION_TRAPEZOIDAL, 0.0, 50.0, 0.70710678},
+	// Rampas de jerk de 0.1 s: 0.6 s acelerando (60 deg), 1.2 s de crucero
+	{"scurve long", MOTION_SCURVE, 0.0, 360.0, 2.4},
+	// Sin aceleracion maxima: cuatro rampas de (d / 2 / j)^(1/3)
+	{"scurve short", MOTION_SCURVE, 0.0, 4.0, 0.31748021},
+	{"scurve reverse short", MOTION_SCURVE, 4.0, 0.0, 0.31748021},
+	{"no move", MOTION_SCURVE, 10.0, 10.0, 0.0},
+};
+
+// Movimiento coordinado de dos ejes y su duracion comun
+#define TEST_SYNC_AXES              2
+
+typedef struct sync_case {
+	const char *name;
+	motion_profile_type type;
+	motion_limits_t limits[TEST_SYNC_AXES];
+	double start[TEST_SYNC_AXES];
+	double target[TEST_SYNC_AXES];
+	double duration;
+} sync_case_t;
+
+static const sync_case_t SYNC_CASES[] = {
+	{"sync trapezoidal", MOTION_TRAPEZOIDAL, {LIMITS_INIT, LIMITS_INIT},
+		{0.0, 0.0}, {360.0, 50.0}, 2.3},
+	{"sync scurve", MOTION_SCURVE, {LIMITS_INIT, LIMITS_INIT},
+		{0.0, 0.0}, {4.0, -360.0}, 2.4},
+	// El segundo eje sin crucero: 1 s acelerando y 1 s frenando
+	{"sync slow axis", MOTION_TRAPEZOIDAL, {LIMITS_INIT, {100.0, 100.0, 1000.0}},
+		{0.0, 0.0}, {360.0, -100.0}, 2.3},
+	// Un eje sin movimiento mantiene duracion 0
+	{"sync one axis", MOTION_SCURVE, {LIMITS_INIT, LIMITS_INIT},
+		{0.0, 20.0}, {360.0, 20.0}, 2.4},
+};
+
+// Trayectoria de dos ejes por varios puntos y su duracion calculada a mano
+#define TEST_PATH_POINTS            4
+
+typedef struct path_case {
+	const char *name;
+	motion_limits_t limits[MOTION_PATH_MAX_AXES];
+	int n_points;
+	double points[TEST_PATH_POINTS][MOTION_PATH_MAX_AXES];
+	double duration;
+} path_case_t;
+
+static const path_case_t PATH_CASES[] = {
+	// Un tramo de 1 s con mezclas de 0.5 s al salir y al llegar
+	{"path straight", {LIMITS_INIT, LIMITS_INIT}, 2, {{0.0, 0.0}, {200.0, 0.0}}, 1.5},
+	// Esquina de 90 grados sin detenerse: dos tramos de 1 s
+	{"path corner", {LIMITS_INIT, LIMITS_INIT}, 3,
+		{{0.0, 0.0}, {200.0, 0.0}, {200.0, 200.0}}, 2.5},
+	// Las mezclas no caben en tramos de 0.1 s: se alargan a 0.5 s y las mezclas
+	// bajan a 0.1 s
+	{"path short segments", {LIMITS_INIT, LIMITS_INIT}, 3,
+		{{0.0, 0.0}, {20.0, 0.0}, {20.0, 20.0}}, 1.1},
+	// Un punto repetido es una parada: el tramo nulo se alarga a 0.5 s
+	{"path repeated point", {LIMITS_INIT, {100.0, 100.0, 1000.0}}, 4,
+		{{0.0, 0.0}, {100.0, 0.0}, {100.0, 0.0}, {0.0, 0.0}}, 2.0},
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+/**
+ * @brief Comprueba que un perfil termina en el destino en reposo sin pasar de la
+ *        velocidad maxima ni salirse del recorrido.
+ *
+ * @return 0 si se cumple, 1 si no.
+ */
+static int check_profile(const char *name, const motion_profile_t *profile,
+		const motion_limits_t *limits) {
+	double low = fmin(profile->start, profile->target) - TEST_POSITION_TOLERANCE;
+	double high = fmax(profile->start, profile->target) + TEST_POSITION_TOLERANCE;
+	double position, speed;
+
+	for (int i = 0; i <= TEST_SAMPLES; i++) {
+		motion_profile_sample(profile, profile->duration * i / TEST_SAMPLES, &position, &speed);
+		if (fabs(speed) > limits->max_speed * (1.0 + 1e-9) || position < low || position > high) {
+			printf("%s: t = %.4f s: position %.4f deg, speed %.4f deg/s out of bounds\n",
+					name, profile->duration * i / TEST_SAMPLES, position, speed);
+			return 1;
+		}
+	}
+
+	// Integrando los tramos hasta justo antes del final (al final devuelve target)
+	motion_profile_sample(profile, profile->duration - TEST_END_DT, &position, &speed);
+	if (profile->duration > 0.0 && (fabs(position - profile->target) > TEST_POSITION_TOLERANCE ||
+			fabs(speed) > TEST_SPEED_TOLERANCE)) {
+		printf("%s: ends at %.6f deg, %.6f deg/s instead of %.6f deg at rest\n",
+				name, position, speed, profile->target);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_profiles(void) {
+	int failed = 0;
+	for (int i = 0; i < N_CASES(PROFILE_CASES); i++) {
+		const profile_case_t *test = &PROFILE_CASES[i];
+		motion_profile_t profile;
+
+		if (motion_profile_plan(&profile, test->type, &LIMITS, test->start, test->target) != 0) {
+			printf("%s: plan failed\n", test->name);
+			failed = 1;
+			continue;
+		}
+		if (fabs(profile.duration - test->duration) > TEST_TIME_TOLERANCE) {
+			printf("%s: duration %.6f s, expected %.6f s\n", test->name, profile.duration,
+					test->duration);
+			failed = 1;
+		}
+		failed |= check_profile(test->name, &profile, &LIMITS);
+	}
+
+	// Limites no positivos
+	motion_profile_t profile;
+	motion_limits_t no_jerk = {200.0, 400.0, 0.0};
+	if (motion_profile_plan(&profile, MOTION_SCURVE, &no_jerk, 0.0, 10.0) == 0 ||
+			motion_profile_plan(&profile, MOTION_TRAPEZOIDAL, &no_jerk, 0.0, 10.0) != 0) {
+		printf("limits: max_jerk = 0 must only be rejected for the S-curve\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_sync(void) {
+	int failed = 0;
+	for (int i = 0; i < N_CASES(SYNC_CASES); i++) {
+		const sync_case_t *test = &SYNC_CASES[i];
+		motion_profile_t profiles[TEST_SYNC_AXES];
+
+		if (motion_profile_plan_sync(profiles, TEST_SYNC_AXES, test->type, test->limits,
+				test->start, test->target) != 0) {
+			printf("%s: plan failed\n", test->name);
+			failed = 1;
+			continue;
+		}
+		for (int j = 0; j < TEST_SYNC_AXES; j++) {
+			double expected = (test->start[j] != test->target[j]) ? test->duration : 0.0;
+			if (fabs(profiles[j].duration - expected) > TEST_TIME_TOLERANCE) {
+				printf("%s: axis %d lasts %.6f s, expected %.6f s\n", test->name, j,
+						profiles[j].duration, expected);
+				failed = 1;
+			}
+			failed |= check_profile(test->name, &profiles[j], &test->limits[j]);
+		}
+	}
+	return failed;
+}
+
+/**
+ * @brief Comprueba una trayectoria: sale del primer punto y llega al ultimo en
+ *        reposo, pasa por cada punto intermedio a menos de a * blend^2 / 8 (el
+ *        recorte de una mezcla de aceleracion a), las mezclas no se solapan y
+ *        ningun eje pasa de su velocidad y aceleracion maximas.
+ *
+ * @return 0 si se cumple, 1 si no.
+ */
+static int check_path(const path_case_t *test, const motion_path_t *path) {
+	double position[MOTION_PATH_MAX_AXES], speed[MOTION_PATH_MAX_AXES];
+	double last_speed[MOTION_PATH_MAX_AXES];
+	double dt = path->duration / TEST_SAMPLES;
+
+	motion_path_sample(path, path->duration, position, speed);
+	for (int j = 0; j < path->n_axes; j++) {
+		if (fabs(position[j] - test->points[test->n_points - 1][j]) > TEST_POSITION_TOLERANCE ||
+				fabs(speed[j]) > TEST_SPEED_TOLERANCE) {
+			printf("%s: axis %d ends at %.6f deg, %.6f deg/s\n", test->name, j, position[j], speed[j]);
+			return 1;
+		}
+	}
+
+	for (int k = 1; k < path->n_points; k++) {
+		if (path->switch_time[k] - path->switch_time[k - 1] <
+				(path->blend[k] + path->blend[k - 1]) / 2.0 - TEST_TIME_TOLERANCE) {
+			printf("%s: blends %d and %d overlap\n", test->name, k - 1, k);
+			return 1;
+		}
+	}
+	for (int k = 1; k < path->n_points - 1; k++) {
+		motion_path_sample(path, path->switch_time[k], position, speed);
+		for (int j = 0; j < path->n_axes; j++) {
+			double cut = test->limits[j].max_accel * path->blend[k] * path->blend[k] / 8.0;
+			if (fabs(position[j] - test->points[k][j]) > cut + TEST_POSITION_TOLERANCE) {
+				printf("%s: axis %d passes point %d at %.6f deg, %.6f deg away (blend cut %.6f)\n",
+						test->name, j, k, position[j], fabs(position[j] - test->points[k][j]), cut);
+				return 1;
+			}
+		}
+	}
+
+	motion_path_sample(path, 0.0, position, last_speed);
+	for (int j = 0; j < path->n_axes; j++) {
+		if (position[j] != test->points[0][j] || last_speed[j] != 0.0) {
+			printf("%s: axis %d does not start at rest on the first point\n", test->name, j);
+			return 1;
+		}
+	}
+	for (int i = 1; i <= TEST_SAMPLES; i++) {
+		motion_path_sample(path, dt * i, position, speed);
+		for (int j = 0; j < path->n_axes; j++) {
+			double accel = (speed[j] - last_speed[j]) / dt;
+			if (fabs(speed[j]) > test->limits[j].max_speed * (1.0 + 1e-9) ||
+					fabs(accel) > test->limits[j].max_accel * (1.0 + 1e-6)) {
+				printf("%s: axis %d at t = %.4f s: %.4f deg/s, %.4f deg/s^2 over the limits\n",
+						test->name, j, dt * i, speed[j], accel);
+				return 1;
+			}
+			last_speed[j] = speed[j];
+		}
+	}
+	return 0;
+}
+
+static int test_paths(void) {
+	int failed = 0;
+	motion_path_t path;
+
+	for (int i = 0; i < N_CASES(PATH_CASES); i++) {
+		const path_case_t *test = &PATH_CASES[i];
+		if (motion_path_plan(&path, MOTION_PATH_MAX_AXES, test->limits, test->points, test->n_points) != 0) {
+			printf("%s: plan failed\n", test->name);
+			failed = 1;
+			continue;
+		}
+		if (fabs(path.duration - test->duration) > TEST_TIME_TOLERANCE) {
+			printf("%s: duration %.6f s, expected %.6f s\n", test->name, path.duration, test->duration);
+			failed = 1;
+		}
+		failed |= check_path(test, &path);
+	}
+
+	// Numero de puntos o ejes no valido
+	const motion_limits_t limits[MOTION_PATH_MAX_AXES + 1] = {LIMITS_INIT, LIMITS_INIT, LIMITS_INIT};
+	if (motion_path_plan(&path, MOTION_PATH_MAX_AXES, limits, PATH_CASES[0].points, 0) != EINVAL ||
+			motion_path_plan(&path, MOTION_PATH_MAX_AXES + 1, limits, PATH_CASES[0].points, 2) != EINVAL) {
+		printf("path: invalid point or axis counts must be rejected\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+int main(void) {
+	int failed = test_profiles();
+	failed |= test_sync();
+	failed |= test_paths();
+	printf("motion_profile_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
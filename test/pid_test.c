@@ -0,0 +1,126 @@
+/*
+ * File: pid_test.c
+ *
+ * Descripcion: Pruebas del controlador PID con tablas de casos. Un primer periodo
+ *              desde reposo comprueba la salida, la saturacion y la integral de cada
+ *              termino. Los casos de windup mantienen un error durante muchos
+ *              periodos y despues lo cambian: la integral no debe pasar de lo que
+ *              cabe sin saturar, por lo que la salida responde al nuevo error en el
+ *              primer periodo.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "pid.h"
+
+#define TEST_DT                     0.01    // units: s
+#define TEST_LIMIT                  100.0   // units: %
+#define TEST_TOLERANCE              1e-6
+
+// Primer periodo de un controlador sin historia
+typedef struct step_case {
+	const char *name;
+	double kp, ki, kd;
+	double error;
+	double feedforward;
+	double output;
+	bool saturated;
+	double integral;
+} step_case_t;
+
+static const step_case_t STEP_CASES[] = {
+	{"proportional", 2.0, 0.0, 0.0, 10.0, 0.0, 20.0, false, 0.1},
+	{"feedforward", 2.0, 0.0, 0.0, 10.0, 30.0, 50.0, false, 0.1},
+	// Sin error anterior no hay derivada
+	{"first derivative", 0.0, 0.0, 5.0, 10.0, 0.0, 0.0, false, 0.1},
+	{"integral", 1.0, 10.0, 0.0, 10.0, 0.0, 11.0, false, 0.1},
+	// Satura en el sentido del error: el paso de la integral se descarta
+	{"clip positive", 20.0, 0.0, 0.0, 10.0, 0.0, TEST_LIMIT, true, 0.0},
+	{"clip negative", 20.0, 10.0, 0.0, -10.0, 0.0, -TEST_LIMIT, true, 0.0},
+	// Satura por la prealimentacion contra el error: la integral acumula
+	{"clip against error", 2.0, 10.0, 0.0, -10.0, 300.0, TEST_LIMIT, true, -0.1},
+};
+
+// Error mantenido hold_steps periodos y salida del primer periodo con otro error
+typedef struct windup_case {
+	const char *name;
+	double kp, ki;
+	double hold_error;
+	int hold_steps;
+	double release_error;
+	double release_output;
+} windup_case_t;
+
+static const windup_case_t WINDUP_CASES[] = {
+	// Satura desde el primer periodo: la integral se queda en 0 y al invertir el
+	// error la salida es -5 - 10 * 0.05. Sin anti-windup la integral llegaria a
+	// 400 y con el error de -5 la salida seguiria saturada unos 78 s.
+	{"saturated from the start", 1.0, 10.0, 200.0, 200, -5.0, -5.5},
+	{"saturated negative", 1.0, 10.0, -200.0, 200, 5.0, 5.5},
+	// La integral crece de 0.03 en 0.03 hasta 9.69 (3 + 10 * 9.69 <= 100) y se
+	// detiene ahi: sin error la salida es 96.9
+	{"integral up to the limit", 1.0, 10.0, 3.0, 1000, 0.0, 96.9},
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+static int test_steps(void) {
+	int failed = 0;
+	for (int i = 0; i < N_CASES(STEP_CASES); i++) {
+		const step_case_t *test = &STEP_CASES[i];
+		pid_controller_t pid;
+		bool saturated;
+
+		pid_init(&pid, test->kp, test->ki, test->kd, TEST_LIMIT);
+		double output = pid_update(&pid, test->error, test->feedforward, TEST_DT, &saturated);
+		if (fabs(output - test->output) > TEST_TOLERANCE || saturated != test->saturated ||
+				fabs(pid.integral - test->integral) > TEST_TOLERANCE) {
+			printf("%s: output %.6f%s, integral %.6f; expected %.6f%s, %.6f\n", test->name, output,
+					saturated ? " (saturated)" : "", pid.integral, test->output,
+					test->saturated ? " (saturated)" : "", test->integral);
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+static int test_windup(void) {
+	int failed = 0;
+	for (int i = 0; i < N_CASES(WINDUP_CASES); i++) {
+		const windup_case_t *test = &WINDUP_CASES[i];
+		pid_controller_t pid;
+		bool saturated;
+
+		pid_init(&pid, test->kp, test->ki, 0.0, TEST_LIMIT);
+		for (int step = 0; step < test->hold_steps; step++) {
+			pid_update(&pid, test->hold_error, 0.0, TEST_DT, NULL);
+			double unsaturated = fabs(test->kp * test->hold_error + test->ki * pid.integral);
+			if (unsaturated > TEST_LIMIT && pid.integral != 0.0) {
+				printf("%s: step %d: integral %.3f winds the output to %.3f\n", test->name, step,
+						pid.integral, unsaturated);
+				failed = 1;
+				break;
+			}
+		}
+
+		double output = pid_update(&pid, test->release_error, 0.0, TEST_DT, &saturated);
+		if (fabs(output - test->release_output) > TEST_TOLERANCE || saturated) {
+			printf("%s: output %.6f%s after the release, expected %.6f\n", test->name, output,
+					saturated ? " (saturated)" : "", test->release_output);
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+int main(void) {
+	int failed = test_steps();
+	failed |= test_windup();
+	printf("pid_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
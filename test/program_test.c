@@ -0,0 +1,134 @@
+/*
+ * File: program_test.c
+ *
+ * Descripcion: Prueba de los ficheros de programa de teach-and-repeat. Guarda un
+ *              programa en un directorio temporal (EV3_PROGRAM), comprueba que se
+ *              lee igual y despues aplica una tabla de corrupciones al fichero: cada
+ *              una debe rechazarse con EINVAL sin modificar el programa en memoria.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "program.h"
+
+#define PATH_SIZE                   256
+
+// Corrupcion del fichero: byte offset con xor y cambio del tamaño
+typedef struct corruption {
+	const char *name;
+	int offset;
+	uint8_t xor;
+	int resize;
+} corruption_t;
+
+static const corruption_t CORRUPTIONS[] = {
+	{"magic", 0, 0x01, 0},
+	{"version", 4, 0x02, 0},
+	{"waypoint count", 6, 0x01, 0},
+	{"checksum", 8, 0x80, 0},
+	{"rotation", 12, 0x01, 0},
+	{"elevation high byte", 12 + 5 + 3, 0x40, 0},
+	{"claw", 12 + 2 * 5 + 4, 0x01, 0},
+	{"truncated", 0, 0x00, -1},
+	{"trailing byte", 0, 0x00, 1},
+};
+
+static const program_waypoint_t WAYPOINTS[] = {
+	{0, 0, false}, {-720, 150, false}, {32767, -32768, true}, {90, -45, true},
+};
+
+#define N_CASES(cases)              ((int) (sizeof(cases) / sizeof((cases)[0])))
+
+static int write_file(const char *path, const uint8_t *bytes, size_t size) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return 1;
+	}
+	size_t written = fwrite(bytes, 1, size, file);
+	return (fclose(file) != 0 || written != size) ? 1 : 0;
+}
+
+int main(void) {
+	char dir[] = "/tmp/program_test.XXXXXX";
+	char path[PATH_SIZE];
+	uint8_t saved[PATH_SIZE], bytes[PATH_SIZE + 1];
+	program_t program = {0}, loaded;
+	int failed = 0;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/test.prg", dir);
+	setenv(PROGRAM_FILE_ENV, path, 1);
+
+	for (int i = 0; i < N_CASES(WAYPOINTS); i++) {
+		program_add(&program, WAYPOINTS[i].rotation, WAYPOINTS[i].elevation, WAYPOINTS[i].claw_closed);
+	}
+	if (program_add(&program, 32768, 0, false) != ERANGE || program_add(&program, 0, -32769, false) != ERANGE) {
+		printf("program_add: positions out of 16 bits must be rejected\n");
+		failed = 1;
+	}
+
+	// Ida y vuelta
+	int error = program_save(&program);
+	if (error == 0) {
+		error = program_load(&loaded);
+	}
+	if (error != 0) {
+		printf("save/load: %s\n", strerror(error));
+		failed = 1;
+	} else if (loaded.n_waypoints != program.n_waypoints ||
+			memcmp(loaded.waypoints, program.waypoints, sizeof(program.waypoints[0]) * program.n_waypoints) != 0) {
+		printf("save/load: the loaded program differs\n");
+		failed = 1;
+	}
+
+	FILE *file = fopen(path, "rb");
+	size_t size = (file != NULL) ? fread(saved, 1, sizeof(saved), file) : 0;
+	if (file != NULL) {
+		fclose(file);
+	}
+	if (size != program_size(&program)) {
+		printf("file: %zu bytes, expected %zu\n", size, program_size(&program));
+		failed = 1;
+	}
+
+	for (int i = 0; i < N_CASES(CORRUPTIONS) && size > 0; i++) {
+		const corruption_t *test = &CORRUPTIONS[i];
+		memcpy(bytes, saved, size);
+		bytes[size] = 0;
+		bytes[test->offset] ^= test->xor;
+		if (write_file(path, bytes, size + test->resize) != 0) {
+			perror(path);
+			failed = 1;
+			break;
+		}
+
+		loaded.n_waypoints = -1;
+		error = program_load(&loaded);
+		printf("%-20s %s\n", test->name, (error == EINVAL) ? "rejected" : "accepted");
+		if (error != EINVAL || loaded.n_waypoints != -1) {
+			failed = 1;
+		}
+	}
+
+	unlink(path);
+	if (program_load(&loaded) != ENOENT) {
+		printf("missing file: expected ENOENT\n");
+		failed = 1;
+	}
+	rmdir(dir);
+
+	printf("program_test: %s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# File: run_tests.sh
+#
+# Descripcion: Compila y ejecuta las pruebas de test/. Una prueba que devuelve 77
+#              se ha saltado (p.ej. sin /dev/uinput).
+#
+#              Uso: test/run_tests.sh
+#
+# Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+# Version: 1.0
+# Date: dec-23
+#
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+TEST_FLAGS=
+CFLAGS="-std=gnu11 -Wall -Wextra -O2 -I$ROOT -I$ROOT/sim"
+failures=0
+
+# run_test nombre fuentes... (con las opciones de $TEST_FLAGS)
+run_test() {
+	name=$1
+	shift
+	if ! gcc $CFLAGS $TEST_FLAGS -o "$WORK/$name" "$@" -lpthread -lm; then
+		echo "$name: BUILD FAILED"
+		failures=$((failures + 1))
+		return
+	fi
+	"$WORK/$name"
+	case $? in
+		0) ;;
+		77) echo "$name: SKIPPED" ;;
+		*) echo "$name: FAILED"; failures=$((failures + 1)) ;;
+	esac
+}
+
+cd "$ROOT"
+run_test buttons_input_test test/buttons_input_test.c buttons_input.c periodic.c timebase.c
+run_test shutdown_test test/shutdown_test.c executive.c periodic.c task_stats.c timebase.c
+run_test lcd_test test/lcd_test.c lcd.c
+run_test motion_profile_test test/motion_profile_test.c motion_profile.c
+run_test program_test test/program_test.c program.c
+run_test pid_test test/pid_test.c pid.c
+run_test gravity_test test/gravity_test.c gravity.c
+run_test calibration_test test/calibration_test.c calibration.c gravity.c
+run_test job_test test/job_test.c job.c
+TEST_FLAGS=-DVIRTUAL_TIME
+run_test shutdown_test_vt test/shutdown_test.c executive.c periodic.c task_stats.c timebase.c
+
+[ $failures -eq 0 ]
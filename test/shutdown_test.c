@@ -0,0 +1,155 @@
+/*
+ * File: shutdown_test.c
+ *
+ * Descripcion: Prueba de la finalizacion de las tareas periodicas. Arranca hilos
+ *              task_thread con periodos de 5 ms a 10 s (uno con rate que duerme
+ *              1 s y otro al que despierta task_wake en cada activacion de un
+ *              tercero, como los sensores y los ejes, y otro que se despierta a si
+ *              mismo antes de su espera) y un ejecutivo ciclico en su propio hilo,
+ *              comprueba que siguen activandose, da la orden de finalizacion
+ *              (periodic_shutdown) y
+ *              comprueba que todos terminan antes de TEST_JOIN_BOUND_MS. Se compila
+ *              en tiempo real y con VIRTUAL_TIME (test/run_tests.sh).
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "executive.h"
+#include "periodic.h"
+#include "timebase.h"
+
+#define TEST_RUN_MS                 300     // ejecucion antes de la orden de finalizacion
+#define TEST_JOIN_BOUND_MS          20      // desde la orden hasta que termina cada hilo
+#define TEST_SLEEP_PERIOD           1000000000L
+#define TEST_SELF_WAKER_PERIOD      20000000L
+
+enum test_task_id {
+	FAST_TASK, WAKER_TASK, SLEEPER_TASK, SELF_WAKER_TASK, SLOW_TASK, IDLE_TASK, N_TEST_TASKS
+};
+
+static unsigned long activations[N_TEST_TASKS];
+
+static void count_step(void *context);
+static void waker_step(void *context);
+static void self_waker_step(void *context);
+static long sleeper_rate(void *context);
+
+static task_t tasks[N_TEST_TASKS] = {
+	[FAST_TASK] = { .name = "fast", .step = count_step, .context = &activations[FAST_TASK], .period = 5000000L },
+	[WAKER_TASK] = { .name = "waker", .step = waker_step, .context = &activations[WAKER_TASK], .period = 20000000L },
+	[SLEEPER_TASK] = { .name = "sleeper", .step = count_step, .context = &activations[SLEEPER_TASK],
+			.period = 20000000L, .rate = sleeper_rate },
+	[SELF_WAKER_TASK] = { .name = "selfwake", .step = self_waker_step, .context = &activations[SELF_WAKER_TASK],
+			.period = TEST_SELF_WAKER_PERIOD },
+	[SLOW_TASK] = { .name = "slow", .step = count_step, .context = &activations[SLOW_TASK], .period = 500000000L },
+	[IDLE_TASK] = { .name = "idle", .step = count_step, .context = &activations[IDLE_TASK], .period = 10000000000L },
+};
+
+static void count_step(void *context) {
+	(*(unsigned long *) context)++;
+}
+
+// Despierta a la tarea con rate en cada activacion, como un eje a su sensor
+static void waker_step(void *context) {
+	(*(unsigned long *) context)++;
+	task_wake(&tasks[SLEEPER_TASK]);
+}
+
+// Se despierta a si misma en una de cada dos activaciones, antes de llegar a
+// periodic_wait: la siguiente activacion debe ser inmediata y no una finalizacion
+static void self_waker_step(void *context) {
+	if ((*(unsigned long *) context)++ % 2 == 0) {
+		task_wake(&tasks[SELF_WAKER_TASK]);
+	}
+}
+
+static long sleeper_rate(void *context) {
+	(void) context;
+	return TEST_SLEEP_PERIOD;
+}
+
+static long long elapsed_ms(const struct timespec *start, const struct timespec *end) {
+	return ((end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec)) / 1000000;
+}
+
+static void* executive_thread(void *params) {
+	static unsigned long activations[2];
+	static task_t executive_tasks[2] = {
+		{ .name = "ce fast", .step = count_step, .context = &activations[0], .period = 10000000L },
+		{ .name = "ce slow", .step = count_step, .context = &activations[1], .period = 50000000L },
+	};
+	static executive_stats_t stats;
+	(void) params;
+
+	int error = cyclic_executive(executive_tasks, 2, &stats);
+	if (error != 0) {
+		printf("shutdown_test: cyclic_executive returned %d\n", error);
+	}
+	return NULL;
+}
+
+int main(void) {
+	pthread_t threads[N_TEST_TASKS + 1];
+	struct timespec shutdown_time, joined;
+	int failures = 0;
+
+	timebase_init();
+	if (periodic_shutdown_init() != 0) {
+		printf("shutdown_test: periodic_shutdown_init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < N_TEST_TASKS; i++) {
+		if (timebase_thread_create(&threads[i], NULL, task_thread, &tasks[i]) != 0) {
+			printf("shutdown_test: cannot create task %s\n", tasks[i].name);
+			return EXIT_FAILURE;
+		}
+	}
+	if (timebase_thread_create(&threads[N_TEST_TASKS], NULL, executive_thread, NULL) != 0) {
+		printf("shutdown_test: cannot create the cyclic executive\n");
+		return EXIT_FAILURE;
+	}
+
+	timebase_usleep(TEST_RUN_MS * 1000L);
+	timebase_now(&shutdown_time);
+	periodic_shutdown();
+
+	for (int i = 0; i <= N_TEST_TASKS; i++) {
+		const char *name = (i < N_TEST_TASKS) ? tasks[i].name : "cyclic executive";
+		timebase_thread_join(threads[i]);
+		timebase_now(&joined);
+		long long join_ms = elapsed_ms(&shutdown_time, &joined);
+		if (join_ms > TEST_JOIN_BOUND_MS) {
+			printf("shutdown_test: %s joined %lld ms after the shutdown order (bound %d ms)\n", name,
+					join_ms, TEST_JOIN_BOUND_MS);
+			failures++;
+		}
+		if (i < N_TEST_TASKS) {
+			printf("Task %-8s %4lu activations, joined after %lld ms\n", name, activations[i], join_ms);
+		} else {
+			printf("Task %-8s joined after %lld ms\n", name, join_ms);
+		}
+	}
+
+	// La tarea con rate solo se activa por task_wake o cada TEST_SLEEP_PERIOD
+	if (activations[SLEEPER_TASK] <= 1 || activations[FAST_TASK] == 0) {
+		printf("shutdown_test: tasks did not run (fast %lu, sleeper %lu)\n", activations[FAST_TASK],
+				activations[SLEEPER_TASK]);
+		failures++;
+	}
+
+	// Con cada despertar propio una activacion adicional: al menos una por periodo
+	if (activations[SELF_WAKER_TASK] < TEST_RUN_MS * 1000000L / TEST_SELF_WAKER_PERIOD) {
+		printf("shutdown_test: self-woken task stopped after %lu activations\n", activations[SELF_WAKER_TASK]);
+		failures++;
+	}
+
+	periodic_shutdown_close();
+	printf("shutdown_test: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,266 @@
+/*
+ * File: timebase.c
+ *
+ * Descripcion: Planificador de tiempo virtual. Solo se compila con VIRTUAL_TIME.
+ *
+ *              Cada hilo gestionado ocupa una entrada de la tabla, asignada por
+ *              quien lo crea para que la numeracion no dependa del orden real de
+ *              arranque. Solo el hilo que tiene el testigo (current) se ejecuta;
+ *              al dormir, bloquearse en un join o terminar, cede el testigo al hilo
+ *              con el despertar mas temprano (empates: mayor prioridad, menor
+ *              numero) y el reloj avanza hasta ese despertar.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#include "timebase.h"
+
+#ifdef VIRTUAL_TIME
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NSEC_PER_SEC                1000000000LL
+
+typedef enum timebase_state_enum {
+	SLOT_FREE, SLOT_RUNNING, SLOT_READY, SLOT_SLEEPING, SLOT_JOINING, SLOT_EXITED
+} timebase_state;
+
+typedef struct timebase_slot {
+	timebase_state state;
+	long long wakeup;               // units: nsecs (virtuales)
+	bool interruptible;
+	int priority;
+	int joining;                    // hilo esperado en SLOT_JOINING
+	pthread_t thread;
+	pthread_cond_t cond;
+} timebase_slot_t;
+
+// Arranque de un hilo gestionado
+typedef struct timebase_start {
+	int id;
+	void *(*start_routine)(void *);
+	void *arg;
+} timebase_start_t;
+
+static pthread_mutex_t timebase_mutex = PTHREAD_MUTEX_INITIALIZER;
+static timebase_slot_t slots[TIMEBASE_MAX_THREADS];
+static atomic_llong virtual_now;
+static int current;
+static unsigned long switches;
+static __thread int self = -1;
+
+/**
+ * @brief Cede el testigo al siguiente hilo. Llamar con timebase_mutex y con el
+ *        estado del hilo llamante ya actualizado.
+ */
+static void timebase_schedule(void) {
+	int next = -1;
+	for (int i = 0; i < TIMEBASE_MAX_THREADS; i++) {
+		if (slots[i].state != SLOT_READY && slots[i].state != SLOT_SLEEPING) {
+			continue;
+		}
+		if (next < 0 || slots[i].wakeup < slots[next].wakeup ||
+				(slots[i].wakeup == slots[next].wakeup && slots[i].priority > slots[next].priority)) {
+			next = i;
+		}
+	}
+	if (next < 0) {
+		fprintf(stderr, "timebase: all threads blocked\n");
+		abort();
+	}
+
+	if (slots[next].wakeup > atomic_load(&virtual_now)) {
+		atomic_store(&virtual_now, slots[next].wakeup);
+	}
+	if (next != current) {
+		switches++;
+	}
+	current = next;
+	slots[next].state = SLOT_RUNNING;
+	pthread_cond_signal(&slots[next].cond);
+}
+
+/**
+ * @brief Espera a tener el testigo. Llamar con timebase_mutex.
+ */
+static void timebase_wait_turn(int id) {
+	while (current != id) {
+		pthread_cond_wait(&slots[id].cond, &timebase_mutex);
+	}
+}
+
+static long long timebase_ns(const struct timespec *time) {
+	return time->tv_sec * NSEC_PER_SEC + time->tv_nsec;
+}
+
+void timebase_init(void) {
+	pthread_mutex_lock(&timebase_mutex);
+	for (int i = 0; i < TIMEBASE_MAX_THREADS; i++) {
+		slots[i].state = SLOT_FREE;
+		pthread_cond_init(&slots[i].cond, NULL);
+	}
+	atomic_store(&virtual_now, 0);
+	switches = 0;
+	self = 0;
+	current = 0;
+	slots[0].state = SLOT_RUNNING;
+	slots[0].priority = 0;
+	slots[0].thread = pthread_self();
+	pthread_mutex_unlock(&timebase_mutex);
+}
+
+void timebase_now(struct timespec *now) {
+	long long ns = atomic_load(&virtual_now);
+	now->tv_sec = ns / NSEC_PER_SEC;
+	now->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+int timebase_sleep_until(const struct timespec *time, bool interruptible) {
+	pthread_mutex_lock(&timebase_mutex);
+	slots[self].state = SLOT_SLEEPING;
+	slots[self].wakeup = timebase_ns(time);
+	slots[self].interruptible = interruptible;
+	timebase_schedule();
+	timebase_wait_turn(self);
+	pthread_mutex_unlock(&timebase_mutex);
+	return 0;
+}
+
+void timebase_interrupt(void) {
+	pthread_mutex_lock(&timebase_mutex);
+	long long now = atomic_load(&virtual_now);
+	for (int i = 0; i < TIMEBASE_MAX_THREADS; i++) {
+		if (slots[i].state == SLOT_SLEEPING && slots[i].interruptible && slots[i].wakeup > now) {
+			slots[i].wakeup = now;
+		}
+	}
+	pthread_mutex_unlock(&timebase_mutex);
+}
+
+void timebase_interrupt_thread(pthread_t thread) {
+	pthread_mutex_lock(&timebase_mutex);
+	long long now = atomic_load(&virtual_now);
+	for (int i = 0; i < TIMEBASE_MAX_THREADS; i++) {
+		if (slots[i].state == SLOT_SLEEPING && slots[i].interruptible && slots[i].wakeup > now &&
+				pthread_equal(slots[i].thread, thread)) {
+			slots[i].wakeup = now;
+		}
+	}
+	pthread_mutex_unlock(&timebase_mutex);
+}
+
+/**
+ * @brief Fin de un hilo gestionado (tambien con pthread_exit): despierta a quien lo
+ *        espera y cede el testigo.
+ */
+static void timebase_thread_exit(void *param) {
+	(void) param;
+	pthread_mutex_lock(&timebase_mutex);
+	slots[self].state = SLOT_EXITED;
+	for (int i = 0; i < TIMEBASE_MAX_THREADS; i++) {
+		if (slots[i].state == SLOT_JOINING && slots[i].joining == self) {
+			slots[i].state = SLOT_READY;
+			slots[i].wakeup = atomic_load(&virtual_now);
+		}
+	}
+	timebase_schedule();
+	pthread_mutex_unlock(&timebase_mutex);
+}
+
+static void* timebase_thread_start(void *param) {
+	timebase_start_t start = *(timebase_start_t *) param;
+	void *result;
+	free(param);
+
+	self = start.id;
+	pthread_mutex_lock(&timebase_mutex);
+	timebase_wait_turn(self);
+	pthread_mutex_unlock(&timebase_mutex);
+
+	pthread_cleanup_push(timebase_thread_exit, NULL);
+	result = start.start_routine(start.arg);
+	pthread_cleanup_pop(1);
+	return result;
+}
+
+int timebase_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+		void *(*start_routine)(void *), void *arg) {
+	struct sched_param param = { .sched_priority = 0 };
+	timebase_start_t *start = malloc(sizeof(timebase_start_t));
+	if (start == NULL) {
+		return ENOMEM;
+	}
+	if (attr != NULL) {
+		pthread_attr_getschedparam(attr, &param);
+	}
+
+	pthread_mutex_lock(&timebase_mutex);
+	int id = -1;
+	for (int i = 0; i < TIMEBASE_MAX_THREADS && id < 0; i++) {
+		if (slots[i].state == SLOT_FREE) {
+			id = i;
+		}
+	}
+	if (id < 0) {
+		pthread_mutex_unlock(&timebase_mutex);
+		free(start);
+		return EAGAIN;
+	}
+	slots[id].state = SLOT_READY;
+	slots[id].wakeup = atomic_load(&virtual_now);
+	slots[id].priority = param.sched_priority;
+
+	start->id = id;
+	start->start_routine = start_routine;
+	start->arg = arg;
+	int error = pthread_create(&slots[id].thread, NULL, timebase_thread_start, start);
+	if (error != 0) {
+		slots[id].state = SLOT_FREE;
+		free(start);
+	} else {
+		*thread = slots[id].thread;
+	}
+	pthread_mutex_unlock(&timebase_mutex);
+	return error;
+}
+
+int timebase_thread_join(pthread_t thread) {
+	pthread_mutex_lock(&timebase_mutex);
+	int id = -1;
+	for (int i = 0; i < TIMEBASE_MAX_THREADS && id < 0; i++) {
+		if (slots[i].state != SLOT_FREE && pthread_equal(slots[i].thread, thread)) {
+			id = i;
+		}
+	}
+	if (id < 0) {
+		pthread_mutex_unlock(&timebase_mutex);
+		return ESRCH;
+	}
+	if (slots[id].state != SLOT_EXITED) {
+		slots[self].state = SLOT_JOINING;
+		slots[self].joining = id;
+		timebase_schedule();
+		timebase_wait_turn(self);
+	}
+	pthread_mutex_unlock(&timebase_mutex);
+
+	int error = pthread_join(thread, NULL);
+
+	pthread_mutex_lock(&timebase_mutex);
+	slots[id].state = SLOT_FREE;
+	pthread_mutex_unlock(&timebase_mutex);
+	return error;
+}
+
+void timebase_print_stats(void) {
+	printf("Virtual time: %.3f s simulated, %lu thread switches\n",
+			atomic_load(&virtual_now) / (double) NSEC_PER_SEC, switches);
+}
+
+#endif
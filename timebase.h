@@ -0,0 +1,133 @@
+/*
+ * File: timebase.h
+ *
+ * Descripcion: Base de tiempos del programa. Todas las lecturas del reloj, esperas
+ *              y creaciones de hilos pasan por aqui.
+ *
+ *              Por defecto son llamadas directas a CLOCK_MONOTONIC, clock_nanosleep
+ *              y pthread. Compilando con VIRTUAL_TIME (solo tiene sentido con el
+ *              simulador) el tiempo es virtual: un planificador de eventos discretos
+ *              deja ejecutar a un unico hilo cada vez y, cuando todos duermen,
+ *              avanza el reloj hasta el siguiente despertar. La ejecucion no espera
+ *              nunca en tiempo real y es reproducible: los empates se resuelven por
+ *              prioridad y despues por orden de creacion del hilo.
+ *
+ * Author: Mario Martin Perez <mmp819@alumnos.unican.es>
+ * Version: 1.0
+ * Date: dec-23
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef VIRTUAL_TIME
+
+// Numero maximo de hilos gestionados por el planificador virtual
+#define TIMEBASE_MAX_THREADS        32
+
+/**
+ * @brief Inicializa el reloj virtual (instante 0) y registra al hilo llamante como
+ *        primer hilo en ejecucion. Debe llamarse antes de cualquier otra funcion.
+ */
+void timebase_init(void);
+
+/**
+ * @brief Instante actual (virtual).
+ */
+void timebase_now(struct timespec *now);
+
+/**
+ * @brief Duerme hasta el instante absoluto indicado.
+ *
+ * @param interruptible Si es true, timebase_interrupt lo despierta antes.
+ *
+ * @return 0.
+ */
+int timebase_sleep_until(const struct timespec *time, bool interruptible);
+
+/**
+ * @brief Despierta en el instante actual a todos los hilos dormidos de forma
+ *        interrumpible.
+ */
+void timebase_interrupt(void);
+
+/**
+ * @brief Despierta en el instante actual al hilo indicado si duerme de forma
+ *        interrumpible.
+ */
+void timebase_interrupt_thread(pthread_t thread);
+
+/**
+ * @brief Crea un hilo gestionado por el planificador. Los atributos de planificacion
+ *        solo se usan para ordenar los empates: el hilo se crea sin politica
+ *        explicita, por lo que no hacen falta privilegios.
+ */
+int timebase_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+		void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Espera a que termine un hilo creado con timebase_thread_create.
+ */
+int timebase_thread_join(pthread_t thread);
+
+/**
+ * @brief Avance del reloj y numero de cambios de hilo desde timebase_init.
+ */
+void timebase_print_stats(void);
+
+#else
+
+static inline void timebase_init(void) {
+}
+
+static inline void timebase_now(struct timespec *now) {
+	clock_gettime(CLOCK_MONOTONIC, now);
+}
+
+static inline int timebase_sleep_until(const struct timespec *time, bool interruptible) {
+	(void) interruptible;
+	return clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, time, NULL);
+}
+
+static inline void timebase_interrupt(void) {
+}
+
+static inline void timebase_interrupt_thread(pthread_t thread) {
+	(void) thread;
+}
+
+static inline int timebase_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+		void *(*start_routine)(void *), void *arg) {
+	return pthread_create(thread, attr, start_routine, arg);
+}
+
+static inline int timebase_thread_join(pthread_t thread) {
+	return pthread_join(thread, NULL);
+}
+
+static inline void timebase_print_stats(void) {
+}
+
+#endif
+
+/**
+ * @brief Equivalente a usleep sobre la base de tiempos.
+ */
+static inline void timebase_usleep(long usec) {
+	struct timespec time;
+	timebase_now(&time);
+	time.tv_sec += usec / 1000000;
+	time.tv_nsec += (usec % 1000000) * 1000;
+	if (time.tv_nsec >= 1000000000) {
+		time.tv_sec++;
+		time.tv_nsec -= 1000000000;
+	}
+	timebase_sleep_until(&time, false);
+}
+
+#endif